@@ -265,6 +265,8 @@ static void     reload_config_callback                  (const ConfigPointer
 static void     fallback_commit_string_cb               (IMEngineInstanceBase   *si,
                                                          const WideString       &str);
 
+static gboolean preload_idle_cb                         (gpointer                data);
+
 
 
 
@@ -287,6 +289,7 @@ static IMEngineInstancePointer                          _default_instance;
 static ConfigModule                                    *_config_module              = 0;
 static ConfigPointer                                    _config;
 static BackEndPointer                                   _backend;
+static guint                                            _preload_idle_source        = 0;
 
 static GtkIMContextSCIM                                *_focused_ic                 = 0;
 static GtkWidget                                       *_focused_widget             = 0;
@@ -1848,12 +1851,17 @@ initialize (void)
     _config->signal_connect_reload (slot (reload_config_callback));
 
     // create backend
-    _backend = new CommonBackEnd (_config, load_engine_list.size () ? load_engine_list : engine_list);
+    CommonBackEnd *backend = new CommonBackEnd (_config, load_engine_list.size () ? load_engine_list : engine_list);
+
+    _backend = backend;
 
     if (_backend.null ()) {
         fprintf (stderr, "GTK IM Module SCIM: Cannot create BackEnd Object!\n");
     } else {
         _fallback_factory = _backend->get_factory (SCIM_COMPOSE_KEY_FACTORY_UUID);
+
+        // Preload the default factories one by one when the main loop is idle.
+        _preload_idle_source = g_idle_add (preload_idle_cb, backend);
     }
 
     if (_fallback_factory.null ()) _fallback_factory = new DummyIMEngineFactory ();
@@ -1911,6 +1919,11 @@ finalize (void)
     _fallback_instance.reset ();
     _fallback_factory.reset ();
 
+    if (_preload_idle_source) {
+        g_source_remove (_preload_idle_source);
+        _preload_idle_source = 0;
+    }
+
     SCIM_DEBUG_FRONTEND(2) << " Releasing BackEnd...\n";
     _backend.reset ();
 
@@ -2436,6 +2449,16 @@ fallback_commit_string_cb (IMEngineInstanceBase  *si,
         g_signal_emit_by_name (_focused_ic, "commit", utf8_wcstombs (str).c_str ());
 }
 
+static gboolean
+preload_idle_cb (gpointer data)
+{
+    if (static_cast <CommonBackEnd *> (data)->preload_default_factory ())
+        return TRUE;
+
+    _preload_idle_source = 0;
+    return FALSE;
+}
+
 /*
 vi:ts=4:expandtab:nowrap
 */
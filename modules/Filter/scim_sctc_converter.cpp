@@ -0,0 +1,327 @@
+/*
+ * Smart Common Input Method
+ *
+ * Copyright (c) 2005 James Su <suzhe@tsinghua.org.cn>
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define Uses_SCIM_UTILITY
+#define Uses_C_STRING
+#include "scim_private.h"
+#include "scim.h"
+#include "scim_sctc_converter.h"
+
+namespace scim {
+
+class SCTCConverter::PhraseLessThan
+{
+    const ucs4_t *m_buffer;
+
+public:
+    PhraseLessThan (const ucs4_t *buffer) : m_buffer (buffer) { }
+
+    bool operator () (const Phrase &lhs, const Phrase &rhs) const {
+        return std::lexicographical_compare (m_buffer + lhs.m_key, m_buffer + lhs.m_key + lhs.m_key_len,
+                                             m_buffer + rhs.m_key, m_buffer + rhs.m_key + rhs.m_key_len);
+    }
+};
+
+// Compares the char at a given position of the phrase keys.
+class PhraseCharLessThan
+{
+    const ucs4_t *m_buffer;
+    size_t        m_pos;
+
+public:
+    PhraseCharLessThan (const ucs4_t *buffer, size_t pos) : m_buffer (buffer), m_pos (pos) { }
+
+    template <class T>
+    bool operator () (const T &lhs, ucs4_t rhs) const {
+        return m_buffer [lhs.m_key + m_pos] < rhs;
+    }
+
+    template <class T>
+    bool operator () (ucs4_t lhs, const T &rhs) const {
+        return lhs < m_buffer [rhs.m_key + m_pos];
+    }
+};
+
+static inline bool
+__is_blank (char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+SCTCConverter::SCTCConverter ()
+    : m_max_phrase_len (0)
+{
+    for (size_t i = 0; i < 256; ++i)
+        m_char_index [i] = 0;
+}
+
+void
+SCTCConverter::add_char (ucs4_t from, ucs4_t to)
+{
+    if (from > 0xFFFF || to > 0xFFFF || !to)
+        return;
+
+    if (!m_char_index [from >> 8]) {
+        m_char_data.resize (m_char_data.size () + 256, 0);
+        m_char_index [from >> 8] = m_char_data.size () / 256;
+    }
+
+    m_char_data [(m_char_index [from >> 8] - 1) * 256 + (from & 0xFF)] = to;
+}
+
+inline ucs4_t
+SCTCConverter::convert_char (ucs4_t wc) const
+{
+    // ASCII and chars out of BMP are never converted.
+    if (wc < 0x80 || wc > 0xFFFF || !m_char_index [wc >> 8])
+        return wc;
+
+    unsigned short to = m_char_data [(m_char_index [wc >> 8] - 1) * 256 + (wc & 0xFF)];
+
+    return to ? to : wc;
+}
+
+bool
+SCTCConverter::convert_chars (WideString::iterator begin, WideString::iterator end) const
+{
+    bool changed = false;
+
+    for (; begin != end; ++begin) {
+        ucs4_t wc = convert_char (*begin);
+        if (wc != *begin) {
+            *begin = wc;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+size_t
+SCTCConverter::load_phrases (const String &file, bool reverse)
+{
+    int fd = open (file.c_str (), O_RDONLY);
+
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    void *addr = MAP_FAILED;
+
+    if (fstat (fd, &st) == 0 && st.st_size > 0)
+        addr = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close (fd);
+
+    if (addr == MAP_FAILED)
+        return 0;
+
+    const char *ptr = (const char *) addr;
+    const char *end = ptr + st.st_size;
+    size_t      count = 0;
+
+    while (ptr < end) {
+        const char *eol = (const char *) memchr (ptr, '\n', end - ptr);
+        if (!eol) eol = end;
+
+        const char *p = ptr;
+        ptr = eol + 1;
+
+        if (p == eol || *p == '#')
+            continue;
+
+        // Split the line by blanks.
+        std::vector <String> fields;
+        while (p < eol) {
+            while (p < eol && __is_blank (*p)) ++p;
+            const char *q = p;
+            while (q < eol && !__is_blank (*q)) ++q;
+            if (q > p) fields.push_back (String (p, q));
+            p = q;
+        }
+
+        if (fields.size () != 2)
+            continue;
+
+        WideString key   = utf8_mbstowcs (fields [reverse ? 1 : 0]);
+        WideString value = utf8_mbstowcs (fields [reverse ? 0 : 1]);
+
+        if (!key.length () || !value.length ())
+            continue;
+
+        Phrase phrase;
+        phrase.m_key       = m_phrase_buffer.size ();
+        phrase.m_key_len   = key.length ();
+        m_phrase_buffer.insert (m_phrase_buffer.end (), key.begin (), key.end ());
+        phrase.m_value     = m_phrase_buffer.size ();
+        phrase.m_value_len = value.length ();
+        m_phrase_buffer.insert (m_phrase_buffer.end (), value.begin (), value.end ());
+
+        m_phrases.push_back (phrase);
+        ++ count;
+    }
+
+    munmap (addr, st.st_size);
+
+    if (count)
+        sort_phrases ();
+
+    SCIM_DEBUG_MAIN (2) << "SCTCConverter: " << count << " phrases loaded from " << file << "\n";
+
+    return count;
+}
+
+void
+SCTCConverter::sort_phrases ()
+{
+    PhraseLessThan less (&m_phrase_buffer [0]);
+    std::vector <Phrase> phrases;
+
+    std::stable_sort (m_phrases.begin (), m_phrases.end (), less);
+
+    // Only keep the last one of the phrases with the same key.
+    for (size_t i = 0; i < m_phrases.size (); ++i) {
+        if (i + 1 < m_phrases.size () && !less (m_phrases [i], m_phrases [i + 1]))
+            continue;
+        phrases.push_back (m_phrases [i]);
+    }
+
+    m_phrases.swap (phrases);
+
+    m_phrase_first.clear ();
+    m_phrase_first.resize (0x10000 / 8, 0);
+    m_max_phrase_len = 0;
+
+    for (size_t i = 0; i < m_phrases.size (); ++i) {
+        ucs4_t first = m_phrase_buffer [m_phrases [i].m_key];
+
+        if (first <= 0xFFFF)
+            m_phrase_first [first >> 3] |= (1 << (first & 7));
+
+        if (m_phrases [i].m_key_len > m_max_phrase_len)
+            m_max_phrase_len = m_phrases [i].m_key_len;
+    }
+}
+
+size_t
+SCTCConverter::number_of_phrases () const
+{
+    return m_phrases.size ();
+}
+
+int
+SCTCConverter::match_phrase (const ucs4_t *str, size_t len, size_t &match_len) const
+{
+    std::vector <Phrase>::const_iterator lo = m_phrases.begin ();
+    std::vector <Phrase>::const_iterator hi = m_phrases.end ();
+
+    int best = -1;
+
+    // Narrow the range of phrases sharing the first i chars with str.
+    for (size_t i = 0; i < len && i < m_max_phrase_len && lo != hi; ++i) {
+        // The phrase which has exactly i chars sorts first, skip it.
+        if (lo->m_key_len == i)
+            ++ lo;
+
+        PhraseCharLessThan less (&m_phrase_buffer [0], i);
+
+        lo = std::lower_bound (lo, hi, str [i], less);
+        hi = std::upper_bound (lo, hi, str [i], less);
+
+        if (lo != hi && lo->m_key_len == i + 1) {
+            best = lo - m_phrases.begin ();
+            match_len = i + 1;
+        }
+    }
+
+    return best;
+}
+
+bool
+SCTCConverter::convert (WideString &str) const
+{
+    if (!m_phrases.size ())
+        return convert_chars (str.begin (), str.end ());
+
+    WideString result;
+    size_t     done = 0;
+    size_t     match_len = 0;
+    bool       matched = false;
+    int        phrase;
+
+    for (size_t i = 0; i < str.length (); ) {
+        ucs4_t wc = str [i];
+
+        if (wc > 0xFFFF || (m_phrase_first [wc >> 3] & (1 << (wc & 7)))) {
+            phrase = match_phrase (str.data () + i, str.length () - i, match_len);
+
+            if (phrase >= 0) {
+                if (!matched) {
+                    result.reserve (str.length () + 8);
+                    matched = true;
+                }
+
+                // Convert the chars before the phrase one by one.
+                size_t pos = result.length ();
+                result.append (str, done, i - done);
+                convert_chars (result.begin () + pos, result.end ());
+
+                const ucs4_t *value = &m_phrase_buffer [m_phrases [phrase].m_value];
+                result.append (value, value + m_phrases [phrase].m_value_len);
+
+                i += match_len;
+                done = i;
+                continue;
+            }
+        }
+
+        ++ i;
+    }
+
+    if (!matched)
+        return convert_chars (str.begin (), str.end ());
+
+    size_t pos = result.length ();
+    result.append (str, done, WideString::npos);
+    convert_chars (result.begin () + pos, result.end ());
+
+    bool changed = (result != str);
+
+    str.swap (result);
+
+    return changed;
+}
+
+} // namespace scim
+
+/*
+vi:ts=4:nowrap:ai:expandtab
+*/
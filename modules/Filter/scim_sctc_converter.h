@@ -0,0 +1,113 @@
+/** @file scim_sctc_converter.h
+ * definition of SCTCConverter, which does the actual Simplified Chinese <-> Traditional Chinese conversion.
+ */
+
+/*
+ * Smart Common Input Method
+ *
+ * Copyright (c) 2005 James Su <suzhe@tsinghua.org.cn>
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ */
+
+#if !defined (__SCIM_SCTC_CONVERTER_H)
+#define __SCIM_SCTC_CONVERTER_H
+
+namespace scim {
+
+/**
+ * Converts strings in one direction (SC->TC or TC->SC).
+ *
+ * A string is first matched against the phrase dictionary, longest phrase
+ * first, so that the chars which have several counterparts depending on
+ * the context (eg. 发 -> 發/髮) are converted correctly. The chars not
+ * covered by any phrase are converted one by one by the char table.
+ */
+class SCTCConverter
+{
+    struct Phrase
+    {
+        uint32 m_key;
+        uint32 m_key_len;
+        uint32 m_value;
+        uint32 m_value_len;
+    };
+
+    class PhraseLessThan;
+
+    // Two level direct index table for the BMP chars. The high byte of a
+    // char selects a block (1 based, 0 means no char in it is converted),
+    // an entry of 0 in a block means the char is not converted.
+    unsigned short                m_char_index [256];
+    std::vector <unsigned short>  m_char_data;
+
+    // Keys and values of all phrases, sorted by the key.
+    std::vector <ucs4_t>          m_phrase_buffer;
+    std::vector <Phrase>          m_phrases;
+    size_t                        m_max_phrase_len;
+
+    // Bitmap of the BMP chars which start a phrase.
+    std::vector <unsigned char>   m_phrase_first;
+
+public:
+    SCTCConverter ();
+
+    /**
+     * Add a char mapping into the char table.
+     */
+    void add_char (ucs4_t from, ucs4_t to);
+
+    /**
+     * Load phrases from a UTF-8 text file, one phrase per line, as
+     * "<simplified> <traditional>". Lines starting with '#' are comments.
+     *
+     * A phrase loaded later overrides an earlier one with the same key.
+     *
+     * @param file the file to be loaded.
+     * @param reverse true to use the traditional phrase as the key.
+     * @return the number of phrases loaded.
+     */
+    size_t load_phrases (const String &file, bool reverse);
+
+    size_t number_of_phrases () const;
+
+    /**
+     * Convert a string in place.
+     *
+     * @return true if the string is changed.
+     */
+    bool convert (WideString &str) const;
+
+private:
+    ucs4_t convert_char (ucs4_t wc) const;
+
+    bool convert_chars (WideString::iterator begin, WideString::iterator end) const;
+
+    int match_phrase (const ucs4_t *str, size_t len, size_t &match_len) const;
+
+    void sort_phrases ();
+};
+
+} // namespace scim
+
+#endif
+
+/*
+vi:ts=4:nowrap:ai:expandtab
+*/
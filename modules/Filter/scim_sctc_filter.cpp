@@ -29,10 +29,12 @@
 #define Uses_SCIM_FILTER
 #define Uses_SCIM_FILTER_MODULE
 #define Uses_SCIM_CONFIG_BASE
+#include <pthread.h>
+#include <typeinfo>
 #include "scim_private.h"
 #include "scim.h"
-#include "scim_stl_map.h"
 #include "scim_sctc_filter.h"
+#include "scim_sctc_converter.h"
 #include "scim_sctc_filter_data.h"
 
 #define scim_module_init sctc_LTX_scim_module_init
@@ -43,14 +45,8 @@
 
 using namespace scim;
 
-// Private datatype definition.
-#if SCIM_USE_STL_EXT_HASH_MAP
-typedef __gnu_cxx::hash_map <unsigned short, unsigned short, __gnu_cxx::hash <unsigned short> > UUMap;
-#elif SCIM_USE_STL_HASH_MAP
-typedef std::hash_map <unsigned short, unsigned short, std::hash <unsigned short> >             UUMap;
-#else
-typedef std::map <unsigned short, unsigned short>                                               UUMap;
-#endif
+#define SCIM_SCTC_PHRASE_FILE      (SCIM_DATADIR "/sctc-phrases")
+#define SCIM_SCTC_USER_PHRASE_FILE "sctc-phrases"
 
 // Private data definition.
 static FilterInfo   __filter_info (String ("adb861a9-76da-454c-941b-1957e644a94e"),
@@ -62,10 +58,12 @@ static FilterInfo   __filter_info (String ("adb861a9-76da-454c-941b-1957e644a94e
 static std::vector <String> __sc_encodings;
 static std::vector <String> __tc_encodings;
 
-static UUMap        __sc_to_tc_map;
-static UUMap        __tc_to_sc_map;
-static bool         __sc_to_tc_initialized = false;
-static bool         __tc_to_sc_initialized = false;
+static SCTCConverter __sc_to_tc_converter;
+static SCTCConverter __tc_to_sc_converter;
+// The converters are loaded on first use, which may happen in several
+// SocketFrontEnd worker threads at the same time.
+static pthread_once_t __sc_to_tc_once = PTHREAD_ONCE_INIT;
+static pthread_once_t __tc_to_sc_once = PTHREAD_ONCE_INIT;
 
 static Property     __prop_root     (String ("/Filter/SCTC"),
                                      String (_("SC-TC")),
@@ -94,8 +92,14 @@ static void       __init_tc_to_sc ();
 static bool       __is_sc_encoding (const String &encoding);
 static bool       __is_tc_encoding (const String &encoding);
 
+static void       __init_converter (SCTCConverter &converter, const UShortPair *pairs, bool reverse);
+
 static WideString __sc_to_tc (const WideString &sc);
 static WideString __tc_to_sc (const WideString &tc);
+static bool       __sc_to_tc_in_place (WideString &str);
+static bool       __tc_to_sc_in_place (WideString &str);
+
+static uint64     __hash_lookup_table_page (const LookupTable &table, int mode);
 
 
 //Module Interface
@@ -141,74 +145,129 @@ extern "C" {
 
 //Implementation of private functions
 static void
-__init_sc_to_tc ()
+__init_converter (SCTCConverter &converter, const UShortPair *pairs, bool reverse)
 {
-    if (__sc_to_tc_initialized) return;
-
-    __sc_to_tc_map.clear ();
+    for (size_t i = 0; pairs [i].first; ++i)
+        converter.add_char (pairs [i].first, pairs [i].second);
 
-    for (size_t i = 0; __sc_to_tc_table [i].first; ++i)
-        __sc_to_tc_map [__sc_to_tc_table [i].first] = __sc_to_tc_table [i].second;
+    // The same phrase files are used for both directions,
+    // the user's phrases override the system ones.
+    converter.load_phrases (SCIM_SCTC_PHRASE_FILE, reverse);
+    converter.load_phrases (scim_get_user_data_dir () + SCIM_PATH_DELIM_STRING + SCIM_SCTC_USER_PHRASE_FILE, reverse);
+}
 
-    __sc_to_tc_initialized = true;
+static void
+__init_sc_to_tc ()
+{
+    __init_converter (__sc_to_tc_converter, __sc_to_tc_table, false);
 }
 
 static void
 __init_tc_to_sc ()
 {
-    if (__tc_to_sc_initialized) return;
+    __init_converter (__tc_to_sc_converter, __tc_to_sc_table, true);
+}
+
+static bool
+__sc_to_tc_in_place (WideString &str)
+{
+    pthread_once (&__sc_to_tc_once, __init_sc_to_tc);
+
+    return __sc_to_tc_converter.convert (str);
+}
 
-    __tc_to_sc_map.clear ();
+static bool
+__tc_to_sc_in_place (WideString &str)
+{
+    pthread_once (&__tc_to_sc_once, __init_tc_to_sc);
 
-    for (size_t i = 0; __tc_to_sc_table [i].first; ++i)
-        __tc_to_sc_map [__tc_to_sc_table [i].first] = __tc_to_sc_table [i].second;
+    return __tc_to_sc_converter.convert (str);
+}
 
-    __tc_to_sc_initialized = true;
+// FNV-1a hash of the content of the current page of a lookup table,
+// the cursor position and visibility are not included.
+static inline uint64
+__hash_update (uint64 hash, uint32 val)
+{
+    for (int i = 0; i < 4; ++i, val >>= 8)
+        hash = (hash ^ (val & 0xFF)) * 0x100000001b3ULL;
+    return hash;
 }
 
-static WideString __sc_to_tc (const WideString &sc)
+static inline uint64
+__hash_update (uint64 hash, const ucs4_t *str, uint32 len)
 {
-    WideString tc;
-    if (!__sc_to_tc_initialized) __init_sc_to_tc ();
+    hash = __hash_update (hash, len);
+    for (uint32 i = 0; i < len; ++i)
+        hash = __hash_update (hash, str [i]);
+    return hash;
+}
 
-    UUMap::const_iterator mapit;
-    WideString::const_iterator sit;
+static inline uint64
+__hash_update (uint64 hash, const Attribute *attrs, uint32 count)
+{
+    hash = __hash_update (hash, count);
+    for (uint32 i = 0; i < count; ++i) {
+        hash = __hash_update (hash, attrs [i].get_type ());
+        hash = __hash_update (hash, attrs [i].get_value ());
+        hash = __hash_update (hash, attrs [i].get_start ());
+        hash = __hash_update (hash, attrs [i].get_length ());
+    }
+    return hash;
+}
 
-    for (sit = sc.begin (); sit != sc.end (); ++sit) {
-        if (*sit <= 0xFFFF) {
-            mapit = __sc_to_tc_map.find ((unsigned short) (*sit));
-            if (mapit != __sc_to_tc_map.end ()) {
-                tc.push_back (static_cast<ucs4_t> (mapit->second));
-            } else {
-                tc.push_back (*sit);
-            }
+static uint64
+__hash_lookup_table_page (const LookupTable &table, int mode)
+{
+    // Derived classes may override get_candidate (), so only the exact type
+    // of CommonLookupTable can be read straight from its buffers.
+    const CommonLookupTable *common = 0;
+
+    if (typeid (table) == typeid (CommonLookupTable))
+        common = static_cast <const CommonLookupTable *> (&table);
+
+    uint64 hash = 0xcbf29ce484222325ULL;
+    int    page_size = table.get_current_page_size ();
+    int    start = table.get_current_page_start ();
+
+    hash = __hash_update (hash, mode);
+    hash = __hash_update (hash, page_size);
+    hash = __hash_update (hash, start ? 1 : 0);
+    hash = __hash_update (hash, (start + page_size < (int) table.number_of_candidates ()) ? 1 : 0);
+
+    for (int i = 0; i < page_size; ++i) {
+        WideString label = table.get_candidate_label (i);
+        hash = __hash_update (hash, label.data (), label.length ());
+
+        // Avoid copying the candidates if possible.
+        if (common) {
+            uint32 len;
+            const ucs4_t *cand = common->get_candidate_buffer (start + i, len);
+            hash = __hash_update (hash, cand, len);
+            const Attribute *attrs = common->get_attributes_buffer (start + i, len);
+            hash = __hash_update (hash, attrs, len);
         } else {
-            tc.push_back (*sit);
+            WideString cand = table.get_candidate_in_current_page (i);
+            hash = __hash_update (hash, cand.data (), cand.length ());
+            AttributeList attrs = table.get_attributes_in_current_page (i);
+            hash = __hash_update (hash, attrs.size () ? &attrs [0] : 0, attrs.size ());
         }
     }
+
+    return hash;
+}
+
+static WideString __sc_to_tc (const WideString &sc)
+{
+    WideString tc (sc);
+    __sc_to_tc_in_place (tc);
     return tc;
 }
 
 static WideString __tc_to_sc (const WideString &tc)
 {
-    WideString sc;
-    if (!__tc_to_sc_initialized) __init_tc_to_sc ();
-
-    UUMap::const_iterator mapit;
-    WideString::const_iterator sit;
-
-    for (sit = tc.begin (); sit != tc.end (); ++sit) {
-        if (*sit <= 0xFFFF) {
-            mapit = __tc_to_sc_map.find ((unsigned short) (*sit));
-            if (mapit != __tc_to_sc_map.end ()) {
-                sc.push_back (static_cast<ucs4_t> (mapit->second));
-            } else {
-                sc.push_back (*sit);
-            }
-        } else {
-            sc.push_back (*sit);
-        }
-    }
+    WideString sc (tc);
+    __tc_to_sc_in_place (sc);
     return sc;
 }
 
@@ -367,7 +426,9 @@ SCTCFilterInstance::SCTCFilterInstance (SCTCFilterFactory *factory, const SCTCWo
     : FilterInstanceBase (factory, orig_inst),
       m_factory (factory),
       m_props_registered (false),
-      m_work_mode (mode)
+      m_work_mode (mode),
+      m_lookup_table_hash (0),
+      m_lookup_table_valid (false)
 {
     IMEngineInstanceBase::set_encoding (client_encoding);
 }
@@ -445,9 +506,9 @@ SCTCFilterInstance::filter_update_preedit_string (const WideString    &str,
     WideString nstr = str;
 
     if (m_work_mode == SCTC_MODE_SC_TO_TC || m_work_mode == SCTC_MODE_FORCE_SC_TO_TC)
-        nstr = __sc_to_tc (str);
-    if (m_work_mode == SCTC_MODE_TC_TO_SC || m_work_mode == SCTC_MODE_FORCE_TC_TO_SC)
-        nstr = __tc_to_sc (str);
+        __sc_to_tc_in_place (nstr);
+    else if (m_work_mode == SCTC_MODE_TC_TO_SC || m_work_mode == SCTC_MODE_FORCE_TC_TO_SC)
+        __tc_to_sc_in_place (nstr);
 
     update_preedit_string (nstr, attrs);
 }
@@ -459,9 +520,9 @@ SCTCFilterInstance::filter_update_aux_string (const WideString    &str,
     WideString nstr = str;
 
     if (m_work_mode == SCTC_MODE_SC_TO_TC || m_work_mode == SCTC_MODE_FORCE_SC_TO_TC)
-        nstr = __sc_to_tc (str);
-    if (m_work_mode == SCTC_MODE_TC_TO_SC || m_work_mode == SCTC_MODE_FORCE_TC_TO_SC)
-        nstr = __tc_to_sc (str);
+        __sc_to_tc_in_place (nstr);
+    else if (m_work_mode == SCTC_MODE_TC_TO_SC || m_work_mode == SCTC_MODE_FORCE_TC_TO_SC)
+        __tc_to_sc_in_place (nstr);
 
     update_aux_string (nstr, attrs);
 }
@@ -471,43 +532,59 @@ SCTCFilterInstance::filter_update_lookup_table (const LookupTable &table)
 {
     if (m_work_mode == SCTC_MODE_OFF) {
         update_lookup_table (table);
-    } else {
-        CommonLookupTable ntable;
+        return;
+    }
+
+    uint64 hash = __hash_lookup_table_page (table, m_work_mode);
+
+    // Only convert the page if its content is changed.
+    if (!m_lookup_table_valid || hash != m_lookup_table_hash) {
         std::vector<WideString> labels;
+        bool   sc_to_tc = (m_work_mode == SCTC_MODE_SC_TO_TC || m_work_mode == SCTC_MODE_FORCE_SC_TO_TC);
         size_t i;
 
+        m_lookup_table.clear ();
+
         // Can be paged up.
         if (table.get_current_page_start ())
-            ntable.append_candidate (0x3400);
+            m_lookup_table.append_candidate (0x3400);
 
-        if (m_work_mode == SCTC_MODE_SC_TO_TC || m_work_mode == SCTC_MODE_FORCE_SC_TO_TC) {
-            for (i = 0; i < table.get_current_page_size (); ++i) {
-                ntable.append_candidate (__sc_to_tc (table.get_candidate_in_current_page (i)), table.get_attributes_in_current_page (i));
-                labels.push_back (__sc_to_tc (table.get_candidate_label (i)));
-            }
-        } else {
-            for (i = 0; i < table.get_current_page_size (); ++i) {
-                ntable.append_candidate (__tc_to_sc (table.get_candidate_in_current_page (i)), table.get_attributes_in_current_page (i));
-                labels.push_back (__tc_to_sc (table.get_candidate_label (i)));
+        for (i = 0; i < table.get_current_page_size (); ++i) {
+            WideString cand  = table.get_candidate_in_current_page (i);
+            WideString label = table.get_candidate_label (i);
+
+            if (sc_to_tc) {
+                __sc_to_tc_in_place (cand);
+                __sc_to_tc_in_place (label);
+            } else {
+                __tc_to_sc_in_place (cand);
+                __tc_to_sc_in_place (label);
             }
+
+            m_lookup_table.append_candidate (cand, table.get_attributes_in_current_page (i));
+            labels.push_back (label);
         }
 
         if (table.get_current_page_start () + table.get_current_page_size () < table.number_of_candidates ())
-            ntable.append_candidate (0x3400);
+            m_lookup_table.append_candidate (0x3400);
 
         if (table.get_current_page_start ()) {
-            ntable.set_page_size (1);
-            ntable.page_down ();
+            m_lookup_table.set_page_size (1);
+            m_lookup_table.page_down ();
         }
 
-        ntable.set_page_size (table.get_current_page_size ());
-        ntable.set_cursor_pos_in_current_page (table.get_cursor_pos_in_current_page ());
-        ntable.show_cursor (table.is_cursor_visible ());
-        ntable.fix_page_size (table.is_page_size_fixed ());
-        ntable.set_candidate_labels (labels);
+        m_lookup_table.set_page_size (table.get_current_page_size ());
+        m_lookup_table.set_candidate_labels (labels);
 
-        update_lookup_table (ntable);
+        m_lookup_table_hash = hash;
+        m_lookup_table_valid = true;
     }
+
+    m_lookup_table.set_cursor_pos_in_current_page (table.get_cursor_pos_in_current_page ());
+    m_lookup_table.show_cursor (table.is_cursor_visible ());
+    m_lookup_table.fix_page_size (table.is_page_size_fixed ());
+
+    update_lookup_table (m_lookup_table);
 }
 
 void
@@ -516,9 +593,9 @@ SCTCFilterInstance::filter_commit_string (const WideString &str)
     WideString nstr = str;
 
     if (m_work_mode == SCTC_MODE_SC_TO_TC || m_work_mode == SCTC_MODE_FORCE_SC_TO_TC)
-        nstr = __sc_to_tc (str);
-    if (m_work_mode == SCTC_MODE_TC_TO_SC || m_work_mode == SCTC_MODE_FORCE_TC_TO_SC)
-        nstr = __tc_to_sc (str);
+        __sc_to_tc_in_place (nstr);
+    else if (m_work_mode == SCTC_MODE_TC_TO_SC || m_work_mode == SCTC_MODE_FORCE_TC_TO_SC)
+        __tc_to_sc_in_place (nstr);
 
     commit_string (nstr);
 }
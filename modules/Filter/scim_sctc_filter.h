@@ -73,6 +73,12 @@ class SCTCFilterInstance : public FilterInstanceBase
 
     SCTCWorkMode       m_work_mode;
 
+    // The converted lookup table of the last page, it's reused if the
+    // next page has the same content, only the cursor is updated.
+    CommonLookupTable  m_lookup_table;
+    uint64             m_lookup_table_hash;
+    bool               m_lookup_table_valid;
+
 public:
     SCTCFilterInstance (SCTCFilterFactory *factory,
                         const SCTCWorkMode &mode,
@@ -36,6 +36,14 @@
 #define Uses_C_STDLIB
 
 #include <limits.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <deque>
+#include <set>
 #include "scim_private.h"
 #include "scim.h"
 #include "scim_socket_frontend.h"
@@ -49,8 +57,44 @@
 #define SCIM_CONFIG_FRONTEND_SOCKET_CONFIG_READONLY    "/FrontEnd/Socket/ConfigReadOnly"
 #define SCIM_CONFIG_FRONTEND_SOCKET_MAXCLIENTS        "/FrontEnd/Socket/MaxClients"
 
+// The number of worker threads to process the requests of clients,
+// 0 means all requests are processed by the main thread.
+// IMEngine instances owned by different clients may be used concurrently
+// if it's not 0, so it must only be enabled with IMEngines supporting it.
+#define SCIM_CONFIG_FRONTEND_SOCKET_WORKERS           "/FrontEnd/Socket/Workers"
+
+#define SCIM_SOCKET_FRONTEND_MAX_WORKERS              64
+
 using namespace scim;
 
+struct SocketFrontEnd::Worker
+{
+    SocketFrontEnd  *frontend;
+    pthread_t        thread;
+    pthread_mutex_t  mutex;
+    pthread_cond_t   cond;
+    bool             running;
+
+    /**
+     * The clients which have a pending request, and their information.
+     */
+    std::deque <std::pair <int, ClientInfo> > requests;
+
+    RequestContext   context;
+};
+
+/**
+ * Sent by a worker thread to the main thread when a request is finished.
+ */
+struct WorkerResult
+{
+    int client;
+    int closed;
+};
+
+// The RequestContext of the current worker thread, 0 in the main thread.
+static __thread void *_worker_context = 0;
+
 static Pointer <SocketFrontEnd> _scim_frontend (0);
 
 static int _argc;
@@ -96,71 +140,114 @@ SocketFrontEnd::SocketFrontEnd (const BackEndPointer &backend,
                                 const ConfigPointer  &config)
     : FrontEndBase (backend),
       m_config (config),
+      m_socket_server (-1, SCIM_SOCKET_SERVER_AUTO),
       m_stay (true),
       m_config_readonly (false),
-      m_socket_timeout (scim_get_default_socket_timeout ()),
-      m_current_instance (-1),
-      m_current_socket_client (-1),
-      m_current_socket_client_key (0)
+      m_socket_timeout (scim_get_default_socket_timeout ())
 {
     SCIM_DEBUG_FRONTEND (2) << " Constructing SocketFrontEnd object...\n";
+
+    m_worker_notify_fds [0] = -1;
+    m_worker_notify_fds [1] = -1;
+
+    pthread_rwlock_init (&m_backend_lock, 0);
+
+    init_commands ();
 }
 
 SocketFrontEnd::~SocketFrontEnd ()
 {
     SCIM_DEBUG_FRONTEND (2) << " Destructing SocketFrontEnd object...\n";
+
+    stop_workers ();
+
     if (m_socket_server.is_running ())
         m_socket_server.shutdown ();
+
+    release_loaded_files ();
+
+    for (SocketClientRepository::iterator it = m_socket_client_repository.begin ();
+         it != m_socket_client_repository.end (); ++it)
+        delete it->second.lookup_table_cache;
+
+    pthread_rwlock_destroy (&m_backend_lock);
+}
+
+SocketFrontEnd::RequestContext::RequestContext ()
+    : current_instance (-1),
+      current_socket_client (-1),
+      current_socket_client_key (0),
+      current_sequence (0),
+      current_lookup_table_cache (0)
+{
+    for (size_t i = 0; i < MAX_COMMANDS; ++i) {
+        statistics [i].calls = 0;
+        statistics [i].usecs = 0;
+    }
 }
 
 void
 SocketFrontEnd::show_preedit_string (int id)
 {
-    if (m_current_instance == id)
-        m_send_trans.put_command (SCIM_TRANS_CMD_SHOW_PREEDIT_STRING);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id)
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_SHOW_PREEDIT_STRING);
 }
 
 void
 SocketFrontEnd::show_aux_string (int id)
 {
-    if (m_current_instance == id)
-        m_send_trans.put_command (SCIM_TRANS_CMD_SHOW_AUX_STRING);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id)
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_SHOW_AUX_STRING);
 }
 
 void
 SocketFrontEnd::show_lookup_table (int id)
 {
-    if (m_current_instance == id)
-        m_send_trans.put_command (SCIM_TRANS_CMD_SHOW_LOOKUP_TABLE);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id)
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_SHOW_LOOKUP_TABLE);
 }
 
 void
 SocketFrontEnd::hide_preedit_string (int id)
 {
-    if (m_current_instance == id)
-        m_send_trans.put_command (SCIM_TRANS_CMD_HIDE_PREEDIT_STRING);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id)
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_HIDE_PREEDIT_STRING);
 }
 
 void
 SocketFrontEnd::hide_aux_string (int id)
 {
-    if (m_current_instance == id)
-        m_send_trans.put_command (SCIM_TRANS_CMD_HIDE_AUX_STRING);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id)
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_HIDE_AUX_STRING);
 }
 
 void
 SocketFrontEnd::hide_lookup_table (int id)
 {
-    if (m_current_instance == id)
-        m_send_trans.put_command (SCIM_TRANS_CMD_HIDE_LOOKUP_TABLE);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id)
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_HIDE_LOOKUP_TABLE);
 }
 
 void
 SocketFrontEnd::update_preedit_caret (int id, int caret)
 {
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_UPDATE_PREEDIT_CARET);
-        m_send_trans.put_data ((uint32) caret);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_UPDATE_PREEDIT_CARET);
+        ctx.send_trans.put_data ((uint32) caret);
     }
 }
 
@@ -169,10 +256,12 @@ SocketFrontEnd::update_preedit_string (int id,
                                        const WideString & str,
                                        const AttributeList & attrs)
 {
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_UPDATE_PREEDIT_STRING);
-        m_send_trans.put_data (str);
-        m_send_trans.put_data (attrs);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_UPDATE_PREEDIT_STRING);
+        ctx.send_trans.put_data (str);
+        ctx.send_trans.put_data (attrs);
     }
 }
 
@@ -181,126 +270,157 @@ SocketFrontEnd::update_aux_string (int id,
                                    const WideString & str,
                                    const AttributeList & attrs)
 {
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_UPDATE_AUX_STRING);
-        m_send_trans.put_data (str);
-        m_send_trans.put_data (attrs);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_UPDATE_AUX_STRING);
+        ctx.send_trans.put_data (str);
+        ctx.send_trans.put_data (attrs);
     }
 }
 
 void
 SocketFrontEnd::commit_string (int id, const WideString & str)
 {
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_COMMIT_STRING);
-        m_send_trans.put_data (str);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_COMMIT_STRING);
+        ctx.send_trans.put_data (str);
     }
 }
 
 void
 SocketFrontEnd::forward_key_event (int id, const KeyEvent & key)
 {
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_FORWARD_KEY_EVENT);
-        m_send_trans.put_data (key);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_FORWARD_KEY_EVENT);
+        ctx.send_trans.put_data (key);
     }
 }
 
 void
 SocketFrontEnd::update_lookup_table (int id, const LookupTable & table)
 {
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_UPDATE_LOOKUP_TABLE);
-        m_send_trans.put_data (table);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_UPDATE_LOOKUP_TABLE);
+        if (ctx.current_lookup_table_cache)
+            ctx.send_trans.put_data (table, *ctx.current_lookup_table_cache);
+        else
+            ctx.send_trans.put_data (table);
     }
 }
 
 void
 SocketFrontEnd::register_properties (int id, const PropertyList &properties)
 {
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_REGISTER_PROPERTIES);
-        m_send_trans.put_data (properties);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_REGISTER_PROPERTIES);
+        ctx.send_trans.put_data (properties);
     }
 }
 
 void
 SocketFrontEnd::update_property (int id, const Property &property)
 {
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_UPDATE_PROPERTY);
-        m_send_trans.put_data (property);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_UPDATE_PROPERTY);
+        ctx.send_trans.put_data (property);
     }
 }
 
 void
 SocketFrontEnd::beep (int id)
 {
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_BEEP);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_BEEP);
     }
 }
 
 void
 SocketFrontEnd::start_helper (int id, const String &helper_uuid)
 {
+    RequestContext &ctx = context ();
+
     SCIM_DEBUG_FRONTEND (2) << "start_helper (" << helper_uuid << ")\n";
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_START_HELPER);
-        m_send_trans.put_data (helper_uuid);
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_START_HELPER);
+        ctx.send_trans.put_data (helper_uuid);
     }
 }
 
 void
 SocketFrontEnd::stop_helper (int id, const String &helper_uuid)
 {
+    RequestContext &ctx = context ();
+
     SCIM_DEBUG_FRONTEND (2) << "stop_helper (" << helper_uuid << ")\n";
 
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_STOP_HELPER);
-        m_send_trans.put_data (helper_uuid);
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_STOP_HELPER);
+        ctx.send_trans.put_data (helper_uuid);
     }
 }
 
 void
 SocketFrontEnd::send_helper_event (int id, const String &helper_uuid, const Transaction &trans)
 {
-    if (m_current_instance == id) {
-        m_send_trans.put_command (SCIM_TRANS_CMD_SEND_HELPER_EVENT);
-        m_send_trans.put_data (helper_uuid);
-        m_send_trans.put_data (trans);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id) {
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_SEND_HELPER_EVENT);
+        ctx.send_trans.put_data (helper_uuid);
+        ctx.send_trans.put_data (trans);
     }
 }
 
 bool
 SocketFrontEnd::get_surrounding_text (int id, WideString &text, int &cursor, int maxlen_before, int maxlen_after)
 {
+    RequestContext &ctx = context ();
+
     text.clear ();
     cursor = 0;
 
-    if (m_current_instance == id && m_current_socket_client >= 0 && (maxlen_before != 0 || maxlen_after != 0)) {
+    if (ctx.current_instance == id && ctx.current_socket_client >= 0 && (maxlen_before != 0 || maxlen_after != 0)) {
         if (maxlen_before < 0) maxlen_before = -1;
         if (maxlen_after < 0) maxlen_after = -1;
 
-        m_temp_trans.clear ();
-        m_temp_trans.put_command (SCIM_TRANS_CMD_REPLY);
-        m_temp_trans.put_command (SCIM_TRANS_CMD_GET_SURROUNDING_TEXT);
-        m_temp_trans.put_data ((uint32) maxlen_before);
-        m_temp_trans.put_data ((uint32) maxlen_after);
+        ctx.temp_trans.clear ();
+        ctx.temp_trans.put_command (SCIM_TRANS_CMD_REPLY);
+
+        if (ctx.current_sequence) {
+            ctx.temp_trans.put_command (SCIM_TRANS_CMD_SEQUENCE);
+            ctx.temp_trans.put_data (ctx.current_sequence);
+        }
+
+        ctx.temp_trans.put_command (SCIM_TRANS_CMD_GET_SURROUNDING_TEXT);
+        ctx.temp_trans.put_data ((uint32) maxlen_before);
+        ctx.temp_trans.put_data ((uint32) maxlen_after);
 
-        Socket socket_client (m_current_socket_client);
+        Socket socket_client (ctx.current_socket_client);
 
-        if (m_temp_trans.write_to_socket (socket_client) &&
-            m_temp_trans.read_from_socket (socket_client, m_socket_timeout)) {
+        if (ctx.temp_trans.write_to_socket (socket_client) &&
+            ctx.temp_trans.read_from_socket (socket_client, m_socket_timeout)) {
 
             int cmd;
             uint32 key;
             uint32 cur;
 
-            if (m_temp_trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_REQUEST &&
-                m_temp_trans.get_data (key) && key == m_current_socket_client_key &&
-                m_temp_trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_GET_SURROUNDING_TEXT &&
-                m_temp_trans.get_data (text) && m_temp_trans.get_data (cur)) {
+            if (ctx.temp_trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_REQUEST &&
+                ctx.temp_trans.get_data (key) && key == ctx.current_socket_client_key &&
+                ctx.temp_trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_GET_SURROUNDING_TEXT &&
+                ctx.temp_trans.get_data (text) && ctx.temp_trans.get_data (cur)) {
                 cursor = (int) cur;
                 return true;
             }
@@ -312,25 +432,33 @@ SocketFrontEnd::get_surrounding_text (int id, WideString &text, int &cursor, int
 bool
 SocketFrontEnd::delete_surrounding_text (int id, int offset, int len)
 {
-    if (m_current_instance == id && m_current_socket_client >= 0 && len > 0) {
-        m_temp_trans.clear ();
-        m_temp_trans.put_command (SCIM_TRANS_CMD_REPLY);
-        m_temp_trans.put_command (SCIM_TRANS_CMD_DELETE_SURROUNDING_TEXT);
-        m_temp_trans.put_data ((uint32) offset);
-        m_temp_trans.put_data ((uint32) len);
+    RequestContext &ctx = context ();
+
+    if (ctx.current_instance == id && ctx.current_socket_client >= 0 && len > 0) {
+        ctx.temp_trans.clear ();
+        ctx.temp_trans.put_command (SCIM_TRANS_CMD_REPLY);
+
+        if (ctx.current_sequence) {
+            ctx.temp_trans.put_command (SCIM_TRANS_CMD_SEQUENCE);
+            ctx.temp_trans.put_data (ctx.current_sequence);
+        }
 
-        Socket socket_client (m_current_socket_client);
+        ctx.temp_trans.put_command (SCIM_TRANS_CMD_DELETE_SURROUNDING_TEXT);
+        ctx.temp_trans.put_data ((uint32) offset);
+        ctx.temp_trans.put_data ((uint32) len);
 
-        if (m_temp_trans.write_to_socket (socket_client) &&
-            m_temp_trans.read_from_socket (socket_client, m_socket_timeout)) {
+        Socket socket_client (ctx.current_socket_client);
+
+        if (ctx.temp_trans.write_to_socket (socket_client) &&
+            ctx.temp_trans.read_from_socket (socket_client, m_socket_timeout)) {
 
             int cmd;
             uint32 key;
 
-            if (m_temp_trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_REQUEST &&
-                m_temp_trans.get_data (key) && key == m_current_socket_client_key &&
-                m_temp_trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_DELETE_SURROUNDING_TEXT &&
-                m_temp_trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_OK)
+            if (ctx.temp_trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_REQUEST &&
+                ctx.temp_trans.get_data (key) && key == ctx.current_socket_client_key &&
+                ctx.temp_trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_DELETE_SURROUNDING_TEXT &&
+                ctx.temp_trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_OK)
                 return true;
         }
     }
@@ -341,6 +469,7 @@ void
 SocketFrontEnd::init (int argc, char **argv)
 {
     int max_clients = -1;
+    int num_workers = 0;
 
     if (!m_config.null ()) {
         String str;
@@ -349,6 +478,8 @@ SocketFrontEnd::init (int argc, char **argv)
 
         max_clients = m_config->read (String (SCIM_CONFIG_FRONTEND_SOCKET_MAXCLIENTS), -1);
 
+        num_workers = m_config->read (String (SCIM_CONFIG_FRONTEND_SOCKET_WORKERS), 0);
+
         m_config->signal_connect_reload (slot (this, &SocketFrontEnd::reload_config_callback));
     } else {
         m_config_readonly = false;
@@ -360,6 +491,9 @@ SocketFrontEnd::init (int argc, char **argv)
 
     m_socket_server.set_max_clients (max_clients);
 
+    if (num_workers > 0 && !start_workers (num_workers))
+        SCIM_DEBUG_FRONTEND (1) << "SocketFrontEnd -- Cannot start worker threads, serve all clients in main thread.\n";
+
     m_socket_server.signal_connect_accept (
         slot (this, &SocketFrontEnd::socket_accept_callback));
 
@@ -369,6 +503,9 @@ SocketFrontEnd::init (int argc, char **argv)
     m_socket_server.signal_connect_exception(
         slot (this, &SocketFrontEnd::socket_exception_callback));
 
+    m_socket_server.signal_connect_idle (
+        slot (this, &SocketFrontEnd::socket_idle_callback));
+
     if (argv && argc > 1) {
         for (int i = 1; i < argc && argv [i]; ++i) {
             if (String ("--no-stay") == argv [i])
@@ -428,13 +565,28 @@ void
 SocketFrontEnd::socket_receive_callback (SocketServer *server, const Socket &client)
 {
     int id = client.get_id ();
-    int cmd;
-    uint32 key;
 
     ClientInfo client_info;
 
     SCIM_DEBUG_FRONTEND (1) << "socket_receive_callback (" << id << ").\n";
 
+    if (m_workers.size ()) {
+        // Some requests were finished by the worker threads.
+        if (id == m_worker_notify_fds [0]) {
+            socket_finish_requests (server);
+            return;
+        }
+
+        // The requests of registered clients are processed by the worker threads,
+        // only the connections are managed here.
+        client_info = socket_get_client_info (client);
+
+        if (client_info.type != UNKNOWN_CLIENT) {
+            socket_dispatch_request (server, client, client_info);
+            return;
+        }
+    }
+
     // Check if the client is closed.
     if (!check_client_connection (client)) {
         SCIM_DEBUG_FRONTEND (2) << " closing client connection.\n";
@@ -450,121 +602,127 @@ SocketFrontEnd::socket_receive_callback (SocketServer *server, const Socket &cli
         return;
     }
 
+    if (!socket_process_request (client, client_info))
+        socket_close_connection (server, client);
+
+    SCIM_DEBUG_FRONTEND (1) << "End of socket_receive_callback (" << id << ").\n";
+}
+
+bool
+SocketFrontEnd::socket_process_request (const Socket &client, const ClientInfo &client_info)
+{
+    RequestContext &ctx = context ();
+
+    int id = client.get_id ();
+    int cmd;
+    uint32 key;
+
     // If can not read the transaction,
     // or the transaction is not started with SCIM_TRANS_CMD_REQUEST,
     // or the key is mismatch,
     // just return.
-    if (!m_receive_trans.read_from_socket (client, m_socket_timeout) ||
-        !m_receive_trans.get_command (cmd) || cmd != SCIM_TRANS_CMD_REQUEST ||
-        !m_receive_trans.get_data (key) || key != (uint32) client_info.key)
-        return;
+    if (!ctx.receive_trans.read_from_socket (client, m_socket_timeout) ||
+        !ctx.receive_trans.get_command (cmd) || cmd != SCIM_TRANS_CMD_REQUEST ||
+        !ctx.receive_trans.get_data (key) || key != (uint32) client_info.key)
+        return true;
 
-    m_current_socket_client     = id;
-    m_current_socket_client_key = key;
+    ctx.current_socket_client     = id;
+    ctx.current_socket_client_key = key;
+    ctx.current_sequence          = 0;
+    ctx.current_lookup_table_cache = client_info.lookup_table_cache;
 
-    m_send_trans.clear ();
-    m_send_trans.put_command (SCIM_TRANS_CMD_REPLY);
+    ctx.send_trans.clear ();
+    ctx.send_trans.put_command (SCIM_TRANS_CMD_REPLY);
 
     // Move the read ptr to the end.
-    m_send_trans.get_command (cmd);
-
-    while (m_receive_trans.get_command (cmd)) {
-        if (cmd == SCIM_TRANS_CMD_PROCESS_KEY_EVENT)
-            socket_process_key_event (id);
-        else if (cmd == SCIM_TRANS_CMD_MOVE_PREEDIT_CARET)
-            socket_move_preedit_caret (id);
-        else if (cmd == SCIM_TRANS_CMD_SELECT_CANDIDATE)
-            socket_select_candidate (id);
-        else if (cmd == SCIM_TRANS_CMD_UPDATE_LOOKUP_TABLE_PAGE_SIZE)
-            socket_update_lookup_table_page_size (id);
-        else if (cmd == SCIM_TRANS_CMD_LOOKUP_TABLE_PAGE_UP)
-            socket_lookup_table_page_up (id);
-        else if (cmd == SCIM_TRANS_CMD_LOOKUP_TABLE_PAGE_DOWN)
-            socket_lookup_table_page_down (id);
-        else if (cmd == SCIM_TRANS_CMD_RESET)
-            socket_reset (id);
-        else if (cmd == SCIM_TRANS_CMD_FOCUS_IN)
-            socket_focus_in (id);
-        else if (cmd == SCIM_TRANS_CMD_FOCUS_OUT)
-            socket_focus_out (id);
-        else if (cmd == SCIM_TRANS_CMD_TRIGGER_PROPERTY)
-            socket_trigger_property (id);
-        else if (cmd == SCIM_TRANS_CMD_PROCESS_HELPER_EVENT)
-            socket_process_helper_event (id);
-        else if (cmd == SCIM_TRANS_CMD_UPDATE_CLIENT_CAPABILITIES)
-            socket_update_client_capabilities (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_FACTORY_LIST)
-            socket_get_factory_list (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_FACTORY_NAME)
-            socket_get_factory_name (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_FACTORY_AUTHORS)
-            socket_get_factory_authors (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_FACTORY_CREDITS)
-            socket_get_factory_credits (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_FACTORY_HELP)
-            socket_get_factory_help (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_FACTORY_LOCALES)
-            socket_get_factory_locales (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_FACTORY_ICON_FILE)
-            socket_get_factory_icon_file (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_FACTORY_LANGUAGE)
-            socket_get_factory_language (id);
-        else if (cmd == SCIM_TRANS_CMD_NEW_INSTANCE)
-            socket_new_instance (id);
-        else if (cmd == SCIM_TRANS_CMD_DELETE_INSTANCE)
-            socket_delete_instance (id);
-        else if (cmd == SCIM_TRANS_CMD_DELETE_ALL_INSTANCES)
-            socket_delete_all_instances (id);
-        else if (cmd == SCIM_TRANS_CMD_FLUSH_CONFIG)
-            socket_flush_config (id);
-        else if (cmd == SCIM_TRANS_CMD_ERASE_CONFIG)
-            socket_erase_config (id);
-        else if (cmd == SCIM_TRANS_CMD_RELOAD_CONFIG)
-            socket_reload_config (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_CONFIG_STRING)
-            socket_get_config_string (id);
-        else if (cmd == SCIM_TRANS_CMD_SET_CONFIG_STRING)
-            socket_set_config_string (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_CONFIG_INT)
-            socket_get_config_int (id);
-        else if (cmd == SCIM_TRANS_CMD_SET_CONFIG_INT)
-            socket_set_config_int (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_CONFIG_BOOL)
-            socket_get_config_bool (id);
-        else if (cmd == SCIM_TRANS_CMD_SET_CONFIG_BOOL)
-            socket_set_config_bool (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_CONFIG_DOUBLE)
-            socket_get_config_double (id);
-        else if (cmd == SCIM_TRANS_CMD_SET_CONFIG_DOUBLE)
-            socket_set_config_double (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_CONFIG_VECTOR_STRING)
-            socket_get_config_vector_string (id);
-        else if (cmd == SCIM_TRANS_CMD_SET_CONFIG_VECTOR_STRING)
-            socket_set_config_vector_string (id);
-        else if (cmd == SCIM_TRANS_CMD_GET_CONFIG_VECTOR_INT)
-            socket_get_config_vector_int (id);
-        else if (cmd == SCIM_TRANS_CMD_SET_CONFIG_VECTOR_INT)
-            socket_set_config_vector_int (id);
-        else if (cmd == SCIM_TRANS_CMD_LOAD_FILE)
-            socket_load_file (id);
-        else if (cmd == SCIM_TRANS_CMD_CLOSE_CONNECTION) {
-            socket_close_connection (server, client);
-            m_current_socket_client     = -1;
-            m_current_socket_client_key = 0;
-            return;
+    ctx.send_trans.get_command (cmd);
+
+    while (ctx.receive_trans.get_command (cmd)) {
+        if (cmd == SCIM_TRANS_CMD_CLOSE_CONNECTION) {
+            release_loaded_files ();
+            ctx.current_socket_client     = -1;
+            ctx.current_socket_client_key = 0;
+            ctx.current_sequence          = 0;
+            ctx.current_lookup_table_cache = 0;
+            return false;
         }
+
+        if (cmd <= 0 || cmd >= COMMAND_TABLE_SIZE || !m_command_slots [cmd])
+            continue;
+
+        size_t slot = m_command_slots [cmd] - 1;
+        struct timeval begin, end;
+
+        lock_backend (m_commands [slot].shared);
+
+        gettimeofday (&begin, 0);
+
+        (this->*m_commands [slot].handler) (id);
+
+        gettimeofday (&end, 0);
+
+        // Updated with the backend lock held, so that
+        // socket_get_command_statistics () sees consistent values.
+        ctx.statistics [slot].calls ++;
+        ctx.statistics [slot].usecs += (uint64) ((end.tv_sec - begin.tv_sec) * 1000000 + (end.tv_usec - begin.tv_usec));
+
+        unlock_backend ();
     }
 
     // Send reply to client
-    if (m_send_trans.get_data_type () == SCIM_TRANS_DATA_UNKNOWN)
-        m_send_trans.put_command (SCIM_TRANS_CMD_FAIL);
+    if (ctx.send_trans.get_data_type () == SCIM_TRANS_DATA_UNKNOWN)
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_FAIL);
 
-    m_send_trans.write_to_socket (client);
+    // The client may have missed the lookup table sent in the reply.
+    if (!ctx.send_trans.write_to_socket (client) && ctx.current_lookup_table_cache)
+        ctx.current_lookup_table_cache->clear ();
 
-    m_current_socket_client     = -1;
-    m_current_socket_client_key = 0;
+    release_loaded_files ();
 
-    SCIM_DEBUG_FRONTEND (1) << "End of socket_receive_callback (" << id << ").\n";
+    ctx.current_socket_client     = -1;
+    ctx.current_socket_client_key = 0;
+    ctx.current_sequence          = 0;
+    ctx.current_lookup_table_cache = 0;
+
+    return true;
+}
+
+void
+SocketFrontEnd::socket_dispatch_request (SocketServer *server, const Socket &client, const ClientInfo &client_info)
+{
+    Worker *worker = m_workers [client.get_id () % m_workers.size ()];
+
+    SCIM_DEBUG_FRONTEND (2) << " Dispatch request of client " << client.get_id () << " to worker "
+        << (client.get_id () % m_workers.size ()) << ".\n";
+
+    // Nothing more will be received from the client until the worker
+    // has finished this request, so the requests are kept in order.
+    if (!server->suspend_socket (client))
+        return;
+
+    pthread_mutex_lock (&worker->mutex);
+    worker->requests.push_back (std::make_pair (client.get_id (), client_info));
+    pthread_cond_signal (&worker->cond);
+    pthread_mutex_unlock (&worker->mutex);
+}
+
+void
+SocketFrontEnd::socket_finish_requests (SocketServer *server)
+{
+    WorkerResult result;
+
+    while (recv (m_worker_notify_fds [0], &result, sizeof (result), MSG_DONTWAIT) == sizeof (result)) {
+        Socket client (result.client);
+
+        SCIM_DEBUG_FRONTEND (2) << " Request of client " << result.client << " finished.\n";
+
+        if (result.closed) {
+            SCIM_DEBUG_FRONTEND (2) << " closing client connection.\n";
+            socket_close_connection (server, client);
+        } else {
+            server->resume_socket (client);
+        }
+    }
 }
 
 bool
@@ -577,12 +735,18 @@ SocketFrontEnd::socket_open_connection (SocketServer *server, const Socket &clie
                                                  String ("SocketFrontEnd"), 
                                                  String ("SocketIMEngine,SocketConfig"),
                                                  client,
-                                                 m_socket_timeout);
+                                                 m_socket_timeout,
+                                                 SCIM_SOCKET_PROTOCOL_SEQUENCE |
+                                                 SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA);
 
     if (type.length ()) {
         ClientInfo info;
         info.key = key;
         info.type = ((type == "SocketIMEngine") ? IMENGINE_CLIENT : CONFIG_CLIENT);
+        info.lookup_table_cache = 0;
+
+        if (client.get_protocol_options () & SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA)
+            info.lookup_table_cache = new LookupTableCache;
 
         SCIM_DEBUG_MAIN (2) << " Add client to repository. Type=" << type << " key=" << key << "\n";
         m_socket_client_repository [client.get_id ()] = info;
@@ -607,8 +771,13 @@ SocketFrontEnd::socket_close_connection (SocketServer *server, const Socket &cli
     if (client_info.type != UNKNOWN_CLIENT) {
         m_socket_client_repository.erase (client.get_id ());
 
-        if (client_info.type == IMENGINE_CLIENT)
+        delete client_info.lookup_table_cache;
+
+        if (client_info.type == IMENGINE_CLIENT) {
+            lock_backend (false);
             socket_delete_all_instances (client.get_id ());
+            unlock_backend ();
+        }
 
         if (!m_socket_client_repository.size () && !m_stay)
             server->shutdown ();
@@ -618,7 +787,7 @@ SocketFrontEnd::socket_close_connection (SocketServer *server, const Socket &cli
 SocketFrontEnd::ClientInfo
 SocketFrontEnd::socket_get_client_info (const Socket &client)
 {
-    static ClientInfo null_client = { 0, UNKNOWN_CLIENT };
+    static ClientInfo null_client = { 0, UNKNOWN_CLIENT, 0 };
     SocketClientRepository::iterator it = m_socket_client_repository.find (client.get_id ());
 
     if (it != m_socket_client_repository.end ())
@@ -635,15 +804,29 @@ SocketFrontEnd::socket_exception_callback (SocketServer *server, const Socket &c
     socket_close_connection (server, client);
 }
 
+bool
+SocketFrontEnd::socket_idle_callback (SocketServer *server)
+{
+    // Preload the default IMEngine factories one by one, while there is
+    // no request from the clients.
+    lock_backend (false);
+    bool more = preload_default_factory ();
+    unlock_backend ();
+
+    return more;
+}
+
 //client_id is client's socket id
 void
 SocketFrontEnd::socket_get_factory_list (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     String encoding;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_factory_list.\n";
 
-    if (m_receive_trans.get_data (encoding)) {
+    if (ctx.receive_trans.get_data (encoding)) {
         std::vector<String> uuids;
 
         get_factory_list_for_encoding (uuids, encoding);
@@ -651,132 +834,200 @@ SocketFrontEnd::socket_get_factory_list (int /*client_id*/)
         SCIM_DEBUG_FRONTEND (3) << "  Encoding (" << encoding
             << ") Num(" << uuids.size () << ").\n";
 
-        m_send_trans.put_data (uuids);
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_data (uuids);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_factory_name (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     String sfid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_factory_name.\n";
 
-    if (m_receive_trans.get_data (sfid)) {
+    if (ctx.receive_trans.get_data (sfid)) {
         WideString name = get_factory_name (sfid);
 
-        m_send_trans.put_data (name);
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_data (name);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_factory_authors (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     String sfid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_factory_authors.\n";
 
-    if (m_receive_trans.get_data (sfid)) {
+    if (ctx.receive_trans.get_data (sfid)) {
         WideString authors = get_factory_authors (sfid);
 
-        m_send_trans.put_data (authors);
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_data (authors);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_factory_credits (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     String sfid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_factory_credits.\n";
 
-    if (m_receive_trans.get_data (sfid)) {
+    if (ctx.receive_trans.get_data (sfid)) {
         WideString credits = get_factory_credits (sfid);
 
-        m_send_trans.put_data (credits);
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_data (credits);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_factory_help (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     String sfid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_factory_help.\n";
 
-    if (m_receive_trans.get_data (sfid)) {
+    if (ctx.receive_trans.get_data (sfid)) {
         WideString help = get_factory_help (sfid);
 
-        m_send_trans.put_data (help);
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_data (help);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_factory_locales (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     String sfid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_factory_locales.\n";
 
-    if (m_receive_trans.get_data (sfid)) {
+    if (ctx.receive_trans.get_data (sfid)) {
         String locales = get_factory_locales (sfid);
 
         SCIM_DEBUG_FRONTEND (3) << "  Locales (" << locales << ").\n";
 
-        m_send_trans.put_data (locales);
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_data (locales);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_factory_icon_file (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     String sfid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_factory_icon_file.\n";
 
-    if (m_receive_trans.get_data (sfid)) {
+    if (ctx.receive_trans.get_data (sfid)) {
         String iconfile = get_factory_icon_file (sfid);
 
         SCIM_DEBUG_FRONTEND (3) << "  ICON File (" << iconfile << ").\n";
 
-        m_send_trans.put_data (iconfile);
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_data (iconfile);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_factory_language (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     String sfid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_factory_language.\n";
 
-    if (m_receive_trans.get_data (sfid)) {
+    if (ctx.receive_trans.get_data (sfid)) {
         String language = get_factory_language (sfid);
 
         SCIM_DEBUG_FRONTEND (3) << "  Language (" << language << ").\n";
 
-        m_send_trans.put_data (language);
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_data (language);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
+    }
+}
+
+void
+SocketFrontEnd::socket_get_factory_info_bulk (int /*client_id*/)
+{
+    RequestContext &ctx = context ();
+
+    String encoding;
+    uint32 with_icons;
+
+    SCIM_DEBUG_FRONTEND (2) << " socket_get_factory_info_bulk.\n";
+
+    if (ctx.receive_trans.get_data (encoding) &&
+        ctx.receive_trans.get_data (with_icons)) {
+        std::vector<String> uuids;
+        std::set<String> icons;
+
+        get_factory_list_for_encoding (uuids, encoding);
+
+        SCIM_DEBUG_FRONTEND (3) << "  Encoding (" << encoding
+            << ") Num(" << uuids.size () << ").\n";
+
+        ctx.send_trans.put_data ((uint32) uuids.size ());
+
+        for (size_t i = 0; i < uuids.size (); ++i) {
+            String iconfile = get_factory_icon_file (uuids [i]);
+
+            ctx.send_trans.put_data (uuids [i]);
+            ctx.send_trans.put_data (get_factory_name (uuids [i]));
+            ctx.send_trans.put_data (get_factory_locales (uuids [i]));
+            ctx.send_trans.put_data (get_factory_language (uuids [i]));
+            ctx.send_trans.put_data (iconfile);
+
+            if (!with_icons) continue;
+
+            char *bufptr = 0;
+            size_t filesize = 0;
+
+            // Many factories share the same icon, send it only once.
+            if (iconfile.length () && icons.insert (iconfile).second &&
+                (filesize = scim_load_file (iconfile, &bufptr)) > 0) {
+                ctx.send_trans.put_data ((uint32) 1);
+                ctx.send_trans.put_borrowed_data (bufptr, filesize);
+                ctx.loaded_files.push_back (bufptr);
+            } else {
+                delete [] bufptr;
+                ctx.send_trans.put_data ((uint32) 0);
+            }
+        }
+
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_new_instance (int client_id)
 {
+    RequestContext &ctx = context ();
+
     String sfid;
     String encoding;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_new_instance.\n";
 
-    if (m_receive_trans.get_data (sfid) &&
-        m_receive_trans.get_data (encoding)) {
+    if (ctx.receive_trans.get_data (sfid) &&
+        ctx.receive_trans.get_data (encoding)) {
         int siid = new_instance (sfid, encoding);
 
         // Instance created OK.
@@ -793,8 +1044,8 @@ SocketFrontEnd::socket_new_instance (int client_id)
 
             SCIM_DEBUG_FRONTEND (3) << "  InstanceID (" << siid << ").\n";
 
-            m_send_trans.put_data ((uint32)siid);
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_data ((uint32)siid);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
         }
     }
 }
@@ -802,19 +1053,21 @@ SocketFrontEnd::socket_new_instance (int client_id)
 void
 SocketFrontEnd::socket_delete_instance (int client_id)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_delete_instance.\n";
 
-    if (m_receive_trans.get_data (siid)) {
+    if (ctx.receive_trans.get_data (siid)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  InstanceID (" << siid << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         delete_instance ((int) siid);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
 
         SocketInstanceRepository::iterator it =
             std::lower_bound (m_socket_instance_repository.begin (),
@@ -825,13 +1078,15 @@ SocketFrontEnd::socket_delete_instance (int client_id)
             *it == std::pair <int, int> (client_id, siid))
             m_socket_instance_repository.erase (it);
 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_delete_all_instances (int client_id)
 {
+    RequestContext &ctx = context ();
+
     SCIM_DEBUG_FRONTEND (2) << " socket_delete_all_instances.\n";
 
     SocketInstanceRepository::iterator it;
@@ -848,272 +1103,296 @@ SocketFrontEnd::socket_delete_all_instances (int client_id)
 
     if (lit != uit) {
         for (it = lit; it != uit; ++it) {
-            m_current_instance = it->second;
+            ctx.current_instance = it->second;
             delete_instance (it->second);
         }
-        m_current_instance = -1;
+        ctx.current_instance = -1;
         m_socket_instance_repository.erase (lit, uit);
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_process_key_event (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32   siid;
     KeyEvent event;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_process_key_event.\n";
 
-    if (m_receive_trans.get_data (siid) &&
-        m_receive_trans.get_data (event)) {
+    if (ctx.receive_trans.get_data (siid) &&
+        ctx.receive_trans.get_data (event)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid << ") KeyEvent ("
             << event.code << "," << event.mask << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         if (process_key_event ((int) siid, event))
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
         else
-            m_send_trans.put_command (SCIM_TRANS_CMD_FAIL);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_FAIL);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
 void
 SocketFrontEnd::socket_move_preedit_caret (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
     uint32 caret;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_move_preedit_caret.\n";
 
-    if (m_receive_trans.get_data (siid) &&
-        m_receive_trans.get_data (caret)) {
+    if (ctx.receive_trans.get_data (siid) &&
+        ctx.receive_trans.get_data (caret)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid
             << ") Caret (" << caret << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         move_preedit_caret ((int) siid, caret); 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
 void
 SocketFrontEnd::socket_select_candidate (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
     uint32 item;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_select_candidate.\n";
 
-    if (m_receive_trans.get_data (siid) &&
-        m_receive_trans.get_data (item)) {
+    if (ctx.receive_trans.get_data (siid) &&
+        ctx.receive_trans.get_data (item)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid << ") Item (" << item << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         select_candidate ((int) siid, item); 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
 void
 SocketFrontEnd::socket_update_lookup_table_page_size (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
     uint32 size;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_update_lookup_table_page_size.\n";
 
-    if (m_receive_trans.get_data (siid) &&
-        m_receive_trans.get_data (size)) {
+    if (ctx.receive_trans.get_data (siid) &&
+        ctx.receive_trans.get_data (size)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid << ") PageSize (" << size << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         update_lookup_table_page_size ((int) siid, size); 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
 void
 SocketFrontEnd::socket_lookup_table_page_up (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_lookup_table_page_up.\n";
 
-    if (m_receive_trans.get_data (siid)) {
+    if (ctx.receive_trans.get_data (siid)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         lookup_table_page_up ((int) siid); 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
 void
 SocketFrontEnd::socket_lookup_table_page_down (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_lookup_table_page_down.\n";
 
-    if (m_receive_trans.get_data (siid)) {
+    if (ctx.receive_trans.get_data (siid)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         lookup_table_page_down ((int) siid); 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
 void
 SocketFrontEnd::socket_reset (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_reset.\n";
 
-    if (m_receive_trans.get_data (siid)) {
+    if (ctx.receive_trans.get_data (siid)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         reset ((int) siid); 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
 void
 SocketFrontEnd::socket_focus_in (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_focus_in.\n";
 
-    if (m_receive_trans.get_data (siid)) {
+    if (ctx.receive_trans.get_data (siid)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         focus_in ((int) siid); 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
 void
 SocketFrontEnd::socket_focus_out (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_focus_out.\n";
 
-    if (m_receive_trans.get_data (siid)) {
+    if (ctx.receive_trans.get_data (siid)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         focus_out ((int) siid); 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
 void
 SocketFrontEnd::socket_trigger_property (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
     String property;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_trigger_property.\n";
 
-    if (m_receive_trans.get_data (siid) &&
-        m_receive_trans.get_data (property)) {
+    if (ctx.receive_trans.get_data (siid) &&
+        ctx.receive_trans.get_data (property)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         trigger_property ((int) siid, property); 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
 void
 SocketFrontEnd::socket_process_helper_event (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
     String helper_uuid;
     Transaction trans;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_process_helper_event.\n";
 
-    if (m_receive_trans.get_data (siid) &&
-        m_receive_trans.get_data (helper_uuid) &&
-        m_receive_trans.get_data (trans)) {
+    if (ctx.receive_trans.get_data (siid) &&
+        ctx.receive_trans.get_data (helper_uuid) &&
+        ctx.receive_trans.get_data (trans)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         process_helper_event ((int) siid, helper_uuid, trans); 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
 void
 SocketFrontEnd::socket_update_client_capabilities (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     uint32 siid;
     uint32 cap;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_update_client_capabilities.\n";
 
-    if (m_receive_trans.get_data (siid) && m_receive_trans.get_data (cap)) {
+    if (ctx.receive_trans.get_data (siid) && ctx.receive_trans.get_data (cap)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  SI (" << siid << ").\n";
 
-        m_current_instance = (int) siid;
+        ctx.current_instance = (int) siid;
 
         update_client_capabilities ((int) siid, cap); 
 
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 
-        m_current_instance = -1;
+        ctx.current_instance = -1;
     }
 }
 
@@ -1121,18 +1400,22 @@ SocketFrontEnd::socket_update_client_capabilities (int /*client_id*/)
 void
 SocketFrontEnd::socket_flush_config (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config_readonly || m_config.null ())
         return;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_flush_config.\n";
 
     if (m_config->flush ())
-        m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 }
 
 void
 SocketFrontEnd::socket_erase_config (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config_readonly || m_config.null ())
         return;
 
@@ -1140,18 +1423,20 @@ SocketFrontEnd::socket_erase_config (int /*client_id*/)
 
     SCIM_DEBUG_FRONTEND (2) << " socket_erase_config.\n";
 
-    if (m_receive_trans.get_data (key)) {
+    if (ctx.receive_trans.get_data (key)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  Key   (" << key << ").\n";
 
         if (m_config->erase (key))
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_reload_config (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     static timeval last_timestamp = {0, 0};
 
     if (m_config.null ())
@@ -1168,26 +1453,28 @@ SocketFrontEnd::socket_reload_config (int /*client_id*/)
 
     gettimeofday (&last_timestamp, 0);
 
-    m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+    ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
 }
 
 void
 SocketFrontEnd::socket_get_config_string (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config.null ()) return;
 
     String key;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_config_string.\n";
 
-    if (m_receive_trans.get_data (key)) {
+    if (ctx.receive_trans.get_data (key)) {
         String value;
 
         SCIM_DEBUG_FRONTEND (3) << "  Key (" << key << ").\n";
 
         if (m_config->read (key, &value)) {
-            m_send_trans.put_data (value);
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_data (value);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
         }
     }
 }
@@ -1195,6 +1482,8 @@ SocketFrontEnd::socket_get_config_string (int /*client_id*/)
 void
 SocketFrontEnd::socket_set_config_string (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config_readonly || m_config.null ())
         return;
 
@@ -1203,34 +1492,36 @@ SocketFrontEnd::socket_set_config_string (int /*client_id*/)
 
     SCIM_DEBUG_FRONTEND (2) << " socket_set_config_string.\n";
 
-    if (m_receive_trans.get_data (key) &&
-        m_receive_trans.get_data (value)) {
+    if (ctx.receive_trans.get_data (key) &&
+        ctx.receive_trans.get_data (value)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  Key   (" << key << ").\n";
         SCIM_DEBUG_FRONTEND (3) << "  Value (" << value << ").\n";
 
         if (m_config->write (key, value))
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_config_int (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config.null ()) return;
 
     String key;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_config_int.\n";
 
-    if (m_receive_trans.get_data (key)) {
+    if (ctx.receive_trans.get_data (key)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  Key (" << key << ").\n";
 
         int value;
         if (m_config->read (key, &value)) {
-            m_send_trans.put_data ((uint32) value);
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_data ((uint32) value);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
         }
     }
 }
@@ -1238,6 +1529,8 @@ SocketFrontEnd::socket_get_config_int (int /*client_id*/)
 void
 SocketFrontEnd::socket_set_config_int (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config_readonly || m_config.null ())
         return;
 
@@ -1246,34 +1539,36 @@ SocketFrontEnd::socket_set_config_int (int /*client_id*/)
 
     SCIM_DEBUG_FRONTEND (2) << " socket_set_config_int.\n";
 
-    if (m_receive_trans.get_data (key) &&
-        m_receive_trans.get_data (value)) {
+    if (ctx.receive_trans.get_data (key) &&
+        ctx.receive_trans.get_data (value)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  Key   (" << key << ").\n";
         SCIM_DEBUG_FRONTEND (3) << "  Value (" << value << ").\n";
 
         if (m_config->write (key, (int) value))
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_config_bool (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config.null ()) return;
 
     String key;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_config_bool.\n";
 
-    if (m_receive_trans.get_data (key)) {
+    if (ctx.receive_trans.get_data (key)) {
         bool value;
 
         SCIM_DEBUG_FRONTEND (3) << "  Key (" << key << ").\n";
 
         if (m_config->read (key, &value)) {
-            m_send_trans.put_data ((uint32) value);
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_data ((uint32) value);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
         }
     }
 }
@@ -1281,6 +1576,8 @@ SocketFrontEnd::socket_get_config_bool (int /*client_id*/)
 void
 SocketFrontEnd::socket_set_config_bool (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config_readonly || m_config.null ())
         return;
 
@@ -1289,27 +1586,29 @@ SocketFrontEnd::socket_set_config_bool (int /*client_id*/)
 
     SCIM_DEBUG_FRONTEND (2) << " socket_set_config_bool.\n";
 
-    if (m_receive_trans.get_data (key) &&
-        m_receive_trans.get_data (value)) {
+    if (ctx.receive_trans.get_data (key) &&
+        ctx.receive_trans.get_data (value)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  Key   (" << key << ").\n";
         SCIM_DEBUG_FRONTEND (3) << "  Value (" << value << ").\n";
 
         if (m_config->write (key, (bool) value))
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_config_double (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config.null ()) return;
 
     String key;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_config_double.\n";
 
-    if (m_receive_trans.get_data (key)) {
+    if (ctx.receive_trans.get_data (key)) {
         double value;
 
         SCIM_DEBUG_FRONTEND (3) << "  Key (" << key << ").\n";
@@ -1317,8 +1616,8 @@ SocketFrontEnd::socket_get_config_double (int /*client_id*/)
         if (m_config->read (key, &value)) {
             char buf [80];
             snprintf (buf, 79, "%lE", value);
-            m_send_trans.put_data (String (buf));
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_data (String (buf));
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
         }
     }
 }
@@ -1326,6 +1625,8 @@ SocketFrontEnd::socket_get_config_double (int /*client_id*/)
 void
 SocketFrontEnd::socket_set_config_double (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config_readonly || m_config.null ())
         return;
 
@@ -1334,8 +1635,8 @@ SocketFrontEnd::socket_set_config_double (int /*client_id*/)
 
     SCIM_DEBUG_FRONTEND (2) << " socket_set_config_double.\n";
 
-    if (m_receive_trans.get_data (key) &&
-        m_receive_trans.get_data (str)) {
+    if (ctx.receive_trans.get_data (key) &&
+        ctx.receive_trans.get_data (str)) {
         double value;
         sscanf (str.c_str (), "%lE", &value);
 
@@ -1343,27 +1644,29 @@ SocketFrontEnd::socket_set_config_double (int /*client_id*/)
         SCIM_DEBUG_FRONTEND (3) << "  Value (" << value << ").\n";
 
         if (m_config->write (key, value))
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_config_vector_string (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config.null ()) return;
 
     String key;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_config_vector_string.\n";
 
-    if (m_receive_trans.get_data (key)) {
+    if (ctx.receive_trans.get_data (key)) {
         std::vector <String> vec;
 
         SCIM_DEBUG_FRONTEND (3) << "  Key (" << key << ").\n";
 
         if (m_config->read (key, &vec)) {
-            m_send_trans.put_data (vec);
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_data (vec);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
         }
     }
 }
@@ -1371,6 +1674,8 @@ SocketFrontEnd::socket_get_config_vector_string (int /*client_id*/)
 void
 SocketFrontEnd::socket_set_config_vector_string (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config_readonly || m_config.null ())
         return;
 
@@ -1379,26 +1684,28 @@ SocketFrontEnd::socket_set_config_vector_string (int /*client_id*/)
 
     SCIM_DEBUG_FRONTEND (2) << " socket_set_config_vector_string.\n";
 
-    if (m_receive_trans.get_data (key) &&
-        m_receive_trans.get_data (vec)) {
+    if (ctx.receive_trans.get_data (key) &&
+        ctx.receive_trans.get_data (vec)) {
 
         SCIM_DEBUG_FRONTEND (3) << "  Key (" << key << ").\n";
 
         if (m_config->write (key, vec))
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
     }
 }
 
 void
 SocketFrontEnd::socket_get_config_vector_int (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config.null ()) return;
 
     String key;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_get_config_vector_int.\n";
 
-    if (m_receive_trans.get_data (key)) {
+    if (ctx.receive_trans.get_data (key)) {
         std::vector <int> vec;
 
         SCIM_DEBUG_FRONTEND (3) << "  Key (" << key << ").\n";
@@ -1409,8 +1716,8 @@ SocketFrontEnd::socket_get_config_vector_int (int /*client_id*/)
             for (uint32 i=0; i<vec.size (); ++i)
                 reply.push_back ((uint32) vec[i]);
 
-            m_send_trans.put_data (reply);
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_data (reply);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
         }
     }
 }
@@ -1418,6 +1725,8 @@ SocketFrontEnd::socket_get_config_vector_int (int /*client_id*/)
 void
 SocketFrontEnd::socket_set_config_vector_int (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     if (m_config_readonly || m_config.null ())
         return;
 
@@ -1426,8 +1735,8 @@ SocketFrontEnd::socket_set_config_vector_int (int /*client_id*/)
 
     SCIM_DEBUG_FRONTEND (2) << " socket_set_config_vector_int.\n";
 
-    if (m_receive_trans.get_data (key) &&
-        m_receive_trans.get_data (vec)) {
+    if (ctx.receive_trans.get_data (key) &&
+        ctx.receive_trans.get_data (vec)) {
         std::vector<int> req;
 
         SCIM_DEBUG_FRONTEND (3) << "  Key (" << key << ").\n";
@@ -1436,29 +1745,339 @@ SocketFrontEnd::socket_set_config_vector_int (int /*client_id*/)
             req.push_back ((int) vec[i]);
 
         if (m_config->write (key, req))
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
+    }
+}
+
+void
+SocketFrontEnd::init_commands ()
+{
+    // Instance level commands come first, they can run in parallel.
+    static const Command commands [] = {
+        { SCIM_TRANS_CMD_PROCESS_KEY_EVENT,             &SocketFrontEnd::socket_process_key_event,             true  },
+        { SCIM_TRANS_CMD_MOVE_PREEDIT_CARET,            &SocketFrontEnd::socket_move_preedit_caret,            true  },
+        { SCIM_TRANS_CMD_SELECT_CANDIDATE,              &SocketFrontEnd::socket_select_candidate,              true  },
+        { SCIM_TRANS_CMD_UPDATE_LOOKUP_TABLE_PAGE_SIZE, &SocketFrontEnd::socket_update_lookup_table_page_size, true  },
+        { SCIM_TRANS_CMD_LOOKUP_TABLE_PAGE_UP,          &SocketFrontEnd::socket_lookup_table_page_up,          true  },
+        { SCIM_TRANS_CMD_LOOKUP_TABLE_PAGE_DOWN,        &SocketFrontEnd::socket_lookup_table_page_down,        true  },
+        { SCIM_TRANS_CMD_RESET,                         &SocketFrontEnd::socket_reset,                         true  },
+        { SCIM_TRANS_CMD_FOCUS_IN,                      &SocketFrontEnd::socket_focus_in,                      true  },
+        { SCIM_TRANS_CMD_FOCUS_OUT,                     &SocketFrontEnd::socket_focus_out,                     true  },
+        { SCIM_TRANS_CMD_TRIGGER_PROPERTY,              &SocketFrontEnd::socket_trigger_property,              true  },
+        { SCIM_TRANS_CMD_PROCESS_HELPER_EVENT,          &SocketFrontEnd::socket_process_helper_event,          true  },
+        { SCIM_TRANS_CMD_UPDATE_CLIENT_CAPABILITIES,    &SocketFrontEnd::socket_update_client_capabilities,    true  },
+        { SCIM_TRANS_CMD_LOAD_FILE,                     &SocketFrontEnd::socket_load_file,                     true  },
+        { SCIM_TRANS_CMD_SEQUENCE,                      &SocketFrontEnd::socket_sequence,                      true  },
+        { SCIM_TRANS_CMD_GET_FACTORY_LIST,              &SocketFrontEnd::socket_get_factory_list,              false },
+        { SCIM_TRANS_CMD_GET_FACTORY_NAME,              &SocketFrontEnd::socket_get_factory_name,              false },
+        { SCIM_TRANS_CMD_GET_FACTORY_AUTHORS,           &SocketFrontEnd::socket_get_factory_authors,           false },
+        { SCIM_TRANS_CMD_GET_FACTORY_CREDITS,           &SocketFrontEnd::socket_get_factory_credits,           false },
+        { SCIM_TRANS_CMD_GET_FACTORY_HELP,              &SocketFrontEnd::socket_get_factory_help,              false },
+        { SCIM_TRANS_CMD_GET_FACTORY_LOCALES,           &SocketFrontEnd::socket_get_factory_locales,           false },
+        { SCIM_TRANS_CMD_GET_FACTORY_ICON_FILE,         &SocketFrontEnd::socket_get_factory_icon_file,         false },
+        { SCIM_TRANS_CMD_GET_FACTORY_LANGUAGE,          &SocketFrontEnd::socket_get_factory_language,          false },
+        { SCIM_TRANS_CMD_GET_FACTORY_INFO_BULK,         &SocketFrontEnd::socket_get_factory_info_bulk,         false },
+        { SCIM_TRANS_CMD_NEW_INSTANCE,                  &SocketFrontEnd::socket_new_instance,                  false },
+        { SCIM_TRANS_CMD_DELETE_INSTANCE,               &SocketFrontEnd::socket_delete_instance,               false },
+        { SCIM_TRANS_CMD_DELETE_ALL_INSTANCES,          &SocketFrontEnd::socket_delete_all_instances,          false },
+        { SCIM_TRANS_CMD_FLUSH_CONFIG,                  &SocketFrontEnd::socket_flush_config,                  false },
+        { SCIM_TRANS_CMD_ERASE_CONFIG,                  &SocketFrontEnd::socket_erase_config,                  false },
+        { SCIM_TRANS_CMD_RELOAD_CONFIG,                 &SocketFrontEnd::socket_reload_config,                 false },
+        { SCIM_TRANS_CMD_GET_CONFIG_STRING,             &SocketFrontEnd::socket_get_config_string,             false },
+        { SCIM_TRANS_CMD_SET_CONFIG_STRING,             &SocketFrontEnd::socket_set_config_string,             false },
+        { SCIM_TRANS_CMD_GET_CONFIG_INT,                &SocketFrontEnd::socket_get_config_int,                false },
+        { SCIM_TRANS_CMD_SET_CONFIG_INT,                &SocketFrontEnd::socket_set_config_int,                false },
+        { SCIM_TRANS_CMD_GET_CONFIG_BOOL,               &SocketFrontEnd::socket_get_config_bool,               false },
+        { SCIM_TRANS_CMD_SET_CONFIG_BOOL,               &SocketFrontEnd::socket_set_config_bool,               false },
+        { SCIM_TRANS_CMD_GET_CONFIG_DOUBLE,             &SocketFrontEnd::socket_get_config_double,             false },
+        { SCIM_TRANS_CMD_SET_CONFIG_DOUBLE,             &SocketFrontEnd::socket_set_config_double,             false },
+        { SCIM_TRANS_CMD_GET_CONFIG_VECTOR_STRING,      &SocketFrontEnd::socket_get_config_vector_string,      false },
+        { SCIM_TRANS_CMD_SET_CONFIG_VECTOR_STRING,      &SocketFrontEnd::socket_set_config_vector_string,      false },
+        { SCIM_TRANS_CMD_GET_CONFIG_VECTOR_INT,         &SocketFrontEnd::socket_get_config_vector_int,         false },
+        { SCIM_TRANS_CMD_SET_CONFIG_VECTOR_INT,         &SocketFrontEnd::socket_set_config_vector_int,         false },
+        { SCIM_TRANS_CMD_GET_COMMAND_STATISTICS,        &SocketFrontEnd::socket_get_command_statistics,        false },
+        { SCIM_TRANS_CMD_RESET_LOOKUP_TABLE_CACHE,      &SocketFrontEnd::socket_reset_lookup_table_cache,      true  }
+    };
+
+    m_commands.assign (commands, commands + sizeof (commands) / sizeof (commands [0]));
+
+    for (size_t i = 0; i < COMMAND_TABLE_SIZE; ++i)
+        m_command_slots [i] = 0;
+
+    // Enlarge COMMAND_TABLE_SIZE or MAX_COMMANDS if these fail,
+    // out of range commands are never dispatched.
+    assert (m_commands.size () <= MAX_COMMANDS);
+
+    for (size_t i = 0; i < m_commands.size () && i < MAX_COMMANDS; ++i) {
+        int cmd = m_commands [i].cmd;
+
+        assert (cmd > 0 && cmd < COMMAND_TABLE_SIZE);
+
+        if (cmd > 0 && cmd < COMMAND_TABLE_SIZE)
+            m_command_slots [cmd] = (unsigned char) (i + 1);
+    }
+}
+
+void
+SocketFrontEnd::socket_reset_lookup_table_cache (int /*client_id*/)
+{
+    RequestContext &ctx = context ();
+
+    SCIM_DEBUG_FRONTEND (2) << " socket_reset_lookup_table_cache.\n";
+
+    if (ctx.current_lookup_table_cache)
+        ctx.current_lookup_table_cache->clear ();
+}
+
+void
+SocketFrontEnd::socket_get_command_statistics (int /*client_id*/)
+{
+    RequestContext &ctx = context ();
+
+    std::vector <uint32> stats;
+
+    SCIM_DEBUG_FRONTEND (2) << " socket_get_command_statistics.\n";
+
+    // All other commands are blocked by the exclusive backend lock,
+    // so the statistics of the worker contexts can be read safely.
+    for (size_t i = 0; i < m_commands.size () && i < MAX_COMMANDS; ++i) {
+        uint32 calls = m_main_context.statistics [i].calls;
+        uint64 usecs = m_main_context.statistics [i].usecs;
+
+        for (size_t j = 0; j < m_workers.size (); ++j) {
+            calls += m_workers [j]->context.statistics [i].calls;
+            usecs += m_workers [j]->context.statistics [i].usecs;
+        }
+
+        if (!calls) continue;
+
+        stats.push_back ((uint32) m_commands [i].cmd);
+        stats.push_back (calls);
+        stats.push_back ((uint32) (usecs >> 32));
+        stats.push_back ((uint32) (usecs & 0xFFFFFFFF));
+    }
+
+    ctx.send_trans.put_data (stats);
+    ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
+}
+
+void
+SocketFrontEnd::socket_sequence (int /*client_id*/)
+{
+    RequestContext &ctx = context ();
+
+    uint32 seq;
+
+    SCIM_DEBUG_FRONTEND (2) << " socket_sequence.\n";
+
+    // Mark the results of the following command,
+    // so that the client can match them with its pipelined requests.
+    if (ctx.receive_trans.get_data (seq) && seq) {
+        SCIM_DEBUG_FRONTEND (3) << "  Sequence (" << seq << ").\n";
+
+        ctx.current_sequence = seq;
+
+        ctx.send_trans.put_command (SCIM_TRANS_CMD_SEQUENCE);
+        ctx.send_trans.put_data (seq);
     }
 }
 
 void
 SocketFrontEnd::socket_load_file (int /*client_id*/)
 {
+    RequestContext &ctx = context ();
+
     String filename;
     char *bufptr = 0;
     size_t filesize = 0;
 
     SCIM_DEBUG_FRONTEND (2) << " socket_load_file.\n";
 
-    if (m_receive_trans.get_data (filename)) {
+    if (ctx.receive_trans.get_data (filename)) {
         SCIM_DEBUG_FRONTEND (3) << "  File (" << filename << ").\n";
 
         if ((filesize = scim_load_file (filename, &bufptr)) > 0) {
-            m_send_trans.put_data (bufptr, filesize);
-            m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+            // The file may be large, send it directly from the loaded buffer.
+            ctx.send_trans.put_borrowed_data (bufptr, filesize);
+            ctx.send_trans.put_command (SCIM_TRANS_CMD_OK);
+            ctx.loaded_files.push_back (bufptr);
+        } else {
+            delete [] bufptr;
         }
+    }
+}
 
-        delete [] bufptr;
+void
+SocketFrontEnd::release_loaded_files ()
+{
+    RequestContext &ctx = context ();
+
+    if (ctx.loaded_files.empty ()) return;
+
+    ctx.send_trans.clear ();
+
+    for (size_t i = 0; i < ctx.loaded_files.size (); ++i)
+        delete [] ctx.loaded_files [i];
+
+    ctx.loaded_files.clear ();
+}
+
+SocketFrontEnd::RequestContext &
+SocketFrontEnd::context ()
+{
+    if (_worker_context)
+        return *static_cast <RequestContext *> (_worker_context);
+
+    return m_main_context;
+}
+
+bool
+SocketFrontEnd::start_workers (int num_workers)
+{
+    if (num_workers <= 0 || m_workers.size ())
+        return false;
+
+    if (num_workers > SCIM_SOCKET_FRONTEND_MAX_WORKERS)
+        num_workers = SCIM_SOCKET_FRONTEND_MAX_WORKERS;
+
+    if (socketpair (AF_UNIX, SOCK_DGRAM, 0, m_worker_notify_fds) != 0) {
+        m_worker_notify_fds [0] = -1;
+        m_worker_notify_fds [1] = -1;
+        return false;
+    }
+
+    if (!m_socket_server.insert_external_socket (Socket (m_worker_notify_fds [0]))) {
+        stop_workers ();
+        return false;
+    }
+
+    for (int i = 0; i < num_workers; ++i) {
+        Worker *worker = new Worker;
+
+        worker->frontend = this;
+        worker->running = true;
+
+        pthread_mutex_init (&worker->mutex, 0);
+        pthread_cond_init (&worker->cond, 0);
+
+        if (pthread_create (&worker->thread, 0, worker_thread, worker) != 0) {
+            pthread_cond_destroy (&worker->cond);
+            pthread_mutex_destroy (&worker->mutex);
+            delete worker;
+            break;
+        }
+
+        m_workers.push_back (worker);
+    }
+
+    if (m_workers.empty ()) {
+        stop_workers ();
+        return false;
+    }
+
+    SCIM_DEBUG_FRONTEND (2) << " Started " << m_workers.size () << " worker threads.\n";
+
+    return true;
+}
+
+void
+SocketFrontEnd::stop_workers ()
+{
+    for (size_t i = 0; i < m_workers.size (); ++i) {
+        pthread_mutex_lock (&m_workers [i]->mutex);
+        m_workers [i]->running = false;
+        pthread_cond_signal (&m_workers [i]->cond);
+        pthread_mutex_unlock (&m_workers [i]->mutex);
+    }
+
+    for (size_t i = 0; i < m_workers.size (); ++i) {
+        pthread_join (m_workers [i]->thread, 0);
+        pthread_cond_destroy (&m_workers [i]->cond);
+        pthread_mutex_destroy (&m_workers [i]->mutex);
+        delete m_workers [i];
     }
+
+    m_workers.clear ();
+
+    if (m_worker_notify_fds [0] >= 0) {
+        m_socket_server.remove_external_socket (Socket (m_worker_notify_fds [0]));
+        ::close (m_worker_notify_fds [0]);
+        ::close (m_worker_notify_fds [1]);
+        m_worker_notify_fds [0] = -1;
+        m_worker_notify_fds [1] = -1;
+    }
+}
+
+void *
+SocketFrontEnd::worker_thread (void *data)
+{
+    Worker *worker = static_cast <Worker *> (data);
+
+    worker->frontend->run_worker (worker);
+
+    return 0;
+}
+
+void
+SocketFrontEnd::run_worker (Worker *worker)
+{
+    std::pair <int, ClientInfo> request;
+    WorkerResult result;
+
+    _worker_context = &worker->context;
+
+    while (1) {
+        pthread_mutex_lock (&worker->mutex);
+
+        while (worker->running && worker->requests.empty ())
+            pthread_cond_wait (&worker->cond, &worker->mutex);
+
+        if (!worker->running) {
+            pthread_mutex_unlock (&worker->mutex);
+            break;
+        }
+
+        request = worker->requests.front ();
+        worker->requests.pop_front ();
+
+        pthread_mutex_unlock (&worker->mutex);
+
+        Socket client (request.first);
+
+        result.client = request.first;
+        result.closed = !check_client_connection (client) ||
+                        !socket_process_request (client, request.second);
+
+        // Hand the client back to the main thread.
+        while (send (m_worker_notify_fds [1], &result, sizeof (result), 0) < 0 && errno == EINTR)
+            continue;
+    }
+
+    release_loaded_files ();
+
+    // The Transaction pool is per thread, free it before the thread exits.
+    scim_transaction_clear_pool ();
+
+    _worker_context = 0;
+}
+
+void
+SocketFrontEnd::lock_backend (bool shared)
+{
+    if (m_workers.empty ())
+        return;
+
+    if (shared)
+        pthread_rwlock_rdlock (&m_backend_lock);
+    else
+        pthread_rwlock_wrlock (&m_backend_lock);
+}
+
+void
+SocketFrontEnd::unlock_backend ()
+{
+    if (m_workers.size ())
+        pthread_rwlock_unlock (&m_backend_lock);
 }
 
 void
@@ -45,6 +45,12 @@ class SocketFrontEnd : public FrontEndBase
     struct ClientInfo {
         uint32     key;
         ClientType type;
+
+        /**
+         * The lookup table last sent to the client, 0 if the client
+         * did not negotiate SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA.
+         */
+        LookupTableCache *lookup_table_cache;
     };
 
     /**
@@ -60,29 +66,115 @@ class SocketFrontEnd : public FrontEndBase
     typedef std::map <int, ClientInfo>                                      SocketClientRepository;
 #endif
 
+    typedef void (SocketFrontEnd::*CommandHandler) (int client_id);
+
+    /**
+     * An entry of the command dispatch table.
+     */
+    struct Command {
+        int            cmd;
+        CommandHandler handler;
+
+        /**
+         * true if the command only uses the IMEngine instances owned by
+         * the client, so that it can run in parallel with other workers.
+         */
+        bool           shared;
+    };
+
+    struct CommandStatistics {
+        uint32 calls;
+        uint64 usecs;
+    };
+
+    enum {
+        /**
+         * Commands handled by SocketFrontEnd must be smaller than this.
+         */
+        COMMAND_TABLE_SIZE = 512,
+
+        /**
+         * The max number of commands handled by SocketFrontEnd.
+         */
+        MAX_COMMANDS       = 64
+    };
+
+    /**
+     * The state of the request being processed.
+     *
+     * The main thread uses m_main_context, each worker thread has its own one,
+     * so that the requests of different clients can be processed in parallel.
+     */
+    struct RequestContext {
+        Transaction send_trans;
+        Transaction receive_trans;
+        Transaction temp_trans;
+
+        int    current_instance;
+        int    current_socket_client;
+        uint32 current_socket_client_key;
+        uint32 current_sequence;
+
+        LookupTableCache *current_lookup_table_cache;
+
+        /**
+         * Files loaded for the current request, they are sent as borrowed
+         * data, so must be kept until the reply is written out.
+         */
+        std::vector <char *> loaded_files;
+
+        /**
+         * Statistics of the commands processed by this context,
+         * indexed by the slot in m_commands.
+         */
+        CommandStatistics statistics [MAX_COMMANDS];
+
+        RequestContext ();
+    };
+
+    struct Worker;
+
     ConfigPointer     m_config;
 
     SocketServer      m_socket_server;
 
-    Transaction       m_send_trans;
-    Transaction       m_receive_trans;
-    Transaction       m_temp_trans;
+    RequestContext    m_main_context;
 
     SocketInstanceRepository m_socket_instance_repository;
 
     SocketClientRepository   m_socket_client_repository;
 
-    bool   m_stay;
+    /**
+     * The dispatch table, indexed by command, the value is the slot of the
+     * command in m_commands plus one, or zero if it's not handled.
+     */
+    unsigned char     m_command_slots [COMMAND_TABLE_SIZE];
 
-    bool   m_config_readonly;
+    std::vector <Command>    m_commands;
 
-    int    m_socket_timeout;
+    /**
+     * The worker threads, clients are sharded onto them by socket id.
+     * Empty if all requests are processed by the main thread.
+     */
+    std::vector <Worker *>   m_workers;
+
+    /**
+     * The workers report finished requests through this socket pair,
+     * [0] is watched by m_socket_server.
+     */
+    int               m_worker_notify_fds [2];
 
-    int    m_current_instance;
+    /**
+     * Protects the IMEngine instances and the other shared states
+     * when there are worker threads.
+     */
+    pthread_rwlock_t  m_backend_lock;
+
+    bool   m_stay;
 
-    int    m_current_socket_client;
+    bool   m_config_readonly;
 
-    uint32 m_current_socket_client_key;
+    int    m_socket_timeout;
 
 public:
     SocketFrontEnd (const BackEndPointer &backend,
@@ -127,14 +219,31 @@ private:
 
     bool check_client_connection (const Socket &client) const;
 
+    RequestContext & context ();
+
+    void init_commands ();
+
+    bool start_workers (int num_workers);
+    void stop_workers ();
+    void run_worker (Worker *worker);
+    static void * worker_thread (void *data);
+
+    void lock_backend (bool shared);
+    void unlock_backend ();
+
     void socket_accept_callback    (SocketServer *server, const Socket &client);
     void socket_receive_callback   (SocketServer *server, const Socket &client);
     void socket_exception_callback (SocketServer *server, const Socket &client);
+    bool socket_idle_callback      (SocketServer *server);
 
     bool socket_open_connection    (SocketServer *server, const Socket &client);
     void socket_close_connection   (SocketServer *server, const Socket &client);
     ClientInfo socket_get_client_info (const Socket &client);
 
+    bool socket_process_request    (const Socket &client, const ClientInfo &client_info);
+    void socket_dispatch_request   (SocketServer *server, const Socket &client, const ClientInfo &client_info);
+    void socket_finish_requests    (SocketServer *server);
+
     //client_id is client's socket id
     void socket_get_factory_list            (int client_id);
     void socket_get_factory_name            (int client_id);
@@ -144,6 +253,7 @@ private:
     void socket_get_factory_locales         (int client_id);
     void socket_get_factory_icon_file       (int client_id);
     void socket_get_factory_language        (int client_id);
+    void socket_get_factory_info_bulk       (int client_id);
 
     void socket_new_instance                (int client_id);
     void socket_delete_instance             (int client_id);
@@ -178,7 +288,14 @@ private:
     void socket_set_config_vector_int       (int client_id);
     void socket_reload_config               (int client_id);
 
+    void socket_sequence                    (int client_id);
+
+    void socket_get_command_statistics      (int client_id);
+
+    void socket_reset_lookup_table_cache    (int client_id);
+
     void socket_load_file                   (int client_id);
+    void release_loaded_files               ();
 
     void reload_config_callback (const ConfigPointer &config);
 };
@@ -449,11 +449,15 @@ X11FrontEnd::run ()
     FD_SET (panel_fd, &active_fds);
     FD_SET (xserver_fd, &active_fds);
 
+    // Set while there are IMEngine factories to be preloaded when idle.
+    bool preloading = true;
+
     m_should_exit = false;
 
     // Select between the X Server and the Panel GUI.
     while (!m_should_exit) {
         int ret;
+        struct timeval no_wait = { 0, 0 };
 
         read_fds = active_fds;
 
@@ -464,13 +468,18 @@ X11FrontEnd::run ()
             XFilterEvent (&event, None);
         }
 
-        if ((ret = select (max_fd + 1, &read_fds, NULL, NULL, NULL)) < 0) {
+        if ((ret = select (max_fd + 1, &read_fds, NULL, NULL, preloading ? &no_wait : NULL)) < 0) {
             SCIM_DEBUG_FRONTEND(1) << "X11 -- Error when watching events!\n";
             return;
         }
 
         if (m_should_exit) break;
 
+        if (ret == 0) {
+            preloading = preload_default_factory ();
+            continue;
+        }
+
         if (FD_ISSET (panel_fd, &read_fds)) {
             if (!m_panel_client.filter_event ()) {
                 SCIM_DEBUG_FRONTEND(1) << "X11 -- Lost connection with panel daemon, re-establish it!\n";
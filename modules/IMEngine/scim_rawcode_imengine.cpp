@@ -196,6 +196,10 @@ RawCodeInstance::RawCodeInstance (RawCodeFactory *factory,
         m_client_iconv.set_encoding ("UTF-8");
 
     set_working_encoding ("Unicode");
+
+    // process_key_event () may update the preedit string
+    // and lookup table several times for one key.
+    set_frame_mode (true);
 }
 
 RawCodeInstance::~RawCodeInstance ()
@@ -32,7 +32,9 @@
 #define Uses_SCIM_CONFIG_PATH
 #define Uses_SCIM_SOCKET
 #define Uses_SCIM_TRANSACTION
+#define Uses_SCIM_GLOBAL_CONFIG
 #define Uses_C_STDLIB
+#define Uses_C_STRING
 
 #include <unistd.h>
 #include "scim_private.h"
@@ -48,6 +50,10 @@
 #define SCIM_CONFIG_IMENGINE_SOCKET_TIMEOUT "/IMEngine/Socket/Timeout"
 #define SCIM_CONFIG_IMENGINE_SOCKET_ADDRESS "/IMEngine/Socket/Address"
 
+// If true, the requests which need no immediate result are queued and sent
+// along with the next request, if SocketFrontEnd supports it.
+#define SCIM_CONFIG_IMENGINE_SOCKET_PIPELINED "/IMEngine/Socket/Pipelined"
+
 #define SCIM_SOCKET_FRONTEND_DEF_ADDRESS    "local:/tmp/scim-socket-frontend"
 
 #ifndef SCIM_TEMPDIR
@@ -71,12 +77,51 @@ typedef std::map <String, String> IconRepository;
     uint32                   m_socket_magic_key;
     int                      m_socket_timeout;
 
+    // Request a shared memory ring instead of the socket to carry the data.
+    bool                     m_socket_shared_memory;
+
     std::vector<String>      m_peer_factories;
 
+    // The information of the peer factories, if SocketFrontEnd
+    // supports SCIM_TRANS_CMD_GET_FACTORY_INFO_BULK.
+    struct PeerFactoryInfo
+    {
+        WideString           name;
+        String               locales;
+        String               language;
+        String               icon_file;
+    };
+
+    std::vector<PeerFactoryInfo> m_peer_factory_infos;
+
     IconRepository           m_icon_repository;
 
     Signal0<void>            m_signal_reconnect;
 
+    struct PendingRequest
+    {
+        SocketInstance      *instance;
+        int                  cmd;
+        int                  peer_id;
+        uint32               value;
+        bool                 has_value;
+    };
+
+    std::vector<PendingRequest> m_pending_requests;
+
+    SocketSequenceList       m_request_sequences;
+
+    uint32                   m_sequence;
+
+    bool                     m_pipelined;
+
+    // The lookup table last received from SocketFrontEnd.
+    LookupTableCache         m_lookup_table_cache;
+
+    // A delta did not match the cache, SocketFrontEnd must be told
+    // to send the next lookup table as a whole.
+    bool                     m_lookup_table_cache_lost;
+
 public:
     SocketIMEngineGlobal ();
     ~SocketIMEngineGlobal ();
@@ -91,12 +136,26 @@ public:
 
     String          load_icon (const String &icon);
 
+    void            set_pipelined (bool pipelined);
+    bool            is_pipelined () const;
+
+    bool            queue_request (SocketInstance *instance, int cmd, int peer_id, uint32 value);
+    void            init_request (Transaction &trans, SocketInstance *instance);
+    void            take_request_sequences (SocketSequenceList &sequences);
+    void            forget_instance (SocketInstance *instance);
+
+    LookupTableCache & get_lookup_table_cache ();
+    void            lookup_table_cache_lost ();
+
     Connection      connect_reconnect_signal (Slot0<void> *slot_reconnect);
 
 private:
     void            init ();
     void            destroy ();
 
+    bool            get_factory_info_bulk ();
+    String          save_icon (const String &icon, const char *buf, size_t size);
+
     void            destroy_all_icons ();
 };
 
@@ -119,8 +178,12 @@ extern "C" {
 
     unsigned int scim_imengine_module_init (const ConfigPointer &config)
     {
-        if (global)
+        if (global) {
+            if (!config.null ())
+                global->set_pipelined (config->read (String (SCIM_CONFIG_IMENGINE_SOCKET_PIPELINED), false));
+
             return global->number_of_factories ();
+        }
         return 0;
     }
 
@@ -144,7 +207,11 @@ namespace scim {
 
 SocketIMEngineGlobal::SocketIMEngineGlobal ()
     : m_socket_magic_key (0),
-      m_socket_timeout (-1)
+      m_socket_timeout (-1),
+      m_socket_shared_memory (false),
+      m_sequence (0),
+      m_pipelined (false),
+      m_lookup_table_cache_lost (false)
 {
     init ();
 }
@@ -164,6 +231,14 @@ SocketIMEngineGlobal::init ()
     m_socket_timeout = scim_get_default_socket_timeout ();
     m_socket_address.set_address (address);
 
+    // The connection is created before the config module is available,
+    // so this option can only be set in the global config or environment.
+    m_socket_shared_memory = scim_global_config_read (SCIM_GLOBAL_CONFIG_DEFAULT_SOCKET_SHARED_MEMORY, false);
+
+    const char *env = getenv ("SCIM_SOCKET_SHARED_MEMORY");
+    if (env && strlen (env))
+        m_socket_shared_memory = (atoi (env) != 0);
+
     if (!m_socket_address.valid ())
         return;
 
@@ -176,6 +251,10 @@ SocketIMEngineGlobal::init ()
     SCIM_DEBUG_IMENGINE(2) << " Connected to SocketFrontEnd (" << address
                          << ") MagicKey (" << m_socket_magic_key << ").\n";
 
+    // Get the information of all IMEngineFactories at once, if possible.
+    if (get_factory_info_bulk ())
+        return;
+
     // Init the connection, and get IMEngineFactory list.
     Transaction trans;
 
@@ -198,6 +277,71 @@ SocketIMEngineGlobal::init ()
     }
 }
 
+bool
+SocketIMEngineGlobal::get_factory_info_bulk ()
+{
+    Transaction trans;
+    int cmd;
+    uint32 num;
+
+    // The icons can't be accessed directly if SocketFrontEnd is on another host.
+    uint32 with_icons = (m_socket_address.get_family () != SCIM_SOCKET_LOCAL);
+
+    init_transaction (trans);
+
+    trans.put_command (SCIM_TRANS_CMD_GET_FACTORY_INFO_BULK);
+    trans.put_data (String (""));
+    trans.put_data (with_icons);
+
+    if (!send_transaction (trans) || !receive_transaction (trans) ||
+        !trans.get_command (cmd) || cmd != SCIM_TRANS_CMD_REPLY ||
+        !trans.get_data (num)) {
+        SCIM_DEBUG_IMENGINE(2) << " SCIM_TRANS_CMD_GET_FACTORY_INFO_BULK is not supported.\n";
+        return false;
+    }
+
+    std::vector<String>          uuids;
+    std::vector<PeerFactoryInfo> infos;
+
+    for (uint32 i = 0; i < num; ++i) {
+        String uuid;
+        PeerFactoryInfo info;
+
+        if (!trans.get_data (uuid) || !trans.get_data (info.name) ||
+            !trans.get_data (info.locales) || !trans.get_data (info.language) ||
+            !trans.get_data (info.icon_file))
+            return false;
+
+        if (with_icons) {
+            uint32 has_icon;
+            char *bufptr = 0;
+            size_t filesize = 0;
+
+            if (!trans.get_data (has_icon) || (has_icon && !trans.get_data (&bufptr, filesize)))
+                return false;
+
+            if (has_icon && scim_load_file (info.icon_file, 0) == 0)
+                save_icon (info.icon_file, bufptr, filesize);
+
+            delete [] bufptr;
+        }
+
+        uuids.push_back (uuid);
+        infos.push_back (info);
+    }
+
+    if (!trans.get_command (cmd) || cmd != SCIM_TRANS_CMD_OK)
+        return false;
+
+    m_peer_factories.swap (uuids);
+    m_peer_factory_infos.swap (infos);
+
+    SCIM_DEBUG_IMENGINE(2) << " Found " << m_peer_factories.size ()
+        << " IMEngine Factories.\n";
+
+    return true;
+}
+
 bool
 SocketIMEngineGlobal::create_connection ()
 {
@@ -205,15 +349,27 @@ SocketIMEngineGlobal::create_connection ()
     if (!m_socket_client.connect (m_socket_address))
         return false;
 
+    uint32 options = SCIM_SOCKET_PROTOCOL_DEFAULT | SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA;
+
+    if (m_socket_shared_memory)
+        options |= SCIM_SOCKET_PROTOCOL_SHM_RING;
+
     if (!scim_socket_open_connection (m_socket_magic_key,
                                       String ("SocketIMEngine"),
                                       String ("SocketFrontEnd"),
                                       m_socket_client,
-                                      m_socket_timeout)) {
+                                      m_socket_timeout,
+                                      options)) {
         m_socket_client.close ();
         return false;
     }
 
+    // The queued requests refer to the instances of the old connection.
+    m_pending_requests.clear ();
+    m_request_sequences.clear ();
+    m_lookup_table_cache.clear ();
+    m_lookup_table_cache_lost = false;
+
     m_signal_reconnect.emit ();
 
     return true;
@@ -238,6 +394,10 @@ SocketIMEngineGlobal::number_of_factories ()
 SocketFactory *
 SocketIMEngineGlobal::create_factory (unsigned int index)
 {
+    if (index < m_peer_factory_infos.size ()) {
+        const PeerFactoryInfo &info = m_peer_factory_infos [index];
+        return new SocketFactory (m_peer_factories [index], info.name, info.locales, info.language, info.icon_file);
+    }
     if (index < m_peer_factories.size ()) {
         return new SocketFactory (m_peer_factories [index]);
     }
@@ -250,6 +410,11 @@ SocketIMEngineGlobal::init_transaction (Transaction &trans)
     trans.clear ();
     trans.put_command (SCIM_TRANS_CMD_REQUEST);
     trans.put_data (m_socket_magic_key);
+
+    if (m_lookup_table_cache_lost) {
+        trans.put_command (SCIM_TRANS_CMD_RESET_LOOKUP_TABLE_CACHE);
+        m_lookup_table_cache_lost = false;
+    }
 }
 
 bool
@@ -264,6 +429,123 @@ SocketIMEngineGlobal::receive_transaction (Transaction &trans)
     return trans.read_from_socket (m_socket_client, m_socket_timeout);
 }
 
+void
+SocketIMEngineGlobal::set_pipelined (bool pipelined)
+{
+    m_pipelined = pipelined;
+}
+
+LookupTableCache &
+SocketIMEngineGlobal::get_lookup_table_cache ()
+{
+    return m_lookup_table_cache;
+}
+
+void
+SocketIMEngineGlobal::lookup_table_cache_lost ()
+{
+    m_lookup_table_cache_lost = true;
+}
+
+bool
+SocketIMEngineGlobal::is_pipelined () const
+{
+    return m_pipelined && (m_socket_client.get_protocol_options () & SCIM_SOCKET_PROTOCOL_SEQUENCE);
+}
+
+bool
+SocketIMEngineGlobal::queue_request (SocketInstance *instance, int cmd, int peer_id, uint32 value)
+{
+    if (!is_pipelined () || peer_id < 0)
+        return false;
+
+    std::vector<PendingRequest>::reverse_iterator it;
+
+    for (it = m_pending_requests.rbegin (); it != m_pending_requests.rend (); ++it)
+        if (it->instance == instance) break;
+
+    // Coalesce with the last request queued for the same instance:
+    // only the last value of an update matters, and a focus in
+    // immediately followed by a focus out is just a focus out.
+    if (it != m_pending_requests.rend () &&
+        (it->cmd == cmd || (it->cmd == SCIM_TRANS_CMD_FOCUS_IN && cmd == SCIM_TRANS_CMD_FOCUS_OUT))) {
+        SCIM_DEBUG_IMENGINE(2) << " Coalesce request " << it->cmd << " with " << cmd << " (" << peer_id << ").\n";
+        it->cmd = cmd;
+        it->value = value;
+        return true;
+    }
+
+    PendingRequest request;
+
+    request.instance  = instance;
+    request.cmd       = cmd;
+    request.peer_id   = peer_id;
+    request.value     = value;
+    request.has_value = (cmd != SCIM_TRANS_CMD_FOCUS_IN && cmd != SCIM_TRANS_CMD_FOCUS_OUT);
+
+    m_pending_requests.push_back (request);
+
+    SCIM_DEBUG_IMENGINE(2) << " Queue request " << cmd << " (" << peer_id << "), "
+                           << m_pending_requests.size () << " pending.\n";
+
+    return true;
+}
+
+void
+SocketIMEngineGlobal::init_request (Transaction &trans, SocketInstance *instance)
+{
+    init_transaction (trans);
+
+    m_request_sequences.clear ();
+
+    if (!is_pipelined ())
+        return;
+
+    // Put all queued requests in front of the new one,
+    // each of them marked by its own sequence number.
+    for (size_t i = 0; i <= m_pending_requests.size (); ++i) {
+        if (++m_sequence == 0) ++m_sequence;
+
+        trans.put_command (SCIM_TRANS_CMD_SEQUENCE);
+        trans.put_data (m_sequence);
+
+        if (i < m_pending_requests.size ()) {
+            const PendingRequest &request = m_pending_requests [i];
+
+            trans.put_command (request.cmd);
+            trans.put_data ((uint32) request.peer_id);
+            if (request.has_value)
+                trans.put_data (request.value);
+
+            m_request_sequences.push_back (std::make_pair (m_sequence, request.instance));
+        } else {
+            m_request_sequences.push_back (std::make_pair (m_sequence, instance));
+        }
+    }
+
+    m_pending_requests.clear ();
+}
+
+void
+SocketIMEngineGlobal::take_request_sequences (SocketSequenceList &sequences)
+{
+    sequences.clear ();
+    sequences.swap (m_request_sequences);
+}
+
+void
+SocketIMEngineGlobal::forget_instance (SocketInstance *instance)
+{
+    std::vector<PendingRequest>::iterator it = m_pending_requests.begin ();
+
+    while (it != m_pending_requests.end ()) {
+        if (it->instance == instance)
+            it = m_pending_requests.erase (it);
+        else
+            ++it;
+    }
+}
+
 String
 SocketIMEngineGlobal::load_icon (const String &icon)
 {
@@ -294,45 +576,51 @@ SocketIMEngineGlobal::load_icon (const String &icon)
     if (send_transaction (trans) && receive_transaction (trans) &&
         trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_REPLY &&
         trans.get_data (&bufptr, filesize) &&
-        trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_OK) {
+        trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_OK)
+        local_icon = save_icon (icon, bufptr, filesize);
 
-        String tempfile;
-        String::size_type pos = icon.rfind (SCIM_PATH_DELIM);
+    delete [] bufptr;
 
-        if (pos != String::npos) {
-            tempfile = icon.substr (pos + 1, String::npos);
-        } else {
-            tempfile = icon;
-        }
+    return local_icon;
+}
+
+String
+SocketIMEngineGlobal::save_icon (const String &icon, const char *buf, size_t size)
+{
+    String tempfile;
+    String::size_type pos = icon.rfind (SCIM_PATH_DELIM);
 
-        char tmp [80];
-        snprintf (tmp, 80, "%lu", (unsigned long) m_socket_magic_key);
+    if (pos != String::npos) {
+        tempfile = icon.substr (pos + 1, String::npos);
+    } else {
+        tempfile = icon;
+    }
 
-        tempfile = String (SCIM_TEMPDIR) + String (SCIM_PATH_DELIM_STRING) +
-                   String ("scim-") + String (tmp) + String ("-") +
-                   tempfile;
+    char tmp [80];
+    snprintf (tmp, 80, "%lu", (unsigned long) m_socket_magic_key);
 
-        SCIM_DEBUG_IMENGINE(1) << "Creating temporary icon file: " << tempfile << "\n";
+    tempfile = String (SCIM_TEMPDIR) + String (SCIM_PATH_DELIM_STRING) +
+               String ("scim-") + String (tmp) + String ("-") +
+               tempfile;
 
-        std::ofstream os (tempfile.c_str ());
+    SCIM_DEBUG_IMENGINE(1) << "Creating temporary icon file: " << tempfile << "\n";
 
-        if (os) {
-            os.write (bufptr, filesize);
-            os.close ();
+    std::ofstream os (tempfile.c_str ());
 
-            // Check if the file is written correctly.
-            if (scim_load_file (tempfile, 0) == filesize) {
-                m_icon_repository [icon] = tempfile;
-                local_icon = tempfile;
-            } else {
-                unlink (tempfile.c_str ());
-            }
+    if (os) {
+        os.write (buf, size);
+        os.close ();
+
+        // Check if the file is written correctly.
+        if (scim_load_file (tempfile, 0) == size) {
+            m_icon_repository [icon] = tempfile;
+            return tempfile;
         }
-    }
 
-    delete [] bufptr;
+        unlink (tempfile.c_str ());
+    }
 
-    return local_icon;
+    return String ("");
 }
 
 Connection
@@ -405,7 +693,7 @@ SocketFactory::SocketFactory (const String &peer_uuid)
     if (global->send_transaction (trans)) {
         if (global->receive_transaction (trans) &&
             trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_REPLY &&
-            trans.get_data (m_name) &&
+            trans.get_data (m_name) && m_name.length () &&
             trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_OK) {
 
             SCIM_DEBUG_IMENGINE(2) << " Name (" << utf8_wcstombs (m_name) << ")\n";
@@ -467,6 +755,33 @@ SocketFactory::SocketFactory (const String &peer_uuid)
     m_ok = (m_name_ok && m_locale_ok);
 }
 
+SocketFactory::SocketFactory (const String     &peer_uuid,
+                              const WideString &name,
+                              const String     &locales,
+                              const String     &language,
+                              const String     &icon_file)
+    : m_name (name),
+      m_language (language),
+      m_peer_uuid (peer_uuid),
+      m_icon_file (String ("")),
+      m_ok (false)
+{
+    SCIM_DEBUG_IMENGINE(1) << "Create SocketFactory " << peer_uuid << ".\n";
+
+    // SocketFrontEnd sends an empty name for a factory it doesn't have.
+    if (!m_name.length ()) {
+        m_name = utf8_mbstowcs (_("Unknown"));
+        return;
+    }
+
+    set_locales (locales);
+
+    m_ok = true;
+
+    if (icon_file.length ())
+        m_icon_file = global->load_icon (icon_file);
+}
+
 SocketFactory::~SocketFactory ()
 {
 }
@@ -617,8 +932,10 @@ SocketInstance::~SocketInstance ()
 
     m_signal_reconnect_connection.disconnect ();
 
+    global->forget_instance (this);
+
     if (m_peer_id >= 0) {
-        global->init_transaction (trans);
+        init_transaction (trans);
 
         trans.put_command (SCIM_TRANS_CMD_DELETE_INSTANCE);
         trans.put_data (m_peer_id);
@@ -632,7 +949,7 @@ SocketInstance::process_key_event (const KeyEvent& key)
 {
     Transaction trans;
 
-    global->init_transaction (trans);
+    init_transaction (trans);
 
     SCIM_DEBUG_IMENGINE(1) << "process_key_event (" << m_peer_id << ")\n";
 
@@ -646,11 +963,14 @@ SocketInstance::process_key_event (const KeyEvent& key)
 void
 SocketInstance::move_preedit_caret (unsigned int pos)
 {
-    Transaction trans;
+    SCIM_DEBUG_IMENGINE(1) << "move_preedit_caret (" << m_peer_id << ")\n";
 
-    global->init_transaction (trans);
+    if (queue_transaction (SCIM_TRANS_CMD_MOVE_PREEDIT_CARET, (uint32) pos))
+        return;
 
-    SCIM_DEBUG_IMENGINE(1) << "move_preedit_caret (" << m_peer_id << ")\n";
+    Transaction trans;
+
+    init_transaction (trans);
 
     trans.put_command (SCIM_TRANS_CMD_MOVE_PREEDIT_CARET);
     trans.put_data (m_peer_id);
@@ -664,7 +984,7 @@ SocketInstance::select_candidate (unsigned int item)
 {
     Transaction trans;
 
-    global->init_transaction (trans);
+    init_transaction (trans);
 
     SCIM_DEBUG_IMENGINE(1) << "select_candidate (" << m_peer_id << ")\n";
 
@@ -678,11 +998,14 @@ SocketInstance::select_candidate (unsigned int item)
 void
 SocketInstance::update_lookup_table_page_size (unsigned int page_size)
 {
-    Transaction trans;
+    SCIM_DEBUG_IMENGINE(1) << "update_lookup_table_page_size (" << m_peer_id << ")\n";
 
-    global->init_transaction (trans);
+    if (queue_transaction (SCIM_TRANS_CMD_UPDATE_LOOKUP_TABLE_PAGE_SIZE, (uint32) page_size))
+        return;
 
-    SCIM_DEBUG_IMENGINE(1) << "update_lookup_table_page_size (" << m_peer_id << ")\n";
+    Transaction trans;
+
+    init_transaction (trans);
 
     trans.put_command (SCIM_TRANS_CMD_UPDATE_LOOKUP_TABLE_PAGE_SIZE);
     trans.put_data (m_peer_id);
@@ -696,7 +1019,7 @@ SocketInstance::lookup_table_page_up ()
 {
     Transaction trans;
 
-    global->init_transaction (trans);
+    init_transaction (trans);
 
     SCIM_DEBUG_IMENGINE(1) << "lookup_table_page_up (" << m_peer_id << ")\n";
 
@@ -711,7 +1034,7 @@ SocketInstance::lookup_table_page_down ()
 {
     Transaction trans;
 
-    global->init_transaction (trans);
+    init_transaction (trans);
 
     SCIM_DEBUG_IMENGINE(1) << "lookup_table_page_up (" << m_peer_id << ")\n";
 
@@ -726,7 +1049,7 @@ SocketInstance::reset ()
 {
     Transaction trans;
 
-    global->init_transaction (trans);
+    init_transaction (trans);
 
     SCIM_DEBUG_IMENGINE(1) << "reset (" << m_peer_id << ")\n";
 
@@ -739,11 +1062,14 @@ SocketInstance::reset ()
 void
 SocketInstance::focus_in ()
 {
-    Transaction trans;
+    SCIM_DEBUG_IMENGINE(1) << "focus_in (" << m_peer_id << ")\n";
 
-    global->init_transaction (trans);
+    if (queue_transaction (SCIM_TRANS_CMD_FOCUS_IN))
+        return;
 
-    SCIM_DEBUG_IMENGINE(1) << "focus_in (" << m_peer_id << ")\n";
+    Transaction trans;
+
+    init_transaction (trans);
 
     trans.put_command (SCIM_TRANS_CMD_FOCUS_IN);
     trans.put_data (m_peer_id);
@@ -754,11 +1080,14 @@ SocketInstance::focus_in ()
 void
 SocketInstance::focus_out ()
 {
-    Transaction trans;
+    SCIM_DEBUG_IMENGINE(1) << "focus_out (" << m_peer_id << ")\n";
 
-    global->init_transaction (trans);
+    if (queue_transaction (SCIM_TRANS_CMD_FOCUS_OUT))
+        return;
 
-    SCIM_DEBUG_IMENGINE(1) << "focus_out (" << m_peer_id << ")\n";
+    Transaction trans;
+
+    init_transaction (trans);
 
     trans.put_command (SCIM_TRANS_CMD_FOCUS_OUT);
     trans.put_data (m_peer_id);
@@ -771,7 +1100,7 @@ SocketInstance::trigger_property (const String &property)
 {
     Transaction trans;
 
-    global->init_transaction (trans);
+    init_transaction (trans);
 
     SCIM_DEBUG_IMENGINE(1) << "trigger_property (" << m_peer_id << ", " << property << ")\n";
 
@@ -787,7 +1116,7 @@ SocketInstance::process_helper_event (const String &helper_uuid, const Transacti
 {
     Transaction trans;
 
-    global->init_transaction (trans);
+    init_transaction (trans);
 
     SCIM_DEBUG_IMENGINE(1) << "process_helper_event (" << m_peer_id << ", " << helper_uuid << ")\n";
 
@@ -802,11 +1131,14 @@ SocketInstance::process_helper_event (const String &helper_uuid, const Transacti
 void
 SocketInstance::update_client_capabilities (unsigned int cap)
 {
-    Transaction trans;
+    SCIM_DEBUG_IMENGINE(1) << "update_client_capabilities (" << m_peer_id << ", " << cap << ")\n";
 
-    global->init_transaction (trans);
+    if (queue_transaction (SCIM_TRANS_CMD_UPDATE_CLIENT_CAPABILITIES, (uint32) cap))
+        return;
 
-    SCIM_DEBUG_IMENGINE(1) << "update_client_capabilities (" << m_peer_id << ", " << cap << ")\n";
+    Transaction trans;
+
+    init_transaction (trans);
 
     trans.put_command (SCIM_TRANS_CMD_UPDATE_CLIENT_CAPABILITIES);
     trans.put_data (m_peer_id);
@@ -815,6 +1147,21 @@ SocketInstance::update_client_capabilities (unsigned int cap)
     commit_transaction (trans);
 }
 
+void
+SocketInstance::init_transaction (Transaction &trans)
+{
+    if (m_peer_id >= 0)
+        global->init_request (trans, this);
+    else
+        global->init_transaction (trans);
+}
+
+bool
+SocketInstance::queue_transaction (int cmd, uint32 value)
+{
+    return global->queue_request (this, cmd, m_peer_id, value);
+}
+
 bool
 SocketInstance::commit_transaction (Transaction &trans)
 {
@@ -822,11 +1169,16 @@ SocketInstance::commit_transaction (Transaction &trans)
 
     bool ret = false;
 
+    SocketSequenceList sequences;
+
+    // Other instances' requests may have been sent along with this one.
+    global->take_request_sequences (sequences);
+
     if (m_peer_id >= 0) {
         if (global->send_transaction (trans)) {
             while (1) {
                 if (!global->receive_transaction (trans)) break;
-                if (!do_transaction (trans, ret)) return ret;
+                if (!do_transaction (trans, ret, sequences)) return ret;
             }
         }
     }
@@ -838,10 +1190,18 @@ SocketInstance::commit_transaction (Transaction &trans)
 }
 
 bool
-SocketInstance::do_transaction (Transaction &trans, bool &ret)
+SocketInstance::do_transaction (Transaction &trans, bool &ret, const SocketSequenceList &sequences)
 {
     int cmd = -1;
     bool cont = false;
+    bool other_ret;
+
+    SocketInstance *target = this;
+
+    // The synchronous request is always the last one in the sequence list,
+    // only its own results may change the return value.
+    uint32 own_seq = sequences.empty () ? 0 : sequences.back ().first;
+    bool own = true;
 
     ret = false;
 
@@ -849,215 +1209,248 @@ SocketInstance::do_transaction (Transaction &trans, bool &ret)
 
     if (trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_REPLY) {
         while (trans.get_command (cmd)) {
-            switch (cmd) {
-                case SCIM_TRANS_CMD_SHOW_PREEDIT_STRING:
-                {
-                    SCIM_DEBUG_IMENGINE(3) << "  show_preedit_string ()\n";
-                    show_preedit_string ();
-                    break;
-                }
-                case SCIM_TRANS_CMD_SHOW_AUX_STRING:
-                {
-                    SCIM_DEBUG_IMENGINE(3) << "  show_aux_string ()\n";
-                    show_aux_string ();
-                    break;
-                }
-                case SCIM_TRANS_CMD_SHOW_LOOKUP_TABLE:
-                {
-                    SCIM_DEBUG_IMENGINE(3) << "  show_lookup_table ()\n";
-                    show_lookup_table ();
-                    break;
-                }
-                case SCIM_TRANS_CMD_HIDE_PREEDIT_STRING:
-                {
-                    SCIM_DEBUG_IMENGINE(3) << "  hide_preedit_string ()\n";
-                    hide_preedit_string ();
-                    break;
-                }
-                case SCIM_TRANS_CMD_HIDE_AUX_STRING:
-                {
-                    SCIM_DEBUG_IMENGINE(3) << "  hide_aux_string ()\n";
-                    hide_aux_string ();
-                    break;
-                }
-                case SCIM_TRANS_CMD_HIDE_LOOKUP_TABLE:
-                {
-                    SCIM_DEBUG_IMENGINE(3) << "  hide_lookup_table ()\n";
-                    hide_lookup_table ();
-                    break;
-                }
-                case SCIM_TRANS_CMD_UPDATE_PREEDIT_CARET:
-                {
-                    uint32 caret;
-                    if (trans.get_data (caret)) {
-                        SCIM_DEBUG_IMENGINE(3) << "  update_preedit_caret (" << caret << ")\n";
-                        update_preedit_caret (caret);
-                    }
-                    break;
-                }
-                case SCIM_TRANS_CMD_UPDATE_PREEDIT_STRING:
-                {
-                    WideString str;
-                    AttributeList attrs;
-                    if (trans.get_data (str) && trans.get_data (attrs)) {
-                        SCIM_DEBUG_IMENGINE(3) << "  update_preedit_string ()\n";
-                        update_preedit_string (str, attrs);
-                    }
-                    break;
-                }
-                case SCIM_TRANS_CMD_UPDATE_AUX_STRING:
-                {
-                    WideString str;
-                    AttributeList attrs;
-                    if (trans.get_data (str) && trans.get_data (attrs)) {
-                        SCIM_DEBUG_IMENGINE(3) << "  update_aux_string ()\n";
-                        update_aux_string (str, attrs);
-                    }
-                    break;
-                }
-                case SCIM_TRANS_CMD_UPDATE_LOOKUP_TABLE:
-                {
-                    CommonLookupTable table;
-                    if (trans.get_data (table)) {
-                        SCIM_DEBUG_IMENGINE(3) << "  update_lookup_table ()\n";
-                        update_lookup_table (table);
-                    }
-                    break;
-                }
-                case SCIM_TRANS_CMD_COMMIT_STRING:
-                {
-                    WideString str;
-                    if (trans.get_data (str)) {
-                        SCIM_DEBUG_IMENGINE(3) << "  commit_string ()\n";
-                        commit_string (str);
-                    }
-                    break;
-                }
-                case SCIM_TRANS_CMD_FORWARD_KEY_EVENT:
-                {
-                    KeyEvent key;
-                    if (trans.get_data (key)) {
-                        SCIM_DEBUG_IMENGINE(3) << "  forward_key_event ()\n";
-                        forward_key_event (key);
+            // The following results belong to a pipelined request,
+            // which may have been queued by another instance.
+            if (cmd == SCIM_TRANS_CMD_SEQUENCE) {
+                uint32 seq;
+                if (trans.get_data (seq)) {
+                    SCIM_DEBUG_IMENGINE(3) << "  sequence (" << seq << ")\n";
+                    target = this;
+                    own = (seq == own_seq);
+                    for (SocketSequenceList::const_iterator it = sequences.begin (); it != sequences.end (); ++it) {
+                        if (it->first == seq) {
+                            target = it->second;
+                            break;
+                        }
                     }
-                    break;
                 }
-                case SCIM_TRANS_CMD_REGISTER_PROPERTIES:
-                {
-                    PropertyList proplist;
-                    if (trans.get_data (proplist)) {
-                        SCIM_DEBUG_IMENGINE(3) << "  register_properties ()\n";
+                continue;
+            }
 
-                        // Load icon files of these properties from remote SocketFrontEnd.
-                        for (PropertyList::iterator it = proplist.begin (); it != proplist.end (); ++it)
-                            it->set_icon (global->load_icon (it->get_icon ()));
+            if (target->do_command (cmd, trans, own ? ret : other_ret))
+                cont = true;
+        }
+    } else {
+        SCIM_DEBUG_IMENGINE(3) << "  Failed to get cmd: " << cmd << "\n";
+    }
 
-                        register_properties (proplist);
-                    }
-                    break;
-                }
-                case SCIM_TRANS_CMD_UPDATE_PROPERTY:
-                {
-                    Property prop;
-                    if (trans.get_data (prop)) {
-                        SCIM_DEBUG_IMENGINE(3) << "  update_property ()\n";
+    SCIM_DEBUG_IMENGINE(2) << " End of Do transaction\n";
 
-                        // Load the icon file of this property from remote SocketFrontEnd.
-                        prop.set_icon (global->load_icon (prop.get_icon ()));
+    return cont;
+}
 
-                        update_property (prop);
-                    }
-                    break;
-                }
-                case SCIM_TRANS_CMD_BEEP:
-                {
-                    SCIM_DEBUG_IMENGINE(3) << "  beep ()\n";
-                    beep ();
-                    break;
-                }
-                case SCIM_TRANS_CMD_START_HELPER:
-                {
-                    String helper_uuid;
-                    if (trans.get_data (helper_uuid)) {
-                        SCIM_DEBUG_IMENGINE(3) << "  start_helper (" << helper_uuid << ")\n";
-                        start_helper (helper_uuid);
-                    }
-                    break; 
-                }
-                case SCIM_TRANS_CMD_STOP_HELPER:
-                {
-                    String helper_uuid;
-                    if (trans.get_data (helper_uuid)) {
-                        SCIM_DEBUG_IMENGINE(3) << "  stop_helper (" << helper_uuid << ")\n";
-                        stop_helper (helper_uuid);
-                    }
-                    break; 
-                }
-                case SCIM_TRANS_CMD_SEND_HELPER_EVENT:
-                {
-                    String helper_uuid;
-                    Transaction temp_trans;
-                    if (trans.get_data (helper_uuid) && trans.get_data (temp_trans)) {
-                        SCIM_DEBUG_IMENGINE(3) << "  send_helper_event (" << helper_uuid << ")\n";
-                        send_helper_event (helper_uuid, temp_trans);
-                    }
-                    break; 
-                }
-                case SCIM_TRANS_CMD_OK:
-                {
-                    SCIM_DEBUG_IMENGINE(3) << "  ret = true\n";
-                    ret = true;
-                    break;
-                }
-                case SCIM_TRANS_CMD_GET_SURROUNDING_TEXT:
-                {
-                    WideString text;
-                    int cursor;
-                    uint32 maxlen_before;
-                    uint32 maxlen_after;
-                    Transaction temp_trans;
-                    if (trans.get_data (maxlen_before) && trans.get_data (maxlen_after)) {
-                        global->init_transaction (temp_trans);
-                        if (get_surrounding_text (text, cursor, (int) maxlen_before, (int) maxlen_after)) {
-                            temp_trans.put_command (SCIM_TRANS_CMD_GET_SURROUNDING_TEXT);
-                            temp_trans.put_data (text);
-                            temp_trans.put_data ((uint32) cursor);
-                        } else {
-                            temp_trans.put_command (SCIM_TRANS_CMD_FAIL);
-                        }
-                        global->send_transaction (temp_trans);
-                    }
-                    cont = true;
-                    break;
+bool
+SocketInstance::do_command (int cmd, Transaction &trans, bool &ret)
+{
+    bool cont = false;
+
+    switch (cmd) {
+        case SCIM_TRANS_CMD_SHOW_PREEDIT_STRING:
+        {
+            SCIM_DEBUG_IMENGINE(3) << "  show_preedit_string ()\n";
+            show_preedit_string ();
+            break;
+        }
+        case SCIM_TRANS_CMD_SHOW_AUX_STRING:
+        {
+            SCIM_DEBUG_IMENGINE(3) << "  show_aux_string ()\n";
+            show_aux_string ();
+            break;
+        }
+        case SCIM_TRANS_CMD_SHOW_LOOKUP_TABLE:
+        {
+            SCIM_DEBUG_IMENGINE(3) << "  show_lookup_table ()\n";
+            show_lookup_table ();
+            break;
+        }
+        case SCIM_TRANS_CMD_HIDE_PREEDIT_STRING:
+        {
+            SCIM_DEBUG_IMENGINE(3) << "  hide_preedit_string ()\n";
+            hide_preedit_string ();
+            break;
+        }
+        case SCIM_TRANS_CMD_HIDE_AUX_STRING:
+        {
+            SCIM_DEBUG_IMENGINE(3) << "  hide_aux_string ()\n";
+            hide_aux_string ();
+            break;
+        }
+        case SCIM_TRANS_CMD_HIDE_LOOKUP_TABLE:
+        {
+            SCIM_DEBUG_IMENGINE(3) << "  hide_lookup_table ()\n";
+            hide_lookup_table ();
+            break;
+        }
+        case SCIM_TRANS_CMD_UPDATE_PREEDIT_CARET:
+        {
+            uint32 caret;
+            if (trans.get_data (caret)) {
+                SCIM_DEBUG_IMENGINE(3) << "  update_preedit_caret (" << caret << ")\n";
+                update_preedit_caret (caret);
+            }
+            break;
+        }
+        case SCIM_TRANS_CMD_UPDATE_PREEDIT_STRING:
+        {
+            WideString str;
+            AttributeList attrs;
+            if (trans.get_data (str) && trans.get_data (attrs)) {
+                SCIM_DEBUG_IMENGINE(3) << "  update_preedit_string ()\n";
+                update_preedit_string (str, attrs);
+            }
+            break;
+        }
+        case SCIM_TRANS_CMD_UPDATE_AUX_STRING:
+        {
+            WideString str;
+            AttributeList attrs;
+            if (trans.get_data (str) && trans.get_data (attrs)) {
+                SCIM_DEBUG_IMENGINE(3) << "  update_aux_string ()\n";
+                update_aux_string (str, attrs);
+            }
+            break;
+        }
+        case SCIM_TRANS_CMD_UPDATE_LOOKUP_TABLE:
+        {
+            CommonLookupTable table;
+            bool delta = (trans.get_data_type () == SCIM_TRANS_DATA_LOOKUP_TABLE_DELTA);
+            if (trans.get_data (table, global->get_lookup_table_cache ())) {
+                SCIM_DEBUG_IMENGINE(3) << "  update_lookup_table ()\n";
+                update_lookup_table (table);
+            } else if (delta) {
+                SCIM_DEBUG_IMENGINE(3) << "  lookup table cache out of sync\n";
+                global->lookup_table_cache_lost ();
+            }
+            break;
+        }
+        case SCIM_TRANS_CMD_COMMIT_STRING:
+        {
+            WideString str;
+            if (trans.get_data (str)) {
+                SCIM_DEBUG_IMENGINE(3) << "  commit_string ()\n";
+                commit_string (str);
+            }
+            break;
+        }
+        case SCIM_TRANS_CMD_FORWARD_KEY_EVENT:
+        {
+            KeyEvent key;
+            if (trans.get_data (key)) {
+                SCIM_DEBUG_IMENGINE(3) << "  forward_key_event ()\n";
+                forward_key_event (key);
+            }
+            break;
+        }
+        case SCIM_TRANS_CMD_REGISTER_PROPERTIES:
+        {
+            PropertyList proplist;
+            if (trans.get_data (proplist)) {
+                SCIM_DEBUG_IMENGINE(3) << "  register_properties ()\n";
+
+                // Load icon files of these properties from remote SocketFrontEnd.
+                for (PropertyList::iterator it = proplist.begin (); it != proplist.end (); ++it)
+                    it->set_icon (global->load_icon (it->get_icon ()));
+
+                register_properties (proplist);
+            }
+            break;
+        }
+        case SCIM_TRANS_CMD_UPDATE_PROPERTY:
+        {
+            Property prop;
+            if (trans.get_data (prop)) {
+                SCIM_DEBUG_IMENGINE(3) << "  update_property ()\n";
+
+                // Load the icon file of this property from remote SocketFrontEnd.
+                prop.set_icon (global->load_icon (prop.get_icon ()));
+
+                update_property (prop);
+            }
+            break;
+        }
+        case SCIM_TRANS_CMD_BEEP:
+        {
+            SCIM_DEBUG_IMENGINE(3) << "  beep ()\n";
+            beep ();
+            break;
+        }
+        case SCIM_TRANS_CMD_START_HELPER:
+        {
+            String helper_uuid;
+            if (trans.get_data (helper_uuid)) {
+                SCIM_DEBUG_IMENGINE(3) << "  start_helper (" << helper_uuid << ")\n";
+                start_helper (helper_uuid);
+            }
+            break; 
+        }
+        case SCIM_TRANS_CMD_STOP_HELPER:
+        {
+            String helper_uuid;
+            if (trans.get_data (helper_uuid)) {
+                SCIM_DEBUG_IMENGINE(3) << "  stop_helper (" << helper_uuid << ")\n";
+                stop_helper (helper_uuid);
+            }
+            break; 
+        }
+        case SCIM_TRANS_CMD_SEND_HELPER_EVENT:
+        {
+            String helper_uuid;
+            Transaction temp_trans;
+            if (trans.get_data (helper_uuid) && trans.get_data (temp_trans)) {
+                SCIM_DEBUG_IMENGINE(3) << "  send_helper_event (" << helper_uuid << ")\n";
+                send_helper_event (helper_uuid, temp_trans);
+            }
+            break; 
+        }
+        case SCIM_TRANS_CMD_OK:
+        {
+            SCIM_DEBUG_IMENGINE(3) << "  ret = true\n";
+            ret = true;
+            break;
+        }
+        case SCIM_TRANS_CMD_GET_SURROUNDING_TEXT:
+        {
+            WideString text;
+            int cursor;
+            uint32 maxlen_before;
+            uint32 maxlen_after;
+            Transaction temp_trans;
+            if (trans.get_data (maxlen_before) && trans.get_data (maxlen_after)) {
+                global->init_transaction (temp_trans);
+                if (get_surrounding_text (text, cursor, (int) maxlen_before, (int) maxlen_after)) {
+                    temp_trans.put_command (SCIM_TRANS_CMD_GET_SURROUNDING_TEXT);
+                    temp_trans.put_data (text);
+                    temp_trans.put_data ((uint32) cursor);
+                } else {
+                    temp_trans.put_command (SCIM_TRANS_CMD_FAIL);
                 }
-                case SCIM_TRANS_CMD_DELETE_SURROUNDING_TEXT:
-                {
-                    uint32 offset;
-                    uint32 len;
-                    Transaction temp_trans;
-                    if (trans.get_data (offset) && trans.get_data (len)) {
-                        global->init_transaction (temp_trans);
-                        if (delete_surrounding_text ((int) offset, (int) len)) {
-                            temp_trans.put_command (SCIM_TRANS_CMD_DELETE_SURROUNDING_TEXT);
-                            temp_trans.put_command (SCIM_TRANS_CMD_OK);
-                        } else {
-                            temp_trans.put_command (SCIM_TRANS_CMD_FAIL);
-                        }
-                        global->send_transaction (temp_trans);
-                    }
-                    cont = true;
-                    break;
+                global->send_transaction (temp_trans);
+            }
+            cont = true;
+            break;
+        }
+        case SCIM_TRANS_CMD_DELETE_SURROUNDING_TEXT:
+        {
+            uint32 offset;
+            uint32 len;
+            Transaction temp_trans;
+            if (trans.get_data (offset) && trans.get_data (len)) {
+                global->init_transaction (temp_trans);
+                if (delete_surrounding_text ((int) offset, (int) len)) {
+                    temp_trans.put_command (SCIM_TRANS_CMD_DELETE_SURROUNDING_TEXT);
+                    temp_trans.put_command (SCIM_TRANS_CMD_OK);
+                } else {
+                    temp_trans.put_command (SCIM_TRANS_CMD_FAIL);
                 }
-                default:
-                    SCIM_DEBUG_IMENGINE(3) << "  Strange cmd: " << cmd << "\n";;
+                global->send_transaction (temp_trans);
             }
+            cont = true;
+            break;
         }
-    } else {
-        SCIM_DEBUG_IMENGINE(3) << "  Failed to get cmd: " << cmd << "\n";
+        default:
+            SCIM_DEBUG_IMENGINE(3) << "  Strange cmd: " << cmd << "\n";;
     }
 
-    SCIM_DEBUG_IMENGINE(2) << " End of Do transaction\n";
-
     return cont;
 }
 
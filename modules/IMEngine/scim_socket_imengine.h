@@ -50,6 +50,16 @@ class SocketFactory : public IMEngineFactoryBase
 public:
     SocketFactory (const String &peer_uuid);
 
+    /**
+     * Create a factory from the information got by
+     * SCIM_TRANS_CMD_GET_FACTORY_INFO_BULK, without any request.
+     */
+    SocketFactory (const String     &peer_uuid,
+                   const WideString &name,
+                   const String     &locales,
+                   const String     &language,
+                   const String     &icon_file);
+
     bool valid () const { return m_ok; }
 
     virtual ~SocketFactory ();
@@ -68,6 +78,14 @@ private:
     int  create_peer_instance (const String &encoding);
 };
 
+class SocketInstance;
+
+/**
+ * The sequence numbers of the pipelined commands in one request,
+ * and the instances to which their results belong.
+ */
+typedef std::vector <std::pair <uint32, SocketInstance *> > SocketSequenceList;
+
 class SocketInstance : public IMEngineInstanceBase
 {
     SocketFactory *m_factory;
@@ -92,8 +110,11 @@ public:
     virtual void update_client_capabilities (unsigned int cap);
 
 private:
+    void init_transaction (Transaction &trans);
+    bool queue_transaction (int cmd, uint32 value = 0);
     bool commit_transaction (Transaction &trans);
-    bool do_transaction (Transaction &trans, bool &ret);
+    bool do_transaction (Transaction &trans, bool &ret, const SocketSequenceList &sequences);
+    bool do_command (int cmd, Transaction &trans, bool &ret);
     void reconnect_callback (void);
 };
 
@@ -28,23 +28,46 @@
 #define Uses_SCIM_IMENGINE
 #define Uses_SCIM_IMENGINE_MODULE
 #define Uses_SCIM_CONFIG_PATH
+#define Uses_SCIM_TRANSACTION
 #define Uses_STL_ALGORITHM
+#define Uses_C_STRING
+#define Uses_C_STDLIB
 #include "scim_private.h"
 #include "scim.h"
 #include "scim_stl_map.h"
+#include "scim_thread_pool.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
 
 namespace scim {
 
 #if SCIM_USE_STL_EXT_HASH_MAP
 typedef __gnu_cxx::hash_map <String, IMEngineFactoryPointer, scim_hash_string >     IMEngineFactoryRepository;
+typedef __gnu_cxx::hash_map <String, size_t, scim_hash_string >                     IMEngineFactoryPositionMap;
 #elif SCIM_USE_STL_HASH_MAP
 typedef std::hash_map <String, IMEngineFactoryPointer, scim_hash_string >           IMEngineFactoryRepository;
+typedef std::hash_map <String, size_t, scim_hash_string >                           IMEngineFactoryPositionMap;
 #else
 typedef std::map <String, IMEngineFactoryPointer>                                   IMEngineFactoryRepository;
+typedef std::map <String, size_t>                                                   IMEngineFactoryPositionMap;
 #endif
 
 typedef std::vector <IMEngineFactoryPointer>                                        IMEngineFactoryPointerVector;
 
+// The factories supporting an encoding or a language, sorted by
+// IMEngineFactoryPointerLess, and the position of each factory in the list.
+struct IMEngineFactoryIndex
+{
+    IMEngineFactoryPointerVector  factories;
+    IMEngineFactoryPositionMap    positions;
+};
+
+typedef std::map <String, IMEngineFactoryIndex>                                     IMEngineFactoryIndexMap;
+
 class LocaleEqual
 {
     String m_lhs;
@@ -76,6 +99,10 @@ class BackEndBase::BackEndBaseImpl
     String                       m_supported_unicode_locales;
     ConfigPointer                m_config;
 
+    // Built on demand, and dropped whenever the repository is changed.
+    mutable IMEngineFactoryIndexMap m_encoding_indexes;
+    mutable IMEngineFactoryIndexMap m_language_indexes;
+
 public:
     BackEndBaseImpl (const ConfigPointer &config)
         : m_config (config)
@@ -103,6 +130,8 @@ public:
     void clear ()
     {
         m_factory_repository.clear ();
+        m_encoding_indexes.clear ();
+        m_language_indexes.clear ();
     }
 
     String get_all_locales () const
@@ -146,37 +175,67 @@ public:
         return IMEngineFactoryPointer (0);
     }
 
-    uint32 get_factories_for_encoding (std::vector<IMEngineFactoryPointer> &factories,
-                                       const String                        &encoding)  const
+    const IMEngineFactoryIndex & get_encoding_index (const String &encoding) const
     {
-        IMEngineFactoryRepository::const_iterator it;
- 
-        factories.clear ();
- 
-        for (it = m_factory_repository.begin (); it != m_factory_repository.end (); ++it) {
-            if ((encoding.length () == 0 || it->second->validate_encoding (encoding)))
-                factories.push_back (it->second);
+        IMEngineFactoryIndexMap::const_iterator it = m_encoding_indexes.find (encoding);
+
+        if (it != m_encoding_indexes.end ())
+            return it->second;
+
+        IMEngineFactoryPointerVector factories;
+
+        if (encoding.length () == 0) {
+            IMEngineFactoryRepository::const_iterator rit;
+
+            for (rit = m_factory_repository.begin (); rit != m_factory_repository.end (); ++rit)
+                factories.push_back (rit->second);
+
+            std::sort (factories.begin (), factories.end (), IMEngineFactoryPointerLess ());
+        } else {
+            // The list of all factories is already sorted.
+            const IMEngineFactoryPointerVector &all = get_encoding_index (String ("")).factories;
+
+            for (size_t i = 0; i < all.size (); ++i) {
+                if (all [i]->validate_encoding (encoding))
+                    factories.push_back (all [i]);
+            }
         }
- 
-        sort_factories (factories);
 
+        return build_index (m_encoding_indexes [encoding], factories);
+    }
+
+    const IMEngineFactoryIndex & get_language_index (const String &language) const
+    {
+        if (language.length () == 0)
+            return get_encoding_index (language);
+
+        IMEngineFactoryIndexMap::const_iterator it = m_language_indexes.find (language);
+
+        if (it != m_language_indexes.end ())
+            return it->second;
+
+        const IMEngineFactoryPointerVector &all = get_encoding_index (String ("")).factories;
+        IMEngineFactoryPointerVector factories;
+
+        for (size_t i = 0; i < all.size (); ++i) {
+            if (all [i]->get_language () == language)
+                factories.push_back (all [i]);
+        }
+
+        return build_index (m_language_indexes [language], factories);
+    }
+
+    uint32 get_factories_for_encoding (std::vector<IMEngineFactoryPointer> &factories,
+                                       const String                        &encoding)  const
+    {
+        factories = get_encoding_index (encoding).factories;
         return factories.size ();
     }
 
     uint32 get_factories_for_language (std::vector<IMEngineFactoryPointer> &factories,
                                        const String                        &language)  const
     {
-        IMEngineFactoryRepository::const_iterator it;
- 
-        factories.clear ();
- 
-        for (it = m_factory_repository.begin (); it != m_factory_repository.end (); ++it) {
-            if ((language.length () == 0 || it->second->get_language () == language))
-                factories.push_back (it->second);
-        }
- 
-        sort_factories (factories);
-
+        factories = get_language_index (language).factories;
         return factories.size ();
     }
 
@@ -184,11 +243,11 @@ public:
     {
         if (!language.length ()) return IMEngineFactoryPointer ();
 
-        IMEngineFactoryPointerVector factories;
+        const IMEngineFactoryPointerVector &factories = get_encoding_index (encoding).factories;
 
-        if (get_factories_for_encoding (factories, encoding) > 0) {
+        if (factories.size () > 0) {
             IMEngineFactoryPointer lang_first;
-            IMEngineFactoryPointerVector::iterator it;
+            IMEngineFactoryPointerVector::const_iterator it;
 
             String def_uuid;
             
@@ -198,7 +257,7 @@ public:
 
             // Match by Normalized language exactly.
             for (it = factories.begin (); it != factories.end (); ++it) {
-                if (scim_get_normalized_language ((*it)->get_language ()) == language && lang_first.null ())
+                if (lang_first.null () && scim_get_normalized_language ((*it)->get_language ()) == language)
                     lang_first = *it;
 
                 if ((*it)->get_uuid () == def_uuid)
@@ -222,73 +281,60 @@ public:
     {
         if (!language.length () || !uuid.length ()) return;
 
-        IMEngineFactoryPointerVector factories;
-        if (get_factories_for_encoding (factories, "") > 0) {
-            IMEngineFactoryPointerVector::iterator it;
-            for (it = factories.begin (); it != factories.end (); ++it) {
-                if ((*it)->get_uuid () == uuid) {
-                    m_config->write (String (SCIM_CONFIG_DEFAULT_IMENGINE_FACTORY) + String ("/") + language, uuid);
-                    return;
-                }
-            }
-        }
+        if (m_factory_repository.find (uuid) != m_factory_repository.end ())
+            m_config->write (String (SCIM_CONFIG_DEFAULT_IMENGINE_FACTORY) + String ("/") + language, uuid);
     }
 
     IMEngineFactoryPointer get_next_factory (const String &language, const String &encoding, const String &cur_uuid) const
     {
-        IMEngineFactoryPointerVector factories;
+        const IMEngineFactoryIndex &index = get_encoding_index (encoding);
+        const IMEngineFactoryPointerVector &factories = index.factories;
 
-        if (get_factories_for_encoding (factories, encoding) > 0) {
-            IMEngineFactoryPointer lang_first;
-            IMEngineFactoryPointerVector::iterator it, itl;
+        IMEngineFactoryPositionMap::const_iterator pos = index.positions.find (cur_uuid);
 
-            for (it = factories.begin (); it != factories.end (); ++it) {
-                if ((language.length () == 0 || (*it)->get_language () == language) && lang_first.null ())
-                    lang_first = *it;
+        if (pos == index.positions.end ())
+            return IMEngineFactoryPointer ();
 
-                if ((*it)->get_uuid () == cur_uuid) {
-                    for (itl = it + 1; itl != factories.end (); ++itl) {
-                        if (language.length () == 0 || (*itl)->get_language () == language)
-                            return *itl;
-                    }
-                    if (!lang_first.null ()) return lang_first;
+        size_t i;
 
-                    return factories [0];
-                }
-            }
+        for (i = pos->second + 1; i < factories.size (); ++i) {
+            if (language.length () == 0 || factories [i]->get_language () == language)
+                return factories [i];
         }
 
-        return IMEngineFactoryPointer ();
+        // Wrap around to the first one of the language.
+        for (i = 0; i <= pos->second; ++i) {
+            if (language.length () == 0 || factories [i]->get_language () == language)
+                return factories [i];
+        }
+
+        return factories [0];
     }
 
     IMEngineFactoryPointer get_previous_factory (const String &language, const String &encoding, const String &cur_uuid) const
     {
-        IMEngineFactoryPointerVector factories;
+        const IMEngineFactoryIndex &index = get_encoding_index (encoding);
+        const IMEngineFactoryPointerVector &factories = index.factories;
 
-        if (get_factories_for_encoding (factories, encoding) > 0) {
-            IMEngineFactoryPointer lang_last;
-            IMEngineFactoryPointerVector::iterator it, itl;
+        IMEngineFactoryPositionMap::const_iterator pos = index.positions.find (cur_uuid);
 
-            for (it = factories.begin (); it != factories.end (); ++it) {
-                if ((language.length () == 0 || (*it)->get_language () == language))
-                    lang_last = *it;
-            }
+        if (pos == index.positions.end ())
+            return IMEngineFactoryPointer ();
 
-            for (it = factories.begin (); it != factories.end (); ++it) {
-                if ((*it)->get_uuid () == cur_uuid) {
-                    for (itl = it; itl != factories.begin (); --itl) {
-                        if (language.length () == 0 || (*(itl-1))->get_language () == language)
-                            return *(itl-1);
-                    }
+        size_t i;
 
-                    if (!lang_last.null ()) return lang_last;
+        for (i = pos->second; i > 0; --i) {
+            if (language.length () == 0 || factories [i - 1]->get_language () == language)
+                return factories [i - 1];
+        }
 
-                    return factories [factories.size () - 1];
-                }
-            }
+        // Wrap around to the last one of the language.
+        for (i = factories.size (); i > pos->second; --i) {
+            if (language.length () == 0 || factories [i - 1]->get_language () == language)
+                return factories [i - 1];
         }
 
-        return IMEngineFactoryPointer ();
+        return factories [factories.size () - 1];
     }
 
     bool add_factory (const IMEngineFactoryPointer &factory)
@@ -298,6 +344,8 @@ public:
 
             if (uuid.length () && m_factory_repository.find (uuid) == m_factory_repository.end ()) {
                 m_factory_repository [uuid] = factory;
+                m_encoding_indexes.clear ();
+                m_language_indexes.clear ();
                 return true;
             }
         }
@@ -306,9 +354,15 @@ public:
     }
 
 private:
-    void sort_factories (std::vector<IMEngineFactoryPointer> &factories) const
+    static const IMEngineFactoryIndex & build_index (IMEngineFactoryIndex &index, IMEngineFactoryPointerVector &factories)
     {
-        std::sort (factories.begin (), factories.end (), IMEngineFactoryPointerLess ());
+        index.factories.swap (factories);
+        index.positions.clear ();
+
+        for (size_t i = 0; i < index.factories.size (); ++i)
+            index.positions [index.factories [i]->get_uuid ()] = i;
+
+        return index;
     }
 };
 
@@ -346,6 +400,18 @@ BackEndBase::get_factories_for_language (std::vector<IMEngineFactoryPointer> &fa
     return m_impl->get_factories_for_language (factories, language);
 }
 
+const std::vector<IMEngineFactoryPointer> &
+BackEndBase::get_factory_index_for_encoding (const String &encoding) const
+{
+    return m_impl->get_encoding_index (encoding).factories;
+}
+
+const std::vector<IMEngineFactoryPointer> &
+BackEndBase::get_factory_index_for_language (const String &language) const
+{
+    return m_impl->get_language_index (language).factories;
+}
+
 IMEngineFactoryPointer
 BackEndBase::get_default_factory (const String &language, const String &encoding) const
 {
@@ -370,6 +436,12 @@ BackEndBase::get_previous_factory (const String &language, const String &encodin
     return m_impl->get_previous_factory (language, encoding, cur_uuid);
 }
 
+bool
+BackEndBase::preload_default_factory ()
+{
+    return false;
+}
+
 bool
 BackEndBase::add_factory (const IMEngineFactoryPointer &factory)
 {
@@ -383,13 +455,491 @@ BackEndBase::clear ()
 }
 
 // Implementation of CommonBackEnd.
+
+#define SCIM_FACTORY_INFO_CACHE_FILE      "imengine-factory-cache"
+#define SCIM_FACTORY_INFO_CACHE_MAGIC     "SCIM_IMENGINE_FACTORY_INFO_CACHE"
+#define SCIM_FACTORY_INFO_CACHE_VERSION   3
+
+struct IMEngineFactoryInfo
+{
+    uint32      index;
+    String      uuid;
+    WideString  name;
+    String      locales;
+    String      language;
+    String      icon_file;
+
+    // The answers of the factory to validate_encoding () and validate_locale ()
+    // for the encodings and locales supported by the backend when it's cached,
+    // all sorted. Other encodings and locales are forwarded to the real factory.
+    std::vector <String> probed_encodings;
+    std::vector <String> valid_encodings;
+    std::vector <String> probed_locales;
+    std::vector <String> valid_locales;
+};
+
+struct IMEngineModuleInfo
+{
+    String                            stamp;
+    std::vector <IMEngineFactoryInfo> factories;
+};
+
+typedef std::map <String, IMEngineModuleInfo> IMEngineModuleInfoRepository;
+
+// One cache file for each locale, since the names of the factories
+// may be translated.
+static String
+__get_factory_info_cache_file ()
+{
+    String locale = scim_get_current_locale ();
+
+    if (!locale.length ())
+        locale = "C";
+
+    for (String::iterator it = locale.begin (); it != locale.end (); ++it)
+        if (*it == SCIM_PATH_DELIM) *it = '_';
+
+    return scim_get_user_data_dir () + String (SCIM_PATH_DELIM_STRING) +
+           String (SCIM_FACTORY_INFO_CACHE_FILE) + String ("-") + locale;
+}
+
+/*
+ * The cache of the metadata of the factories provided by each IMEngine module,
+ * so that the factories can be listed without loading the modules.
+ *
+ * The metadata of a module is only used if the stamp of its files is not
+ * changed. The whole cache is discarded if the binary version or the config
+ * is changed, because the factories may depend on them.
+ *
+ * The data files of a module (eg. the tables of a table engine) are not
+ * covered by the stamp, so the cache is disabled by default.
+ * SCIM_IMENGINE_FACTORY_CACHE=rebuild discards the cache, so that it's
+ * rebuilt after such files are changed.
+ */
+class IMEngineFactoryInfoCache
+{
+    String                        m_file;
+    String                        m_key;
+    IMEngineModuleInfoRepository  m_modules;
+    bool                          m_changed;
+
+public:
+    IMEngineFactoryInfoCache (const ConfigPointer &config, bool rebuild)
+        : m_file (__get_factory_info_cache_file ()),
+          m_key (String (SCIM_BINARY_VERSION) + String (";") + scim_get_current_locale () + String (";") +
+                 config->read (String (SCIM_CONFIG_UPDATE_TIMESTAMP), String (""))),
+          m_changed (false) {
+        if (rebuild) {
+            SCIM_DEBUG_BACKEND (1) << "Rebuilding IMEngine factory info cache.\n";
+            m_changed = true;
+        } else {
+            load ();
+        }
+    }
+
+    const IMEngineModuleInfo * find (const String &module, const String &stamp) const {
+        IMEngineModuleInfoRepository::const_iterator it = m_modules.find (module);
+
+        if (it != m_modules.end () && it->second.stamp == stamp)
+            return &(it->second);
+
+        return 0;
+    }
+
+    void update (const String &module, const IMEngineModuleInfo &info) {
+        m_modules [module] = info;
+        m_changed = true;
+    }
+
+    bool save () {
+        if (!m_changed) return true;
+
+        Transaction trans (4096);
+
+        trans.put_data (String (SCIM_FACTORY_INFO_CACHE_MAGIC));
+        trans.put_data ((uint32) SCIM_FACTORY_INFO_CACHE_VERSION);
+        trans.put_data (m_key);
+        trans.put_data ((uint32) m_modules.size ());
+
+        for (IMEngineModuleInfoRepository::const_iterator it = m_modules.begin (); it != m_modules.end (); ++it) {
+            trans.put_data (it->first);
+            trans.put_data (it->second.stamp);
+            trans.put_data ((uint32) it->second.factories.size ());
+
+            for (size_t i = 0; i < it->second.factories.size (); ++i) {
+                const IMEngineFactoryInfo &info = it->second.factories [i];
+                trans.put_data (info.index);
+                trans.put_data (info.uuid);
+                trans.put_data (info.name);
+                trans.put_data (info.locales);
+                trans.put_data (info.language);
+                trans.put_data (info.icon_file);
+                trans.put_data (info.probed_encodings);
+                trans.put_data (info.valid_encodings);
+                trans.put_data (info.probed_locales);
+                trans.put_data (info.valid_locales);
+            }
+        }
+
+        std::vector <unsigned char> buf (trans.get_size ());
+
+        if (!trans.write_to_buffer (&buf [0], buf.size ()))
+            return false;
+
+        // Write into a temporary file then rename it, so that other processes
+        // never see a partially written cache.
+        char pid [32];
+        snprintf (pid, 32, ".%lu", (unsigned long) getpid ());
+
+        String tmp_file = m_file + String (pid);
+
+        int fd = open (tmp_file.c_str (), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+
+        if (fd < 0) return false;
+
+        bool ok = (write (fd, &buf [0], buf.size ()) == (ssize_t) buf.size ());
+
+        ok = (close (fd) == 0) && ok;
+
+        if (!ok || rename (tmp_file.c_str (), m_file.c_str ()) != 0) {
+            unlink (tmp_file.c_str ());
+            return false;
+        }
+
+        SCIM_DEBUG_BACKEND (1) << "IMEngine factory info cache saved: " << m_file << "\n";
+
+        m_changed = false;
+        return true;
+    }
+
+private:
+    bool load () {
+        int fd = open (m_file.c_str (), O_RDONLY);
+
+        if (fd < 0) return false;
+
+        struct stat st;
+        void *addr = MAP_FAILED;
+
+        // A valid Transaction has at least a 16 bytes header.
+        if (fstat (fd, &st) == 0 && st.st_size > (off_t) (sizeof (uint32) * 4))
+            addr = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        close (fd);
+
+        if (addr == MAP_FAILED)
+            return false;
+
+        Transaction trans (st.st_size);
+        bool ok = trans.read_from_buffer (addr, st.st_size);
+
+        munmap (addr, st.st_size);
+
+        TransactionReader reader (trans);
+        String magic;
+        String key;
+        uint32 version;
+        uint32 num_modules;
+
+        if (!ok || !reader.get_data (magic) || magic != String (SCIM_FACTORY_INFO_CACHE_MAGIC) ||
+            !reader.get_data (version) || version != SCIM_FACTORY_INFO_CACHE_VERSION ||
+            !reader.get_data (key) || key != m_key ||
+            !reader.get_data (num_modules)) {
+            SCIM_DEBUG_BACKEND (1) << "IMEngine factory info cache is outdated.\n";
+            return false;
+        }
+
+        IMEngineModuleInfoRepository modules;
+
+        for (uint32 i = 0; i < num_modules; ++i) {
+            String module;
+            IMEngineModuleInfo module_info;
+            uint32 num_factories;
+
+            if (!reader.get_data (module) || !reader.get_data (module_info.stamp) ||
+                !reader.get_data (num_factories))
+                return false;
+
+            for (uint32 j = 0; j < num_factories; ++j) {
+                IMEngineFactoryInfo info;
+
+                if (!reader.get_data (info.index) || !reader.get_data (info.uuid) ||
+                    !reader.get_data (info.name) || !reader.get_data (info.locales) ||
+                    !reader.get_data (info.language) || !reader.get_data (info.icon_file) ||
+                    !reader.get_data (info.probed_encodings) || !reader.get_data (info.valid_encodings) ||
+                    !reader.get_data (info.probed_locales) || !reader.get_data (info.valid_locales))
+                    return false;
+
+                module_info.factories.push_back (info);
+            }
+
+            modules [module] = module_info;
+        }
+
+        m_modules.swap (modules);
+
+        SCIM_DEBUG_BACKEND (1) << "IMEngine factory info cache loaded: " << m_file << "\n";
+
+        return true;
+    }
+};
+
+/*
+ * An IMEngine module which is only loaded when a factory is created from it.
+ */
+class LazyIMEngineModule : public ReferencedObject
+{
+    IMEngineModule  m_module;
+    String          m_name;
+    ConfigPointer   m_config;
+    bool            m_failed;
+
+public:
+    LazyIMEngineModule (const String &name, const ConfigPointer &config)
+        : m_name (name), m_config (config), m_failed (false) { }
+
+    const String & get_name () const { return m_name; }
+
+    bool load () {
+        if (!m_module.valid () && !m_failed) {
+            SCIM_DEBUG_BACKEND (1) << "Loading IMEngine module: " << m_name << " ...\n";
+
+            if (!m_module.load (m_name, m_config) || !m_module.valid ()) {
+                SCIM_DEBUG_BACKEND (1) << "Failed to load " << m_name << " IMEngine module.\n";
+                m_module.unload ();
+                m_failed = true;
+            }
+        }
+        return m_module.valid ();
+    }
+
+    void unload () {
+        m_module.unload ();
+    }
+
+    bool valid () const {
+        return m_module.valid ();
+    }
+
+    unsigned int number_of_factories () const {
+        return m_module.valid () ? m_module.number_of_factories () : 0;
+    }
+
+    IMEngineFactoryPointer create_factory (unsigned int index) {
+        if (load ()) {
+            try {
+                return m_module.create_factory (index);
+            } catch (const std::exception & err) {
+                std::cerr << err.what () << "\n";
+            }
+        }
+        return IMEngineFactoryPointer (0);
+    }
+};
+
+typedef Pointer <LazyIMEngineModule> LazyIMEngineModulePointer;
+
+// Serializes the loading of the lazy modules, since the factories may be
+// used by several threads of a FrontEnd.
+static pthread_mutex_t __lazy_module_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * A factory registered with the cached metadata, the real factory is only
+ * created when it's really needed, eg. to create an instance.
+ */
+class IMEngineFactoryProxy : public IMEngineFactoryBase
+{
+    // Must be declared before m_factory, so that the module is unloaded
+    // after the real factory is destroyed.
+    LazyIMEngineModulePointer       m_module;
+    mutable IMEngineFactoryPointer  m_factory;
+    mutable bool                    m_failed;
+
+    IMEngineFactoryInfo             m_info;
+
+public:
+    IMEngineFactoryProxy (const LazyIMEngineModulePointer &module, const IMEngineFactoryInfo &info)
+        : m_module (module), m_failed (false), m_info (info) {
+        set_locales (info.locales);
+    }
+
+    virtual WideString  get_name () const      { return m_info.name; }
+    virtual String      get_uuid () const      { return m_info.uuid; }
+    virtual String      get_icon_file () const { return m_info.icon_file; }
+    virtual String      get_language () const  { return m_info.language; }
+
+    virtual WideString  get_authors () const {
+        return load_factory () ? m_factory->get_authors () : WideString ();
+    }
+
+    virtual WideString  get_credits () const {
+        return load_factory () ? m_factory->get_credits () : WideString ();
+    }
+
+    virtual WideString  get_help () const {
+        return load_factory () ? m_factory->get_help () : WideString ();
+    }
+
+    virtual WideString  inverse_query (const WideString &str) {
+        return load_factory () ? m_factory->inverse_query (str) : WideString ();
+    }
+
+    virtual bool validate_encoding (const String &encoding) const {
+        if (std::binary_search (m_info.probed_encodings.begin (), m_info.probed_encodings.end (), encoding))
+            return std::binary_search (m_info.valid_encodings.begin (), m_info.valid_encodings.end (), encoding);
+        if (!load_factory ())
+            return IMEngineFactoryBase::validate_encoding (encoding);
+        return m_factory->validate_encoding (encoding);
+    }
+
+    virtual bool validate_locale (const String &locale) const {
+        if (std::binary_search (m_info.probed_locales.begin (), m_info.probed_locales.end (), locale))
+            return std::binary_search (m_info.valid_locales.begin (), m_info.valid_locales.end (), locale);
+        if (!load_factory ())
+            return IMEngineFactoryBase::validate_locale (locale);
+        return m_factory->validate_locale (locale);
+    }
+
+    virtual IMEngineInstancePointer create_instance (const String& encoding, int id = -1) {
+        if (load_factory ())
+            return m_factory->create_instance (encoding, id);
+        return IMEngineInstancePointer (0);
+    }
+
+    bool preload () {
+        return load_factory ();
+    }
+
+private:
+    bool load_factory () const {
+        pthread_mutex_lock (&__lazy_module_lock);
+
+        if (m_factory.null () && !m_failed) {
+            m_factory = m_module->create_factory (m_info.index);
+
+            if (m_factory.null () || m_factory->get_uuid () != m_info.uuid) {
+                SCIM_DEBUG_BACKEND (1) << "Failed to load IMEngine Factory " << m_info.uuid
+                    << " from " << m_module->get_name () << " IMEngine module, the module may be changed.\n";
+
+                // Rebuild the cache next time.
+                unlink (__get_factory_info_cache_file ().c_str ());
+
+                m_factory.reset ();
+                m_failed = true;
+            }
+        }
+
+        bool ok = !m_factory.null ();
+
+        pthread_mutex_unlock (&__lazy_module_lock);
+
+        return ok;
+    }
+};
+
+typedef Pointer <IMEngineFactoryProxy> IMEngineFactoryProxyPointer;
+
 struct CommonBackEnd::CommonBackEndImpl {
-    IMEngineModule      *m_engine_modules;
-    FilterManager       *m_filter_manager;
+    std::vector <LazyIMEngineModulePointer>    m_engine_modules;
+    FilterManager                             *m_filter_manager;
+
+    // The factories registered as proxies, which can be preloaded.
+    std::vector <IMEngineFactoryProxyPointer>  m_proxies;
+    ConfigPointer                              m_config;
+    bool                                       m_preload;
+
+    std::vector <IMEngineFactoryProxyPointer>  m_preload_factories;
+    size_t                                     m_preload_index;
+    bool                                       m_preload_prepared;
+
+    CommonBackEndImpl () : m_filter_manager (0), m_preload (false), m_preload_index (0), m_preload_prepared (false) { }
 
-    CommonBackEndImpl () : m_engine_modules (0), m_filter_manager (0) { }
+    void prepare_preload () {
+        std::vector <String> languages;
+        std::vector <String> default_uuids;
+
+        languages.push_back (scim_get_normalized_language (scim_get_current_language ()));
+
+        for (size_t i = 0; i < m_proxies.size (); ++i)
+            languages.push_back (scim_get_normalized_language (m_proxies [i]->get_language ()));
+
+        std::sort (languages.begin (), languages.end ());
+        languages.erase (std::unique (languages.begin (), languages.end ()), languages.end ());
+
+        for (size_t i = 0; i < languages.size (); ++i)
+            default_uuids.push_back (m_config->read (String (SCIM_CONFIG_DEFAULT_IMENGINE_FACTORY) + String ("/") + languages [i], String ("")));
+
+        for (size_t i = 0; i < m_proxies.size (); ++i) {
+            if (std::find (default_uuids.begin (), default_uuids.end (), m_proxies [i]->get_uuid ()) != default_uuids.end ())
+                m_preload_factories.push_back (m_proxies [i]);
+        }
+
+        m_preload_prepared = true;
+    }
 };
 
+static bool
+__read_backend_option (const String &key, const char *env_name, bool defval)
+{
+    bool val = scim_global_config_read (key, defval);
+
+    const char *env = getenv (env_name);
+    if (env && strlen (env))
+        val = (atoi (env) != 0);
+
+    return val;
+}
+
+// Record the answers of a factory to validate_encoding () and validate_locale ()
+// for the given sorted encodings and locales.
+static void
+__probe_factory_validation (IMEngineFactoryInfo          &info,
+                            const IMEngineFactoryPointer &factory,
+                            const std::vector <String>   &encodings,
+                            const std::vector <String>   &locales)
+{
+    info.probed_encodings = encodings;
+    info.probed_locales = locales;
+
+    for (size_t i = 0; i < encodings.size (); ++i)
+        if (factory->validate_encoding (encodings [i]))
+            info.valid_encodings.push_back (encodings [i]);
+
+    for (size_t i = 0; i < locales.size (); ++i)
+        if (factory->validate_locale (locales [i]))
+            info.valid_locales.push_back (locales [i]);
+}
+
+// The state of an IMEngine module while creating CommonBackEnd.
+struct IMEngineModuleLoadState
+{
+    LazyIMEngineModulePointer             module;
+    String                                stamp;
+    const IMEngineModuleInfo             *cached_info;
+    std::vector <IMEngineFactoryPointer>  factories;
+
+    IMEngineModuleLoadState () : cached_info (0) { }
+};
+
+// Load a module, may run in a worker thread.
+static void
+__load_imengine_module (size_t index, void *data)
+{
+    (*static_cast <std::vector <IMEngineModuleLoadState *> *> (data)) [index]->module->load ();
+}
+
+// Create all factories of a loaded module. The factories are always created
+// in the calling thread, since their constructors aren't known to be thread
+// safe, eg. they may connect to the signals of the config.
+static void
+__create_imengine_factories (IMEngineModuleLoadState &state)
+{
+    if (state.module->valid ()) {
+        for (size_t j = 0; j < state.module->number_of_factories (); ++j)
+            state.factories.push_back (state.module->create_factory (j));
+    }
+}
+
 CommonBackEnd::CommonBackEnd (const ConfigPointer       &config,
                               const std::vector<String> &modules)
     : BackEndBase (config),
@@ -407,6 +957,11 @@ CommonBackEnd::CommonBackEnd (const ConfigPointer       &config,
     // Get disabled factories list.
     disabled_factories = scim_global_config_read (SCIM_GLOBAL_CONFIG_DISABLED_IMENGINE_FACTORIES, disabled_factories);
 
+    bool use_cache    = __read_backend_option (SCIM_GLOBAL_CONFIG_IMENGINE_FACTORY_CACHE, "SCIM_IMENGINE_FACTORY_CACHE", false);
+    bool reset_cache  = false;
+    bool lazy_loading = __read_backend_option (SCIM_GLOBAL_CONFIG_IMENGINE_LAZY_LOADING, "SCIM_IMENGINE_LAZY_LOADING", false);
+    bool preload      = __read_backend_option (SCIM_GLOBAL_CONFIG_IMENGINE_PRELOAD, "SCIM_IMENGINE_PRELOAD", false);
+
     // Put socket module to the end of list.
     for (std::vector<String>::iterator it = new_modules.begin (); it != new_modules.end (); ++it) {
         if (*it == "socket") {
@@ -416,71 +971,212 @@ CommonBackEnd::CommonBackEnd (const ConfigPointer       &config,
         }
     }
 
-    // Try to load all IMEngine modules
     try {
-        m_impl->m_engine_modules = new IMEngineModule [new_modules.size ()];
         m_impl->m_filter_manager = new FilterManager (config);
     } catch (const std::exception & err) {
         std::cerr << err.what () << "\n";
         return;
     }
 
-    //load IMEngine modules
+    // The cache can't notice the changes of the data files of the modules,
+    // SCIM_IMENGINE_FACTORY_CACHE=rebuild forces it to be rebuilt.
+    const char *cache_env = getenv ("SCIM_IMENGINE_FACTORY_CACHE");
+
+    if (cache_env && String (cache_env) == "rebuild")
+        use_cache = reset_cache = true;
+
+    IMEngineFactoryInfoCache *cache = use_cache ? new IMEngineFactoryInfoCache (config, reset_cache) : 0;
+
+    std::vector <IMEngineModuleLoadState>   states (new_modules.size ());
+    std::vector <IMEngineModuleLoadState *> pending;
+
+    // Find out the modules which must be loaded.
     for (size_t i = 0; i < new_modules.size (); ++i) {
-        SCIM_DEBUG_BACKEND (1) << "Loading IMEngine module: " << new_modules [i] << " ...\n";
+        IMEngineModuleLoadState &state = states [i];
 
-        module_factories_count = 0;
+        state.module = new LazyIMEngineModule (new_modules [i], config);
 
-        if (m_impl->m_engine_modules [i].load (new_modules [i], config) &&
-            m_impl->m_engine_modules [i].valid ()) {
-            for (size_t j=0; j < m_impl->m_engine_modules [i].number_of_factories (); ++j) {
+        m_impl->m_engine_modules.push_back (state.module);
 
-                // Try to load a IMEngine Factory.
-                try {
-                    factory = m_impl->m_engine_modules [i].create_factory (j);
-                } catch (const std::exception & err) {
-                    std::cerr << err.what () << "\n";
-                    factory.reset ();
-                }
+        // The factories provided by socket module are not fixed.
+        if (cache && new_modules [i] != "socket")
+            state.stamp = scim_get_module_stamp (new_modules [i], "IMEngine");
+
+        state.cached_info = state.stamp.length () ? cache->find (new_modules [i], state.stamp) : 0;
+
+        if (!state.cached_info && new_modules [i] != "socket")
+            pending.push_back (&state);
+    }
+
+    // The modules are independent of each other, so they can be loaded in
+    // parallel, the factories are registered in the original order below.
+    if (pending.size () > 1 && scim_thread_pool_parallel_module_loading (config)) {
+        SCIM_DEBUG_BACKEND (1) << "Loading " << pending.size () << " IMEngine modules in parallel ...\n";
+        scim_thread_pool_run (pending.size (), __load_imengine_module, &pending, scim_thread_pool_default_size ());
+    } else {
+        for (size_t i = 0; i < pending.size (); ++i)
+            __load_imengine_module (i, &pending);
+    }
+
+    for (size_t i = 0; i < pending.size (); ++i)
+        __create_imengine_factories (*pending [i]);
+
+    // Socket module is always the last one, and loaded after all others.
+    if (new_modules.size () && new_modules.back () == "socket") {
+        pending.clear ();
+        pending.push_back (&states.back ());
+        __load_imengine_module (0, &pending);
+        __create_imengine_factories (states.back ());
+    }
+
+    // The encodings and locales the FrontEnds may validate the factories
+    // against, that is get_all_locales () once all factories are added.
+    // The answers are recorded for the factories which may become proxies.
+    std::vector <String> probe_encodings;
+    std::vector <String> probe_locales;
+
+    if (cache || lazy_loading) {
+        String all_locales = get_all_locales ();
+
+        for (size_t i = 0; i < states.size (); ++i) {
+            if (states [i].cached_info) {
+                for (size_t j = 0; j < states [i].cached_info->factories.size (); ++j)
+                    all_locales += String (",") + states [i].cached_info->factories [j].locales;
+            }
+            for (size_t j = 0; j < states [i].factories.size (); ++j) {
+                if (!states [i].factories [j].null ())
+                    all_locales += String (",") + states [i].factories [j]->get_locales ();
+            }
+        }
+
+        std::vector <String> locales;
+        scim_split_string_list (locales, all_locales);
+
+        probe_encodings.push_back ("UTF-8");
+
+        for (size_t i = 0; i < locales.size (); ++i) {
+            String locale = scim_validate_locale (locales [i]);
+            if (locale.length ()) {
+                probe_locales.push_back (locale);
+                probe_encodings.push_back (scim_get_locale_encoding (locale));
+            }
+        }
+
+        std::sort (probe_locales.begin (), probe_locales.end ());
+        probe_locales.erase (std::unique (probe_locales.begin (), probe_locales.end ()), probe_locales.end ());
+        std::sort (probe_encodings.begin (), probe_encodings.end ());
+        probe_encodings.erase (std::unique (probe_encodings.begin (), probe_encodings.end ()), probe_encodings.end ());
+    }
+
+    //register IMEngine factories
+    for (size_t i = 0; i < new_modules.size (); ++i) {
+        LazyIMEngineModulePointer module = states [i].module;
+
+        bool is_socket = (new_modules [i] == "socket");
+
+        const IMEngineModuleInfo *cached_info = states [i].cached_info;
+        IMEngineModuleInfo module_info;
+
+        std::vector <IMEngineFactoryPointer>      factories;
+        std::vector <IMEngineFactoryProxyPointer> proxies;
+
+        factories.swap (states [i].factories);
+
+        if (cached_info) {
+            SCIM_DEBUG_BACKEND (1) << "Using cached IMEngine module: " << new_modules [i] << " ...\n";
+            module_info = *cached_info;
+        } else if (module->valid ()) {
+            for (size_t j = 0; j < factories.size () && !is_socket; ++j) {
+                factory = factories [j];
 
                 if (!factory.null ()) {
-                    // Check if it's disabled.
-                    if (std::find (disabled_factories.begin (),
-                                   disabled_factories.end (),
-                                   factory->get_uuid ()) == disabled_factories.end ()) {
+                    IMEngineFactoryInfo info;
+                    info.index     = j;
+                    info.uuid      = factory->get_uuid ();
+                    info.name      = factory->get_name ();
+                    info.locales   = factory->get_locales ();
+                    info.language  = factory->get_language ();
+                    info.icon_file = factory->get_icon_file ();
+                    if (cache || lazy_loading)
+                        __probe_factory_validation (info, factory, probe_encodings, probe_locales);
+                    module_info.factories.push_back (info);
+                }
+            }
+
+            // Only cache the modules loaded successfully, so that the broken
+            // ones are retried next time.
+            if (states [i].stamp.length ()) {
+                module_info.stamp = states [i].stamp;
+                cache->update (new_modules [i], module_info);
+            }
+
+            // In lazy mode, the module is only kept for the factories which
+            // are really used.
+            if (lazy_loading && !is_socket) {
+                factories.clear ();
+                factory.reset ();
+                module->unload ();
+            }
+        }
+
+        if (!factories.size ()) {
+            for (size_t j = 0; j < module_info.factories.size (); ++j) {
+                proxies.push_back (new IMEngineFactoryProxy (module, module_info.factories [j]));
+                factories.push_back (proxies.back ());
+            }
+        }
+
+        module_factories_count = 0;
+
+        for (size_t j = 0; j < factories.size (); ++j) {
+            factory = factories [j];
+
+            if (!factory.null ()) {
+                // Check if it's disabled.
+                if (std::find (disabled_factories.begin (),
+                               disabled_factories.end (),
+                               factory->get_uuid ()) == disabled_factories.end ()) {
+
+                    // Add it into disabled list to prevent from loading again.
+                    disabled_factories.push_back (factory->get_uuid ());
 
-                        // Add it into disabled list to prevent from loading again.
-                        disabled_factories.push_back (factory->get_uuid ());
+                    if (proxies.size ())
+                        m_impl->m_proxies.push_back (proxies [j]);
 
-                        // Only load filter for none socket IMEngines.
-                        if (new_modules [i] != "socket")
-                            factory = m_impl->m_filter_manager->attach_filters_to_factory (factory);
+                    // Only load filter for none socket IMEngines.
+                    if (!is_socket)
+                        factory = m_impl->m_filter_manager->attach_filters_to_factory (factory);
 
-                        add_factory (factory);
+                    add_factory (factory);
 
-                        all_factories_count ++;
-                        module_factories_count ++;
+                    all_factories_count ++;
+                    module_factories_count ++;
 
-                        SCIM_DEBUG_BACKEND (1) << "    Loading IMEngine Factory " << j << " : " << "OK\n";
-                    } else {
-                        SCIM_DEBUG_BACKEND (1) << "    Loading IMEngine Factory " << j << " : " << "Disabled\n";
-                        factory.reset ();
-                    }
+                    SCIM_DEBUG_BACKEND (1) << "    Loading IMEngine Factory " << j << " : " << "OK\n";
                 } else {
-                    SCIM_DEBUG_BACKEND (1) << "    Loading IMEngine Factory " << j << " : " << "Failed\n";
+                    SCIM_DEBUG_BACKEND (1) << "    Loading IMEngine Factory " << j << " : " << "Disabled\n";
+                    factory.reset ();
                 }
-            }
-            if (module_factories_count) {
-                SCIM_DEBUG_BACKEND (1) << new_modules [i] << " IMEngine module is successfully loaded.\n";
             } else {
-                SCIM_DEBUG_BACKEND (1) << "No Factory loaded from " << new_modules [i] << " IMEngine module!\n";
-                m_impl->m_engine_modules [i].unload ();
+                SCIM_DEBUG_BACKEND (1) << "    Loading IMEngine Factory " << j << " : " << "Failed\n";
             }
-        } else {
-            SCIM_DEBUG_BACKEND (1) << "Failed to load " << new_modules [i] << " IMEngine module.\n";
+        }
+
+        if (module_factories_count) {
+            SCIM_DEBUG_BACKEND (1) << new_modules [i] << " IMEngine module is successfully loaded.\n";
+        } else if (module->valid ()) {
+            SCIM_DEBUG_BACKEND (1) << "No Factory loaded from " << new_modules [i] << " IMEngine module!\n";
+            factories.clear ();
+            factory.reset ();
+            module->unload ();
         }
     }
 
+    if (cache) {
+        cache->save ();
+        delete cache;
+    }
+
     factory = new ComposeKeyFactory ();
 
     if (all_factories_count == 0 ||
@@ -490,17 +1186,42 @@ CommonBackEnd::CommonBackEnd (const ConfigPointer       &config,
         factory = m_impl->m_filter_manager->attach_filters_to_factory (factory);
         add_factory (factory);
     }
+
+    m_impl->m_config  = config;
+    m_impl->m_preload = preload;
 }
 
 CommonBackEnd::~CommonBackEnd ()
 {
     clear ();
 
-    delete [] m_impl->m_engine_modules;
+    m_impl->m_preload_factories.clear ();
+    m_impl->m_proxies.clear ();
+    m_impl->m_engine_modules.clear ();
     delete m_impl->m_filter_manager;
     delete m_impl;
 }
 
+bool
+CommonBackEnd::preload_default_factory ()
+{
+    if (!m_impl->m_preload || !m_impl->m_proxies.size ())
+        return false;
+
+    if (!m_impl->m_preload_prepared)
+        m_impl->prepare_preload ();
+
+    if (m_impl->m_preload_index >= m_impl->m_preload_factories.size ())
+        return false;
+
+    IMEngineFactoryProxyPointer factory = m_impl->m_preload_factories [m_impl->m_preload_index ++];
+
+    SCIM_DEBUG_BACKEND (1) << "Preloading IMEngine Factory " << factory->get_uuid () << " ...\n";
+
+    factory->preload ();
+
+    return m_impl->m_preload_index < m_impl->m_preload_factories.size ();
+}
 
 } // namespace scim
 
@@ -119,6 +119,31 @@ public:
      */
     uint32 get_factories_for_language (std::vector<IMEngineFactoryPointer> &factories, const String &language = String ("")) const;
 
+    /**
+     * @brief Get the sorted IMEngine factories list for specific encoding, without copying it.
+     *
+     * The lists are built on the first query and kept until the set of
+     * factories is changed, so it's cheap to be called frequently.
+     *
+     * @param encoding  the encoding to be queried. If empty,
+     *                  all IMEngine factories will be returned.
+     *
+     * @return the list of the factories which support the encoding, which is only
+     *         valid until a factory is added or the backend is cleared.
+     */
+    const std::vector<IMEngineFactoryPointer> & get_factory_index_for_encoding (const String &encoding = String ("")) const;
+
+    /**
+     * @brief Get the sorted IMEngine factories list for specific language, without copying it.
+     *
+     * @param language  the language to be queried. If empty,
+     *                  all IMEngine factories will be returned.
+     *
+     * @return the list of the factories for the language, which is only
+     *         valid until a factory is added or the backend is cleared.
+     */
+    const std::vector<IMEngineFactoryPointer> & get_factory_index_for_language (const String &language = String ("")) const;
+
     /**
      * @brief Get the default IMEngineFactory for a specific language and encoding.
      *
@@ -165,6 +190,19 @@ public:
      * @}
      */
 
+    /**
+     * @brief Load the next IMEngine factory which is likely to be used soon.
+     *
+     * FrontEnds call it when their main loops are idle, until it returns false,
+     * so that the factories registered without loading their modules are ready
+     * before they are really used.
+     *
+     * The default implementation does nothing and returns false.
+     *
+     * @return true if there are more factories to be preloaded.
+     */
+    virtual bool preload_default_factory ();
+
 protected:
 
     bool add_factory (const IMEngineFactoryPointer &factory);
@@ -191,6 +229,14 @@ public:
     /**
      * @brief Constructor
      *
+     * If /IMEngineFactoryCache is enabled in the global config or by
+     * SCIM_IMENGINE_FACTORY_CACHE=1, the metadata of the factories is cached
+     * in the user data dir, one file for each locale, so that the unchanged
+     * modules needn't be loaded. It's disabled by default, because the changes
+     * of the data files used by the modules (eg. the tables of a table engine)
+     * are not detected. SCIM_IMENGINE_FACTORY_CACHE=rebuild rebuilds the cache
+     * after such a change.
+     *
      * @param config The pointer to the Config object.
      * @param modules The list of the IMEngine modules to be loaded.
      */
@@ -198,6 +244,25 @@ public:
                    const std::vector<String> &modules);
 
     virtual ~CommonBackEnd ();
+
+    /**
+     * @brief Load the next default IMEngine factory of all languages.
+     *
+     * The factories found in the factory info cache, or all factories in lazy
+     * loading mode, are registered without loading their modules. Preloading
+     * the default ones makes them ready before they are really used.
+     *
+     * Only one factory is loaded by each call, in the calling thread, so that
+     * it can be called from an idle callback of the main loop until it
+     * returns false, like FrontEndBase does. The modules and the config are
+     * not thread safe, so it must not be called from another thread.
+     *
+     * It does nothing unless /IMEngineBackgroundPreload is enabled in the global
+     * config or by SCIM_IMENGINE_PRELOAD environment variable.
+     *
+     * @return true if there are more factories to be preloaded.
+     */
+    virtual bool preload_default_factory ();
 };
 
 } // namespace scim
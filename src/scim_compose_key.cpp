@@ -29,6 +29,8 @@
 
 #define Uses_SCIM_COMPOSE_KEY
 #define Uses_C_CTYPE
+#define Uses_C_STDLIB
+#define Uses_STL_FSTREAM
 
 #include "scim_private.h"
 #include "scim.h"
@@ -45,51 +47,141 @@ struct ComposeSequence
     ucs4_t unicode;
 };
 
-class ComposeSequenceLessByKeys
+// Generated from /usr/X11R6/lib/X11/locale/en_US.UTF-8/Compose
+// Get rid off all keys with unicode value.
+// Merged with the table in gtk+2.x
+static const ComposeSequence __scim_compose_seqs[] = {
+#include "scim_compose_key_data.h"
+};
+
+#define SCIM_NUM_COMPOSE_SEQS (sizeof (__scim_compose_seqs) / sizeof (__scim_compose_seqs [0]))
+
+/**
+ * A trie of all compose sequences, so that each key press while composing
+ * is a single hash lookup of the (state, key) transition.
+ *
+ * State 0 is the root. The result of a state is either 0 (not a complete
+ * sequence), a unicode char, or an index into m_strings with the high bit
+ * set for the multi-char results from XCompose files.
+ */
+class ComposeTrie
 {
+    struct Transition
+    {
+        uint32 state;
+        uint32 key;
+        uint32 next;
+    };
+
+    std::vector <Transition> m_transitions;
+    size_t                   m_num_transitions;
+    std::vector <uint32>     m_results;
+    std::vector <WideString> m_strings;
+
 public:
-    bool operator () (const ComposeSequence &lhs, const ComposeSequence &rhs) const {
-        for (size_t i = 0; i < SCIM_MAX_COMPOSE_LEN; ++i) {
-            if (lhs.keys [i] < rhs.keys [i]) return true;
-            else if (lhs.keys [i] > rhs.keys [i]) return false;
-        }
-        return false;
+    ComposeTrie () : m_num_transitions (0) {
+        m_transitions.resize (16);
+        m_results.push_back (0);
     }
 
-    bool operator () (const ComposeSequence &lhs, const uint32 *rhs) const {
-        for (size_t i = 0; i < SCIM_MAX_COMPOSE_LEN; ++i) {
-            if (lhs.keys [i] < rhs [i]) return true;
-            else if (lhs.keys [i] > rhs [i]) return false;
+    uint32 find (uint32 state, uint32 key) const {
+        size_t mask = m_transitions.size () - 1;
+        for (size_t i = hash (state, key) & mask; m_transitions [i].next; i = (i + 1) & mask) {
+            if (m_transitions [i].state == state && m_transitions [i].key == key)
+                return m_transitions [i].next;
         }
-        return false;
+        return 0;
     }
 
-    bool operator () (const uint32 *lhs, const ComposeSequence &rhs) const {
-        for (size_t i = 0; i < SCIM_MAX_COMPOSE_LEN; ++i) {
-            if (lhs [i] < rhs.keys [i]) return true;
-            else if (lhs [i] > rhs.keys [i]) return false;
-        }
-        return false;
+    bool get_result (uint32 state, WideString &result) const {
+        uint32 res = m_results [state];
+
+        if (!res) return false;
+
+        if (res & 0x80000000)
+            result = m_strings [res & 0x7FFFFFFF];
+        else
+            result = WideString (1, (ucs4_t) res);
+
+        return true;
     }
 
-    bool operator () (const uint32 *lhs, const uint32 *rhs) const {
-        for (size_t i = 0; i < SCIM_MAX_COMPOSE_LEN; ++i) {
-            if (lhs [i] < rhs [i]) return true;
-            else if (lhs [i] > rhs [i]) return false;
+    /**
+     * Insert a sequence. If replace is true, it wins over the sequences
+     * it conflicts with: a shorter one which is a prefix of it is removed,
+     * and longer ones which it is a prefix of become unreachable.
+     * Otherwise a shorter sequence wins and this one is not inserted.
+     *
+     * Returns false if there was such a conflict.
+     */
+    bool insert (const uint32 *keys, size_t num_keys, const WideString &result, bool replace) {
+        if (!num_keys || !result.length ()) return true;
+
+        uint32 state = 0;
+        bool   ok = true;
+
+        for (size_t i = 0; i < num_keys; ++i) {
+            uint32 next = find (state, keys [i]);
+            if (!next) {
+                next = m_results.size ();
+                m_results.push_back (0);
+                add_transition (state, keys [i], next);
+            } else if (i + 1 < num_keys && m_results [next]) {
+                if (!replace) return false;
+                m_results [next] = 0;
+                ok = false;
+            } else if (i + 1 == num_keys && !m_results [next]) {
+                // Only the states inside the trie have no result.
+                ok = false;
+            }
+            state = next;
         }
-        return false;
+
+        if (result.length () == 1 && (uint32) result [0] < 0x80000000) {
+            m_results [state] = result [0];
+        } else {
+            m_results [state] = m_strings.size () | 0x80000000;
+            m_strings.push_back (result);
+        }
+
+        return ok;
     }
 
-};
+    size_t size () const {
+        return m_results.size ();
+    }
 
-// Generated from /usr/X11R6/lib/X11/locale/en_US.UTF-8/Compose
-// Get rid off all keys with unicode value.
-// Merged with the table in gtk+2.x
-static const ComposeSequence __scim_compose_seqs[] = {
-#include "scim_compose_key_data.h"
+private:
+    static size_t hash (uint32 state, uint32 key) {
+        return (state * 0x9E3779B1U) ^ (key * 0x85EBCA6BU);
+    }
+
+    void add_transition (uint32 state, uint32 key, uint32 next) {
+        // Keep the load factor below 1/2.
+        if ((m_num_transitions + 1) * 2 > m_transitions.size ()) {
+            std::vector <Transition> old (m_transitions.size () * 2);
+            old.swap (m_transitions);
+            m_num_transitions = 0;
+            for (size_t i = 0; i < old.size (); ++i)
+                if (old [i].next) add_transition (old [i].state, old [i].key, old [i].next);
+        }
+
+        size_t mask = m_transitions.size () - 1;
+        size_t i = hash (state, key) & mask;
+
+        while (m_transitions [i].next)
+            i = (i + 1) & mask;
+
+        m_transitions [i].state = state;
+        m_transitions [i].key   = key;
+        m_transitions [i].next  = next;
+
+        ++ m_num_transitions;
+    }
 };
 
-#define SCIM_NUM_COMPOSE_SEQS (sizeof (__scim_compose_seqs) / sizeof (__scim_compose_seqs [0]))
+static ComposeTrie __scim_compose_trie;
+static bool        __scim_compose_trie_initialized = false;
 
 static uint16 __scim_compose_ignores [] = {
     SCIM_KEY_ISO_Level3_Shift,
@@ -113,9 +205,142 @@ static uint16 __scim_compose_ignores [] = {
 
 #define SCIM_NUM_COMPOSE_IGNORES (sizeof (__scim_compose_ignores) / sizeof (__scim_compose_ignores [0]))
 
+// Parse a quoted string of an XCompose file, the position is moved to
+// the char after the closing quote.
+static bool
+__parse_compose_string (const String &line, size_t &pos, String &result)
+{
+    if (pos >= line.length () || line [pos] != '"')
+        return false;
+
+    for (++pos; pos < line.length () && line [pos] != '"'; ++pos) {
+        if (line [pos] != '\\' || pos + 1 >= line.length ()) {
+            result.push_back (line [pos]);
+            continue;
+        }
+
+        char c = line [++pos];
+
+        if (c == 'x' || c == 'X') {
+            size_t end = pos + 1;
+            while (end < line.length () && isxdigit ((unsigned char) line [end])) ++end;
+            // A \x without any hex digit is malformed, reject the line.
+            if (end == pos + 1) return false;
+            result.push_back ((char) strtol (line.substr (pos + 1, end - pos - 1).c_str (), 0, 16));
+            pos = end - 1;
+        } else if (c >= '0' && c <= '7') {
+            size_t end = pos;
+            while (end < line.length () && end < pos + 3 && line [end] >= '0' && line [end] <= '7') ++end;
+            result.push_back ((char) strtol (line.substr (pos, end - pos).c_str (), 0, 8));
+            pos = end - 1;
+        } else {
+            result.push_back (c);
+        }
+    }
+
+    if (pos >= line.length ())
+        return false;
+
+    ++pos;
+    return true;
+}
+
+// Load the sequences of an XCompose file into the trie, the lines look like:
+//   <Multi_key> <a> <e> : "\xc3\xa6" ae   # comment
+// include directives are ignored, because the system table is always loaded.
+static size_t
+__load_compose_file (ComposeTrie &trie, const String &file)
+{
+    std::ifstream is (file.c_str ());
+
+    if (!is) return 0;
+
+    String line;
+    size_t count = 0;
+
+    while (std::getline (is, line)) {
+        std::vector <uint32> keys;
+        String result;
+        size_t pos = 0;
+        bool ok = true;
+
+        while (pos < line.length () && isspace ((unsigned char) line [pos])) ++pos;
+
+        if (pos >= line.length () || line [pos] != '<')
+            continue;
+
+        // The key sequence.
+        while (ok && pos < line.length () && line [pos] == '<') {
+            size_t end = line.find ('>', pos);
+            KeyEvent key;
+            if (end == String::npos) {
+                ok = false;
+                break;
+            }
+
+            String name = line.substr (pos + 1, end - pos - 1);
+
+            // Unicode keysyms like U00E9, Latin-1 chars have the same
+            // keysym as their code.
+            if (name.length () > 1 && name [0] == 'U' && isxdigit ((unsigned char) name [1])) {
+                key.code = strtol (name.c_str () + 1, 0, 16);
+                if (key.code >= 0x100) key.code += 0x01000000;
+            } else
+                ok = scim_string_to_key (key, name) && key.mask == 0;
+
+            keys.push_back (key.code);
+
+            for (pos = end + 1; pos < line.length () && isspace ((unsigned char) line [pos]); ++pos);
+        }
+
+        if (!ok || !keys.size () || pos >= line.length () || line [pos] != ':')
+            continue;
+
+        for (++pos; pos < line.length () && isspace ((unsigned char) line [pos]); ++pos);
+
+        if (!__parse_compose_string (line, pos, result) || !result.length ())
+            continue;
+
+        if (!trie.insert (&keys [0], keys.size (), utf8_mbstowcs (result), true))
+            SCIM_DEBUG_IMENGINE (1) << "ComposeKey: \"" << line << "\" in " << file
+                                    << " overrides the sequences it conflicts with.\n";
+
+        ++ count;
+    }
+
+    return count;
+}
+
+static void
+__init_compose_trie ()
+{
+    if (__scim_compose_trie_initialized) return;
+
+    for (size_t i = 0; i < SCIM_NUM_COMPOSE_SEQS; ++i) {
+        size_t len = 0;
+        while (len < SCIM_MAX_COMPOSE_LEN && __scim_compose_seqs [i].keys [len]) ++len;
+        __scim_compose_trie.insert (__scim_compose_seqs [i].keys, len,
+                                    WideString (1, __scim_compose_seqs [i].unicode), false);
+    }
+
+    // The user's sequences are added into the same trie,
+    // overriding the built-in ones they conflict with.
+    const char *file = getenv ("XCOMPOSEFILE");
+    String user_file = (file && *file) ? String (file) : scim_get_home_dir () + SCIM_PATH_DELIM_STRING + ".XCompose";
+
+    size_t count = __load_compose_file (__scim_compose_trie, user_file);
+
+    SCIM_DEBUG_IMENGINE (1) << "ComposeKey: " << count << " sequences loaded from " << user_file
+                            << ", " << __scim_compose_trie.size () << " states in total.\n";
+
+    __scim_compose_trie_initialized = true;
+}
+
 ComposeKeyFactory::ComposeKeyFactory ()
 {
     set_locales ("C");
+
+    __init_compose_trie ();
 }
 
 ComposeKeyFactory::~ComposeKeyFactory ()
@@ -179,10 +404,9 @@ ComposeKeyFactory::create_instance (const String& encoding, int id)
 ComposeKeyInstance::ComposeKeyInstance (ComposeKeyFactory *factory,
                                         const String& encoding,
                                         int id)
-    : IMEngineInstanceBase (factory, encoding, id)
+    : IMEngineInstanceBase (factory, encoding, id),
+      m_compose_state (0)
 {
-    m_compose_buffer [0] = m_compose_buffer [1] = m_compose_buffer [2] = m_compose_buffer [3] = 0;
-    m_compose_buffer [4] = m_compose_buffer [5] = m_compose_buffer [6] = m_compose_buffer [7] = 0;
 }
 
 ComposeKeyInstance::~ComposeKeyInstance ()
@@ -202,48 +426,22 @@ ComposeKeyInstance::process_key_event (const KeyEvent& key)
     if (key.is_control_down () || key.is_alt_down ())
         return false;
 
-    int n_compose = 0;
-
-    while (m_compose_buffer [n_compose] != 0 && n_compose < SCIM_MAX_COMPOSE_LEN)
-        ++ n_compose;
+    uint32 next = __scim_compose_trie.find (m_compose_state, (uint32) key.code);
 
-    // The buffer is full, then reset the buffer first.
-    if (n_compose == SCIM_MAX_COMPOSE_LEN) {
+    // Not match, reset the state and return.
+    // If it's the first key press, then return false to forward it.
+    // Otherwise return true to ignore it.
+    if (!next) {
+        bool composing = (m_compose_state != 0);
         reset ();
-        n_compose = 0;
+        return composing;
     }
 
-    m_compose_buffer [n_compose] = (uint32) key.code;
-
-    const ComposeSequence *it = std::lower_bound (__scim_compose_seqs,
-                                                  __scim_compose_seqs + SCIM_NUM_COMPOSE_SEQS,
-                                                  m_compose_buffer,
-                                                  ComposeSequenceLessByKeys ());
-
-    // Not result found, reset the buffer and return false.
-    if (it == __scim_compose_seqs + SCIM_NUM_COMPOSE_SEQS) {
-        reset ();
-        return false;
-    }
-
-    // Check if the compose sequence is match.
-    for (n_compose = 0; n_compose < SCIM_MAX_COMPOSE_LEN; ++ n_compose) {
-        if (m_compose_buffer [n_compose] == 0)
-            break;
-
-        // Not match, reset the buffer and return.
-        // If it's the first key press, then return false to forward it.
-        // Otherwise return true to ignore it.
-        if (m_compose_buffer [n_compose] != it->keys [n_compose]) {
-            reset ();
-            return n_compose != 0;
-        }
-    }
+    m_compose_state = next;
 
     // Match exactly, commit the result.
-    if (n_compose == SCIM_MAX_COMPOSE_LEN || it->keys [n_compose] == 0) {
-        WideString wstr;
-        wstr.push_back (it->unicode);
+    WideString wstr;
+    if (__scim_compose_trie.get_result (m_compose_state, wstr)) {
         commit_string (wstr);
         reset ();
     }
@@ -279,8 +477,7 @@ ComposeKeyInstance::lookup_table_page_down ()
 void
 ComposeKeyInstance::reset ()
 {
-    m_compose_buffer [0] = m_compose_buffer [1] = m_compose_buffer [2] = m_compose_buffer [3] = 0;
-    m_compose_buffer [4] = m_compose_buffer [5] = m_compose_buffer [6] = m_compose_buffer [7] = 0;
+    m_compose_state = 0;
 }
 
 void
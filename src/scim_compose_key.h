@@ -62,7 +62,7 @@ public:
 
 class ComposeKeyInstance : public IMEngineInstanceBase
 {
-    uint32 m_compose_buffer [8];
+    uint32 m_compose_state;
 
 public:
     ComposeKeyInstance (ComposeKeyFactory *factory,
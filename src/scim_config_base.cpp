@@ -25,6 +25,9 @@
 #define Uses_SCIM_CONFIG_BASE
 #define Uses_SCIM_CONFIG_PATH
 #define Uses_SCIM_CONFIG_MODULE
+
+#include <pthread.h>
+
 #include "scim_private.h"
 #include "scim.h"
 
@@ -152,10 +155,20 @@ ConfigBase::reload ()
     return true;
 }
 
+// Module init functions may connect to the signal while the modules are
+// loaded in parallel.
+static pthread_mutex_t __config_signal_lock = PTHREAD_MUTEX_INITIALIZER;
+
 Connection
 ConfigBase::signal_connect_reload (ConfigSlotVoid *slot)
 {
-    return m_signal_reload.connect (slot);
+    pthread_mutex_lock (&__config_signal_lock);
+
+    Connection conn = m_signal_reload.connect (slot);
+
+    pthread_mutex_unlock (&__config_signal_lock);
+
+    return conn;
 }
 
 ConfigPointer
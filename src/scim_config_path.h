@@ -70,6 +70,11 @@ namespace scim {
 #define SCIM_GLOBAL_CONFIG_DEFAULT_PANEL_SOCKET_ADDRESS             "/DefaultPanelSocketAddress"
 #define SCIM_GLOBAL_CONFIG_DEFAULT_HELPER_MANAGER_SOCKET_ADDRESS    "/DefaultHelperManagerSocketAddress"
 #define SCIM_GLOBAL_CONFIG_DEFAULT_SOCKET_TIMEOUT                   "/DefaultSocketTimeout"
+#define SCIM_GLOBAL_CONFIG_DEFAULT_SOCKET_SHARED_MEMORY             "/DefaultSocketSharedMemory"
+#define SCIM_GLOBAL_CONFIG_IMENGINE_FACTORY_CACHE                   "/IMEngineFactoryCache"
+#define SCIM_GLOBAL_CONFIG_IMENGINE_LAZY_LOADING                    "/IMEngineLazyLoading"
+#define SCIM_GLOBAL_CONFIG_IMENGINE_PRELOAD                         "/IMEngineBackgroundPreload"
+#define SCIM_GLOBAL_CONFIG_PARALLEL_MODULE_LOADING                  "/ParallelModuleLoading"
 
 /** @} */
 
@@ -67,22 +67,6 @@ public:
     }
 };
 
-class __KeyNameLessByCode
-{
-public:
-    bool operator ()(const __KeyName &lhs, const __KeyName &rhs) const {
-        return lhs.value < rhs.value;
-    }
-
-    bool operator ()(const __KeyName &lhs, const uint16 &rhs) const {
-        return lhs.value < rhs;
-    }
-
-    bool operator ()(const uint16 &lhs, const __KeyName &rhs) const {
-        return lhs < rhs.value;
-    }
-};
-
 class __KeyNameLessByName
 {
 public:
@@ -105,6 +89,179 @@ public:
 // KeyEvent data
 #include "scim_keyevent_data.h"
 
+/*
+ * Lookup tables built from the sorted KeyEvent data above, so that the
+ * conversions between key codes, unicodes and key names don't need any
+ * binary search.
+ *
+ * Key codes are at most 16 bits, they are looked up by two level direct
+ * index tables: the high byte of a code selects a block (1 based, 0 means
+ * the block is empty), the low byte selects the entry in the block.
+ *
+ * Key names are looked up by a perfect hash table (hash and displace): a
+ * name is hashed into a bucket first, then the displacement of the bucket
+ * is mixed into the hash value to get the slot, which is unique among all
+ * key names. So only one strcmp is needed for a lookup.
+ */
+class __KeyEventTables
+{
+    static const uint16 EMPTY = 0xFFFF;
+
+    // key code -> unicode.
+    uint16              m_unicode_index [256];
+    std::vector<uint16> m_unicode_data;
+
+    // key code -> index of __scim_keys_by_code.
+    uint16              m_code_index [256];
+    std::vector<uint16> m_code_data;
+
+    // key name -> index of __scim_keys_by_name.
+    std::vector<uint32> m_name_displacements;
+    std::vector<uint16> m_name_slots;
+    bool                m_name_hash_ok;
+
+public:
+    __KeyEventTables () : m_name_hash_ok (false) {
+        size_t i;
+
+        for (i = 0; i < 256; ++i) {
+            m_unicode_index [i] = 0;
+            m_code_index [i] = 0;
+        }
+
+        for (i = 0; i < SCIM_NUM_KEY_UNICODES; ++i)
+            set_entry (m_unicode_index, m_unicode_data, __scim_key_to_unicode_tab [i].first,
+                       __scim_key_to_unicode_tab [i].second, 0);
+
+        // Several names may have the same code, the first one is preferred.
+        for (i = SCIM_NUM_KEY_NAMES; i > 0; --i)
+            set_entry (m_code_index, m_code_data, __scim_keys_by_code [i - 1].value, i - 1, EMPTY);
+
+        m_name_hash_ok = build_name_hash ();
+    }
+
+    ucs4_t get_unicode (uint16 code) const {
+        uint16 block = m_unicode_index [code >> 8];
+        return block ? m_unicode_data [(block - 1) * 256 + (code & 0xFF)] : 0;
+    }
+
+    const char * get_name (uint16 code) const {
+        uint16 block = m_code_index [code >> 8];
+
+        if (block) {
+            uint16 index = m_code_data [(block - 1) * 256 + (code & 0xFF)];
+            if (index != EMPTY)
+                return __scim_keys_by_code [index].name;
+        }
+        return 0;
+    }
+
+    const __KeyName * find_name (const char *name) const {
+        if (!m_name_hash_ok) {
+            const __KeyName *p = std::lower_bound (__scim_keys_by_name,
+                                                   __scim_keys_by_name + SCIM_NUM_KEY_NAMES,
+                                                   name,
+                                                   __KeyNameLessByName ());
+
+            if (p != __scim_keys_by_name + SCIM_NUM_KEY_NAMES && strcmp (p->name, name) == 0)
+                return p;
+            return 0;
+        }
+
+        uint32 hash  = hash_name (name);
+        uint16 index = m_name_slots [get_slot (hash, m_name_displacements [hash % m_name_displacements.size ()])];
+
+        if (index != EMPTY && strcmp (__scim_keys_by_name [index].name, name) == 0)
+            return __scim_keys_by_name + index;
+        return 0;
+    }
+
+private:
+    static void set_entry (uint16 *index, std::vector<uint16> &data, uint16 code, uint16 value, uint16 empty) {
+        if (!index [code >> 8]) {
+            data.resize (data.size () + 256, empty);
+            index [code >> 8] = data.size () / 256;
+        }
+        data [(index [code >> 8] - 1) * 256 + (code & 0xFF)] = value;
+    }
+
+    static uint32 hash_name (const char *name) {
+        uint32 hash = 2166136261U;
+        for (; *name; ++name)
+            hash = (hash ^ (unsigned char) *name) * 16777619U;
+        return hash;
+    }
+
+    uint32 get_slot (uint32 hash, uint32 displacement) const {
+        hash ^= displacement * 0x9E3779B9U;
+        hash ^= hash >> 16;
+        hash *= 0x85EBCA6BU;
+        hash ^= hash >> 13;
+        return hash & (m_name_slots.size () - 1);
+    }
+
+    bool build_name_hash () {
+        size_t nslots = 1;
+        while (nslots < SCIM_NUM_KEY_NAMES * 2) nslots <<= 1;
+
+        std::vector<uint32> hashes (SCIM_NUM_KEY_NAMES);
+        std::vector<std::vector<uint16> > buckets (SCIM_NUM_KEY_NAMES / 4 + 1);
+        std::vector<std::pair<size_t, size_t> > order;
+        size_t i, j;
+
+        m_name_slots.assign (nslots, (uint16) EMPTY);
+        m_name_displacements.assign (buckets.size (), 0);
+
+        for (i = 0; i < SCIM_NUM_KEY_NAMES; ++i) {
+            hashes [i] = hash_name (__scim_keys_by_name [i].name);
+            buckets [hashes [i] % buckets.size ()].push_back (i);
+        }
+
+        // Place the biggest buckets first, while there are plenty of free slots.
+        for (i = 0; i < buckets.size (); ++i)
+            order.push_back (std::make_pair (buckets [i].size (), i));
+
+        std::sort (order.begin (), order.end ());
+
+        std::vector<uint32> slots;
+        for (i = order.size (); i > 0 && order [i - 1].first; --i) {
+            const std::vector<uint16> &bucket = buckets [order [i - 1].second];
+            uint32 d;
+
+            for (d = 0; d < 0x10000; ++d) {
+                slots.clear ();
+                for (j = 0; j < bucket.size (); ++j) {
+                    uint32 slot = get_slot (hashes [bucket [j]], d);
+                    if (m_name_slots [slot] != EMPTY || std::find (slots.begin (), slots.end (), slot) != slots.end ())
+                        break;
+                    slots.push_back (slot);
+                }
+                if (j == bucket.size ()) break;
+            }
+
+            // Should never happen, fall back to binary search.
+            if (d == 0x10000) {
+                m_name_slots.clear ();
+                m_name_displacements.clear ();
+                return false;
+            }
+
+            m_name_displacements [order [i - 1].second] = d;
+            for (j = 0; j < bucket.size (); ++j)
+                m_name_slots [slots [j]] = bucket [j];
+        }
+
+        return true;
+    }
+};
+
+static const __KeyEventTables &
+__get_key_event_tables ()
+{
+    static __KeyEventTables tables;
+    return tables;
+}
+
 char
 KeyEvent::get_ascii_code () const
 {
@@ -150,17 +307,8 @@ KeyEvent::get_unicode_code () const
     if (code > 0xFFFF)
         return 0;
 
-    /* binary search in table */
-    __Uint16Pair * it = std::lower_bound (__scim_key_to_unicode_tab,
-                                          __scim_key_to_unicode_tab + SCIM_NUM_KEY_UNICODES,
-                                          (uint16) code,
-                                          __Uint16PairLessByFirst ());
-
-    if (it != __scim_key_to_unicode_tab + SCIM_NUM_KEY_UNICODES && it->first == (uint16) code)
-        return it->second;
-
-    /* No matching Unicode value found */
-    return 0;
+    /* 0 means no matching Unicode value found */
+    return __get_key_event_tables ().get_unicode ((uint16) code);
 }
 
 String
@@ -184,13 +332,10 @@ KeyEvent::get_key_string () const
     if (code == 0xFFFFFF) {
         codestr = String ("VoidSymbol");
     } else if (code <= 0xFFFF){
-        __KeyName *it = std::lower_bound (__scim_keys_by_code,
-                                          __scim_keys_by_code + SCIM_NUM_KEY_NAMES,
-                                          (uint16) code,
-                                          __KeyNameLessByCode ());
+        const char *name = __get_key_event_tables ().get_name ((uint16) code);
 
-        if (it != __scim_keys_by_code + SCIM_NUM_KEY_NAMES && it->value == code)
-            codestr = String (it->name);
+        if (name)
+            codestr = String (name);
     }
 
     if (!codestr.length () && code) {
@@ -222,6 +367,91 @@ inline __remap_keycode (uint16 from, const __KeyCodeMap &map)
     return from;
 }
 
+/*
+ * The composed mapping from one layout to another for one modifier class,
+ * as a two level direct index table like __KeyEventTables. A key code in
+ * an empty block maps to itself.
+ */
+class __KeyCodeRemapTable
+{
+    uint16              m_index [256];
+    std::vector<uint16> m_data;
+
+public:
+    __KeyCodeRemapTable (const __KeyCodeMap &from_map, const __KeyCodeMap &to_map) {
+        size_t i;
+
+        for (i = 0; i < 256; ++i)
+            m_index [i] = 0;
+
+        // Only the codes in either map may be changed.
+        for (i = 0; i < from_map.size; ++i)
+            set_entry (from_map.map [i].first, from_map, to_map);
+        for (i = 0; i < to_map.size; ++i)
+            set_entry (to_map.map [i].first, from_map, to_map);
+    }
+
+    uint16 remap (uint16 code) const {
+        uint16 block = m_index [code >> 8];
+        return block ? m_data [(block - 1) * 256 + (code & 0xFF)] : code;
+    }
+
+private:
+    void set_entry (uint16 code, const __KeyCodeMap &from_map, const __KeyCodeMap &to_map) {
+        if (!m_index [code >> 8]) {
+            size_t base = m_data.size ();
+            m_data.resize (base + 256);
+            for (size_t i = 0; i < 256; ++i)
+                m_data [base + i] = (code & 0xFF00) | i;
+            m_index [code >> 8] = m_data.size () / 256;
+        }
+        m_data [(m_index [code >> 8] - 1) * 256 + (code & 0xFF)] =
+            __remap_keycode (__remap_keycode (code, from_map), to_map);
+    }
+};
+
+// Built on demand and kept until exit, indexed by the source layout,
+// the target layout and the state of CapsLock and Shift.
+static __KeyCodeRemapTable *__remap_tables [SCIM_KEYBOARD_NUM_LAYOUTS][SCIM_KEYBOARD_NUM_LAYOUTS][4];
+
+static const __KeyCodeRemapTable &
+__get_remap_table (int from, int to, int caps_shift)
+{
+    __KeyCodeRemapTable **table = &__remap_tables [from][to][caps_shift];
+
+    // Pairs with the compare and swap below, so the table is seen fully built.
+    __KeyCodeRemapTable *cur_table = __atomic_load_n (table, __ATOMIC_ACQUIRE);
+
+    if (!cur_table) {
+        __KeyCodeRemapTable *new_table;
+
+        switch (caps_shift) {
+            case 1:
+                new_table = new __KeyCodeRemapTable (__caps_map [from], __caps_invert_map [to]);
+                break;
+            case 2:
+                new_table = new __KeyCodeRemapTable (__shift_map [from], __shift_invert_map [to]);
+                break;
+            case 3:
+                new_table = new __KeyCodeRemapTable (__caps_shift_map [from], __caps_shift_invert_map [to]);
+                break;
+            default:
+                new_table = new __KeyCodeRemapTable (__normal_map [from], __normal_invert_map [to]);
+                break;
+        }
+
+        // Another thread may have built the same table meanwhile.
+        cur_table = __sync_val_compare_and_swap (table, (__KeyCodeRemapTable *) 0, new_table);
+
+        if (cur_table)
+            delete new_table;
+        else
+            cur_table = new_table;
+    }
+
+    return *cur_table;
+}
+
 KeyEvent
 KeyEvent::map_to_layout (KeyboardLayout new_layout) const
 {
@@ -232,28 +462,12 @@ KeyEvent::map_to_layout (KeyboardLayout new_layout) const
 
     KeyEvent evt (code, mask, new_layout);
 
-    uint16 new_code = (uint16) code;
-
-    switch (mask & (SCIM_KEY_CapsLockMask | SCIM_KEY_ShiftMask)) {
-        case 0:
-            new_code = __remap_keycode (new_code, __normal_map [layout]);
-            new_code = __remap_keycode (new_code, __normal_invert_map [new_layout]);
-            break;
-        case SCIM_KEY_CapsLockMask:
-            new_code = __remap_keycode (new_code, __caps_map [layout]);
-            new_code = __remap_keycode (new_code, __caps_invert_map [new_layout]);
-            break;
-        case SCIM_KEY_ShiftMask:
-            new_code = __remap_keycode (new_code, __shift_map [layout]);
-            new_code = __remap_keycode (new_code, __shift_invert_map [new_layout]);
-            break;
-        case (SCIM_KEY_ShiftMask | SCIM_KEY_CapsLockMask):
-            new_code = __remap_keycode (new_code, __caps_shift_map [layout]);
-            new_code = __remap_keycode (new_code, __caps_shift_invert_map [new_layout]);
-            break;
-    }
+    int caps_shift = 0;
+
+    if (mask & SCIM_KEY_CapsLockMask) caps_shift |= 1;
+    if (mask & SCIM_KEY_ShiftMask)    caps_shift |= 2;
 
-    evt.code = (uint32) new_code;
+    evt.code = (uint32) __get_remap_table (layout, new_layout, caps_shift).remap ((uint16) code);
 
     return evt;
 }
@@ -280,7 +494,7 @@ scim_string_to_key (KeyEvent &key, const String & str)
     for (std::vector <String>::iterator it=list.begin (); it!=list.end (); ++it) {
         skip = false;
         for (i = 0; i < SCIM_NUM_KEY_MASKS; ++i) {
-            if (*it == String (__scim_key_mask_names [i].name)) {
+            if (*it == __scim_key_mask_names [i].name) {
                 key.mask |= __scim_key_mask_names [i].value;
                 skip = true;
                 break;
@@ -289,16 +503,13 @@ scim_string_to_key (KeyEvent &key, const String & str)
 
         if (skip) continue;
 
-        __KeyName *p = std::lower_bound (__scim_keys_by_name,
-                                         __scim_keys_by_name + SCIM_NUM_KEY_NAMES,
-                                         it->c_str (),
-                                         __KeyNameLessByName ());
+        const __KeyName *p = __get_key_event_tables ().find_name (it->c_str ());
 
-        if (p != __scim_keys_by_name + SCIM_NUM_KEY_NAMES && strcmp (p->name, it->c_str ()) == 0) {
+        if (p) {
             key.code = p->value;
         } else if (it->length () >= 6 && (*it)[0] == '0' && ((*it)[1] == 'x' || (*it)[1] == 'X')){
             key.code = strtol (it->c_str () + 2, NULL, 16);
-        } else if (strcmp (p->name, "VoidSymbol") == 0) {
+        } else if (*it == "VoidSymbol") {
             key.code = SCIM_KEY_VoidSymbol; 
         }
     }
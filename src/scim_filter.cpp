@@ -190,7 +190,12 @@ public:
     }
 
     bool process_key_event (const KeyEvent &key) {
-        return m_orig.null () ? false : m_orig->process_key_event (key);
+        if (m_orig.null ()) return false;
+
+        m_orig->begin_frame ();
+        bool ret = m_orig->process_key_event (key);
+        m_orig->end_frame ();
+        return ret;
     }
 
     void move_preedit_caret (unsigned int pos) {
@@ -31,6 +31,7 @@
 #define Uses_SCIM_CONFIG_PATH
 #include "scim_private.h"
 #include "scim.h"
+#include "scim_thread_pool.h"
 
 namespace scim {
 
@@ -48,6 +49,21 @@ static FilterModule            *__filter_modules    = 0;
 
 static std::vector <std::pair <FilterModuleIndex, FilterInfo> > __filter_infos;
 
+struct FilterModuleLoadJob
+{
+    const std::vector <String> *names;
+    ConfigPointer               config;
+};
+
+// Load a filter module, may run in a worker thread.
+static void
+__load_filter_module (size_t index, void *data)
+{
+    FilterModuleLoadJob *job = static_cast <FilterModuleLoadJob *> (data);
+
+    __filter_modules [index].load ((*job->names) [index], job->config);
+}
+
 static void
 __initialize_modules (const ConfigPointer &config)
 {
@@ -65,8 +81,19 @@ __initialize_modules (const ConfigPointer &config)
 
     unsigned int i, j;
 
+    FilterModuleLoadJob job;
+    job.names  = &mod_list;
+    job.config = config;
+
+    if (__number_of_modules > 1 && scim_thread_pool_parallel_module_loading (config)) {
+        scim_thread_pool_run (__number_of_modules, __load_filter_module, &job, scim_thread_pool_default_size ());
+    } else {
+        for (i = 0; i < __number_of_modules; ++i)
+            __load_filter_module (i, &job);
+    }
+
     for (i = 0; i < __number_of_modules; ++i) {
-        if (__filter_modules [i].load (mod_list [i], config)) {
+        if (__filter_modules [i].valid ()) {
             for (j = 0; j < __filter_modules [i].number_of_filters (); ++j) {
                 FilterModuleIndex index;
                 FilterInfo info;
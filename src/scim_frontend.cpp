@@ -209,13 +209,12 @@ FrontEndBase::~FrontEndBase ()
 uint32
 FrontEndBase::get_factory_list_for_encoding (std::vector<String>& uuids, const String &encoding) const
 {
-    std::vector<IMEngineFactoryPointer> factories;
-
-    m_impl->m_backend->get_factories_for_encoding (factories, encoding);
+    const std::vector<IMEngineFactoryPointer> &factories =
+        m_impl->m_backend->get_factory_index_for_encoding (encoding);
 
     uuids.clear ();
 
-    for (std::vector<IMEngineFactoryPointer>::iterator it = factories.begin (); it != factories.end (); ++it)
+    for (std::vector<IMEngineFactoryPointer>::const_iterator it = factories.begin (); it != factories.end (); ++it)
         uuids.push_back ((*it)->get_uuid ());
 
     return uuids.size ();
@@ -224,13 +223,12 @@ FrontEndBase::get_factory_list_for_encoding (std::vector<String>& uuids, const S
 uint32
 FrontEndBase::get_factory_list_for_language (std::vector<String>& uuids, const String &language) const
 {
-    std::vector<IMEngineFactoryPointer> factories;
-
-    m_impl->m_backend->get_factories_for_language (factories, language);
+    const std::vector<IMEngineFactoryPointer> &factories =
+        m_impl->m_backend->get_factory_index_for_language (language);
 
     uuids.clear ();
 
-    for (std::vector<IMEngineFactoryPointer>::iterator it = factories.begin (); it != factories.end (); ++it)
+    for (std::vector<IMEngineFactoryPointer>::const_iterator it = factories.begin (); it != factories.end (); ++it)
         uuids.push_back ((*it)->get_uuid ());
 
     return uuids.size ();
@@ -335,6 +333,12 @@ FrontEndBase::get_all_locales () const
     return m_impl->m_backend->get_all_locales ();
 }
 
+bool
+FrontEndBase::preload_default_factory () const
+{
+    return m_impl->m_backend->preload_default_factory ();
+}
+
 int
 FrontEndBase::new_instance (const String &sf_uuid, const String& encoding)
 {
@@ -514,11 +518,42 @@ FrontEndBase::process_key_event (int id, const KeyEvent& key) const
 {
     IMEngineInstancePointer si = m_impl->find_instance (id);
 
-    if (!si.null ()) return si->process_key_event (key);
+    if (!si.null ()) {
+        si->begin_frame ();
+        bool ret = si->process_key_event (key);
+        si->end_frame ();
+        return ret;
+    }
 
     return false;
 }
 
+size_t
+FrontEndBase::process_key_events (int id, const KeyEventList &keys) const
+{
+    IMEngineInstancePointer si = m_impl->find_instance (id);
+
+    if (si.null ()) return 0;
+
+    // A single key gains nothing from being batched.
+    if (keys.size () == 1)
+        return process_key_event (id, keys [0]) ? 1 : 0;
+
+    size_t count;
+
+    // Hold back the UI updates until the whole batch is processed,
+    // even if the IMEngine doesn't use the frame mode by itself.
+    si->begin_frame (true);
+
+    for (count = 0; count < keys.size (); ++count) {
+        if (!si->process_key_event (keys [count])) break;
+    }
+
+    si->end_frame ();
+
+    return count;
+}
+
 void
 FrontEndBase::move_preedit_caret (int id, unsigned int pos) const
 {
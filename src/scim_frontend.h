@@ -225,6 +225,16 @@ protected:
      */
     String get_all_locales () const;
 
+    /**
+     * @brief let BackEnd preload the next IMEngine factory which is likely to be used.
+     *
+     * It should be called when the main loop is idle, after the FrontEnd starts
+     * serving the clients, until it returns false.
+     *
+     * @return true if there are more factories to be preloaded.
+     */
+    bool preload_default_factory () const;
+
     // IMEngine instance related functions.
 
     /**
@@ -325,6 +335,26 @@ protected:
      */
     bool process_key_event (int id, const KeyEvent& key) const;
 
+    /**
+     * @brief process a batch of key events using specific IMEngine instance.
+     *
+     * The key events are processed one by one in order within a single
+     * frame of the instance (see IMEngineInstanceBase::begin_frame ()),
+     * so the updates of the preedit string, aux string and lookup table
+     * are coalesced. Other signals, like commit_string and forward_key_event,
+     * emit the updates held before them first, so the order is kept.
+     *
+     * The processing stops at the first key event which is not processed by
+     * the instance, so that the caller can forward it to the client application
+     * in the right order and submit the remaining key events again.
+     *
+     * @param id the IMEngine instance id.
+     * @param keys the key events to be processed.
+     * @return the number of leading key events which were processed successfully.
+     *         If it's less than keys.size (), keys [return value] was not processed.
+     */
+    size_t process_key_events (int id, const KeyEventList &keys) const;
+
     /**
      * @brief let a specific IMEngine instance move its preedit caret.
      * @param id the IMEngine instance id.
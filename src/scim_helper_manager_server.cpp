@@ -76,7 +76,7 @@ static bool                 __should_exit           = false;
 static Transaction          __recv_trans;
 static Transaction          __send_trans;
 static HelperRepository     __helpers;
-static SocketServer         __socket_server;
+static SocketServer         __socket_server (-1, SCIM_SOCKET_SERVER_AUTO);
 
 //////////////////////////////////////////////////////////////////////////////
 // Function definition. 
@@ -122,7 +122,92 @@ public:
     int    m_id;
     void * m_frontend_data;
 
-    IMEngineInstanceBaseImpl () : m_id (0), m_frontend_data (0) { }
+    bool          m_frame_mode;
+    int           m_frame_depth;
+
+    // The updates buffered in current frame.
+    // -1 : not changed, 0 : hidden, 1 : shown.
+    int           m_preedit_visible;
+    int           m_aux_visible;
+    int           m_lookup_table_visible;
+
+    bool          m_preedit_caret_updated;
+    bool          m_preedit_string_updated;
+    bool          m_aux_string_updated;
+    bool          m_lookup_table_updated;
+
+    int           m_preedit_caret;
+    WideString    m_preedit_string;
+    AttributeList m_preedit_attrs;
+    WideString    m_aux_string;
+    AttributeList m_aux_attrs;
+    Transaction   m_lookup_table;
+
+    IMEngineInstanceBaseImpl ()
+        : m_id (0),
+          m_frontend_data (0),
+          m_frame_mode (false),
+          m_frame_depth (0),
+          m_preedit_visible (-1),
+          m_aux_visible (-1),
+          m_lookup_table_visible (-1),
+          m_preedit_caret_updated (false),
+          m_preedit_string_updated (false),
+          m_aux_string_updated (false),
+          m_lookup_table_updated (false),
+          m_preedit_caret (0) { }
+
+    bool in_frame () const {
+        return m_frame_depth > 0;
+    }
+
+    bool frame_dirty () const {
+        return m_preedit_visible >= 0 || m_aux_visible >= 0 || m_lookup_table_visible >= 0 ||
+               m_preedit_caret_updated || m_preedit_string_updated ||
+               m_aux_string_updated || m_lookup_table_updated;
+    }
+
+    // Emit the buffered updates, in the order of preedit string,
+    // aux string and lookup table.
+    void flush_frame (IMEngineInstanceBase *si) {
+        if (!frame_dirty ()) return;
+
+        if (m_preedit_string_updated) {
+            m_preedit_string_updated = false;
+            m_signal_update_preedit_string (si, m_preedit_string, m_preedit_attrs);
+        }
+        if (m_preedit_caret_updated) {
+            m_preedit_caret_updated = false;
+            m_signal_update_preedit_caret (si, m_preedit_caret);
+        }
+        if (m_preedit_visible >= 0) {
+            if (m_preedit_visible) m_signal_show_preedit_string (si);
+            else m_signal_hide_preedit_string (si);
+            m_preedit_visible = -1;
+        }
+
+        if (m_aux_string_updated) {
+            m_aux_string_updated = false;
+            m_signal_update_aux_string (si, m_aux_string, m_aux_attrs);
+        }
+        if (m_aux_visible >= 0) {
+            if (m_aux_visible) m_signal_show_aux_string (si);
+            else m_signal_hide_aux_string (si);
+            m_aux_visible = -1;
+        }
+
+        if (m_lookup_table_updated) {
+            CommonLookupTable table;
+            m_lookup_table_updated = false;
+            if (m_lookup_table.get_data (table))
+                m_signal_update_lookup_table (si, table);
+        }
+        if (m_lookup_table_visible >= 0) {
+            if (m_lookup_table_visible) m_signal_show_lookup_table (si);
+            else m_signal_hide_lookup_table (si);
+            m_lookup_table_visible = -1;
+        }
+    }
 };
 
 IMEngineFactoryBase::IMEngineFactoryBase ()
@@ -316,6 +401,36 @@ IMEngineInstanceBase::get_frontend_data (void)
     return m_impl->m_frontend_data;
 }
 
+void
+IMEngineInstanceBase::begin_frame (bool force)
+{
+    if (m_impl->m_frame_mode || force || m_impl->m_frame_depth > 0)
+        ++ m_impl->m_frame_depth;
+}
+
+void
+IMEngineInstanceBase::end_frame ()
+{
+    if (m_impl->m_frame_depth > 0 && -- m_impl->m_frame_depth == 0)
+        m_impl->flush_frame (this);
+}
+
+bool
+IMEngineInstanceBase::get_frame_mode () const
+{
+    return m_impl->m_frame_mode;
+}
+
+void
+IMEngineInstanceBase::set_frame_mode (bool frame)
+{
+    if (!frame && m_impl->m_frame_mode) {
+        m_impl->m_frame_depth = 0;
+        m_impl->flush_frame (this);
+    }
+    m_impl->m_frame_mode = frame;
+}
+
 void
 IMEngineInstanceBase::move_preedit_caret (unsigned int)
 {
@@ -494,110 +609,160 @@ IMEngineInstanceBase::signal_connect_delete_surrounding_text (IMEngineSlotDelete
 void
 IMEngineInstanceBase::show_preedit_string ()
 {
-    m_impl->m_signal_show_preedit_string (this);
+    if (m_impl->in_frame ())
+        m_impl->m_preedit_visible = 1;
+    else
+        m_impl->m_signal_show_preedit_string (this);
 }
 
 void
 IMEngineInstanceBase::show_aux_string ()
 {
-    m_impl->m_signal_show_aux_string (this);
+    if (m_impl->in_frame ())
+        m_impl->m_aux_visible = 1;
+    else
+        m_impl->m_signal_show_aux_string (this);
 }
 
 void
 IMEngineInstanceBase::show_lookup_table ()
 {
-    m_impl->m_signal_show_lookup_table (this);
+    if (m_impl->in_frame ())
+        m_impl->m_lookup_table_visible = 1;
+    else
+        m_impl->m_signal_show_lookup_table (this);
 }
 
 void
 IMEngineInstanceBase::hide_preedit_string ()
 {
-    m_impl->m_signal_hide_preedit_string (this);
+    if (m_impl->in_frame ())
+        m_impl->m_preedit_visible = 0;
+    else
+        m_impl->m_signal_hide_preedit_string (this);
 }
 
 void
 IMEngineInstanceBase::hide_aux_string ()
 {
-    m_impl->m_signal_hide_aux_string (this);
+    if (m_impl->in_frame ())
+        m_impl->m_aux_visible = 0;
+    else
+        m_impl->m_signal_hide_aux_string (this);
 }
 
 void
 IMEngineInstanceBase::hide_lookup_table ()
 {
-    m_impl->m_signal_hide_lookup_table (this);
+    if (m_impl->in_frame ())
+        m_impl->m_lookup_table_visible = 0;
+    else
+        m_impl->m_signal_hide_lookup_table (this);
 }
 
 void
 IMEngineInstanceBase::update_preedit_caret (int caret)
 {
-    m_impl->m_signal_update_preedit_caret (this, caret);
+    if (m_impl->in_frame ()) {
+        m_impl->m_preedit_caret = caret;
+        m_impl->m_preedit_caret_updated = true;
+    } else {
+        m_impl->m_signal_update_preedit_caret (this, caret);
+    }
 }
 
 void
 IMEngineInstanceBase::update_preedit_string (const WideString    &str,
                                              const AttributeList &attrs)
 {
-    m_impl->m_signal_update_preedit_string (this, str, attrs);
+    if (m_impl->in_frame ()) {
+        m_impl->m_preedit_string = str;
+        m_impl->m_preedit_attrs = attrs;
+        m_impl->m_preedit_string_updated = true;
+    } else {
+        m_impl->m_signal_update_preedit_string (this, str, attrs);
+    }
 }
 
 void
 IMEngineInstanceBase::update_aux_string (const WideString    &str,
                                          const AttributeList &attrs)
 {
-    m_impl->m_signal_update_aux_string (this, str, attrs);
+    if (m_impl->in_frame ()) {
+        m_impl->m_aux_string = str;
+        m_impl->m_aux_attrs = attrs;
+        m_impl->m_aux_string_updated = true;
+    } else {
+        m_impl->m_signal_update_aux_string (this, str, attrs);
+    }
 }
 
 void
 IMEngineInstanceBase::update_lookup_table (const LookupTable &table)
 {
-    m_impl->m_signal_update_lookup_table (this, table);
+    // Only the current page is needed by FrontEnds, keep a snapshot of it.
+    if (m_impl->in_frame ()) {
+        m_impl->m_lookup_table.clear ();
+        m_impl->m_lookup_table.put_data (table);
+        m_impl->m_lookup_table_updated = true;
+    } else {
+        m_impl->m_signal_update_lookup_table (this, table);
+    }
 }
 
 void
 IMEngineInstanceBase::commit_string (const WideString &str)
 {
+    m_impl->flush_frame (this);
     m_impl->m_signal_commit_string (this, str);
 }
 
 void
 IMEngineInstanceBase::forward_key_event (const KeyEvent &key)
 {
+    m_impl->flush_frame (this);
     m_impl->m_signal_forward_key_event (this, key);
 }
 
 void
 IMEngineInstanceBase::register_properties (const PropertyList &properties)
 {
+    m_impl->flush_frame (this);
     m_impl->m_signal_register_properties (this, properties);
 }
 
 void
 IMEngineInstanceBase::update_property (const Property &property)
 {
+    m_impl->flush_frame (this);
     m_impl->m_signal_update_property (this, property);
 }
 
 void
 IMEngineInstanceBase::beep ()
 {
+    m_impl->flush_frame (this);
     m_impl->m_signal_beep (this);
 }
 
 void
 IMEngineInstanceBase::start_helper (const String &helper_uuid)
 {
+    m_impl->flush_frame (this);
     m_impl->m_signal_start_helper (this, helper_uuid);
 }
 
 void
 IMEngineInstanceBase::stop_helper (const String &helper_uuid)
 {
+    m_impl->flush_frame (this);
     m_impl->m_signal_stop_helper (this, helper_uuid);
 }
 
 void
 IMEngineInstanceBase::send_helper_event (const String &helper_uuid, const Transaction &trans)
 {
+    m_impl->flush_frame (this);
     m_impl->m_signal_send_helper_event (this, helper_uuid, trans);
 }
 
@@ -610,6 +775,8 @@ IMEngineInstanceBase::get_surrounding_text (WideString &text, int &cursor, int m
     if (maxlen_before == 0 && maxlen_after == 0)
         return false;
 
+    m_impl->flush_frame (this);
+
     if (m_impl->m_signal_get_surrounding_text (this, text, cursor, maxlen_before, maxlen_after) && text.length ())
         return true;
 
@@ -619,6 +786,7 @@ IMEngineInstanceBase::get_surrounding_text (WideString &text, int &cursor, int m
 bool
 IMEngineInstanceBase::delete_surrounding_text (int offset, int len)
 {
+    m_impl->flush_frame (this);
     return m_impl->m_signal_delete_surrounding_text (this, offset, len);
 }
 
@@ -433,6 +433,34 @@ public:
      */
     void * get_frontend_data (void);
 
+    /**
+     * @brief Begin a frame of signals, eg. before processing a key event.
+     *
+     * If the frame mode is enabled by set_frame_mode (), the updates of
+     * preedit string, aux string and lookup table emitted within a frame are
+     * buffered, only the last value of each kind is emitted at the end of the frame.
+     *
+     * Frames can be nested, only the outermost one takes effect.
+     * It does nothing if the frame mode is disabled, unless @a force is true.
+     *
+     * @param force true to buffer the updates within this frame even if
+     *        the frame mode is disabled, eg. when processing a batch of key events.
+     */
+    void begin_frame (bool force = false);
+
+    /**
+     * @brief End a frame of signals begun by begin_frame (),
+     *        and emit the buffered updates.
+     */
+    void end_frame ();
+
+    /**
+     * @brief Check whether the frame mode is enabled.
+     *
+     * @return true if the signals are buffered within frames.
+     */
+    bool get_frame_mode () const;
+
 public:
     /**
      * @name Signal connection functions.
@@ -595,6 +623,20 @@ public:
     /** @} */
 
 protected:
+    /**
+     * @brief Enable or disable the frame mode.
+     *
+     * When enabled, the redundant updates of preedit string, aux string
+     * and lookup table emitted within a frame are coalesced. Any other
+     * signal, like commit_string, causes the buffered updates to be emitted
+     * first, so the order of the signals is kept.
+     *
+     * It's disabled by default.
+     *
+     * @param frame true to enable the frame mode.
+     */
+    void set_frame_mode (bool frame);
+
     /**
      * @name Signal activation functions
      * 
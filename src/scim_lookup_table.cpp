@@ -281,6 +281,10 @@ LookupTable::clear ()
     std::vector <int> ().swap (m_impl->m_page_history);
 }
 
+// The buffers of CommonLookupTable smaller than this are kept by clear (),
+// so that the table can be refilled on each key event without reallocating.
+#define SCIM_LOOKUP_TABLE_MAX_KEPT_CHARS 16384
+
 class CommonLookupTable::CommonLookupTableImpl
 {
 public:
@@ -291,9 +295,8 @@ public:
     std::vector <uint32> m_attrs_index;
 };
 
-//implementation of CommonLookupTable
-CommonLookupTable::CommonLookupTable (int page_size)
-    : LookupTable (page_size), m_impl (new CommonLookupTableImpl ())
+static std::vector <WideString>
+__default_candidate_labels ()
 {
     std::vector <WideString> labels;
     char buf [2] = { 0, 0 };
@@ -304,7 +307,14 @@ CommonLookupTable::CommonLookupTable (int page_size)
 
     labels.push_back (utf8_mbstowcs ("0"));
 
-    set_candidate_labels (labels);
+    return labels;
+}
+
+//implementation of CommonLookupTable
+CommonLookupTable::CommonLookupTable (int page_size)
+    : LookupTable (page_size), m_impl (new CommonLookupTableImpl ())
+{
+    set_candidate_labels (__default_candidate_labels ());
 }
 
 CommonLookupTable::CommonLookupTable (int                            page_size,
@@ -379,6 +389,87 @@ CommonLookupTable::get_candidate (int index) const
     return WideString (start, end);
 }
 
+uint32
+CommonLookupTable::append_candidates (const std::vector<WideString>    &cands,
+                                      const std::vector<AttributeList> &attrs)
+{
+    bool   has_attrs = (attrs.size () == cands.size ());
+    size_t nchars = 0;
+    size_t nattrs = 0;
+    uint32 count = 0;
+    size_t i;
+
+    for (i = 0; i < cands.size (); ++i) {
+        nchars += cands [i].length ();
+        if (has_attrs) nattrs += attrs [i].size ();
+    }
+
+    m_impl->m_index.reserve (m_impl->m_index.size () + cands.size ());
+    m_impl->m_attrs_index.reserve (m_impl->m_attrs_index.size () + cands.size ());
+    m_impl->m_buffer.reserve (m_impl->m_buffer.size () + nchars);
+    m_impl->m_attributes.reserve (m_impl->m_attributes.size () + nattrs);
+
+    for (i = 0; i < cands.size (); ++i) {
+        if (cands [i].length () == 0)
+            continue;
+
+        m_impl->m_index.push_back (m_impl->m_buffer.size ());
+        m_impl->m_buffer.insert (m_impl->m_buffer.end (), cands [i].begin (), cands [i].end ());
+
+        m_impl->m_attrs_index.push_back (m_impl->m_attributes.size ());
+
+        if (has_attrs && attrs [i].size ())
+            m_impl->m_attributes.insert (m_impl->m_attributes.end (), attrs [i].begin (), attrs [i].end ());
+
+        ++ count;
+    }
+
+    return count;
+}
+
+void
+CommonLookupTable::reserve (uint32 candidates, uint32 chars)
+{
+    m_impl->m_index.reserve (candidates);
+    m_impl->m_attrs_index.reserve (candidates);
+    m_impl->m_buffer.reserve (chars ? chars : candidates);
+}
+
+const ucs4_t *
+CommonLookupTable::get_candidate_buffer (int index, uint32 &length) const
+{
+    length = 0;
+
+    if (index < 0 || index >= (int) number_of_candidates ())
+        return 0;
+
+    uint32 start = m_impl->m_index [index];
+    uint32 end = (index < (int) number_of_candidates () - 1) ? m_impl->m_index [index+1] : m_impl->m_buffer.size ();
+
+    length = end - start;
+
+    return &m_impl->m_buffer [0] + start;
+}
+
+const Attribute *
+CommonLookupTable::get_attributes_buffer (int index, uint32 &count) const
+{
+    count = 0;
+
+    if (index < 0 || index >= (int) number_of_candidates ())
+        return 0;
+
+    uint32 start = m_impl->m_attrs_index [index];
+    uint32 end = (index < (int) number_of_candidates () - 1) ? m_impl->m_attrs_index [index+1] : m_impl->m_attributes.size ();
+
+    if (start >= end)
+        return 0;
+
+    count = end - start;
+
+    return &m_impl->m_attributes [0] + start;
+}
+
 AttributeList
 CommonLookupTable::get_attributes (int index) const
 {
@@ -405,11 +496,202 @@ CommonLookupTable::clear ()
 {
     LookupTable::clear ();
 
-    std::vector <ucs4_t> ().swap (m_impl->m_buffer);
-    std::vector <uint32> ().swap (m_impl->m_index);
+    if (m_impl->m_buffer.capacity () <= SCIM_LOOKUP_TABLE_MAX_KEPT_CHARS) {
+        m_impl->m_buffer.clear ();
+        m_impl->m_index.clear ();
+        m_impl->m_attributes.clear ();
+        m_impl->m_attrs_index.clear ();
+    } else {
+        std::vector <ucs4_t> ().swap (m_impl->m_buffer);
+        std::vector <uint32> ().swap (m_impl->m_index);
+
+        AttributeList ().swap (m_impl->m_attributes);
+        std::vector <uint32> ().swap (m_impl->m_attrs_index);
+    }
+}
+
+//implementation of LookupTableSource
+LookupTableSource::~LookupTableSource ()
+{
+}
+
+bool
+LookupTableSource::is_number_exact () const
+{
+    return true;
+}
+
+//implementation of LazyLookupTable
+class LazyLookupTable::LazyLookupTableImpl
+{
+public:
+    LookupTableSourcePointer     m_source;
+
+    // The candidates fetched from the source, starting at m_window_start.
+    uint32                       m_window_start;
+    std::vector <WideString>     m_cands;
+    std::vector <AttributeList>  m_attrs;
+
+    // All candidates before m_fetched_end are known to exist.
+    uint32                       m_fetched_end;
+
+    // Set when the source has run out of candidates, then m_exact_number
+    // is the real number of candidates.
+    bool                         m_exhausted;
+    uint32                       m_exact_number;
+
+    LazyLookupTableImpl () {
+        reset ();
+    }
+
+    void reset () {
+        m_window_start = 0;
+        m_cands.clear ();
+        m_attrs.clear ();
+        m_fetched_end = 0;
+        m_exhausted = false;
+        m_exact_number = 0;
+    }
+
+    bool in_window (uint32 index) const {
+        return index >= m_window_start && index < m_window_start + m_cands.size ();
+    }
 
-    AttributeList ().swap (m_impl->m_attributes);
-    std::vector <uint32> ().swap (m_impl->m_attrs_index);
+    void fetch (uint32 start, uint32 count) {
+        m_window_start = start;
+        m_cands.clear ();
+        m_attrs.clear ();
+
+        if (m_source.null ())
+            return;
+
+        uint32 num = m_source->get_candidates (start, count, m_cands, m_attrs);
+
+        if (num > m_cands.size ())
+            num = m_cands.size ();
+
+        m_cands.resize (num);
+        m_attrs.resize (num);
+
+        // A short result is only trustworthy if the range is contiguous
+        // with the candidates known to exist.
+        if (num < count && start <= m_fetched_end) {
+            m_exhausted = true;
+            m_exact_number = start + num;
+        }
+
+        if (start + num > m_fetched_end)
+            m_fetched_end = start + num;
+
+        SCIM_DEBUG_MAIN (3) << "LazyLookupTable: fetched " << num << " candidates from " << start << "\n";
+    }
+
+    // Make sure the candidate at index is in the window.
+    bool load (int index, uint32 page_start, uint32 page_size) {
+        if (index < 0 || m_source.null ())
+            return false;
+
+        if (m_exhausted && (uint32) index >= m_exact_number)
+            return false;
+
+        if (in_window (index))
+            return true;
+
+        // Fetch the current page and the next one if possible,
+        // otherwise start from the requested candidate.
+        if ((uint32) index < page_start || (uint32) index >= page_start + page_size * 2)
+            page_start = index;
+
+        fetch (page_start, page_size * 2);
+
+        return in_window (index);
+    }
+};
+
+LazyLookupTable::LazyLookupTable (int page_size)
+    : LookupTable (page_size), m_impl (new LazyLookupTableImpl ())
+{
+    set_candidate_labels (__default_candidate_labels ());
+}
+
+LazyLookupTable::LazyLookupTable (int                            page_size,
+                                  const std::vector<WideString> &labels)
+    : LookupTable (page_size), m_impl (new LazyLookupTableImpl ())
+{
+    set_candidate_labels (labels);
+}
+
+LazyLookupTable::~LazyLookupTable ()
+{
+    delete m_impl;
+}
+
+uint32
+LazyLookupTable::number_of_candidates () const
+{
+    if (m_impl->m_source.null ())
+        return 0;
+
+    if (m_impl->m_source->is_number_exact ())
+        return m_impl->m_source->number_of_candidates ();
+
+    // Look one page ahead, so that page_down () and cursor_down ()
+    // won't move into an empty page if the estimation is too large.
+    if (!m_impl->m_exhausted) {
+        uint32 start = get_current_page_start ();
+        uint32 page_size = get_page_size ();
+
+        if (m_impl->m_fetched_end <= start + page_size &&
+            !(m_impl->m_window_start == start && m_impl->m_cands.size () >= page_size * 2))
+            m_impl->fetch (start, page_size * 2);
+    }
+
+    if (m_impl->m_exhausted)
+        return m_impl->m_exact_number;
+
+    return std::max (m_impl->m_source->number_of_candidates (), m_impl->m_fetched_end);
+}
+
+WideString
+LazyLookupTable::get_candidate (int index) const
+{
+    if (m_impl->load (index, get_current_page_start (), get_page_size ()))
+        return m_impl->m_cands [index - m_impl->m_window_start];
+
+    return WideString ();
+}
+
+AttributeList
+LazyLookupTable::get_attributes (int index) const
+{
+    if (m_impl->load (index, get_current_page_start (), get_page_size ()))
+        return m_impl->m_attrs [index - m_impl->m_window_start];
+
+    return AttributeList ();
+}
+
+void
+LazyLookupTable::clear ()
+{
+    LookupTable::clear ();
+
+    m_impl->m_source.reset ();
+    m_impl->reset ();
+}
+
+void
+LazyLookupTable::set_source (const LookupTableSourcePointer &source)
+{
+    LookupTable::clear ();
+
+    m_impl->m_source = source;
+    m_impl->reset ();
+}
+
+LookupTableSourcePointer
+LazyLookupTable::get_source () const
+{
+    return m_impl->m_source;
 }
 
 } // namespace scim
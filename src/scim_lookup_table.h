@@ -299,6 +299,166 @@ public:
      */
     bool append_candidate (ucs4_t               cand,
                            const AttributeList &attrs = AttributeList ());
+
+    /**
+     * @brief Append many candidate strings into the table at once.
+     *
+     * The internal buffers are enlarged only once for all candidates.
+     *
+     * @param cands - the candidate strings to be added, empty ones are ignored.
+     * @param attrs - the attributes of the candidates, it can be empty, or
+     *                has the same size as cands.
+     *
+     * @return the number of candidates added.
+     */
+    uint32 append_candidates (const std::vector<WideString>    &cands,
+                              const std::vector<AttributeList> &attrs = std::vector<AttributeList> ());
+
+    /**
+     * @brief Reserve the space of the internal buffers.
+     *
+     * It's only a hint to avoid reallocating the buffers while appending
+     * a large number of candidates.
+     *
+     * @param candidates - the expected number of candidates.
+     * @param chars      - the expected number of chars of all candidates.
+     */
+    void reserve (uint32 candidates, uint32 chars = 0);
+
+    /**
+     * @brief Get a candidate without copying it.
+     *
+     * @param index  - the index of the candidate in the whole table.
+     * @param length - to hold the number of chars of the candidate.
+     *
+     * @return the chars of the candidate in the internal buffer, which is
+     *         valid until the table is changed; 0 if index is invalid.
+     */
+    const ucs4_t * get_candidate_buffer (int index, uint32 &length) const;
+
+    /**
+     * @brief Get the attributes of a candidate without copying them.
+     *
+     * @param index - the index of the candidate in the whole table.
+     * @param count - to hold the number of attributes.
+     *
+     * @return the attributes of the candidate in the internal buffer, which is
+     *         valid until the table is changed; 0 if there is no attribute.
+     */
+    const Attribute * get_attributes_buffer (int index, uint32 &count) const;
+};
+
+class LookupTableSource;
+/**
+ * @typedef typedef Pointer <LookupTableSource> LookupTableSourcePointer;
+ *
+ * A smart pointer for scim::LookupTableSource and its derived classes.
+ */
+typedef Pointer <LookupTableSource> LookupTableSourcePointer;
+
+/**
+ * @brief The interface to produce candidates on demand for LazyLookupTable.
+ *
+ * An IMEngine with a large number of candidates, eg. all phrases in a
+ * dictionary matching a short prefix, can implement this interface instead
+ * of appending every candidate into a CommonLookupTable, then only the
+ * candidates in the visible page will be produced.
+ */
+class LookupTableSource : public ReferencedObject
+{
+public:
+    virtual ~LookupTableSource ();
+
+    /**
+     * @brief Get the number of candidates.
+     *
+     * If is_number_exact () returns false, the returned value is only an
+     * estimation, the real number will be found by LazyLookupTable
+     * when get_candidates () returns less candidates than requested.
+     */
+    virtual uint32 number_of_candidates () const = 0;
+
+    /**
+     * @brief Tell whether the value returned by number_of_candidates () is exact.
+     *
+     * The default implementation returns true.
+     */
+    virtual bool is_number_exact () const;
+
+    /**
+     * @brief Produce a range of candidates.
+     *
+     * The candidates must be returned in the same order for the same start index,
+     * empty candidates are not allowed.
+     *
+     * @param start - the index of the first candidate to be produced.
+     * @param count - the number of candidates to be produced.
+     * @param cands - to hold the candidate strings, which is empty when called.
+     * @param attrs - to hold the attributes of the candidates, which is empty when called.
+     *                It can be left empty if there is no attribute.
+     *
+     * @return the number of candidates produced, less than count means
+     *         there is no more candidate.
+     */
+    virtual uint32 get_candidates (uint32                      start,
+                                   uint32                      count,
+                                   std::vector<WideString>    &cands,
+                                   std::vector<AttributeList> &attrs) = 0;
+};
+
+/**
+ * @brief A lookup table class whose candidates are produced on demand.
+ *
+ * Only the candidates around the current page are requested from the
+ * LookupTableSource, so the cost of each update is proportional to the
+ * page size rather than the number of candidates.
+ */
+class LazyLookupTable : public LookupTable
+{
+    class LazyLookupTableImpl;
+
+    LazyLookupTableImpl *m_impl;
+
+    LazyLookupTable (const LazyLookupTable &);
+    const LazyLookupTable & operator= (const LazyLookupTable &);
+
+public:
+    LazyLookupTable (int page_size = 10);
+
+    /**
+     * @brief Constructor
+     *
+     * @param page_size - the maximum page size, can be set by set_page_size () later.
+     * @param labels - the strings to label the candidates in one page.
+     */
+    LazyLookupTable (int                            page_size,
+                     const std::vector<WideString> &labels);
+
+    ~LazyLookupTable ();
+
+    virtual WideString get_candidate (int index) const;
+
+    virtual AttributeList get_attributes (int index) const;
+
+    virtual uint32 number_of_candidates () const;
+
+    virtual void clear ();
+
+public:
+    /**
+     * @brief Set the source of the candidates.
+     *
+     * The table will be reset to the first page, and the candidates
+     * cached from the old source will be discarded.
+     *
+     * @param source - the new source, it can be null to empty the table.
+     */
+    void set_source (const LookupTableSourcePointer &source);
+
+    /**
+     * @brief Get the source of the candidates.
+     */
+    LookupTableSourcePointer get_source () const;
 };
 
 /** @} */
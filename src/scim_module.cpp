@@ -31,6 +31,7 @@ extern "C" {
   #include <ltdl.h>
 }
 #include <dirent.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -56,6 +57,33 @@ struct Module::ModuleImpl
 
 static std::vector <ModuleInitFunc> _scim_modules;
 
+// libltdl and the list of loaded modules are not thread safe, and a module
+// may load other modules in its init function, so a recursive lock is used.
+static pthread_mutex_t _scim_modules_lock;
+static pthread_once_t  _scim_modules_lock_once = PTHREAD_ONCE_INIT;
+
+static void
+_scim_modules_lock_init ()
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init (&attr);
+    pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init (&_scim_modules_lock, &attr);
+    pthread_mutexattr_destroy (&attr);
+}
+
+class ModuleLock
+{
+public:
+    ModuleLock () {
+        pthread_once (&_scim_modules_lock_once, _scim_modules_lock_init);
+        pthread_mutex_lock (&_scim_modules_lock);
+    }
+    ~ModuleLock () {
+        pthread_mutex_unlock (&_scim_modules_lock);
+    }
+};
+
 static void
 _scim_get_module_paths (std::vector <String> &paths, const String &type)
 {
@@ -101,10 +129,19 @@ scim_get_module_list (std::vector <String>& mod_list, const String& type)
         if (dir) {
             struct dirent *file = readdir (dir);
             while (file) {
-                struct stat filestat;
-                String absfn = *i + String (SCIM_PATH_DELIM_STRING) + file->d_name;
-                stat (absfn.c_str (), &filestat);
-                if (S_ISREG (filestat.st_mode)) {
+                bool is_reg = false;
+#if defined (_DIRENT_HAVE_D_TYPE)
+                // Avoid a stat () for each file if the file system reports the type.
+                if (file->d_type != DT_UNKNOWN && file->d_type != DT_LNK)
+                    is_reg = (file->d_type == DT_REG);
+                else
+#endif
+                {
+                    struct stat filestat;
+                    String absfn = *i + String (SCIM_PATH_DELIM_STRING) + file->d_name;
+                    is_reg = (stat (absfn.c_str (), &filestat) == 0 && S_ISREG (filestat.st_mode));
+                }
+                if (is_reg) {
                     std::vector<String> vec;
                     scim_split_string_list (vec, String (file->d_name), '.');
                     mod_list.push_back (vec [0]);
@@ -119,6 +156,30 @@ scim_get_module_list (std::vector <String>& mod_list, const String& type)
     return mod_list.size ();
 }
 
+String
+scim_get_module_stamp (const String &name, const String &type)
+{
+    static const char *suffixes [] = { ".la", ".so", 0 };
+
+    std::vector<String> paths;
+    _scim_get_module_paths (paths, type);
+
+    String stamp;
+
+    for (std::vector<String>::iterator i = paths.begin (); i != paths.end () && !stamp.length (); ++i) {
+        for (const char **suffix = suffixes; *suffix; ++suffix) {
+            struct stat filestat;
+            String absfn = *i + String (SCIM_PATH_DELIM_STRING) + name + String (*suffix);
+            if (stat (absfn.c_str (), &filestat) == 0 && S_ISREG (filestat.st_mode)) {
+                char buf [64];
+                snprintf (buf, 64, ":%lu:%lu;", (unsigned long) filestat.st_size, (unsigned long) filestat.st_mtime);
+                stamp += absfn + String (buf);
+            }
+        }
+    }
+    return stamp;
+}
+
 Module::Module ()
     : m_impl (new ModuleImpl)
 {
@@ -134,6 +195,8 @@ Module::Module (const String &name, const String &type)
 
 void Module::init ()
 {
+    ModuleLock lock;
+
     lt_dlinit ();
 #if SCIM_LTDLADVISE
     lt_dladvise_init (&(m_impl->advise));
@@ -144,6 +207,8 @@ void Module::init ()
 
 Module::~Module ()
 {
+    ModuleLock lock;
+
     unload ();
 #if SCIM_LTDLADVISE
     lt_dladvise_destroy (&(m_impl->advise));
@@ -167,6 +232,8 @@ _concatenate_ltdl_prefix (const String &name, const String &symbol)
 bool
 Module::load (const String &name, const String &type)
 {
+    ModuleLock lock;
+
     // If cannot unload original module (it's resident), then return false.
     if (is_resident ())
         return false;
@@ -281,6 +348,8 @@ Module::load (const String &name, const String &type)
 bool
 Module::unload ()
 {
+    ModuleLock lock;
+
     if (!m_impl->handle)
         return true;
 
@@ -341,6 +410,8 @@ Module::get_path () const
 void *
 Module::symbol (const String & sym) const
 {
+    ModuleLock lock;
+
     void * func = 0;
 
     if (m_impl->handle) {
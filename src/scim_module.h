@@ -73,6 +73,20 @@ protected:
 
 int scim_get_module_list (std::vector <String>& mod_list, const String& type = "");
 
+/**
+ * @brief Get a stamp of the files of a module, without loading it.
+ *
+ * The stamp contains the path, size and modification time of the
+ * module's .la and .so files found in the first matching module directory,
+ * so it changes whenever the module is reinstalled. The data files used by
+ * the module are not covered.
+ *
+ * @param name the name of the module.
+ * @param type the type of the module, eg. "IMEngine".
+ * @return the stamp, or an empty string if the module is not found.
+ */
+String scim_get_module_stamp (const String &name, const String &type = "");
+
 /** @} */
 
 } // namespace scim
@@ -57,16 +57,18 @@ ReferencedObject::is_referenced() const
     return m_referenced;
 }
 
+// The reference count is updated atomically, so that the objects like
+// ConfigPointer can be shared by the threads which load modules in parallel.
 void
 ReferencedObject::ref()
 {
-    ++m_ref_count;
+    __sync_add_and_fetch (&m_ref_count, 1);
 }
 
 void
 ReferencedObject::unref()
 {
-    if (--m_ref_count == 0)
+    if (__sync_sub_and_fetch (&m_ref_count, 1) == 0)
         delete this;
 }
 
@@ -33,9 +33,12 @@
 #define Uses_SCIM_HELPER
 #define Uses_SCIM_SOCKET
 #define Uses_SCIM_EVENT
+#define Uses_STL_MAP
 
 #define SCIM_KEYBOARD_ICON_FILE            (SCIM_ICONDIR "/keyboard.png")
 
+#include <sys/time.h>
+#include <assert.h>
 #include "scim_private.h"
 #include "scim.h"
 #include "scim_stl_map.h"
@@ -119,6 +122,7 @@ typedef std::map <int, ClientInfo>                                          Clie
 typedef std::map <int, HelperInfo>                                          HelperInfoRepository;
 typedef std::map <uint32, String>                                           ClientContextUUIDRepository;
 typedef std::map <String, HelperClientStub>                                 HelperClientIndex;
+typedef std::map <int, LookupTableCache>                                    LookupTableCacheRepository;
 typedef std::map <String, std::vector < std::pair <uint32, String> > >                                StartHelperICIndex;
 #endif
 
@@ -135,6 +139,92 @@ get_imengine_client_context (uint32 helper_ic, int &client, uint32 &context)
     context  = ((helper_ic >> 16) & 0x7FFF);
 }
 
+static uint64
+get_time_usecs ()
+{
+    struct timeval tv;
+    gettimeofday (&tv, 0);
+    return ((uint64) tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+typedef std::map <int, std::pair <uint32, uint64> > CommandStatisticsMap;
+
+/**
+ * A dense dispatch table of the commands sent by one type of clients,
+ * indexed by command, which also keeps the statistics of the commands.
+ */
+template <typename Handler>
+class PanelCommandTable
+{
+public:
+    struct Command {
+        int     cmd;
+        Handler handler;
+
+        /**
+         * The command a panel controller client is waiting for
+         * after sending this command, or 0.
+         */
+        int     awaited;
+    };
+
+private:
+    enum { TABLE_SIZE = 1024 };
+
+    std::vector <Command> m_commands;
+    std::vector <uint32>  m_calls;
+    std::vector <uint64>  m_usecs;
+
+    // The slot of each command in m_commands plus one, or zero.
+    unsigned char         m_slots [TABLE_SIZE];
+
+public:
+    PanelCommandTable () {
+        for (size_t i = 0; i < TABLE_SIZE; ++i)
+            m_slots [i] = 0;
+    }
+
+    void assign (const Command *begin, const Command *end) {
+        m_commands.assign (begin, end);
+        m_calls.assign (m_commands.size (), 0);
+        m_usecs.assign (m_commands.size (), 0);
+
+        // Enlarge TABLE_SIZE if this fails, out of range
+        // commands are never dispatched.
+        assert (m_commands.size () <= 255);
+
+        for (size_t i = 0; i < m_commands.size () && i < 255; ++i) {
+            int cmd = m_commands [i].cmd;
+
+            assert (cmd > 0 && cmd < TABLE_SIZE);
+
+            if (cmd > 0 && cmd < TABLE_SIZE)
+                m_slots [cmd] = (unsigned char) (i + 1);
+        }
+    }
+
+    const Command * find (int cmd) const {
+        if (cmd <= 0 || cmd >= TABLE_SIZE || !m_slots [cmd])
+            return 0;
+        return &m_commands [m_slots [cmd] - 1];
+    }
+
+    void record (const Command *command, uint64 begin) {
+        size_t slot = command - &m_commands [0];
+        m_calls [slot] ++;
+        m_usecs [slot] += get_time_usecs () - begin;
+    }
+
+    void collect_statistics (CommandStatisticsMap &stats) const {
+        for (size_t i = 0; i < m_commands.size (); ++i) {
+            if (!m_calls [i]) continue;
+            std::pair <uint32, uint64> &stat = stats [m_commands [i].cmd];
+            stat.first  += m_calls [i];
+            stat.second += m_usecs [i];
+        }
+    }
+};
+
 //==================================== PanelAgent ===========================
 class PanelAgent::PanelAgentImpl
 {
@@ -169,6 +259,12 @@ class PanelAgent::PanelAgentImpl
     StartHelperICIndex                  m_start_helper_ic_index;
 
     ClientContextUUIDRepository         m_client_context_uuids;
+
+    // The lookup tables last received from the FrontEnd clients,
+    // which negotiated SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA.
+    LookupTableCacheRepository          m_lookup_table_caches;
+    LookupTableCache                   *m_recv_lookup_table_cache;
+    bool                                m_recv_lookup_table_cache_lost;
     
     PanelFactoryInfo 					m_currentFactoryInfo;
     PanelFactoryInfo 					m_defaultFactoryInfo;
@@ -206,20 +302,36 @@ class PanelAgent::PanelAgentImpl
     PanelAgentSignalVoid                m_signal_lock;
     PanelAgentSignalVoid                m_signal_unlock;
 
+    typedef void (PanelAgentImpl::*FrontEndCommandHandler) (void);
+    typedef void (PanelAgentImpl::*ClientCommandHandler)   (int client_id);
+
+    typedef PanelCommandTable <FrontEndCommandHandler>  FrontEndCommandTable;
+    typedef PanelCommandTable <ClientCommandHandler>    ClientCommandTable;
+
+    // Commands sent by the focused FrontEnd clients.
+    FrontEndCommandTable                m_frontend_commands;
+    ClientCommandTable                  m_helper_commands;
+    ClientCommandTable                  m_panelcontrol_commands;
+
 public:
     PanelAgentImpl ()
         : m_should_exit (false),
           m_should_resident (false),
           m_current_screen (0),
           m_socket_timeout (scim_get_default_socket_timeout ()),
+          m_socket_server (-1, SCIM_SOCKET_SERVER_AUTO),
           m_current_socket_client (-1), m_current_client_context (0),
           m_last_socket_client (-1), m_last_client_context (0),
+          m_recv_lookup_table_cache (0),
+          m_recv_lookup_table_cache_lost (false),
           m_defaultFactoryInfo (PanelFactoryInfo (String (""), String (_("English/Keyboard")), String ("C"), String (SCIM_KEYBOARD_ICON_FILE))),
           m_currentFactoryInfo (PanelFactoryInfo (String (""), String (_("English/Keyboard")), String ("C"), String (SCIM_KEYBOARD_ICON_FILE)))
     {
         m_socket_server.signal_connect_accept (slot (this, &PanelAgentImpl::socket_accept_callback));
         m_socket_server.signal_connect_receive (slot (this, &PanelAgentImpl::socket_receive_callback));
         m_socket_server.signal_connect_exception (slot (this, &PanelAgentImpl::socket_exception_callback));
+
+        init_commands ();
     }
 
     bool initialize (const String &config, const String &display, bool resident)
@@ -825,6 +937,9 @@ private:
             return;
  
         if (client_info.type == FRONTEND_CLIENT) {
+            LookupTableCacheRepository::iterator cache_it = m_lookup_table_caches.find (client_id);
+            m_recv_lookup_table_cache = (cache_it != m_lookup_table_caches.end ()) ? &cache_it->second : 0;
+
             if (m_recv_trans.get_data (context)) {
                 SCIM_DEBUG_MAIN (1) << "PanelAgent::FrontEnd Client, context = " << context << "\n";
                 socket_transaction_start();
@@ -885,7 +1000,7 @@ private:
                     if (!uuid.length ()) {
                         SCIM_DEBUG_MAIN (3) << "PanelAgent:: Couldn't find context uuid.\n";
                         while (m_recv_trans.get_data_type () != SCIM_TRANS_DATA_COMMAND && m_recv_trans.get_data_type () != SCIM_TRANS_DATA_UNKNOWN)
-                            m_recv_trans.skip_data ();
+                            socket_skip_data ();
                         continue;
                     }
 
@@ -909,85 +1024,41 @@ private:
                     if ((!current && !last) || (last && m_current_socket_client >= 0)) {
                         SCIM_DEBUG_MAIN (3) << "PanelAgent::Not current focused.\n";
                         while (m_recv_trans.get_data_type () != SCIM_TRANS_DATA_COMMAND && m_recv_trans.get_data_type () != SCIM_TRANS_DATA_UNKNOWN)
-                            m_recv_trans.skip_data ();
+                            socket_skip_data ();
                         continue;
                     }
  
                     // Client must focus in before do any other things.
-                    if (cmd == SCIM_TRANS_CMD_PANEL_TURN_ON)
-                        socket_turn_on ();
-                    else if (cmd == SCIM_TRANS_CMD_PANEL_TURN_OFF)
-                        socket_turn_off ();
-                    else if (cmd == SCIM_TRANS_CMD_UPDATE_SCREEN)
-                        socket_update_screen ();
-                    else if (cmd == SCIM_TRANS_CMD_UPDATE_SPOT_LOCATION)
-                        socket_update_spot_location ();
-                    else if (cmd == SCIM_TRANS_CMD_PANEL_UPDATE_FACTORY_INFO)
-                        socket_update_factory_info ();
-                    else if (cmd == SCIM_TRANS_CMD_SHOW_PREEDIT_STRING)
-                        socket_show_preedit_string ();
-                    else if (cmd == SCIM_TRANS_CMD_SHOW_AUX_STRING)
-                        socket_show_aux_string ();
-                    else if (cmd == SCIM_TRANS_CMD_SHOW_LOOKUP_TABLE)
-                        socket_show_lookup_table ();
-                    else if (cmd == SCIM_TRANS_CMD_HIDE_PREEDIT_STRING)
-                        socket_hide_preedit_string ();
-                    else if (cmd == SCIM_TRANS_CMD_HIDE_AUX_STRING)
-                        socket_hide_aux_string ();
-                    else if (cmd == SCIM_TRANS_CMD_HIDE_LOOKUP_TABLE)
-                        socket_hide_lookup_table ();
-                    else if (cmd == SCIM_TRANS_CMD_UPDATE_PREEDIT_STRING)
-                        socket_update_preedit_string ();
-                    else if (cmd == SCIM_TRANS_CMD_UPDATE_PREEDIT_CARET)
-                        socket_update_preedit_caret ();
-                    else if (cmd == SCIM_TRANS_CMD_UPDATE_AUX_STRING)
-                        socket_update_aux_string ();
-                    else if (cmd == SCIM_TRANS_CMD_UPDATE_LOOKUP_TABLE)
-                        socket_update_lookup_table ();
-                    else if (cmd == SCIM_TRANS_CMD_REGISTER_PROPERTIES)
-                        socket_register_properties ();
-                    else if (cmd == SCIM_TRANS_CMD_UPDATE_PROPERTY)
-                        socket_update_property ();
-                    else if (cmd == SCIM_TRANS_CMD_PANEL_SHOW_HELP)
-                        socket_show_help ();
-                    else if (cmd == SCIM_TRANS_CMD_FOCUS_OUT) {
-                        SCIM_DEBUG_MAIN (2) << "PanelAgent::focus_out (" << client_id << "," << "," << context << ")\n";
-                        lock ();
-                        if (m_current_socket_client >= 0) {
-                            m_last_socket_client  = m_current_socket_client;
-                            m_last_client_context = m_current_client_context;
-                            m_last_context_uuid   = m_current_context_uuid;
-                        }
-                        m_current_socket_client  = -1;
-                        m_current_client_context = 0;
-                        m_current_context_uuid   = String ("");
-                        unlock ();
-                        socket_turn_off ();
+                    const FrontEndCommandTable::Command *command = m_frontend_commands.find (cmd);
+
+                    if (command) {
+                        uint64 begin = get_time_usecs ();
+                        (this->*command->handler) ();
+                        m_frontend_commands.record (command, begin);
                     }
                 }
                 socket_transaction_end();
             }
+
+            // Let the client send the next lookup table as a whole.
+            if (m_recv_lookup_table_cache_lost) {
+                Transaction trans;
+                trans.put_command (SCIM_TRANS_CMD_REPLY);
+                trans.put_command (SCIM_TRANS_CMD_RESET_LOOKUP_TABLE_CACHE);
+                trans.write_to_socket (client);
+            }
+
+            m_recv_lookup_table_cache = 0;
+            m_recv_lookup_table_cache_lost = false;
         } else if (client_info.type == HELPER_CLIENT) {
             socket_transaction_start();
             while (m_recv_trans.get_command (cmd)) {
-                if (cmd == SCIM_TRANS_CMD_PANEL_REGISTER_HELPER) {    
-                    socket_helper_register_helper (client_id);
-                } else if (cmd == SCIM_TRANS_CMD_COMMIT_STRING) {
-                    socket_helper_commit_string (client_id);
-                } else if (cmd == SCIM_TRANS_CMD_PROCESS_KEY_EVENT ||
-                           cmd == SCIM_TRANS_CMD_PANEL_SEND_KEY_EVENT) {
-                    socket_helper_send_key_event (client_id);
-                } else if (cmd == SCIM_TRANS_CMD_FORWARD_KEY_EVENT) {
-                    socket_helper_forward_key_event (client_id);
-                } else if (cmd == SCIM_TRANS_CMD_PANEL_SEND_IMENGINE_EVENT) {
-                    socket_helper_send_imengine_event (client_id);
-                } else if (cmd == SCIM_TRANS_CMD_REGISTER_PROPERTIES) {
-                    socket_helper_register_properties (client_id);
-                } else if (cmd == SCIM_TRANS_CMD_UPDATE_PROPERTY) {
-                    socket_helper_update_property (client_id);
-                } else if (cmd == SCIM_TRANS_CMD_RELOAD_CONFIG) {
-                    reload_config ();
-                    m_signal_reload_config ();
+                const ClientCommandTable::Command *command = m_helper_commands.find (cmd);
+
+                if (command) {
+                    uint64 begin = get_time_usecs ();
+                    (this->*command->handler) (client_id);
+                    m_helper_commands.record (command, begin);
                 }
             }
             socket_transaction_end();
@@ -1000,21 +1071,15 @@ private:
 				if(previous_command_is_outstanding_for_client(client_id))
                 		return; //if the response to a previous command is outstanding we ignore the current command 
 					
-                if (cmd == SCIM_TRANS_CMD_CONTROLLER_REQUEST_FACTORY_MENU) {
-                	register_awaited_command_for_client(client_id, SCIM_TRANS_CMD_PANEL_SHOW_FACTORY_MENU);
-                    socket_panelcontroller_request_factory_menu ();
-                }
-                if (cmd == SCIM_TRANS_CMD_CONTROLLER_CHANGE_FACTORY) {
-                	register_awaited_command_for_client(client_id, SCIM_TRANS_CMD_PANEL_UPDATE_FACTORY_INFO);
-                    socket_panelcontroller_change_factory ();
-                }
-                if (cmd == SCIM_TRANS_CMD_CONTROLLER_GET_CURRENT_FACTORY) {
-                	register_awaited_command_for_client(client_id, SCIM_TRANS_CMD_PANEL_RETURN_CURRENT_FACTORY_INFO);
-                    socket_panelcontroller_get_current_factory (client_id);
-                }
-                if (cmd == SCIM_TRANS_CMD_CONTROLLER_GET_CURRENT_CONTEXT) {
-					register_awaited_command_for_client(client_id, SCIM_TRANS_CMD_PANEL_RETURN_CURRENT_CONTEXT);
-                    socket_panelcontroller_get_current_frontend_client_and_context (client_id);
+                const ClientCommandTable::Command *command = m_panelcontrol_commands.find (cmd);
+
+                if (command) {
+                    if (command->awaited)
+                        register_awaited_command_for_client (client_id, command->awaited);
+
+                    uint64 begin = get_time_usecs ();
+                    (this->*command->handler) (client_id);
+                    m_panelcontrol_commands.record (command, begin);
                 }
             }
             socket_transaction_end();
@@ -1042,13 +1107,13 @@ private:
         inform_waiting_client_of_current_context(client_id);
     }
 	
-	void socket_panelcontroller_request_factory_menu()
+	void socket_panelcontroller_request_factory_menu(int /*client_id*/)
 	{
 		SCIM_DEBUG_MAIN (2) << "PanelAgent::socket_panelcontroller_request_factory_menu ()\n";
         request_factory_menu();
 	}
 	
-	void socket_panelcontroller_change_factory ()
+	void socket_panelcontroller_change_factory (int /*client_id*/)
 	{
 		String requested_uuid;
 		m_recv_trans.get_data(requested_uuid);
@@ -1056,6 +1121,33 @@ private:
 		change_factory(requested_uuid);
 	}
 	
+	void socket_panelcontroller_get_command_statistics (int client_id)
+	{
+		SCIM_DEBUG_MAIN (2) << "PanelAgent::socket_panelcontroller_get_command_statistics ()\n";
+
+		CommandStatisticsMap stats;
+		std::vector <uint32> data;
+
+		m_frontend_commands.collect_statistics (stats);
+		m_helper_commands.collect_statistics (stats);
+		m_panelcontrol_commands.collect_statistics (stats);
+
+		for (CommandStatisticsMap::iterator it = stats.begin (); it != stats.end (); ++it) {
+			data.push_back ((uint32) it->first);
+			data.push_back (it->second.first);
+			data.push_back ((uint32) (it->second.second >> 32));
+			data.push_back ((uint32) (it->second.second & 0xFFFFFFFF));
+		}
+
+		Socket client_socket (client_id);
+
+		m_send_trans.clear ();
+		m_send_trans.put_command (SCIM_TRANS_CMD_REPLY);
+		m_send_trans.put_data (data);
+		m_send_trans.put_command (SCIM_TRANS_CMD_OK);
+		m_send_trans.write_to_socket (client_socket);
+	}
+
 	void socket_panelcontroller_get_current_factory	(int client_id)
 	{
 		SCIM_DEBUG_MAIN (2) << "PanelAgent::socket_panelcontroller_get_current_factory ()\n";
@@ -1080,7 +1172,8 @@ private:
                                                      String ("Panel"),
                                                      String ("FrontEnd,Helper,PanelController"),
                                                      client,
-                                                     m_socket_timeout);
+                                                     m_socket_timeout,
+                                                     SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA);
 
         if (type.length ()) {
             ClientInfo info;
@@ -1093,6 +1186,10 @@ private:
             lock ();
             m_client_repository [client.get_id ()] = info;
             unlock ();
+
+            if (info.type == FRONTEND_CLIENT &&
+                (client.get_protocol_options () & SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA))
+                m_lookup_table_caches [client.get_id ()].clear ();
             return true;
         }
 
@@ -1113,6 +1210,8 @@ private:
         m_client_repository.erase (client.get_id ());
  
         server->close_connection (client);
+
+        m_lookup_table_caches.erase (client.get_id ());
  
         // Exit panel if there is no connected client anymore.
         if (client_info.type != UNKNOWN_CLIENT && m_client_repository.size () == 0 && !m_should_resident) {
@@ -1205,6 +1304,63 @@ private:
     }
 
 private:
+    void init_commands                          (void)
+    {
+        static const FrontEndCommandTable::Command frontend_commands [] = {
+            { SCIM_TRANS_CMD_PANEL_TURN_ON,             &PanelAgentImpl::socket_turn_on,                0 },
+            { SCIM_TRANS_CMD_PANEL_TURN_OFF,            &PanelAgentImpl::socket_turn_off,               0 },
+            { SCIM_TRANS_CMD_UPDATE_SCREEN,             &PanelAgentImpl::socket_update_screen,          0 },
+            { SCIM_TRANS_CMD_UPDATE_SPOT_LOCATION,      &PanelAgentImpl::socket_update_spot_location,   0 },
+            { SCIM_TRANS_CMD_PANEL_UPDATE_FACTORY_INFO, &PanelAgentImpl::socket_update_factory_info,    0 },
+            { SCIM_TRANS_CMD_SHOW_PREEDIT_STRING,       &PanelAgentImpl::socket_show_preedit_string,    0 },
+            { SCIM_TRANS_CMD_SHOW_AUX_STRING,           &PanelAgentImpl::socket_show_aux_string,        0 },
+            { SCIM_TRANS_CMD_SHOW_LOOKUP_TABLE,         &PanelAgentImpl::socket_show_lookup_table,      0 },
+            { SCIM_TRANS_CMD_HIDE_PREEDIT_STRING,       &PanelAgentImpl::socket_hide_preedit_string,    0 },
+            { SCIM_TRANS_CMD_HIDE_AUX_STRING,           &PanelAgentImpl::socket_hide_aux_string,        0 },
+            { SCIM_TRANS_CMD_HIDE_LOOKUP_TABLE,         &PanelAgentImpl::socket_hide_lookup_table,      0 },
+            { SCIM_TRANS_CMD_UPDATE_PREEDIT_STRING,     &PanelAgentImpl::socket_update_preedit_string,  0 },
+            { SCIM_TRANS_CMD_UPDATE_PREEDIT_CARET,      &PanelAgentImpl::socket_update_preedit_caret,   0 },
+            { SCIM_TRANS_CMD_UPDATE_AUX_STRING,         &PanelAgentImpl::socket_update_aux_string,      0 },
+            { SCIM_TRANS_CMD_UPDATE_LOOKUP_TABLE,       &PanelAgentImpl::socket_update_lookup_table,    0 },
+            { SCIM_TRANS_CMD_REGISTER_PROPERTIES,       &PanelAgentImpl::socket_register_properties,    0 },
+            { SCIM_TRANS_CMD_UPDATE_PROPERTY,           &PanelAgentImpl::socket_update_property,        0 },
+            { SCIM_TRANS_CMD_PANEL_SHOW_HELP,           &PanelAgentImpl::socket_show_help,              0 },
+            { SCIM_TRANS_CMD_FOCUS_OUT,                 &PanelAgentImpl::socket_focus_out,              0 }
+        };
+
+        static const ClientCommandTable::Command helper_commands [] = {
+            { SCIM_TRANS_CMD_PANEL_REGISTER_HELPER,     &PanelAgentImpl::socket_helper_register_helper,     0 },
+            { SCIM_TRANS_CMD_COMMIT_STRING,             &PanelAgentImpl::socket_helper_commit_string,       0 },
+            { SCIM_TRANS_CMD_PROCESS_KEY_EVENT,         &PanelAgentImpl::socket_helper_send_key_event,      0 },
+            { SCIM_TRANS_CMD_PANEL_SEND_KEY_EVENT,      &PanelAgentImpl::socket_helper_send_key_event,      0 },
+            { SCIM_TRANS_CMD_FORWARD_KEY_EVENT,         &PanelAgentImpl::socket_helper_forward_key_event,   0 },
+            { SCIM_TRANS_CMD_PANEL_SEND_IMENGINE_EVENT, &PanelAgentImpl::socket_helper_send_imengine_event, 0 },
+            { SCIM_TRANS_CMD_REGISTER_PROPERTIES,       &PanelAgentImpl::socket_helper_register_properties, 0 },
+            { SCIM_TRANS_CMD_UPDATE_PROPERTY,           &PanelAgentImpl::socket_helper_update_property,     0 },
+            { SCIM_TRANS_CMD_RELOAD_CONFIG,             &PanelAgentImpl::socket_helper_reload_config,       0 }
+        };
+
+        static const ClientCommandTable::Command panelcontrol_commands [] = {
+            { SCIM_TRANS_CMD_CONTROLLER_REQUEST_FACTORY_MENU, &PanelAgentImpl::socket_panelcontroller_request_factory_menu,
+              SCIM_TRANS_CMD_PANEL_SHOW_FACTORY_MENU },
+            { SCIM_TRANS_CMD_CONTROLLER_CHANGE_FACTORY,       &PanelAgentImpl::socket_panelcontroller_change_factory,
+              SCIM_TRANS_CMD_PANEL_UPDATE_FACTORY_INFO },
+            { SCIM_TRANS_CMD_CONTROLLER_GET_CURRENT_FACTORY,  &PanelAgentImpl::socket_panelcontroller_get_current_factory,
+              SCIM_TRANS_CMD_PANEL_RETURN_CURRENT_FACTORY_INFO },
+            { SCIM_TRANS_CMD_CONTROLLER_GET_CURRENT_CONTEXT,  &PanelAgentImpl::socket_panelcontroller_get_current_frontend_client_and_context,
+              SCIM_TRANS_CMD_PANEL_RETURN_CURRENT_CONTEXT },
+            { SCIM_TRANS_CMD_GET_COMMAND_STATISTICS,          &PanelAgentImpl::socket_panelcontroller_get_command_statistics,
+              0 }
+        };
+
+        m_frontend_commands.assign (frontend_commands,
+                                    frontend_commands + sizeof (frontend_commands) / sizeof (frontend_commands [0]));
+        m_helper_commands.assign (helper_commands,
+                                  helper_commands + sizeof (helper_commands) / sizeof (helper_commands [0]));
+        m_panelcontrol_commands.assign (panelcontrol_commands,
+                                        panelcontrol_commands + sizeof (panelcontrol_commands) / sizeof (panelcontrol_commands [0]));
+    }
+
     void socket_turn_on                         (void)
     {
         SCIM_DEBUG_MAIN(4) << "PanelAgent::socket_turn_on ()\n";
@@ -1220,6 +1376,24 @@ private:
         m_signal_turn_off ();
     }
 
+    void socket_focus_out                       (void)
+    {
+        SCIM_DEBUG_MAIN(2) << "PanelAgent::focus_out (" << m_current_socket_client << "," << m_current_client_context << ")\n";
+
+        lock ();
+        if (m_current_socket_client >= 0) {
+            m_last_socket_client  = m_current_socket_client;
+            m_last_client_context = m_current_client_context;
+            m_last_context_uuid   = m_current_context_uuid;
+        }
+        m_current_socket_client  = -1;
+        m_current_client_context = 0;
+        m_current_context_uuid   = String ("");
+        unlock ();
+
+        socket_turn_off ();
+    }
+
     void socket_update_screen                   (void)
     {
         SCIM_DEBUG_MAIN(4) << "PanelAgent::socket_update_screen ()\n";
@@ -1451,10 +1625,36 @@ private:
         SCIM_DEBUG_MAIN(4) << "PanelAgent::socket_update_lookup_table ()\n";
 
         CommonLookupTable table;
-        if (m_recv_trans.get_data (table))
+        bool ok;
+
+        if (m_recv_lookup_table_cache) {
+            bool delta = (m_recv_trans.get_data_type () == SCIM_TRANS_DATA_LOOKUP_TABLE_DELTA);
+            ok = m_recv_trans.get_data (table, *m_recv_lookup_table_cache);
+            if (!ok && delta)
+                m_recv_lookup_table_cache_lost = true;
+        } else {
+            ok = m_recv_trans.get_data (table);
+        }
+
+        if (ok)
             m_signal_update_lookup_table (table);
     }
 
+    // Skip a data of the command which is not processed.
+    void socket_skip_data                       (void)
+    {
+        // The cache must see all lookup tables of the connection,
+        // otherwise the following deltas can't be restored.
+        if (m_recv_lookup_table_cache &&
+            m_recv_trans.get_data_type () == SCIM_TRANS_DATA_LOOKUP_TABLE) {
+            CommonLookupTable table;
+            if (m_recv_trans.get_data (table, *m_recv_lookup_table_cache))
+                return;
+        }
+
+        m_recv_trans.skip_data ();
+    }
+
     void socket_register_properties             (void)
     {
         SCIM_DEBUG_MAIN(4) << "PanelAgent::socket_register_properties ()\n";
@@ -1709,6 +1909,14 @@ private:
         socket_helper_key_event_op (client, SCIM_TRANS_CMD_FORWARD_KEY_EVENT);
     }
 
+    void socket_helper_reload_config            (int client)
+    {
+        SCIM_DEBUG_MAIN(4) << "PanelAgent::socket_helper_reload_config (" << client << ")\n";
+
+        reload_config ();
+        m_signal_reload_config ();
+    }
+
     void socket_helper_commit_string            (int client)
     {
         SCIM_DEBUG_MAIN(4) << "PanelAgent::socket_helper_commit_string (" << client << ")\n";
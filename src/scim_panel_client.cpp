@@ -65,6 +65,9 @@ class PanelClient::PanelClientImpl
     int                                         m_current_icid;
     int                                         m_send_refcount;
 
+    // The lookup table last sent to the Panel.
+    LookupTableCache                            m_lookup_table_cache;
+
     PanelClientSignalVoid                       m_signal_reload_config;
     PanelClientSignalVoid                       m_signal_exit;
     PanelClientSignalInt                        m_signal_update_lookup_table_page_size;
@@ -96,6 +99,8 @@ public:
 
         if (m_socket.is_connected ()) close_connection ();
 
+        m_lookup_table_cache.clear ();
+
         bool ret;
         int count = 0;
 
@@ -113,7 +118,8 @@ public:
                 }
             }
  
-            if (ret && scim_socket_open_connection (m_socket_magic_key, String ("FrontEnd"), String ("Panel"), m_socket, m_socket_timeout))
+            if (ret && scim_socket_open_connection (m_socket_magic_key, String ("FrontEnd"), String ("Panel"), m_socket, m_socket_timeout,
+                                                    SCIM_SOCKET_PROTOCOL_DEFAULT | SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA))
                 break;
 
             m_socket.close ();
@@ -170,6 +176,9 @@ public:
                     case SCIM_TRANS_CMD_EXIT:
                         m_signal_exit ((int)context);
                         break;
+                    case SCIM_TRANS_CMD_RESET_LOOKUP_TABLE_CACHE:
+                        m_lookup_table_cache.clear ();
+                        break;
                     default:
                         break;
                 }
@@ -442,7 +451,10 @@ public:
     {
         if (m_send_refcount > 0 && m_current_icid == icid) {
             m_send_trans.put_command (SCIM_TRANS_CMD_UPDATE_LOOKUP_TABLE);
-            m_send_trans.put_data (table);
+            if (m_socket.get_protocol_options () & SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA)
+                m_send_trans.put_data (table, m_lookup_table_cache);
+            else
+                m_send_trans.put_data (table);
         }
     }
     void register_properties    (int icid, const PropertyList &properties)
@@ -34,6 +34,9 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -49,10 +52,610 @@
 #include "scim_private.h"
 #include "scim.h"
 
+#if HAVE_SYS_EPOLL_H
+  #include <sys/epoll.h>
+#endif
+
+#if HAVE_SYS_EVENTFD_H && HAVE_MEMFD_CREATE
+  #include <sys/eventfd.h>
+  #include <sys/mman.h>
+  #include <fcntl.h>
+  #include <poll.h>
+#endif
+
+// The size of the shared memory must be sealed, so that the peer can't
+// truncate it under our feet.
+#if HAVE_SYS_EVENTFD_H && HAVE_MEMFD_CREATE && defined (F_ADD_SEALS) && defined (MFD_ALLOW_SEALING)
+  #define SCIM_SOCKET_HAVE_SHM_RING 1
+#else
+  #define SCIM_SOCKET_HAVE_SHM_RING 0
+#endif
+
 #define SCIM_SOCKET_SERVER_MAX_CLIENTS  256
+#define SCIM_SOCKET_SERVER_MAX_EVENTS   64
+
+// Sockets with larger ids never use any optional protocol feature.
+#define SCIM_SOCKET_MAX_PROTOCOL_OPTION_ID  65536
+
+// All protocol options supported by this library.
+#if SCIM_SOCKET_HAVE_SHM_RING
+#define SCIM_SOCKET_PROTOCOL_SUPPORTED      ((uint32) (SCIM_SOCKET_PROTOCOL_FAST_CHECKSUM | SCIM_SOCKET_PROTOCOL_SEQUENCE | SCIM_SOCKET_PROTOCOL_SHM_RING | \
+                                                     SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA))
+#else
+#define SCIM_SOCKET_PROTOCOL_SUPPORTED      ((uint32) (SCIM_SOCKET_PROTOCOL_FAST_CHECKSUM | SCIM_SOCKET_PROTOCOL_SEQUENCE | \
+                                                     SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA))
+#endif
+
+// Protocol options handled by this library itself, which are accepted
+// for all servers. The others are only accepted if the server implements them.
+#define SCIM_SOCKET_PROTOCOL_TRANSPORT      ((uint32) (SCIM_SOCKET_PROTOCOL_FAST_CHECKSUM | SCIM_SOCKET_PROTOCOL_SHM_RING))
+
+// The capacity of each direction of a shared memory ring, must be a power of 2.
+#define SCIM_SOCKET_RING_SIZE               (128 * 1024)
 
 namespace scim {
 
+// The protocol options negotiated for each connection, indexed by socket id.
+// Socket objects are often created temporarily for an existing socket id,
+// so the options can not be stored in the Socket object itself.
+static unsigned char __socket_protocol_options [SCIM_SOCKET_MAX_PROTOCOL_OPTION_ID];
+
+static void
+__set_socket_protocol_options (int id, uint32 options)
+{
+    if (id >= 0 && id < SCIM_SOCKET_MAX_PROTOCOL_OPTION_ID)
+        __socket_protocol_options [id] = (unsigned char) options;
+}
+
+static uint32
+__get_socket_protocol_options (int id)
+{
+    if (id >= 0 && id < SCIM_SOCKET_MAX_PROTOCOL_OPTION_ID)
+        return __socket_protocol_options [id];
+    return 0;
+}
+
+#if SCIM_SOCKET_HAVE_SHM_RING
+// A pair of single producer single consumer byte rings in shared memory,
+// which carries the data of a local connection negotiated
+// SCIM_SOCKET_PROTOCOL_SHM_RING instead of the socket.
+// The socket itself is only watched to detect the closing of the connection.
+//
+// Each direction has two eventfds, one is signaled by the writer when new data
+// is available, the other is signaled by the reader when some space is freed.
+// They are only signaled if the other side is waiting for them.
+//
+// The peer may be hostile, so the positions written by it are checked before
+// being used, any inconsistency breaks the connection. Our own positions are
+// kept privately and only published into the shared memory.
+#define SCIM_SOCKET_RING_SEALS  (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+class SocketRing
+{
+    // The state of one direction, shared by both sides.
+    struct Channel {
+        volatile uint32 head;           // Bytes written, only changed by the writer.
+        uint32          pad1 [15];
+        volatile uint32 tail;           // Bytes read, only changed by the reader.
+        volatile uint32 reader_waiting;
+        volatile uint32 reader_watched; // The reader is always waiting, eg. watched by SocketServer.
+        volatile uint32 writer_waiting;
+        uint32          pad2 [12];
+    };
+
+    int            m_socket;
+    unsigned char *m_mem;
+    Channel       *m_tx;
+    Channel       *m_rx;
+    unsigned char *m_tx_data;
+    unsigned char *m_rx_data;
+    uint32         m_tx_head;
+    uint32         m_rx_tail;
+    bool           m_broken;
+    int            m_tx_data_fd;
+    int            m_tx_space_fd;
+    int            m_rx_data_fd;
+    int            m_rx_space_fd;
+
+public:
+    // The memfd and the eventfds of both channels.
+    enum { NUM_FDS = 5 };
+
+    // Create a ring for the client side of a connection,
+    // the fds to be sent to the server are returned in fds.
+    static SocketRing * create (int socket, int *fds) {
+        int i;
+        void *mem = MAP_FAILED;
+
+        for (i = 0; i < NUM_FDS; ++i) fds [i] = -1;
+
+        fds [0] = memfd_create ("scim-socket-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+        for (i = 1; i < NUM_FDS; ++i)
+            fds [i] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        for (i = 0; i < NUM_FDS && fds [i] >= 0; ++i)
+            continue;
+
+        if (i == NUM_FDS && ftruncate (fds [0], get_mem_size ()) == 0 &&
+            fcntl (fds [0], F_ADD_SEALS, SCIM_SOCKET_RING_SEALS) == 0)
+            mem = mmap (0, get_mem_size (), PROT_READ | PROT_WRITE, MAP_SHARED, fds [0], 0);
+
+        if (mem == MAP_FAILED) {
+            close_fds (fds);
+            return 0;
+        }
+
+        return new SocketRing (socket, static_cast <unsigned char *> (mem), fds, false);
+    }
+
+    // Attach to a ring created by the client,
+    // the memfd is closed, the eventfds are owned by the ring.
+    static SocketRing * attach (int socket, int *fds) {
+        struct stat st;
+        void *mem = MAP_FAILED;
+
+        // Only accept a memfd whose size can't be changed anymore,
+        // otherwise the client could make us crash by SIGBUS.
+        int seals = fcntl (fds [0], F_GET_SEALS);
+
+        if (seals >= 0 && (seals & SCIM_SOCKET_RING_SEALS) == SCIM_SOCKET_RING_SEALS &&
+            fstat (fds [0], &st) == 0 && st.st_size == (off_t) get_mem_size ())
+            mem = mmap (0, get_mem_size (), PROT_READ | PROT_WRITE, MAP_SHARED, fds [0], 0);
+
+        if (mem == MAP_FAILED) {
+            close_fds (fds);
+            return 0;
+        }
+
+        ::close (fds [0]);
+        fds [0] = -1;
+
+        SocketRing *ring = new SocketRing (socket, static_cast <unsigned char *> (mem), fds, true);
+
+        // The server always watches its clients.
+        ring->m_rx->reader_watched = 1;
+        return ring;
+    }
+
+    static void close_fds (int *fds) {
+        for (int i = 0; i < NUM_FDS; ++i) {
+            if (fds [i] >= 0) ::close (fds [i]);
+            fds [i] = -1;
+        }
+    }
+
+    ~SocketRing () {
+        munmap (m_mem, get_mem_size ());
+        ::close (m_tx_data_fd);
+        ::close (m_tx_space_fd);
+        ::close (m_rx_data_fd);
+        ::close (m_rx_space_fd);
+    }
+
+    // The fd which becomes readable when new data is written into the ring.
+    int get_event_fd () const {
+        return m_rx_data_fd;
+    }
+
+    bool has_data () const {
+        return m_broken || m_rx->head != m_rx_tail;
+    }
+
+    // Make the event fd readable again, if it's been cleared while
+    // there is still some data left.
+    void notify () {
+        signal (m_rx_data_fd);
+    }
+
+    void clear_event () {
+        uint64_t count;
+        while (::read (m_rx_data_fd, &count, sizeof (count)) < 0 && errno == EINTR)
+            continue;
+    }
+
+    // Wait until there is some data, return > 0 if there is data or
+    // the connection is closed, 0 if timeout, -1 if error.
+    int wait_for_data (int *timeout) {
+        int ret = wait_for_channel (m_rx->reader_waiting, m_rx_data_fd, timeout, true);
+        return (ret < 0 && errno == EPIPE) ? 1 : ret;
+    }
+
+    // Read the data into iov, if partial is true, return as soon as
+    // some data is read. Return the number of bytes read, which is
+    // smaller than requested if timeout or the connection is closed,
+    // or -1 if error.
+    int read (const struct iovec *iov, int iovcnt, int timeout, bool partial) {
+        int nbytes = 0;
+
+        for (int i = 0; i < iovcnt; ++i) {
+            unsigned char *buf = static_cast <unsigned char *> (iov [i].iov_base);
+            size_t size = iov [i].iov_len;
+
+            while (size > 0) {
+                uint32 avail = m_rx->head - m_rx_tail;
+
+                if (m_broken || avail > SCIM_SOCKET_RING_SIZE)
+                    return set_broken ();
+
+                if (!avail) {
+                    if (partial && nbytes)
+                        return nbytes;
+
+                    int ret = wait_for_channel (m_rx->reader_waiting, m_rx_data_fd, &timeout, true);
+
+                    if (ret < 0)
+                        return (errno == EPIPE || nbytes) ? nbytes : -1;
+                    if (ret == 0)
+                        return nbytes;
+                    continue;
+                }
+
+                // Don't read the data before the head.
+                __sync_synchronize ();
+
+                size_t n = std::min ((size_t) avail, size);
+                copy_from_ring (buf, m_rx_data, m_rx_tail, n);
+
+                // Don't free the space before the data is read.
+                __sync_synchronize ();
+
+                m_rx_tail += n;
+                m_rx->tail = m_rx_tail;
+
+                __sync_synchronize ();
+
+                if (m_rx->writer_waiting)
+                    signal (m_rx_space_fd);
+
+                buf += n;
+                size -= n;
+                nbytes += n;
+            }
+        }
+        return nbytes;
+    }
+
+    // Write all data in iov, return the number of bytes written,
+    // or -1 if error.
+    int write (const struct iovec *iov, int iovcnt) {
+        uint32 head = m_tx_head;
+        int nbytes = 0;
+
+        for (int i = 0; i < iovcnt; ++i) {
+            const unsigned char *buf = static_cast <const unsigned char *> (iov [i].iov_base);
+            size_t size = iov [i].iov_len;
+
+            while (size > 0) {
+                uint32 used = head - m_tx->tail;
+
+                if (m_broken || used > SCIM_SOCKET_RING_SIZE)
+                    return set_broken ();
+
+                uint32 space = SCIM_SOCKET_RING_SIZE - used;
+
+                if (!space) {
+                    publish (head);
+
+                    int timeout = -1;
+                    if (wait_for_channel (m_tx->writer_waiting, m_tx_space_fd, &timeout, false) < 0)
+                        return -1;
+                    continue;
+                }
+
+                // Don't overwrite the space before the reader has freed it.
+                __sync_synchronize ();
+
+                size_t n = std::min ((size_t) space, size);
+                copy_to_ring (m_tx_data, head, buf, n);
+
+                head += n;
+                buf += n;
+                size -= n;
+                nbytes += n;
+            }
+        }
+
+        publish (head);
+        return nbytes;
+    }
+
+private:
+    SocketRing (int socket, unsigned char *mem, const int *fds, bool server)
+        : m_socket (socket), m_mem (mem) {
+        int tx = server ? 1 : 0;
+        int rx = 1 - tx;
+
+        Channel *channels = reinterpret_cast <Channel *> (mem);
+        unsigned char *data = mem + sizeof (Channel) * 2;
+
+        m_tx = channels + tx;
+        m_rx = channels + rx;
+        m_tx_data = data + SCIM_SOCKET_RING_SIZE * tx;
+        m_rx_data = data + SCIM_SOCKET_RING_SIZE * rx;
+        m_tx_head = m_tx->head;
+        m_rx_tail = m_rx->tail;
+        m_broken  = false;
+        m_tx_data_fd  = fds [1 + tx * 2];
+        m_tx_space_fd = fds [2 + tx * 2];
+        m_rx_data_fd  = fds [1 + rx * 2];
+        m_rx_space_fd = fds [2 + rx * 2];
+    }
+
+    static size_t get_mem_size () {
+        return sizeof (Channel) * 2 + SCIM_SOCKET_RING_SIZE * 2;
+    }
+
+    static void copy_to_ring (unsigned char *ring, uint32 pos, const unsigned char *buf, size_t size) {
+        size_t offset = pos & (SCIM_SOCKET_RING_SIZE - 1);
+        size_t first = std::min (size, (size_t) SCIM_SOCKET_RING_SIZE - offset);
+        memcpy (ring + offset, buf, first);
+        if (first < size) memcpy (ring, buf + first, size - first);
+    }
+
+    static void copy_from_ring (unsigned char *buf, const unsigned char *ring, uint32 pos, size_t size) {
+        size_t offset = pos & (SCIM_SOCKET_RING_SIZE - 1);
+        size_t first = std::min (size, (size_t) SCIM_SOCKET_RING_SIZE - offset);
+        memcpy (buf, ring + offset, first);
+        if (first < size) memcpy (buf + first, ring, size - first);
+    }
+
+    // The peer violated the ring protocol, treat it as a broken connection.
+    int set_broken () {
+        m_broken = true;
+        errno = EPROTO;
+        return -1;
+    }
+
+    static void signal (int fd) {
+        uint64_t one = 1;
+        while (::write (fd, &one, sizeof (one)) < 0 && errno == EINTR)
+            continue;
+    }
+
+    void publish (uint32 head) {
+        if (head == m_tx_head)
+            return;
+
+        // Don't publish the head before the data is written.
+        __sync_synchronize ();
+
+        m_tx_head = head;
+        m_tx->head = head;
+
+        __sync_synchronize ();
+
+        if (m_tx->reader_waiting || m_tx->reader_watched)
+            signal (m_tx_data_fd);
+    }
+
+    // An inconsistent channel is also ready, so that the caller finds it broken.
+    bool channel_ready (bool read) const {
+        return read ? (m_rx->head != m_rx_tail) : (m_tx_head - m_tx->tail != SCIM_SOCKET_RING_SIZE);
+    }
+
+    // Wait until the channel is ready for reading or writing,
+    // return 1 if ready, 0 if timeout, -1 if error, errno is EPIPE if
+    // the connection is closed.
+    int wait_for_channel (volatile uint32 &waiting, int fd, int *timeout, bool read) {
+        struct pollfd fds [2];
+        struct timeval begin_tv;
+        int ret;
+
+        if (*timeout > 0)
+            gettimeofday (&begin_tv, 0);
+
+        while (1) {
+            waiting = 1;
+
+            // The flag must be visible before checking the channel,
+            // so that the other side either sees it or has
+            // made the channel ready before.
+            __sync_synchronize ();
+
+            if (channel_ready (read)) {
+                waiting = 0;
+                return 1;
+            }
+
+            fds [0].fd = fd;
+            fds [0].events = POLLIN;
+            fds [0].revents = 0;
+            fds [1].fd = m_socket;
+            fds [1].events = POLLIN;
+            fds [1].revents = 0;
+
+            ret = poll (fds, 2, *timeout);
+
+            waiting = 0;
+
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+
+            if (*timeout > 0) {
+                struct timeval cur_tv;
+                gettimeofday (&cur_tv, 0);
+                *timeout -= (cur_tv.tv_sec - begin_tv.tv_sec) * 1000 +
+                            (cur_tv.tv_usec - begin_tv.tv_usec) / 1000;
+                begin_tv = cur_tv;
+                if (*timeout < 0) *timeout = 0;
+            }
+
+            if (fds [0].revents) {
+                uint64_t count;
+                while (::read (fd, &count, sizeof (count)) < 0 && errno == EINTR)
+                    continue;
+            }
+
+            if (channel_ready (read))
+                return 1;
+
+            // No data is sent through the socket once the ring is used,
+            // so it's only readable if the connection is closed.
+            if (fds [1].revents) {
+                errno = EPIPE;
+                return -1;
+            }
+
+            if (ret == 0 && *timeout == 0)
+                return 0;
+        }
+    }
+};
+
+// The shared memory rings of the connections, indexed by socket id.
+static SocketRing *__socket_rings [SCIM_SOCKET_MAX_PROTOCOL_OPTION_ID];
+
+static SocketRing *
+__get_socket_ring (int id)
+{
+    if (id >= 0 && id < SCIM_SOCKET_MAX_PROTOCOL_OPTION_ID)
+        return __socket_rings [id];
+    return 0;
+}
+
+static void
+__set_socket_ring (int id, SocketRing *ring)
+{
+    if (id >= 0 && id < SCIM_SOCKET_MAX_PROTOCOL_OPTION_ID) {
+        delete __socket_rings [id];
+        __socket_rings [id] = ring;
+    } else {
+        delete ring;
+    }
+}
+
+static bool
+__is_local_socket (int id)
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof (addr);
+    return getsockname (id, (struct sockaddr *) &addr, &len) == 0 && addr.ss_family == AF_UNIX;
+}
+
+// Send one byte along with the fds through a local socket.
+static bool
+__send_socket_fds (int id, const int *fds, int nfds)
+{
+    char byte = 0;
+    struct iovec iov;
+    struct msghdr msg;
+    char control [CMSG_SPACE (sizeof (int) * SocketRing::NUM_FDS)];
+
+    iov.iov_base = &byte;
+    iov.iov_len  = 1;
+
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (nfds > 0) {
+        memset (control, 0, sizeof (control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE (sizeof (int) * nfds);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN (sizeof (int) * nfds);
+        memcpy (CMSG_DATA (cmsg), fds, sizeof (int) * nfds);
+    }
+
+    int ret;
+    while ((ret = sendmsg (id, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+        continue;
+    return ret == 1;
+}
+
+// Receive one byte along with at most nfds fds sent by __send_socket_fds (),
+// return the number of fds received, or -1 if error.
+static int
+__receive_socket_fds (const Socket &socket, int *fds, int nfds, int timeout)
+{
+    char byte;
+    struct iovec iov;
+    struct msghdr msg;
+    char control [CMSG_SPACE (sizeof (int) * SocketRing::NUM_FDS)];
+    int received = 0;
+
+    if (nfds > SocketRing::NUM_FDS || socket.wait_for_data (timeout) <= 0)
+        return -1;
+
+    iov.iov_base = &byte;
+    iov.iov_len  = 1;
+
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof (control);
+
+    int ret;
+    while ((ret = recvmsg (socket.get_id (), &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+        continue;
+
+    if (ret != 1)
+        return -1;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        int n = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+        int *data = reinterpret_cast <int *> (CMSG_DATA (cmsg));
+
+        for (int i = 0; i < n; ++i) {
+            if (received < nfds)
+                fds [received ++] = data [i];
+            else
+                ::close (data [i]);
+        }
+    }
+
+    if (msg.msg_flags & MSG_CTRUNC) {
+        for (int i = 0; i < received; ++i) ::close (fds [i]);
+        return -1;
+    }
+
+    return received;
+}
+#else
+class SocketRing
+{
+public:
+    int  get_event_fd () const { return -1; }
+    bool has_data () const { return false; }
+    void notify () { }
+    void clear_event () { }
+    int  wait_for_data (int *) { return -1; }
+    int  read (const struct iovec *, int, int, bool) { return -1; }
+    int  write (const struct iovec *, int) { return -1; }
+};
+
+static SocketRing *
+__get_socket_ring (int)
+{
+    return 0;
+}
+
+static void
+__set_socket_ring (int, SocketRing *)
+{
+}
+#endif
+
+// Forget everything about a connection, called when the socket id
+// is closed or going to be reused.
+static void
+__reset_socket_protocol (int id)
+{
+    __set_socket_protocol_options (id, 0);
+    __set_socket_ring (id, 0);
+}
+
 static struct in_addr
 __gethostname (const char *host)
 {
@@ -324,6 +927,9 @@ public:
         if (!buf || !size) { m_err = EINVAL; return -1; }
         if (m_id < 0) { m_err = EBADF; return -1; }
 
+        if (SocketRing *ring = __get_socket_ring (m_id))
+            return read_ring (ring, buf, size, -1, true);
+
         m_err = 0;
         int ret;
         while (1) {
@@ -344,6 +950,9 @@ public:
         if (timeout < 0)
             return read (buf, size);
  
+        if (SocketRing *ring = __get_socket_ring (m_id))
+            return read_ring (ring, buf, size, timeout, false);
+
         int   ret;
         int   nbytes = 0;
         char *cbuf = static_cast<char *> (buf);
@@ -370,6 +979,13 @@ public:
         if (!buf || !size) { m_err = EINVAL; return -1; }
         if (m_id < 0) { m_err = EBADF; return -1; }
  
+        if (SocketRing *ring = __get_socket_ring (m_id)) {
+            struct iovec iov;
+            iov.iov_base = const_cast <void *> (buf);
+            iov.iov_len  = size;
+            return write_ring (ring, &iov, 1);
+        }
+
         int ret = -1;
  
         typedef void (*_scim_sighandler_t)(int);
@@ -401,8 +1017,104 @@ public:
         return ret;
     }
 
+    int readv_with_timeout (const struct iovec *iov, int iovcnt, int timeout) {
+        if (!iov || iovcnt <= 0) { m_err = EINVAL; return -1; }
+        if (m_id < 0) { m_err = EBADF; return -1; }
+
+        if (SocketRing *ring = __get_socket_ring (m_id)) {
+            m_err = 0;
+            int ret = ring->read (iov, iovcnt, timeout, false);
+            if (ret < 0) m_err = errno;
+            return ret;
+        }
+
+        std::vector <struct iovec> vec (iov, iov + iovcnt);
+        struct iovec *cur = &vec [0];
+        struct iovec *end = cur + iovcnt;
+
+        int ret;
+        int nbytes = 0;
+
+        m_err = 0;
+
+        while (cur < end) {
+            if (timeout >= 0) {
+                ret = wait_for_data_internal (&timeout);
+
+                if (ret < 0) return ret;
+                if (ret == 0) return nbytes;
+            }
+
+            ret = ::readv (m_id, cur, std::min ((int) (end - cur), (int) IOV_MAX));
+
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                m_err = errno;
+                return ret;
+            }
+
+            if (ret == 0) return nbytes;
+
+            nbytes += ret;
+            cur = advance_iovec (cur, end, (size_t) ret);
+        }
+        return nbytes;
+    }
+
+    int writev (const struct iovec *iov, int iovcnt) {
+        if (!iov || iovcnt <= 0) { m_err = EINVAL; return -1; }
+        if (m_id < 0) { m_err = EBADF; return -1; }
+
+        if (SocketRing *ring = __get_socket_ring (m_id))
+            return write_ring (ring, iov, iovcnt);
+
+        std::vector <struct iovec> vec (iov, iov + iovcnt);
+        struct iovec *cur = &vec [0];
+        struct iovec *end = cur + iovcnt;
+
+        int ret = -1;
+        int nbytes = 0;
+
+        typedef void (*_scim_sighandler_t)(int);
+        _scim_sighandler_t orig_handler = signal (SIGPIPE, SIG_IGN);
+
+        m_err = 0;
+
+        // Skip the leading empty buffers, so that writing nothing is not an error.
+        cur = advance_iovec (cur, end, 0);
+
+        while (cur < end) {
+            ret = ::writev (m_id, cur, std::min ((int) (end - cur), (int) IOV_MAX));
+            if (ret > 0) {
+                nbytes += ret;
+                cur = advance_iovec (cur, end, (size_t) ret);
+                continue;
+            }
+            if (ret < 0 && errno == EINTR)
+                continue;
+            m_err = errno;
+            break;
+        }
+
+        if (orig_handler != SIG_ERR)
+            signal (SIGPIPE, orig_handler);
+        else
+            signal (SIGPIPE, SIG_DFL);
+
+        return (cur < end) ? -1 : nbytes;
+    }
+
     int wait_for_data (int timeout = -1) {
         if (m_id < 0) { m_err = EBADF; return -1; }
+
+        if (SocketRing *ring = __get_socket_ring (m_id)) {
+            m_err = 0;
+            int ret = ring->wait_for_data (&timeout);
+            if (ret < 0) m_err = errno;
+            return ret;
+        }
+
         return wait_for_data_internal (&timeout);
     }
 
@@ -585,6 +1297,7 @@ public:
             m_err = 0;
             m_family = family;
             m_id = ret;
+            __reset_socket_protocol (m_id);
         } else {
             std::cerr << _("Error creating socket") << ": socket " << _("syscall failed") << ": " << strerror(errno) << std::endl;
             m_err = errno;
@@ -601,6 +1314,7 @@ public:
  
         if (!m_no_close) {
             SCIM_DEBUG_SOCKET(2) << "  Closing the socket: " << m_id << " ...\n";
+            __reset_socket_protocol (m_id);
             ::close (m_id);
  
             // Unlink the socket file.
@@ -622,6 +1336,38 @@ public:
     }
 
 private:
+    int read_ring (SocketRing *ring, void *buf, size_t size, int timeout, bool partial) {
+        struct iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len  = size;
+
+        m_err = 0;
+        int ret = ring->read (&iov, 1, timeout, partial);
+        if (ret < 0) m_err = errno;
+        return ret;
+    }
+
+    int write_ring (SocketRing *ring, const struct iovec *iov, int iovcnt) {
+        m_err = 0;
+        int ret = ring->write (iov, iovcnt);
+        if (ret < 0) m_err = errno;
+        return ret;
+    }
+
+    // Consume nbytes from the front of the buffer list,
+    // return the first buffer which still has data left.
+    static struct iovec * advance_iovec (struct iovec *cur, struct iovec *end, size_t nbytes) {
+        while (cur < end && nbytes >= cur->iov_len) {
+            nbytes -= cur->iov_len;
+            ++cur;
+        }
+        if (cur < end && nbytes) {
+            cur->iov_base = static_cast <char *> (cur->iov_base) + nbytes;
+            cur->iov_len -= nbytes;
+        }
+        return cur;
+    }
+
     int wait_for_data_internal (int *timeout) {
         fd_set fds;
         struct timeval tv;
@@ -710,6 +1456,18 @@ Socket::write (const void *buf, size_t size) const
     return m_impl->write (buf, size);
 }
 
+int
+Socket::readv_with_timeout (const struct iovec *iov, int iovcnt, int timeout) const
+{
+    return m_impl->readv_with_timeout (iov, iovcnt, timeout);
+}
+
+int
+Socket::writev (const struct iovec *iov, int iovcnt) const
+{
+    return m_impl->writev (iov, iovcnt);
+}
+
 int
 Socket::wait_for_data (int timeout) const
 {
@@ -758,6 +1516,12 @@ Socket::get_id () const
     return m_impl->get_id ();
 }
 
+uint32
+Socket::get_protocol_options () const
+{
+    return __get_socket_protocol_options (m_impl->get_id ());
+}
+
 bool
 Socket::create (SocketFamily family)
 {
@@ -771,36 +1535,321 @@ Socket::close ()
 }
 
 // Implementation of SocketServer
+// The idle signal goes on if any slot has more work to do.
+class SocketServerIdleMarshal
+{
+    bool m_value;
+
+public:
+    SocketServerIdleMarshal () : m_value (false) { }
+
+    bool & value () { return m_value; }
+
+    bool marshal (bool newval) {
+        m_value = m_value || newval;
+        return false;
+    }
+};
+
 struct SocketServer::SocketServerImpl
 {
+    enum FdState {
+        FD_NONE = 0,
+        FD_CLIENT,
+        FD_EXTERNAL,
+        FD_RING         // The event fd of the shared memory ring of a client.
+    };
+
+    // Set in fd_states along with the FdState, if the socket is not watched temporarily.
+    enum { FD_SUSPENDED = 0x80 };
+
+    SocketServerBackend backend;
+
     fd_set   active_fds;
     int      max_fd;
+    int      epoll_fd;
     int      err;
     bool     running;
     bool     created;
     int      num_clients;
     int      max_clients;
 
-    std::vector <int> ext_fds;
+    // Per socket id bookkeeping, one FdState for each id.
+    std::vector <unsigned char> fd_states;
+
+    // The ring event fd of each client, and the client of each ring event fd.
+    std::vector <int> ring_peers;
 
     SocketServerSignalSocket accept_signal;
     SocketServerSignalSocket receive_signal;
     SocketServerSignalSocket exception_signal;
 
-    SocketServerImpl (int mc)
-        : max_fd (0), err (0), running (false), created (false),
-          num_clients (0), max_clients (std::min (mc, SCIM_SOCKET_SERVER_MAX_CLIENTS)) {
+    Signal1 <bool, SocketServer *, SocketServerIdleMarshal> idle_signal;
+
+    // Set while the idle signal should be emitted when there is no event.
+    bool     idle_pending;
+
+    SocketServerImpl (int mc, SocketServerBackend be)
+        : backend (be), max_fd (0), epoll_fd (-1), err (0), running (false), created (false),
+          num_clients (0), max_clients (mc), idle_pending (false) {
+#if !HAVE_SYS_EPOLL_H
+        backend = SCIM_SOCKET_SERVER_SELECT;
+#endif
+        if (backend == SCIM_SOCKET_SERVER_AUTO)
+            backend = SCIM_SOCKET_SERVER_EPOLL;
+        if (max_clients > max_clients_limit ())
+            max_clients = max_clients_limit ();
         FD_ZERO (&active_fds);
     }
+
+    ~SocketServerImpl () {
+        close_backend ();
+    }
+
+    int max_clients_limit () const {
+        return backend == SCIM_SOCKET_SERVER_EPOLL ? INT_MAX : SCIM_SOCKET_SERVER_MAX_CLIENTS;
+    }
+
+    bool init_backend (int server_fd) {
+        fd_states.clear ();
+        FD_ZERO (&active_fds);
+        max_fd = server_fd;
+
+#if HAVE_SYS_EPOLL_H
+        if (backend == SCIM_SOCKET_SERVER_EPOLL) {
+            epoll_fd = epoll_create (SCIM_SOCKET_SERVER_MAX_CLIENTS);
+
+            if (epoll_fd >= 0) {
+                struct epoll_event ev;
+                memset (&ev, 0, sizeof (ev));
+                // The listening socket is level-triggered, one connection is accepted per event.
+                ev.events = EPOLLIN | EPOLLPRI;
+                ev.data.fd = server_fd;
+                if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, server_fd, &ev) == 0)
+                    return true;
+                ::close (epoll_fd);
+                epoll_fd = -1;
+            }
+
+            SCIM_DEBUG_SOCKET (1) << "SocketServer: epoll is not available, fallback to select.\n";
+            backend = SCIM_SOCKET_SERVER_SELECT;
+        }
+#endif
+        if (server_fd >= FD_SETSIZE) {
+            err = EMFILE;
+            return false;
+        }
+
+        FD_SET (server_fd, &active_fds);
+        return true;
+    }
+
+    void close_backend () {
+        if (epoll_fd >= 0) {
+            ::close (epoll_fd);
+            epoll_fd = -1;
+        }
+        fd_states.clear ();
+        ring_peers.clear ();
+        FD_ZERO (&active_fds);
+        max_fd = 0;
+    }
+
+    FdState get_state (int fd) const {
+        if (fd >= 0 && fd < (int) fd_states.size ())
+            return (FdState) (fd_states [fd] & ~FD_SUSPENDED);
+        return FD_NONE;
+    }
+
+    bool is_suspended (int fd) const {
+        return fd >= 0 && fd < (int) fd_states.size () && (fd_states [fd] & FD_SUSPENDED);
+    }
+
+    // Check if the signals should be emitted for the socket.
+    bool is_watched (int fd) const {
+        return get_state (fd) != FD_NONE && !is_suspended (fd);
+    }
+
+    bool add_fd (int fd, FdState state) {
+        if (fd < 0 || get_state (fd) != FD_NONE || !watch_fd (fd))
+            return false;
+
+        if (fd >= (int) fd_states.size ())
+            fd_states.resize (fd + 1, FD_NONE);
+
+        fd_states [fd] = state;
+        return true;
+    }
+
+    void remove_fd (int fd) {
+        if (get_state (fd) == FD_NONE)
+            return;
+
+        if (get_state (fd) == FD_CLIENT)
+            unwatch_ring (fd);
+
+        if (!is_suspended (fd))
+            unwatch_fd (fd);
+
+        fd_states [fd] = FD_NONE;
+    }
+
+    bool suspend_fd (int fd) {
+        if (!is_watched (fd))
+            return false;
+
+        unwatch_fd (fd);
+        fd_states [fd] |= FD_SUSPENDED;
+
+        if (get_state (fd) == FD_CLIENT && get_ring_peer (fd) >= 0)
+            suspend_fd (get_ring_peer (fd));
+        return true;
+    }
+
+    bool resume_fd (int fd) {
+        if (get_state (fd) == FD_NONE || !is_suspended (fd) || !watch_fd (fd))
+            return false;
+
+        fd_states [fd] &= ~FD_SUSPENDED;
+
+        if (get_state (fd) != FD_CLIENT)
+            return true;
+
+        if (get_ring_peer (fd) >= 0) {
+            resume_fd (get_ring_peer (fd));
+
+            // The event may have been consumed while reading the ring.
+            if (has_ring_data (fd))
+                __get_socket_ring (fd)->notify ();
+        } else {
+            watch_ring (fd);
+        }
+        return true;
+    }
+
+    int get_ring_peer (int fd) const {
+        if (fd >= 0 && fd < (int) ring_peers.size ())
+            return ring_peers [fd];
+        return -1;
+    }
+
+    void set_ring_peer (int fd, int peer) {
+        if (fd >= (int) ring_peers.size ())
+            ring_peers.resize (fd + 1, -1);
+        ring_peers [fd] = peer;
+    }
+
+    bool has_ring_data (int fd) const {
+        SocketRing *ring = __get_socket_ring (fd);
+        return ring && ring->has_data ();
+    }
+
+    // Watch the shared memory ring of a client, if it has one, so that
+    // the data written into the ring is reported like the data on the socket.
+    void watch_ring (int fd) {
+        SocketRing *ring = __get_socket_ring (fd);
+
+        if (!ring || !is_watched (fd) || get_state (fd) != FD_CLIENT || get_ring_peer (fd) >= 0)
+            return;
+
+        int efd = ring->get_event_fd ();
+
+        if (!add_fd (efd, FD_RING))
+            return;
+
+        set_ring_peer (fd, efd);
+        set_ring_peer (efd, fd);
+
+        // The data written before is not reported yet.
+        if (ring->has_data ())
+            ring->notify ();
+    }
+
+    void unwatch_ring (int fd) {
+        int efd = get_ring_peer (fd);
+
+        if (efd < 0)
+            return;
+
+        set_ring_peer (fd, -1);
+        set_ring_peer (efd, -1);
+        remove_fd (efd);
+    }
+
+    // Get the client of a ring event fd, or -1 if the ring has gone.
+    int get_ring_client (int efd) {
+        int fd = get_ring_peer (efd);
+        SocketRing *ring = __get_socket_ring (fd);
+
+        if (ring && ring->get_event_fd () == efd)
+            return fd;
+
+        if (fd >= 0)
+            unwatch_ring (fd);
+        else
+            remove_fd (efd);
+        return -1;
+    }
+
+    bool watch_fd (int fd) {
+#if HAVE_SYS_EPOLL_H
+        if (backend == SCIM_SOCKET_SERVER_EPOLL) {
+            struct epoll_event ev;
+            memset (&ev, 0, sizeof (ev));
+            ev.events = EPOLLIN | EPOLLPRI | EPOLLRDHUP | EPOLLET;
+            ev.data.fd = fd;
+            if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                err = errno;
+                return false;
+            }
+        } else
+#endif
+        {
+            if (fd >= FD_SETSIZE) {
+                err = EMFILE;
+                return false;
+            }
+            FD_SET (fd, &active_fds);
+            if (max_fd < fd) max_fd = fd;
+        }
+        return true;
+    }
+
+    void unwatch_fd (int fd) {
+#if HAVE_SYS_EPOLL_H
+        if (backend == SCIM_SOCKET_SERVER_EPOLL) {
+            struct epoll_event ev;
+            epoll_ctl (epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+        } else
+#endif
+            FD_CLR (fd, &active_fds);
+    }
+
+    // Check if there is any data left unread on the socket.
+    bool has_pending_data (int fd) const {
+        int nbytes = 0;
+        return has_ring_data (fd) || (ioctl (fd, FIONREAD, &nbytes) == 0 && nbytes > 0);
+    }
 };
 
 SocketServer::SocketServer (int max_clients)
-    : Socket (-1), m_impl (new SocketServerImpl (max_clients))
+    : Socket (-1), m_impl (new SocketServerImpl (max_clients, SCIM_SOCKET_SERVER_SELECT))
 {
 }
 
 SocketServer::SocketServer (const SocketAddress &address, int max_clients)
-    : Socket (-1), m_impl (new SocketServerImpl (max_clients))
+    : Socket (-1), m_impl (new SocketServerImpl (max_clients, SCIM_SOCKET_SERVER_SELECT))
+{
+    create (address);
+}
+
+SocketServer::SocketServer (int max_clients, SocketServerBackend backend)
+    : Socket (-1), m_impl (new SocketServerImpl (max_clients, backend))
+{
+}
+
+SocketServer::SocketServer (const SocketAddress &address, int max_clients, SocketServerBackend backend)
+    : Socket (-1), m_impl (new SocketServerImpl (max_clients, backend))
 {
     create (address);
 }
@@ -816,6 +1865,12 @@ SocketServer::valid () const
     return m_impl->created;
 }
 
+SocketServerBackend
+SocketServer::get_backend () const
+{
+    return m_impl->backend;
+}
+
 bool
 SocketServer::create (const SocketAddress &address)
 {
@@ -828,15 +1883,15 @@ SocketServer::create (const SocketAddress &address)
         if (family != SCIM_SOCKET_UNKNOWN) {
             if (Socket::create (family) &&
                 Socket::bind (address) &&
-                Socket::listen ()) {
+                Socket::listen () &&
+                m_impl->init_backend (Socket::get_id ())) {
                 m_impl->created = true;
-                m_impl->max_fd = Socket::get_id ();
-                FD_ZERO (&(m_impl->active_fds));
-                FD_SET (m_impl->max_fd, &(m_impl->active_fds));
                 m_impl->err = 0;
                 return true;
             }
-            m_impl->err = Socket::get_error_number ();
+            if (!m_impl->err || m_impl->err == EBUSY)
+                m_impl->err = Socket::get_error_number ();
+            m_impl->close_backend ();
             Socket::close ();
         } else {
             m_impl->err = EBADF;
@@ -845,13 +1900,55 @@ SocketServer::create (const SocketAddress &address)
     return false;
 }
 
+bool
+SocketServer::accept_connection ()
+{
+    int client = Socket::accept ();
+
+    SCIM_DEBUG_SOCKET (3) << "  SocketServer: Accept new connection:"
+                          << client << "\n";
+
+    if (client < 0) {
+        m_impl->err = Socket::get_error_number ();
+        m_impl->running = false;
+
+        SCIM_DEBUG_SOCKET (4) << "   SocketServer: Error occurred: "
+            << Socket::get_error_message () << "\n";
+
+        return false;
+    }
+
+    if (m_impl->max_clients > 0 &&
+        m_impl->num_clients >= m_impl->max_clients) {
+        SCIM_DEBUG_SOCKET (4) << "   SocketServer: Too many clients.\n";
+        ::close (client);
+    } else if (!m_impl->add_fd (client, SocketServerImpl::FD_CLIENT)) {
+        SCIM_DEBUG_SOCKET (4) << "   SocketServer: Can't watch the client.\n";
+        ::close (client);
+    } else {
+        m_impl->num_clients ++;
+
+        __reset_socket_protocol (client);
+
+        Socket client_socket (client);
+        //emit the signal.
+        m_impl->accept_signal.emit (this, client_socket);
+    }
+
+    return true;
+}
+
 bool
 SocketServer::run ()
 {
     if (m_impl->created && !m_impl->running) {
+#if HAVE_SYS_EPOLL_H
+        if (m_impl->backend == SCIM_SOCKET_SERVER_EPOLL)
+            return run_epoll ();
+#endif
         fd_set read_fds, exception_fds;
-        int client;
-        int i;
+        struct timeval no_wait;
+        int i, ret;
 
         m_impl->running = true;
         m_impl->err = 0;
@@ -859,9 +1956,14 @@ SocketServer::run ()
             read_fds = m_impl->active_fds;
             exception_fds = m_impl->active_fds;
 
+            // Only poll the sockets if there is some idle work to do.
+            no_wait.tv_sec = 0;
+            no_wait.tv_usec = 0;
+
             SCIM_DEBUG_SOCKET (2) << " SocketServer: Watching socket...\n";
 
-            if (select (m_impl->max_fd + 1, &read_fds, NULL, &exception_fds, NULL) < 0) {
+            if ((ret = select (m_impl->max_fd + 1, &read_fds, NULL, &exception_fds,
+                               m_impl->idle_pending ? &no_wait : NULL)) < 0) {
                 m_impl->err = errno;
                 m_impl->running = false;
                 SCIM_DEBUG_SOCKET (3) << "  SocketServer: Error: "
@@ -873,41 +1975,31 @@ SocketServer::run ()
             if (!m_impl->running)
                 return true;
 
+            if (ret == 0) {
+                m_impl->idle_pending = m_impl->idle_signal.emit (this);
+                if (!m_impl->running)
+                    return true;
+                continue;
+            }
+
             for (i = 0; i<m_impl->max_fd + 1; i++) {
                 if (FD_ISSET (i, &read_fds)) {
 
                     //New connection
                     if (i == Socket::get_id ()) {
-                        client = Socket::accept ();
-
-                        SCIM_DEBUG_SOCKET (3) << "  SocketServer: Accept new connection:"
-                                              << client << "\n";
-
-                        if (client < 0) {
-                            m_impl->err = Socket::get_error_number ();
-                            m_impl->running = false;
-
-                            SCIM_DEBUG_SOCKET (4) << "   SocketServer: Error occurred: "
-                                << Socket::get_error_message () << "\n";
-
+                        if (!accept_connection ())
                             return false;
-                        }
 
-                        if (m_impl->max_clients > 0 &&
-                            m_impl->num_clients >= m_impl->max_clients) {
-                            SCIM_DEBUG_SOCKET (4) << "   SocketServer: Too many clients.\n";
-                            ::close (client);
-                        } else {
-                            m_impl->num_clients ++;
+                    //Client writing into its shared memory ring
+                    } else if (m_impl->get_state (i) == SocketServerImpl::FD_RING) {
+                        int client = m_impl->get_ring_client (i);
 
-                            //Store the new client
-                            FD_SET (client, &(m_impl->active_fds));
-                            if (m_impl->max_fd < client)
-                                m_impl->max_fd = client;
+                        if (client >= 0) {
+                            __get_socket_ring (client)->clear_event ();
 
                             Socket client_socket (client);
-                            //emit the signal.
-                            m_impl->accept_signal.emit (this, client_socket);
+                            while (m_impl->running && m_impl->is_watched (client) && m_impl->has_ring_data (client))
+                                m_impl->receive_signal.emit (this, client_socket);
                         }
 
                     //Client reading
@@ -917,6 +2009,9 @@ SocketServer::run ()
                         Socket client_socket (i);
                         //emit the signal.
                         m_impl->receive_signal.emit (this, client_socket);
+
+                        // The connection may have just negotiated a shared memory ring.
+                        m_impl->watch_ring (i);
                     }
                 }
 
@@ -930,7 +2025,7 @@ SocketServer::run ()
                         shutdown ();
                         return true;
 
-                    } else {
+                    } else if (m_impl->is_watched (i) && m_impl->get_state (i) != SocketServerImpl::FD_RING) {
                         SCIM_DEBUG_SOCKET (3) << "  SocketServer: Client "
                                               << i
                                               << "got an exception, callbacking...\n";
@@ -954,6 +2049,119 @@ SocketServer::run ()
     return false;
 }
 
+#if HAVE_SYS_EPOLL_H
+bool
+SocketServer::run_epoll ()
+{
+    struct epoll_event events [SCIM_SOCKET_SERVER_MAX_EVENTS];
+    int nevents;
+    int i;
+
+    m_impl->running = true;
+    m_impl->err = 0;
+    while (1) {
+        SCIM_DEBUG_SOCKET (2) << " SocketServer: Watching socket (epoll)...\n";
+
+        // Only poll the sockets if there is some idle work to do.
+        nevents = epoll_wait (m_impl->epoll_fd, events, SCIM_SOCKET_SERVER_MAX_EVENTS,
+                              m_impl->idle_pending ? 0 : -1);
+
+        if (nevents < 0) {
+            if (errno == EINTR && m_impl->running)
+                continue;
+
+            m_impl->err = errno;
+            m_impl->running = false;
+            SCIM_DEBUG_SOCKET (3) << "  SocketServer: Error: "
+                                  << get_error_message () << "\n";
+            return false;
+        }
+
+        //The server has been shut down.
+        if (!m_impl->running)
+            return true;
+
+        if (nevents == 0) {
+            m_impl->idle_pending = m_impl->idle_signal.emit (this);
+            if (!m_impl->running)
+                return true;
+            continue;
+        }
+
+        for (i = 0; i < nevents; ++i) {
+            int fd = events [i].data.fd;
+            uint32 ev = events [i].events;
+
+            //Client writing into its shared memory ring
+            if (m_impl->get_state (fd) == SocketServerImpl::FD_RING) {
+                fd = m_impl->get_ring_client (fd);
+                if (fd < 0 || !m_impl->has_ring_data (fd))
+                    continue;
+                ev = EPOLLIN;
+            }
+
+            if (fd == Socket::get_id ()) {
+                //The server got an exception, return.
+                if (ev & EPOLLPRI) {
+                    SCIM_DEBUG_SOCKET (3) << "  SocketServer: Server got an exception, exiting...\n";
+                    shutdown ();
+                    return true;
+                }
+
+                //New connection
+                if ((ev & EPOLLIN) && !accept_connection ())
+                    return false;
+
+            } else if (m_impl->is_watched (fd)) {
+                Socket client_socket (fd);
+
+                if (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    SCIM_DEBUG_SOCKET (3) << "  SocketServer: Accept client reading...\n";
+
+                    // The socket is edge-triggered, so keep emitting the signal
+                    // until all pending data has been consumed.
+                    do {
+                        m_impl->receive_signal.emit (this, client_socket);
+                    } while (m_impl->running &&
+                             m_impl->is_watched (fd) &&
+                             m_impl->has_pending_data (fd));
+
+                    // Let the slot see the closed connection, no more event
+                    // will be reported for it.
+                    if (m_impl->running &&
+                        m_impl->is_watched (fd) &&
+                        (ev & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+                        m_impl->receive_signal.emit (this, client_socket);
+                }
+
+                if ((ev & EPOLLPRI) && m_impl->running &&
+                    m_impl->is_watched (fd)) {
+                    SCIM_DEBUG_SOCKET (3) << "  SocketServer: Client "
+                                          << fd
+                                          << "got an exception, callbacking...\n";
+
+                    m_impl->exception_signal.emit (this, client_socket);
+                }
+
+                // The connection may have just negotiated a shared memory ring.
+                if (m_impl->running)
+                    m_impl->watch_ring (fd);
+            }
+
+            if (!m_impl->running)
+                return true;
+        }
+    }
+}
+#else
+bool
+SocketServer::run_epoll ()
+{
+    m_impl->err = EBADF;
+    return false;
+}
+#endif
+
 bool
 SocketServer::is_running () const
 {
@@ -968,23 +2176,19 @@ SocketServer::shutdown ()
 
         m_impl->running = false;
 
-        for (int i = 0; i<m_impl->ext_fds.size (); i++)
-            FD_CLR (m_impl->ext_fds [i], &m_impl->active_fds);
-
-        for (int i = 0; i<m_impl->max_fd + 1; i++) {
-            //Close all client
-            if (FD_ISSET (i, &(m_impl->active_fds)) && i != Socket::get_id ()) {
+        for (int i = 0; i < (int) m_impl->fd_states.size (); i++) {
+            //Close all client, external sockets are owned by others.
+            if (m_impl->get_state (i) == SocketServerImpl::FD_CLIENT && i != Socket::get_id ()) {
                 SCIM_DEBUG_SOCKET (3) << "  SocketServer: Closing client: "
                                       << i << "\n";
+                __reset_socket_protocol (i);
                 ::close (i);
             }
         }
-        m_impl->max_fd = 0;
+        m_impl->close_backend ();
         m_impl->created = false;
         m_impl->err = 0;
         m_impl->num_clients = 0;
-        m_impl->ext_fds.clear ();
-        FD_ZERO (&(m_impl->active_fds));
 
         Socket::close ();
     }
@@ -994,17 +2198,15 @@ bool
 SocketServer::close_connection (const Socket &socket)
 {
     int id = socket.get_id ();
-    if (m_impl->created && m_impl->running && id > 0 && FD_ISSET (id, &(m_impl->active_fds))) {
+    if (m_impl->created && m_impl->running && id > 0 && m_impl->get_state (id) != SocketServerImpl::FD_NONE) {
 
         SCIM_DEBUG_SOCKET (2) << " SocketServer: Closing the connection: " << id << "\n";
 
         m_impl->num_clients --;
 
-        FD_CLR (id, &(m_impl->active_fds));
-
-        std::vector <int>::iterator it = std::find (m_impl->ext_fds.begin (), m_impl->ext_fds.end (), id);
-        if (it != m_impl->ext_fds.end ()) m_impl->ext_fds.erase (it);
+        m_impl->remove_fd (id);
 
+        __reset_socket_protocol (id);
         ::close (id);
         return true;
     }
@@ -1038,7 +2240,7 @@ SocketServer::get_max_clients () const
 void
 SocketServer::set_max_clients (int max_clients)
 {
-    if (max_clients < SCIM_SOCKET_SERVER_MAX_CLIENTS)
+    if (max_clients < m_impl->max_clients_limit ())
         m_impl->max_clients = max_clients;
 }
 
@@ -1048,11 +2250,8 @@ SocketServer::insert_external_socket (const Socket &sock)
     int fd = sock.get_id ();
 
     if (valid () && sock.valid () && sock.wait_for_data (0) >= 0 &&
-        m_impl->num_clients < m_impl->max_clients &&
-        !FD_ISSET (fd, &m_impl->active_fds)) {
-        m_impl->ext_fds.push_back (fd);
-        FD_SET (fd, &m_impl->active_fds);
-        if (m_impl->max_fd < fd) m_impl->max_fd = fd;
+        (m_impl->max_clients <= 0 || m_impl->num_clients < m_impl->max_clients) &&
+        m_impl->add_fd (fd, SocketServerImpl::FD_EXTERNAL)) {
         m_impl->num_clients ++;
         return true;
     }
@@ -1064,16 +2263,26 @@ SocketServer::remove_external_socket (const Socket &sock)
 {
     int fd = sock.get_id ();
 
-    if (valid () && FD_ISSET (fd, &m_impl->active_fds)) {
-        FD_CLR (fd, &m_impl->active_fds);
-        std::vector <int>::iterator it = std::find (m_impl->ext_fds.begin (), m_impl->ext_fds.end (), fd);
-        if (it != m_impl->ext_fds.end ()) m_impl->ext_fds.erase (it);
+    if (valid () && m_impl->get_state (fd) != SocketServerImpl::FD_NONE) {
+        m_impl->remove_fd (fd);
         m_impl->num_clients --;
         return true;
     }
     return false;
 }
 
+bool
+SocketServer::suspend_socket (const Socket &sock)
+{
+    return valid () && m_impl->suspend_fd (sock.get_id ());
+}
+
+bool
+SocketServer::resume_socket (const Socket &sock)
+{
+    return valid () && m_impl->resume_fd (sock.get_id ());
+}
+
 Connection
 SocketServer::signal_connect_accept (SocketServerSlotSocket *slot)
 {
@@ -1092,6 +2301,13 @@ SocketServer::signal_connect_exception (SocketServerSlotSocket *slot)
     return m_impl->exception_signal.connect (slot);
 }
 
+Connection
+SocketServer::signal_connect_idle (SocketServerSlotIdle *slot)
+{
+    m_impl->idle_pending = true;
+    return m_impl->idle_signal.connect (slot);
+}
+
 //Implementation of SocketClient
 SocketClient::SocketClient ()
     : Socket (-1), m_connected (false)
@@ -1306,35 +2522,148 @@ scim_socket_check_type (const String &types,
     return std::find (type_list.begin (), type_list.end (), atype) != type_list.end ();
 }
 
+// Set up the shared memory ring on the client side, after the hand shake.
+// Return 1 if the ring is used, 0 if not, -1 if the connection is broken.
+static int
+__open_socket_ring (const Socket &socket, int timeout)
+{
+#if SCIM_SOCKET_HAVE_SHM_RING
+    int fds [SocketRing::NUM_FDS];
+    char ack = 0;
+
+    SocketRing *ring = SocketRing::create (socket.get_id (), fds);
+
+    // Tell the server even if the ring can't be created,
+    // it's waiting for the fds.
+    bool sent = __send_socket_fds (socket.get_id (), fds, ring ? SocketRing::NUM_FDS : 0);
+
+    // The memfd is only needed by the server to map the ring.
+    if (ring) {
+        ::close (fds [0]);
+        fds [0] = -1;
+    }
+
+    if (!sent || socket.read_with_timeout (&ack, 1, timeout) != 1) {
+        delete ring;
+        return -1;
+    }
+
+    if (!ring || !ack) {
+        delete ring;
+        return 0;
+    }
+
+    __set_socket_ring (socket.get_id (), ring);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+// Set up the shared memory ring on the server side, after the hand shake.
+// Return 1 if the ring is used, 0 if not, -1 if the connection is broken.
+static int
+__accept_socket_ring (const Socket &socket, int timeout)
+{
+#if SCIM_SOCKET_HAVE_SHM_RING
+    int fds [SocketRing::NUM_FDS];
+    SocketRing *ring = 0;
+
+    int nfds = __receive_socket_fds (socket, fds, SocketRing::NUM_FDS, timeout);
+
+    if (nfds < 0)
+        return -1;
+
+    if (nfds == SocketRing::NUM_FDS)
+        ring = SocketRing::attach (socket.get_id (), fds);
+    else
+        for (int i = 0; i < nfds; ++i) ::close (fds [i]);
+
+    // The ack must be sent through the socket, before the ring is used.
+    char ack = ring ? 1 : 0;
+
+    if (socket.write (&ack, 1) != 1) {
+        delete ring;
+        return -1;
+    }
+
+    if (!ring)
+        return 0;
+
+    __set_socket_ring (socket.get_id (), ring);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
 bool
 scim_socket_open_connection   (uint32       &key,
                                const String &client_type,
                                const String &server_type,
                                const Socket &socket,
                                int           timeout)
+{
+    return scim_socket_open_connection (key, client_type, server_type, socket, timeout,
+                                        SCIM_SOCKET_PROTOCOL_DEFAULT);
+}
+
+bool
+scim_socket_open_connection   (uint32       &key,
+                               const String &client_type,
+                               const String &server_type,
+                               const Socket &socket,
+                               int           timeout,
+                               uint32        options)
 {
     if (!socket.valid () || !client_type.length () || !server_type.length ())
         return false;
 
     Transaction trans;
 
+    options &= SCIM_SOCKET_PROTOCOL_SUPPORTED;
+
     trans.put_command (SCIM_TRANS_CMD_REQUEST);
     trans.put_command (SCIM_TRANS_CMD_OPEN_CONNECTION);
     trans.put_data (String (SCIM_BINARY_VERSION));
     trans.put_data (client_type);
 
+    // Advertise the requested protocol options,
+    // old servers just ignore them.
+    trans.put_data (options);
+
+    __reset_socket_protocol (socket.get_id ());
+
     if (trans.write_to_socket (socket)) {
         int cmd;
+        uint32 accepted = 0;
         String server_types;
         if (trans.read_from_socket (socket, timeout) &&
             trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_REPLY &&
             trans.get_data (server_types) && scim_socket_check_type (server_types, server_type) &&
             trans.get_data (key)) {
+            // Old servers do not reply the accepted options.
+            if (trans.get_data (accepted))
+                accepted &= options;
+
+            // The ring is only used after it's set up.
+            __set_socket_protocol_options (socket.get_id (), accepted & ~SCIM_SOCKET_PROTOCOL_SHM_RING);
+
             trans.clear ();
             trans.put_command (SCIM_TRANS_CMD_REPLY);
             trans.put_command (SCIM_TRANS_CMD_OK);
-            if (trans.write_to_socket (socket))
-                return true;
+            if (!trans.write_to_socket (socket))
+                return false;
+
+            if (accepted & SCIM_SOCKET_PROTOCOL_SHM_RING) {
+                int ret = __open_socket_ring (socket, timeout);
+                if (ret < 0)
+                    return false;
+                if (ret > 0)
+                    __set_socket_protocol_options (socket.get_id (), accepted);
+            }
+
+            return true;
         } else {
             trans.clear ();
             trans.put_command (SCIM_TRANS_CMD_REPLY);
@@ -1352,14 +2681,29 @@ scim_socket_accept_connection (uint32       &key,
                                const String &client_types,
                                const Socket &socket,
                                int           timeout)
+{
+    return scim_socket_accept_connection (key, server_types, client_types, socket, timeout, 0);
+}
+
+String
+scim_socket_accept_connection (uint32       &key,
+                               const String &server_types,
+                               const String &client_types,
+                               const Socket &socket,
+                               int           timeout,
+                               uint32        server_options)
 {
     if (!socket.valid () || !client_types.length () || !server_types.length ())
         return String ("");
 
     Transaction trans;
 
+    __reset_socket_protocol (socket.get_id ());
+
     if (trans.read_from_socket (socket, timeout)) {
         int cmd;
+        uint32 options = 0;
+        bool has_options;
         String version;
         String client_type;
         if (trans.get_command (cmd)  && cmd == SCIM_TRANS_CMD_REQUEST &&
@@ -1367,17 +2711,40 @@ scim_socket_accept_connection (uint32       &key,
             trans.get_data (version) && version == String (SCIM_BINARY_VERSION) &&
             trans.get_data (client_type) && 
             (scim_socket_check_type (client_types, client_type) || client_type == "ConnectionTester")) {
+            // Old clients do not advertise any protocol option.
+            has_options = trans.get_data (options);
+            options &= SCIM_SOCKET_PROTOCOL_SUPPORTED & (SCIM_SOCKET_PROTOCOL_TRANSPORT | server_options);
+
+            // The shared memory ring only works for local connections.
+#if SCIM_SOCKET_HAVE_SHM_RING
+            if (!__is_local_socket (socket.get_id ()))
+#endif
+                options &= ~SCIM_SOCKET_PROTOCOL_SHM_RING;
+
             key = (uint32) rand ();
             trans.clear ();
             trans.put_command (SCIM_TRANS_CMD_REPLY);
             trans.put_data (server_types);
             trans.put_data (key);
 
+            if (has_options)
+                trans.put_data (options);
+
             if (trans.write_to_socket (socket) &&
                 trans.read_from_socket (socket, timeout) &&
                 trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_REPLY &&
                 trans.get_command (cmd) && cmd == SCIM_TRANS_CMD_OK) {
 
+                if (options & SCIM_SOCKET_PROTOCOL_SHM_RING) {
+                    int ret = __accept_socket_ring (socket, timeout);
+                    if (ret < 0)
+                        return String ("");
+                    if (ret == 0)
+                        options &= ~SCIM_SOCKET_PROTOCOL_SHM_RING;
+                }
+
+                __set_socket_protocol_options (socket.get_id (), options);
+
                 // Client is ok, return the client type.
                 return (client_type == "ConnectionTester") ? String ("") : client_type;
             }
@@ -30,6 +30,8 @@
 #ifndef __SCIM_SOCKET_H
 #define __SCIM_SOCKET_H
 
+struct iovec;
+
 namespace scim {
 
 /**
@@ -48,6 +50,9 @@ typedef Slot2<void, SocketServer *, const Socket &>
 typedef Signal2<void, SocketServer *, const Socket &>
         SocketServerSignalSocket;
 
+typedef Slot1<bool, SocketServer *>
+        SocketServerSlotIdle;
+
 /**
  * @brief An exception class to hold Socket related errors.
  *
@@ -73,6 +78,39 @@ enum SocketFamily
     SCIM_SOCKET_INET     /**< Internet (ipv4) socket address/protocol */
 };
 
+/**
+ * @brief Optional protocol features of a socket connection.
+ *
+ * These features are negotiated by scim_socket_open_connection () and
+ * scim_socket_accept_connection (), they are only used if both
+ * sides of the connection support them, so old peers keep working.
+ * #SCIM_SOCKET_PROTOCOL_SEQUENCE and #SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA
+ * must be implemented by the server, so they are only accepted if the
+ * server asks for them explicitly.
+ */
+enum SocketProtocolOption
+{
+    SCIM_SOCKET_PROTOCOL_FAST_CHECKSUM = 1, /**< Transactions are checked by CRC32C instead of the legacy byte sum. */
+    SCIM_SOCKET_PROTOCOL_SEQUENCE      = 2, /**< Requests may contain pipelined commands marked by SCIM_TRANS_CMD_SEQUENCE. */
+    SCIM_SOCKET_PROTOCOL_SHM_RING      = 4, /**< The data of a local connection is carried by a shared memory ring instead of the socket. */
+    SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA = 8, /**< Lookup tables may be sent as SCIM_TRANS_DATA_LOOKUP_TABLE_DELTA, both sides keep a LookupTableCache. */
+
+    /**
+     * The options requested by scim_socket_open_connection () if not specified.
+     */
+    SCIM_SOCKET_PROTOCOL_DEFAULT       = SCIM_SOCKET_PROTOCOL_FAST_CHECKSUM | SCIM_SOCKET_PROTOCOL_SEQUENCE
+};
+
+/**
+ * @brief The mechanism used by SocketServer to wait for socket events.
+ */
+enum SocketServerBackend
+{
+    SCIM_SOCKET_SERVER_AUTO,    /**< Use the best backend available on this system. */
+    SCIM_SOCKET_SERVER_SELECT,  /**< Use select (), the number of clients is limited by FD_SETSIZE. */
+    SCIM_SOCKET_SERVER_EPOLL    /**< Use edge-triggered epoll, falls back to select if not available. */
+};
+
 /**
  * @brief The class to hold a socket address.
  * 
@@ -237,6 +275,35 @@ public:
      */
     int write (const void *buf, size_t size) const;
 
+    /**
+     * @brief Read data from socket into several buffers with a timeout.
+     *
+     * The buffers are filled in order, as if they were one contiguous buffer,
+     * so a header and a body can be received with a single system call.
+     *
+     * @param iov the buffers to store the data, defined in <sys/uio.h>.
+     * @param iovcnt the number of buffers in iov.
+     * @param timeout time out in millisecond (1/1000 second), -1 means infinity.
+     *
+     * @return the amount of data actually read,
+     *         0 means the connection is closed,
+     *         -1 means error occurred.
+     */
+    int readv_with_timeout (const struct iovec *iov, int iovcnt, int timeout) const;
+
+    /**
+     * @brief Write data stored in several buffers to socket.
+     *
+     * All buffers are sent in order with as few system calls as possible,
+     * without copying them into one contiguous buffer first.
+     *
+     * @param iov the buffers store the data, defined in <sys/uio.h>.
+     * @param iovcnt the number of buffers in iov.
+     *
+     * @return the amount of data acutally sent, or -1 if an error occurred.
+     */
+    int writev (const struct iovec *iov, int iovcnt) const;
+
     /**
      * @brief Wait until there are some data ready to read.
      *
@@ -267,6 +334,14 @@ public:
      */
     int get_id () const;
 
+    /**
+     * @brief Get the protocol options negotiated for this socket connection.
+     *
+     * @return the bitwise OR of the SocketProtocolOption values
+     *         enabled for this connection, 0 if nothing was negotiated.
+     */
+    uint32 get_protocol_options () const;
+
 protected:
 
     /**
@@ -330,6 +405,9 @@ class SocketServer : private Socket
 
     SocketServerImpl *m_impl;
 
+    bool accept_connection ();
+    bool run_epoll ();
+
 public:
     /**
      * @brief Default constructor, do nothing.
@@ -344,6 +422,25 @@ public:
      */
     SocketServer (const SocketAddress &address, int max_clients = -1);
 
+    /**
+     * @brief Constructor with a specific event backend.
+     *
+     * The servers created by other constructors always use select ().
+     *
+     * @param max_clients the max number of socket clients, -1 means unlimited.
+     * @param backend the mechanism used to wait for socket events.
+     */
+    SocketServer (int max_clients, SocketServerBackend backend);
+
+    /**
+     * @brief Constructor with a specific event backend.
+     *
+     * @param address create a server on this address.
+     * @param max_clients the max number of socket clients, -1 means unlimited.
+     * @param backend the mechanism used to wait for socket events.
+     */
+    SocketServer (const SocketAddress &address, int max_clients, SocketServerBackend backend);
+
     /**
      * @brief Destructor.
      */
@@ -356,6 +453,13 @@ public:
      */
     bool valid () const;
 
+    /**
+     * @brief Get the backend actually used by this server.
+     *
+     * @return SCIM_SOCKET_SERVER_SELECT or SCIM_SOCKET_SERVER_EPOLL.
+     */
+    SocketServerBackend get_backend () const;
+
     /**
      * @brief Create a socket on an address.
      *
@@ -438,6 +542,30 @@ public:
      */
     bool remove_external_socket (const Socket &sock);
 
+    /**
+     * @brief Stop watching a client or an external socket temporarily.
+     *
+     * No signal will be emitted for the socket until resume_socket () is called,
+     * so that it can be served by another thread meanwhile.
+     * The socket is still owned by this server.
+     *
+     * This method must be called by the thread running the server.
+     *
+     * @param sock The socket to be suspended.
+     * @return true if the socket is watched by this server and has been suspended.
+     */
+    bool suspend_socket (const Socket &sock);
+
+    /**
+     * @brief Watch a socket suspended by suspend_socket () again.
+     *
+     * This method must be called by the thread running the server.
+     *
+     * @param sock The socket to be resumed.
+     * @return true if the socket has been resumed successfully.
+     */
+    bool resume_socket (const Socket &sock);
+
 public:
     /**
      * @brief Connect a slot to socket accept signal.
@@ -477,6 +605,25 @@ public:
      *         to disconnect the slot later.
      */
     Connection signal_connect_exception (SocketServerSlotSocket *slot);
+
+    /**
+     * @brief Connect a slot to idle signal.
+     *
+     * Connect a slot to idle signal, which is emitted by run () when there is
+     * no pending socket event, so that some low priority work can be done in
+     * small pieces without delaying the clients.
+     *
+     * The slot should return true if it has more work to do, then the signal
+     * will be emitted again the next time the server is idle. Once all slots
+     * return false, the signal is not emitted any more until another slot is
+     * connected.
+     *
+     * @param slot the slot to be connected to this signal.
+     *
+     * @return the Connection object of this slot-signal connection, can be used
+     *         to disconnect the slot later.
+     */
+    Connection signal_connect_idle (SocketServerSlotIdle *slot);
 };
 
 /**
@@ -602,6 +749,39 @@ bool   scim_socket_open_connection   (uint32       &key,
                                       const Socket &socket,
                                       int           timeout = -1);
 
+/**
+ * @brief Helper function to open a connection to a socket server
+ * with a standard hand shake protocol, requesting some optional
+ * protocol features.
+ *
+ * Same as above, except that the protocol options to be requested
+ * can be specified, for example #SCIM_SOCKET_PROTOCOL_SHM_RING, which
+ * is not requested by default. The options actually negotiated
+ * can be checked by Socket::get_protocol_options () afterwards.
+ *
+ * #SCIM_SOCKET_PROTOCOL_SHM_RING is only accepted for local sockets.
+ * Once it's negotiated, all data of the connection is carried by
+ * a pair of rings in shared memory, the socket is only used to detect
+ * the closing of the connection, so it must not be watched by select ()
+ * or similar functions directly. SocketServer handles it transparently.
+ *
+ * @param key         A random magic key sent from the socket server.
+ * @param client_type The type of this socket client.
+ * @param server_type The request socket server type.
+ * @param socket      The client socket connected to the socket server.
+ * @param timeout     The socket read timeout in millisecond, -1 means unlimited.
+ * @param options     The protocol options to be requested, a combination of
+ *                    #SocketProtocolOption.
+ *
+ * @return true if the connection was established successfully.
+ */
+bool   scim_socket_open_connection   (uint32       &key,
+                                      const String &client_type,
+                                      const String &server_type,
+                                      const Socket &socket,
+                                      int           timeout,
+                                      uint32        options);
+
 /**
  * @brief Helper function to accept a connection request from a socket client
  * with a standard hand shake protocol.
@@ -631,6 +811,36 @@ String scim_socket_accept_connection (uint32       &key,
                                       const String &client_types,
                                       const Socket &socket,
                                       int           timeout = -1);
+
+/**
+ * @brief Helper function to accept a connection request from a socket client
+ * with a standard hand shake protocol, accepting some optional protocol
+ * features implemented by the server.
+ *
+ * Same as above, except that the protocol options which are implemented
+ * by the server itself can be specified, for example
+ * #SCIM_SOCKET_PROTOCOL_SEQUENCE. Options which are handled transparently
+ * by the socket library, like #SCIM_SOCKET_PROTOCOL_FAST_CHECKSUM and
+ * #SCIM_SOCKET_PROTOCOL_SHM_RING, are always accepted.
+ *
+ * @param key          A random magic key to identify the socket client in later
+ *                     communications.
+ * @param server_types The type of this server.
+ * @param client_types A list of acceptable client types, separated by comma.
+ * @param socket       The socket connected to the client.
+ * @param timeout      the socket read timeout in millisecond, -1 means unlimited.
+ * @param options      The protocol options implemented by the server,
+ *                     a combination of #SocketProtocolOption.
+ *
+ * @return The type of the accepted socket client, or an empty string if the
+ *         connection could not be established.
+ */
+String scim_socket_accept_connection (uint32       &key,
+                                      const String &server_types,
+                                      const String &client_types,
+                                      const Socket &socket,
+                                      int           timeout,
+                                      uint32        options);
 /** @} */
 
 } // namespace scim
@@ -0,0 +1,120 @@
+/** @file scim_thread_pool.cpp
+ *  @brief Implementation of the internal thread pool.
+ */
+
+/*
+ * Smart Common Input Method
+ *
+ * Copyright (c) 2005 James Su <suzhe@tsinghua.org.cn>
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ */
+
+#define Uses_SCIM_CONFIG_BASE
+#define Uses_SCIM_CONFIG_PATH
+#define Uses_SCIM_GLOBAL_CONFIG
+#define Uses_C_STRING
+#define Uses_C_STDLIB
+#include "scim_private.h"
+#include "scim.h"
+#include "scim_thread_pool.h"
+#include <pthread.h>
+#include <unistd.h>
+
+using namespace scim;
+
+struct ScimThreadPoolJob
+{
+    size_t              count;
+    size_t              next;
+    ScimThreadPoolTask  task;
+    void               *data;
+};
+
+static void *
+__thread_pool_worker (void *arg)
+{
+    ScimThreadPoolJob *job = static_cast <ScimThreadPoolJob *> (arg);
+
+    // Each thread takes the next task until all of them are taken.
+    size_t index;
+    while ((index = __sync_fetch_and_add (&job->next, 1)) < job->count)
+        job->task (index, job->data);
+
+    return 0;
+}
+
+void
+scim_thread_pool_run (size_t count, ScimThreadPoolTask task, void *data, size_t max_threads)
+{
+    ScimThreadPoolJob job;
+
+    job.count = count;
+    job.next  = 0;
+    job.task  = task;
+    job.data  = data;
+
+    if (max_threads > count)
+        max_threads = count;
+
+    std::vector <pthread_t> threads;
+
+    for (size_t i = 1; i < max_threads; ++i) {
+        pthread_t thread;
+        if (pthread_create (&thread, 0, __thread_pool_worker, &job) != 0)
+            break;
+        threads.push_back (thread);
+    }
+
+    __thread_pool_worker (&job);
+
+    for (size_t i = 0; i < threads.size (); ++i)
+        pthread_join (threads [i], 0);
+}
+
+size_t
+scim_thread_pool_default_size ()
+{
+#if defined (_SC_NPROCESSORS_ONLN)
+    long n = sysconf (_SC_NPROCESSORS_ONLN);
+    if (n > 1) return (size_t) n;
+#endif
+    return 1;
+}
+
+bool
+scim_thread_pool_parallel_module_loading (const ConfigPointer &config)
+{
+    // Only these config modules are known to be safe to read from several
+    // threads at the same time.
+    if (config.null () || (config->get_name () != "simple" && config->get_name () != "dummy"))
+        return false;
+
+    bool parallel = scim_global_config_read (SCIM_GLOBAL_CONFIG_PARALLEL_MODULE_LOADING, false);
+
+    const char *env = getenv ("SCIM_PARALLEL_MODULE_LOADING");
+    if (env && strlen (env))
+        parallel = (atoi (env) != 0);
+
+    return parallel;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab
+*/
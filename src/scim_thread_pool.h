@@ -0,0 +1,74 @@
+/** @file scim_thread_pool.h
+ *  @brief Runs independent tasks in parallel, only used inside libscim.
+ */
+
+/*
+ * Smart Common Input Method
+ *
+ * Copyright (c) 2005 James Su <suzhe@tsinghua.org.cn>
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ */
+
+#ifndef __SCIM_THREAD_POOL_H
+#define __SCIM_THREAD_POOL_H
+
+// These functions are not in namespace scim, so that they are not
+// exported by libscim.version-script.
+
+typedef void (*ScimThreadPoolTask) (size_t index, void *data);
+
+/**
+ * Run task (i, data) for each i in [0, count) by at most max_threads
+ * threads, including the calling one. The tasks are started in the order
+ * of their indexes. Returns after all tasks are done.
+ *
+ * The tasks are run one by one in the calling thread if no thread can be
+ * created.
+ */
+void scim_thread_pool_run (size_t count, ScimThreadPoolTask task, void *data, size_t max_threads);
+
+/**
+ * The number of online CPUs, at least 1.
+ */
+size_t scim_thread_pool_default_size ();
+
+/**
+ * Check if the modules should be loaded in parallel, according to
+ * /ParallelModuleLoading in the global config or SCIM_PARALLEL_MODULE_LOADING
+ * environment variable.
+ *
+ * Only the init functions of the modules run in parallel, the factories
+ * are created one by one in the calling thread. The init functions may
+ * read the config, which is why it's only enabled with the config modules
+ * which can be read by several threads at the same time, that is simple
+ * and dummy config. They may also call scim_validate_locale (),
+ * scim_get_locale_encoding (), scim_get_locale_maxlen (), which don't
+ * touch the global locale, and ConfigBase::signal_connect_reload (),
+ * which is serialized. Anything
+ * else which changes a global state, like writing the config or calling
+ * setlocale (), is not safe.
+ */
+bool scim_thread_pool_parallel_module_loading (const scim::ConfigPointer &config);
+
+#endif //__SCIM_THREAD_POOL_H
+
+/*
+vi:ts=4:nowrap:ai:expandtab
+*/
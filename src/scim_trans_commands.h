@@ -122,6 +122,7 @@ namespace scim {
  *     - #SCIM_TRANS_CMD_GET_FACTORY_LOCALES
  *     - #SCIM_TRANS_CMD_GET_FACTORY_ICON_FILE
  *     - #SCIM_TRANS_CMD_GET_FACTORY_LANGUAGE
+ *     - #SCIM_TRANS_CMD_GET_FACTORY_INFO_BULK
  *     - #SCIM_TRANS_CMD_PROCESS_KEY_EVENT
  *     - #SCIM_TRANS_CMD_MOVE_PREEDIT_CARET
  *     - #SCIM_TRANS_CMD_SELECT_CANDIDATE
@@ -429,6 +430,62 @@ const int SCIM_TRANS_CMD_LOAD_FILE                        = 7;
  */
 const int SCIM_TRANS_CMD_SAVE_FILE                        = 8;
 
+/**
+ * @brief Mark the beginning of a pipelined command in a request, or the
+ *        beginning of its results in the reply.
+ *
+ * The corresponding data is:
+ *   - (uint32) a non-zero sequence number chosen by the client.
+ *
+ * A client may put several commands into one request, each one preceded by
+ * this command, so that the commands which do not need an immediate reply
+ * can be sent together with the next one.
+ * The server must put this command with the same sequence number into the
+ * reply before the results of the corresponding command, including the
+ * intermediate replies, like #SCIM_TRANS_CMD_GET_SURROUNDING_TEXT, sent
+ * while the command is being executed.
+ *
+ * This command can only be used if #SCIM_SOCKET_PROTOCOL_SEQUENCE was
+ * negotiated for the connection. It's currently only supported by
+ * SocketFrontEnd.
+ *
+ */
+const int SCIM_TRANS_CMD_SEQUENCE                         = 9;
+
+/**
+ * @brief Get the statistics of the commands processed by a socket server.
+ *
+ * No data is associated to this command.
+ *
+ * If the server supports this command, it should return:
+ *   - #SCIM_TRANS_CMD_REPLY
+ *   - (std::vector<uint32>) four items for each command processed so far:
+ *     the command, the number of calls, and the high and low 32 bits of
+ *     the cumulative processing time in microseconds.
+ *   - #SCIM_TRANS_CMD_OK
+ *
+ * This command is currently supported by SocketFrontEnd and Panel.
+ *
+ */
+const int SCIM_TRANS_CMD_GET_COMMAND_STATISTICS           = 10;
+
+/**
+ * @brief Ask the peer to forget the lookup table page it sent last time.
+ *
+ * No data is associated to this command.
+ *
+ * It's sent by the receiver of a #SCIM_TRANS_DATA_LOOKUP_TABLE_DELTA which
+ * does not match its scim::LookupTableCache, the peer must clear its own
+ * cache, so that the next lookup table is sent as a whole.
+ *
+ * SocketIMEngine sends it in its next request to SocketFrontEnd, Panel sends
+ * it to the FrontEnd client with #SCIM_TRANS_CMD_REPLY but no context id.
+ * It can only be used if #SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA was
+ * negotiated for the connection.
+ *
+ */
+const int SCIM_TRANS_CMD_RESET_LOOKUP_TABLE_CACHE         = 11;
+
 /**
  * @brief This command should be sent from a socket server to its clients to let them exit.
  *
@@ -509,6 +566,37 @@ const int SCIM_TRANS_CMD_GET_FACTORY_LOCALES              = 208;
 const int SCIM_TRANS_CMD_GET_FACTORY_ICON_FILE            = 209;
 const int SCIM_TRANS_CMD_GET_FACTORY_LANGUAGE             = 210;
 
+/**
+ * @brief This command is used in SocketIMEngine to SocketFrontEnd protocol
+ *        to get the information of all IMEngineFactories in one request.
+ *
+ * The corresponding data is:
+ *   - (String) the encoding which must be supported by the factories,
+ *     empty for all factories, like #SCIM_TRANS_CMD_GET_FACTORY_LIST.
+ *   - (uint32) non-zero if the contents of the icon files should be
+ *     returned as well, for the clients which can't access the files of
+ *     SocketFrontEnd directly.
+ *
+ * The Transaction returned from SocketFrontEnd should contain:
+ *   - #SCIM_TRANS_CMD_REPLY
+ *   - (uint32) the number of factories.
+ *   - For each factory:
+ *     - (String) the uuid.
+ *     - (WideString) the name.
+ *     - (String) the locales.
+ *     - (String) the language.
+ *     - (String) the icon file.
+ *     - Only if the icon contents were requested:
+ *       (uint32) 1 followed by (raw) the contents of the icon file, or
+ *       (uint32) 0 if the file can't be loaded or has been returned for
+ *       a previous factory.
+ *   - #SCIM_TRANS_CMD_OK
+ *
+ * A SocketFrontEnd which doesn't support this command returns
+ * #SCIM_TRANS_CMD_FAIL, then the individual commands above should be used.
+ */
+const int SCIM_TRANS_CMD_GET_FACTORY_INFO_BULK            = 211;
+
 // Socket Config to Socket FrontEnd
 const int SCIM_TRANS_CMD_FLUSH_CONFIG                     = 300;
 const int SCIM_TRANS_CMD_ERASE_CONFIG                     = 301;
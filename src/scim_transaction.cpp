@@ -32,6 +32,9 @@
 #define Uses_C_STDLIB
 #define Uses_C_STRING
 
+#include <sys/uio.h>
+#include <typeinfo>
+
 #include "scim_private.h"
 #include "scim.h"
 
@@ -40,23 +43,174 @@ namespace scim {
 #define SCIM_TRANS_MIN_BUFSIZE 512
 #define SCIM_TRANS_MAX_BUFSIZE (1048576*16)
 #define SCIM_TRANS_MAGIC       0x4d494353
+// Magic of transactions checked by CRC32C, only sent to peers which
+// negotiated SCIM_SOCKET_PROTOCOL_FAST_CHECKSUM.
+#define SCIM_TRANS_MAGIC_CRC32C 0x6d494353
 #define SCIM_TRANS_HEADER_SIZE (sizeof (uint32) * 4)
 
+// Max number of holders and readers kept in the pool of each thread.
+#define SCIM_TRANS_POOL_SIZE        16
+// Holders with a larger buffer are freed instead of being pooled.
+#define SCIM_TRANS_POOL_MAX_BUFSIZE 65536
+
+#if defined (__GNUC__)
+  #define SCIM_TRANS_THREAD_LOCAL __thread
+#else
+  #define SCIM_TRANS_THREAD_LOCAL
+#endif
+
+class TransactionHolder;
+
+struct TransactionPool
+{
+    TransactionHolder        *holders [SCIM_TRANS_POOL_SIZE];
+    size_t                    num_holders;
+    TransactionReader        *readers [SCIM_TRANS_POOL_SIZE];
+    size_t                    num_readers;
+    TransactionPoolStatistics stats;
+};
+
+static SCIM_TRANS_THREAD_LOCAL TransactionPool __transaction_pool;
+
+static inline uint32
+__update_checksum (uint32 sum, const unsigned char *ptr, size_t len)
+{
+    const unsigned char *ptr_end = ptr + len;
+
+    while (ptr < ptr_end) {
+        sum += (uint32) (*ptr);
+        sum = (sum << 1) | (sum >> 31);
+        ++ ptr;
+    }
+
+    return sum;
+}
+
+// CRC32C (Castagnoli), slice-by-8 tables for the portable implementation.
+struct Crc32cTable
+{
+    uint32 table [8][256];
+
+    Crc32cTable () {
+        for (uint32 i = 0; i < 256; ++i) {
+            uint32 crc = i;
+            for (int j = 0; j < 8; ++j)
+                crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+            table [0][i] = crc;
+        }
+        for (uint32 i = 0; i < 256; ++i)
+            for (int k = 1; k < 8; ++k)
+                table [k][i] = (table [k - 1][i] >> 8) ^ table [0][table [k - 1][i] & 0xff];
+    }
+};
+
+static uint32
+__update_crc32c_portable (uint32 crc, const unsigned char *ptr, size_t len)
+{
+    static const Crc32cTable tab;
+    const uint32 (*t)[256] = tab.table;
+
+    while (len >= 8) {
+        uint32 lo = crc ^ ((uint32) ptr [0] | ((uint32) ptr [1] << 8) |
+                           ((uint32) ptr [2] << 16) | ((uint32) ptr [3] << 24));
+        uint32 hi = (uint32) ptr [4] | ((uint32) ptr [5] << 8) |
+                    ((uint32) ptr [6] << 16) | ((uint32) ptr [7] << 24);
+
+        crc = t [7][lo & 0xff] ^ t [6][(lo >> 8) & 0xff] ^
+              t [5][(lo >> 16) & 0xff] ^ t [4][lo >> 24] ^
+              t [3][hi & 0xff] ^ t [2][(hi >> 8) & 0xff] ^
+              t [1][(hi >> 16) & 0xff] ^ t [0][hi >> 24];
+
+        ptr += 8;
+        len -= 8;
+    }
+
+    while (len--)
+        crc = (crc >> 8) ^ t [0][(crc ^ *ptr++) & 0xff];
+
+    return crc;
+}
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define SCIM_TRANS_HAVE_SSE42_CRC32C 1
+
+__attribute__ ((target ("sse4.2"))) static uint32
+__update_crc32c_sse42 (uint32 crc, const unsigned char *ptr, size_t len)
+{
+#if defined (__x86_64__)
+    unsigned long long crc64 = crc;
+    while (len >= 8) {
+        unsigned long long val;
+        memcpy (&val, ptr, 8);
+        crc64 = __builtin_ia32_crc32di (crc64, val);
+        ptr += 8;
+        len -= 8;
+    }
+    crc = (uint32) crc64;
+#endif
+    while (len >= 4) {
+        unsigned int val;
+        memcpy (&val, ptr, 4);
+        crc = __builtin_ia32_crc32si (crc, val);
+        ptr += 4;
+        len -= 4;
+    }
+    while (len--)
+        crc = __builtin_ia32_crc32qi (crc, *ptr++);
+
+    return crc;
+}
+
+static bool
+__cpu_has_sse42 ()
+{
+    __builtin_cpu_init ();
+    return __builtin_cpu_supports ("sse4.2");
+}
+#endif
+
+// Update a CRC32C value, without the initial and final inversion.
+static inline uint32
+__update_crc32c (uint32 crc, const unsigned char *ptr, size_t len)
+{
+#if SCIM_TRANS_HAVE_SSE42_CRC32C
+    static const bool has_sse42 = __cpu_has_sse42 ();
+    if (has_sse42)
+        return __update_crc32c_sse42 (crc, ptr, len);
+#endif
+    return __update_crc32c_portable (crc, ptr, len);
+}
+
 class TransactionHolder
 {
     mutable int    m_ref;
 
 public:
-    size_t         m_buffer_size;
-    size_t         m_write_pos;
-    unsigned char *m_buffer;
+    // A borrowed payload, which logically belongs at m_offset of m_buffer,
+    // but is kept out of it until the transaction is sent or flattened.
+    struct BorrowedData
+    {
+        size_t               m_offset;
+        const unsigned char *m_data;
+        size_t               m_size;
+    };
+
+    // The storage is mutable, since flatten () only changes how the
+    // content is laid out, not the content itself.
+    mutable size_t         m_buffer_size;
+    mutable size_t         m_write_pos;
+    mutable unsigned char *m_buffer;
+
+    mutable std::vector <BorrowedData> m_borrowed;
+    mutable size_t                     m_borrowed_size;
 
 public:
     TransactionHolder (size_t bufsize)
         : m_ref (0),
           m_buffer_size (std::max ((size_t)SCIM_TRANS_MIN_BUFSIZE, bufsize)),
           m_write_pos (SCIM_TRANS_HEADER_SIZE),
-          m_buffer ((unsigned char*) malloc (std::max ((size_t)SCIM_TRANS_MIN_BUFSIZE, bufsize))) {
+          m_buffer ((unsigned char*) malloc (std::max ((size_t)SCIM_TRANS_MIN_BUFSIZE, bufsize))),
+          m_borrowed_size (0) {
         if (!m_buffer)
             throw Exception ("TransactionHolder::TransactionHolder() Out of memory");
     }
@@ -74,12 +228,14 @@ public:
     }
 
     void unref () const {
-        if ((--m_ref) <= 0) delete this;
+        if ((--m_ref) <= 0) release (const_cast <TransactionHolder *> (this));
     }
 
     void request_buffer_size (size_t request) {
         if (m_write_pos + request >= m_buffer_size) {
-            size_t bufsize = std::max ((size_t) SCIM_TRANS_MIN_BUFSIZE, request + 1) + m_buffer_size;
+            // Grow geometrically, so that building a transaction by many
+            // small put_data () calls only reallocs a few times.
+            size_t bufsize = std::max (m_buffer_size * 2, m_write_pos + request + 1);
             unsigned char *tmp = (unsigned char*) realloc (m_buffer, bufsize);
 
             if (!tmp)
@@ -87,28 +243,143 @@ public:
 
             m_buffer = tmp;
             m_buffer_size = bufsize;
+
+            if (__transaction_pool.stats.peak_size < bufsize)
+                __transaction_pool.stats.peak_size = bufsize;
+        }
+    }
+
+    // Get a holder with at least bufsize bytes of buffer,
+    // reuse a pooled one of the current thread if possible.
+    static TransactionHolder * acquire (size_t bufsize) {
+        TransactionPool &pool = __transaction_pool;
+
+        if (pool.num_holders) {
+            TransactionHolder *holder = pool.holders [--pool.num_holders];
+            ++pool.stats.hits;
+            if (holder->m_buffer_size < bufsize)
+                holder->request_buffer_size (bufsize - holder->m_write_pos);
+            return holder;
+        }
+
+        ++pool.stats.misses;
+
+        TransactionHolder *holder = new TransactionHolder (bufsize);
+
+        if (pool.stats.peak_size < holder->m_buffer_size)
+            pool.stats.peak_size = holder->m_buffer_size;
+
+        return holder;
+    }
+
+    static void release (TransactionHolder *holder) {
+        TransactionPool &pool = __transaction_pool;
+
+        if (pool.num_holders < SCIM_TRANS_POOL_SIZE &&
+            holder->m_buffer_size <= SCIM_TRANS_POOL_MAX_BUFSIZE) {
+            holder->m_ref = 0;
+            holder->m_write_pos = SCIM_TRANS_HEADER_SIZE;
+            holder->drop_borrowed ();
+            pool.holders [pool.num_holders++] = holder;
+        } else {
+            delete holder;
         }
     }
 
-    uint32 calc_checksum () const {
-        uint32 sum = 0;
+    void borrow (const void *data, size_t size) {
+        BorrowedData borrowed;
+        borrowed.m_offset = m_write_pos;
+        borrowed.m_data   = static_cast <const unsigned char *> (data);
+        borrowed.m_size   = size;
+        m_borrowed.push_back (borrowed);
+        m_borrowed_size += size;
+    }
+
+    void drop_borrowed () const {
+        m_borrowed.clear ();
+        m_borrowed_size = 0;
+    }
+
+    // Copy all borrowed payloads into the buffer, so that
+    // the transaction can be read or copied as a whole.
+    void flatten () const {
+        if (m_borrowed.empty ()) return;
+
+        size_t total = m_write_pos + m_borrowed_size;
+        unsigned char *tmp = (unsigned char*) malloc (std::max ((size_t) SCIM_TRANS_MIN_BUFSIZE, total + 1));
+
+        if (!tmp)
+            throw Exception ("TransactionHolder::flatten() Out of memory");
 
-        unsigned char *ptr = m_buffer + SCIM_TRANS_HEADER_SIZE;
-        unsigned char *ptr_end = m_buffer + m_write_pos;
+        size_t src = 0;
+        size_t dst = 0;
 
-        while (ptr < ptr_end) {
-            sum += (uint32) (*ptr);
-            sum = (sum << 1) | (sum >> 31);
-            ++ ptr;
+        for (size_t i = 0; i < m_borrowed.size (); ++i) {
+            memcpy (tmp + dst, m_buffer + src, m_borrowed [i].m_offset - src);
+            dst += m_borrowed [i].m_offset - src;
+            src = m_borrowed [i].m_offset;
+            memcpy (tmp + dst, m_borrowed [i].m_data, m_borrowed [i].m_size);
+            dst += m_borrowed [i].m_size;
         }
+        memcpy (tmp + dst, m_buffer + src, m_write_pos - src);
 
-        return sum;
+        free (m_buffer);
+
+        m_buffer = tmp;
+        m_buffer_size = std::max ((size_t) SCIM_TRANS_MIN_BUFSIZE, total + 1);
+        m_write_pos = total;
+
+        if (__transaction_pool.stats.peak_size < m_buffer_size)
+            __transaction_pool.stats.peak_size = m_buffer_size;
+
+        drop_borrowed ();
+    }
+
+    uint32 calc_checksum (bool crc32c = false) const {
+        uint32 (*update) (uint32, const unsigned char *, size_t) =
+            crc32c ? __update_crc32c : __update_checksum;
+        uint32 sum = crc32c ? 0xFFFFFFFF : 0;
+        size_t pos = SCIM_TRANS_HEADER_SIZE;
+
+        for (size_t i = 0; i < m_borrowed.size (); ++i) {
+            sum = update (sum, m_buffer + pos, m_borrowed [i].m_offset - pos);
+            sum = update (sum, m_borrowed [i].m_data, m_borrowed [i].m_size);
+            pos = m_borrowed [i].m_offset;
+        }
+
+        sum = update (sum, m_buffer + pos, m_write_pos - pos);
+
+        return crc32c ? ~sum : sum;
     }
 };
 
+static TransactionReader *
+__acquire_reader ()
+{
+    TransactionPool &pool = __transaction_pool;
+
+    if (pool.num_readers)
+        return pool.readers [--pool.num_readers];
+
+    return new TransactionReader ();
+}
+
+static void
+__release_reader (TransactionReader *reader)
+{
+    TransactionPool &pool = __transaction_pool;
+
+    if (pool.num_readers < SCIM_TRANS_POOL_SIZE) {
+        reader->detach ();
+        pool.readers [pool.num_readers++] = reader;
+    } else {
+        delete reader;
+    }
+}
+
 Transaction::Transaction (size_t bufsize)
-    : m_holder (new TransactionHolder (bufsize)),
-      m_reader (new TransactionReader ())
+    : m_holder (TransactionHolder::acquire (bufsize)),
+      m_reader (__acquire_reader ())
 {
     m_holder->ref ();
     m_reader->attach (*this);
@@ -116,7 +387,7 @@ Transaction::Transaction (size_t bufsize)
 
 Transaction::~Transaction ()
 {
-    delete m_reader;
+    __release_reader (m_reader);
     m_holder->unref ();
 }
 
@@ -130,11 +401,39 @@ bool
 Transaction::write_to_socket (const Socket &socket, uint32 signature) const
 {
     if (socket.valid () && valid ()) {
+        size_t size = m_holder->m_write_pos + m_holder->m_borrowed_size;
+        bool crc32c = (socket.get_protocol_options () & SCIM_SOCKET_PROTOCOL_FAST_CHECKSUM) != 0;
+
         scim_uint32tobytes (m_holder->m_buffer, signature);
-        scim_uint32tobytes (m_holder->m_buffer + sizeof (uint32), SCIM_TRANS_MAGIC);
-        scim_uint32tobytes (m_holder->m_buffer + sizeof (uint32) * 2, m_holder->m_write_pos - SCIM_TRANS_HEADER_SIZE);
-        scim_uint32tobytes (m_holder->m_buffer + sizeof (uint32) * 3, m_holder->calc_checksum ());
-        return socket.write (m_holder->m_buffer, m_holder->m_write_pos) == (int) m_holder->m_write_pos;
+        scim_uint32tobytes (m_holder->m_buffer + sizeof (uint32), crc32c ? SCIM_TRANS_MAGIC_CRC32C : SCIM_TRANS_MAGIC);
+        scim_uint32tobytes (m_holder->m_buffer + sizeof (uint32) * 2, size - SCIM_TRANS_HEADER_SIZE);
+        scim_uint32tobytes (m_holder->m_buffer + sizeof (uint32) * 3, m_holder->calc_checksum (crc32c));
+
+        if (m_holder->m_borrowed.empty ())
+            return socket.write (m_holder->m_buffer, m_holder->m_write_pos) == (int) m_holder->m_write_pos;
+
+        // Gather the buffer and all borrowed payloads, and send them at once.
+        std::vector <struct iovec> iov;
+        struct iovec seg;
+        size_t pos = 0;
+
+        iov.reserve (m_holder->m_borrowed.size () * 2 + 1);
+
+        for (size_t i = 0; i < m_holder->m_borrowed.size (); ++i) {
+            seg.iov_base = m_holder->m_buffer + pos;
+            seg.iov_len  = m_holder->m_borrowed [i].m_offset - pos;
+            iov.push_back (seg);
+            seg.iov_base = const_cast <unsigned char *> (m_holder->m_borrowed [i].m_data);
+            seg.iov_len  = m_holder->m_borrowed [i].m_size;
+            iov.push_back (seg);
+            pos = m_holder->m_borrowed [i].m_offset;
+        }
+
+        seg.iov_base = m_holder->m_buffer + pos;
+        seg.iov_len  = m_holder->m_write_pos - pos;
+        iov.push_back (seg);
+
+        return socket.writev (&iov [0], (int) iov.size ()) == (int) size;
     }
     return false;
 }
@@ -143,37 +442,48 @@ bool
 Transaction::read_from_socket (const Socket &socket, int timeout)
 {
     if (socket.valid () && valid ()) {
-        unsigned char buf [sizeof (uint32) * 2];
+        unsigned char buf [sizeof (uint32) * 4];
+        unsigned char *checksum_buf;
         uint32 sign1, sign2;
-        uint32 checksum;
+        bool crc32c;
         int size;
         int nbytes;
 
-        nbytes = socket.read_with_timeout (buf, sizeof (uint32) * 2, timeout);
-        if (nbytes < sizeof (uint32) * 2)
+        // The shortest possible transaction is a header without signature
+        // plus at least one byte of data, so the first three words can
+        // always be read at once without touching the next transaction.
+        nbytes = socket.read_with_timeout (buf, sizeof (uint32) * 3, timeout);
+        if (nbytes < (int) sizeof (uint32) * 3)
             return false;
 
         sign1 = scim_bytestouint32 (buf);
         sign2 = scim_bytestouint32 (buf + sizeof (uint32));
 
-        if (sign1 != SCIM_TRANS_MAGIC && sign2 != SCIM_TRANS_MAGIC)
+        // The signature may be equal to the magic,
+        // so check the second word first.
+        if (sign2 == SCIM_TRANS_MAGIC || sign2 == SCIM_TRANS_MAGIC_CRC32C)
+            crc32c = (sign2 == SCIM_TRANS_MAGIC_CRC32C);
+        else if (sign1 == SCIM_TRANS_MAGIC || sign1 == SCIM_TRANS_MAGIC_CRC32C)
+            crc32c = (sign1 == SCIM_TRANS_MAGIC_CRC32C);
+        else
             return false;
 
-        if (sign2 == SCIM_TRANS_MAGIC) {
-            nbytes = socket.read_with_timeout (buf, sizeof (uint32), timeout);
-            if (nbytes < sizeof (uint32))
-                return false;
-            size = scim_bytestouint32 (buf);
+        struct iovec iov [2];
+        int iovcnt = 0;
+
+        if (sign2 == SCIM_TRANS_MAGIC || sign2 == SCIM_TRANS_MAGIC_CRC32C) {
+            // The signature is present, the checksum is still pending,
+            // so receive it together with the data.
+            size = (int) scim_bytestouint32 (buf + sizeof (uint32) * 2);
+            checksum_buf = buf + sizeof (uint32) * 3;
+            iov [iovcnt].iov_base = checksum_buf;
+            iov [iovcnt].iov_len  = sizeof (uint32);
+            ++iovcnt;
         } else {
             size = (int) sign2;
+            checksum_buf = buf + sizeof (uint32) * 2;
         }
 
-        nbytes = socket.read_with_timeout (buf, sizeof (uint32), timeout);
-        if (nbytes < sizeof (uint32))
-            return false;
-
-        checksum = scim_bytestouint32 (buf);
-
         if (size <= 0 || size > SCIM_TRANS_MAX_BUFSIZE)
             return false;
 
@@ -181,18 +491,18 @@ Transaction::read_from_socket (const Socket &socket, int timeout)
 
         m_holder->request_buffer_size (size);
 
-        while (size != 0) {
-            nbytes = socket.read_with_timeout (m_holder->m_buffer + m_holder->m_write_pos, size, timeout);
-            if (nbytes <= 0) {
-                m_holder->m_write_pos = SCIM_TRANS_HEADER_SIZE;
-                return false;
-            }
+        iov [iovcnt].iov_base = m_holder->m_buffer + m_holder->m_write_pos;
+        iov [iovcnt].iov_len  = size;
+        ++iovcnt;
 
-            size -= nbytes;
-            m_holder->m_write_pos += nbytes;
-        }
+        nbytes = socket.readv_with_timeout (iov, iovcnt, timeout);
+
+        if (nbytes != (int) ((iovcnt - 1) * sizeof (uint32)) + size)
+            return false;
 
-        if (checksum != m_holder->calc_checksum ()) {
+        m_holder->m_write_pos += size;
+
+        if (scim_bytestouint32 (checksum_buf) != m_holder->calc_checksum (crc32c)) {
             m_holder->m_write_pos = SCIM_TRANS_HEADER_SIZE;
             return false;
         }
@@ -205,13 +515,15 @@ Transaction::read_from_socket (const Socket &socket, int timeout)
 size_t
 Transaction::get_size () const
 {
-    return m_holder->m_write_pos;
+    return m_holder->m_write_pos + m_holder->m_borrowed_size;
 }
 
 bool
 Transaction::write_to_buffer (void *buf, size_t bufsize) const
 {
-    if (valid () && buf && bufsize >= m_holder->m_write_pos) {
+    if (valid () && buf && bufsize >= get_size ()) {
+        m_holder->flatten ();
+
         unsigned char *cbuf = static_cast <unsigned char *> (buf);
 
         memcpy (buf, m_holder->m_buffer, m_holder->m_write_pos); 
@@ -231,7 +543,7 @@ Transaction::read_from_buffer (const void *buf, size_t bufsize)
 {
     const unsigned char * cbuf = static_cast <const unsigned char *> (buf);
 
-    if (valid () && buf &&
+    if (valid () && buf && bufsize >= SCIM_TRANS_HEADER_SIZE &&
         scim_bytestouint32 (cbuf) == 0 &&
         scim_bytestouint32 (cbuf + sizeof (uint32)) == SCIM_TRANS_MAGIC &&
         scim_bytestouint32 (cbuf + sizeof (uint32) * 2) <= bufsize - SCIM_TRANS_HEADER_SIZE) {
@@ -239,12 +551,13 @@ Transaction::read_from_buffer (const void *buf, size_t bufsize)
         uint32 size = scim_bytestouint32 (cbuf + sizeof (uint32) * 2) + SCIM_TRANS_HEADER_SIZE;
         uint32 checksum = scim_bytestouint32 (cbuf + sizeof (uint32) * 3);
 
-        if (m_holder->m_buffer_size < size)
-            m_holder->request_buffer_size (size - m_holder->m_buffer_size);
+        m_holder->drop_borrowed ();
+        m_holder->m_write_pos = SCIM_TRANS_HEADER_SIZE;
+        m_holder->request_buffer_size (size - SCIM_TRANS_HEADER_SIZE);
 
         memcpy (m_holder->m_buffer, buf, size);
 
-        m_holder->m_write_pos = SCIM_TRANS_HEADER_SIZE;
+        m_holder->m_write_pos = size;
 
         if (checksum == m_holder->calc_checksum ())
             return true;
@@ -292,23 +605,58 @@ Transaction::put_data (const String &str)
     m_holder->m_write_pos += str.length ();
 }
 
-void
-Transaction::put_data (const WideString &str)
+// Store an ucs4 string as utf8 directly into the holder's buffer,
+// without the temporary String used by utf8_wcstombs ().
+static void
+__put_wstring (TransactionHolder *holder, const ucs4_t *str, size_t len)
 {
-    String mbs = utf8_wcstombs (str);
+    size_t len_pos;
+    size_t i;
+    int    un;
 
-    m_holder->request_buffer_size (1 + mbs.length () + sizeof (uint32));
+    holder->request_buffer_size (1 + len * 6 + sizeof (uint32));
 
-    m_holder->m_buffer [m_holder->m_write_pos++] = (unsigned char) SCIM_TRANS_DATA_WSTRING;
+    holder->m_buffer [holder->m_write_pos++] = (unsigned char) SCIM_TRANS_DATA_WSTRING;
 
-    scim_uint32tobytes (m_holder->m_buffer + m_holder->m_write_pos, mbs.length ());
+    len_pos = holder->m_write_pos;
 
-    m_holder->m_write_pos += sizeof (uint32);
+    holder->m_write_pos += sizeof (uint32);
 
-    if (mbs.length ())
-        memcpy (m_holder->m_buffer + m_holder->m_write_pos, mbs.c_str (), mbs.length ());
+    for (i = 0; i < len; ++i) {
+        un = utf8_wctomb (holder->m_buffer + holder->m_write_pos, str [i], 6);
+        if (un > 0)
+            holder->m_write_pos += un;
+    }
 
-    m_holder->m_write_pos += mbs.length ();
+    scim_uint32tobytes (holder->m_buffer + len_pos, holder->m_write_pos - len_pos - sizeof (uint32));
+}
+
+static void
+__put_attributes (TransactionHolder *holder, const Attribute *attrs, size_t count)
+{
+    holder->request_buffer_size (count * (sizeof (uint32) * 3 + 1) + sizeof (uint32) + 1);
+
+    holder->m_buffer [holder->m_write_pos++] = (unsigned char) SCIM_TRANS_DATA_ATTRIBUTE_LIST;
+
+    scim_uint32tobytes (holder->m_buffer + holder->m_write_pos, count);
+
+    holder->m_write_pos += sizeof (uint32);
+
+    for (size_t i=0; i<count; ++i) {
+        holder->m_buffer [holder->m_write_pos++] = (unsigned char) attrs[i].get_type ();
+        scim_uint32tobytes (holder->m_buffer + holder->m_write_pos, attrs[i].get_value ());
+        holder->m_write_pos += sizeof (uint32);
+        scim_uint32tobytes (holder->m_buffer + holder->m_write_pos, attrs[i].get_start ());
+        holder->m_write_pos += sizeof (uint32);
+        scim_uint32tobytes (holder->m_buffer + holder->m_write_pos, attrs[i].get_length ());
+        holder->m_write_pos += sizeof (uint32);
+    }
+}
+
+void
+Transaction::put_data (const WideString &str)
+{
+    __put_wstring (m_holder, str.length () ? &str [0] : 0, str.length ());
 }
 
 void
@@ -334,25 +682,7 @@ Transaction::put_data (const KeyEvent &key)
 void
 Transaction::put_data (const AttributeList &attrs)
 {
-    size_t size = attrs.size () * (sizeof (uint32) * 3 + 1) + sizeof (uint32) + 1;
-
-    m_holder->request_buffer_size (size);
-
-    m_holder->m_buffer [m_holder->m_write_pos++] = (unsigned char) SCIM_TRANS_DATA_ATTRIBUTE_LIST;
-
-    scim_uint32tobytes (m_holder->m_buffer + m_holder->m_write_pos, attrs.size ());
-
-    m_holder->m_write_pos += sizeof (uint32);
-
-    for (size_t i=0; i<attrs.size (); ++i) {
-        m_holder->m_buffer [m_holder->m_write_pos++] = (unsigned char) attrs[i].get_type ();
-        scim_uint32tobytes (m_holder->m_buffer + m_holder->m_write_pos, attrs[i].get_value ());
-        m_holder->m_write_pos += sizeof (uint32);
-        scim_uint32tobytes (m_holder->m_buffer + m_holder->m_write_pos, attrs[i].get_start ());
-        m_holder->m_write_pos += sizeof (uint32);
-        scim_uint32tobytes (m_holder->m_buffer + m_holder->m_write_pos, attrs[i].get_length ());
-        m_holder->m_write_pos += sizeof (uint32);
-    }
+    __put_attributes (m_holder, attrs.size () ? &attrs [0] : 0, attrs.size ());
 }
 
 void
@@ -396,7 +726,7 @@ void
 Transaction::put_data (const LookupTable &table)
 {
     unsigned char stat = 0;
-    size_t i;
+    int i;
 
     m_holder->request_buffer_size (4);
 
@@ -406,7 +736,7 @@ Transaction::put_data (const LookupTable &table)
 
     //Can be page down.
     if (table.get_current_page_start () + table.get_current_page_size () <
-        table.number_of_candidates ())
+        (int) table.number_of_candidates ())
         stat |= 2;
 
     //Cursor is visible.
@@ -427,9 +757,63 @@ Transaction::put_data (const LookupTable &table)
         put_data (table.get_candidate_label (i));
 
     // Store page candidates, attributes.
-    for (i = 0; i < table.get_current_page_size (); ++i) {
-        put_data (table.get_candidate_in_current_page (i));
-        put_data (table.get_attributes_in_current_page (i));
+    // CommonLookupTable can be serialized straight from its buffers.
+    // Derived classes may override get_candidate (), so only the exact type qualifies.
+    if (typeid (table) == typeid (CommonLookupTable)) {
+        const CommonLookupTable *common = static_cast <const CommonLookupTable *> (&table);
+        const ucs4_t    *cand;
+        const Attribute *attrs;
+        uint32           len;
+        int              start = table.get_current_page_start ();
+
+        for (i = 0; i < table.get_current_page_size (); ++i) {
+            cand = common->get_candidate_buffer (start + i, len);
+            __put_wstring (m_holder, cand, len);
+            attrs = common->get_attributes_buffer (start + i, len);
+            __put_attributes (m_holder, attrs, len);
+        }
+    } else {
+        for (i = 0; i < table.get_current_page_size (); ++i) {
+            put_data (table.get_candidate_in_current_page (i));
+            put_data (table.get_attributes_in_current_page (i));
+        }
+    }
+}
+
+void
+Transaction::put_data (const LookupTable &table, LookupTableCache &cache)
+{
+    size_t start = m_holder->m_write_pos;
+
+    put_data (table);
+
+    // Compare the labels, candidates and attributes of the page with the cached ones.
+    const unsigned char *page = m_holder->m_buffer + start + 4;
+    size_t page_len = m_holder->m_write_pos - start - 4;
+    uint32 page_size = m_holder->m_buffer [start + 2];
+
+    if (cache.m_valid && cache.m_page_size == page_size &&
+        cache.m_page.length () == page_len &&
+        memcmp (cache.m_page.data (), page, page_len) == 0) {
+        unsigned char stat = m_holder->m_buffer [start + 1];
+        unsigned char cursor = m_holder->m_buffer [start + 3];
+
+        m_holder->m_write_pos = start;
+        m_holder->request_buffer_size (4 + sizeof (uint32));
+
+        m_holder->m_buffer [m_holder->m_write_pos++] = (unsigned char) SCIM_TRANS_DATA_LOOKUP_TABLE_DELTA;
+        m_holder->m_buffer [m_holder->m_write_pos++] = stat;
+        m_holder->m_buffer [m_holder->m_write_pos++] = (unsigned char) page_size;
+        m_holder->m_buffer [m_holder->m_write_pos++] = cursor;
+
+        // So that the receiver can tell whether its cache is the same.
+        scim_uint32tobytes (m_holder->m_buffer + m_holder->m_write_pos, cache.m_checksum);
+        m_holder->m_write_pos += sizeof (uint32);
+    } else {
+        cache.m_page.assign ((const char *) page, page_len);
+        cache.m_page_size = page_size;
+        cache.m_checksum = ~__update_crc32c (0xFFFFFFFF, page, page_len);
+        cache.m_valid = true;
     }
 }
 
@@ -503,12 +887,46 @@ Transaction::put_data (const char *raw, size_t bufsize)
     m_holder->m_write_pos += bufsize;
 }
 
+void
+Transaction::put_borrowed_data (const char *raw, size_t bufsize)
+{
+    if (!raw || !bufsize)
+        return;
+
+    m_holder->request_buffer_size (sizeof (uint32) + 1);
+
+    m_holder->m_buffer [m_holder->m_write_pos++] = (unsigned char) SCIM_TRANS_DATA_RAW;
+
+    scim_uint32tobytes (m_holder->m_buffer + m_holder->m_write_pos, (uint32) bufsize);
+
+    m_holder->m_write_pos += sizeof (uint32);
+
+    m_holder->borrow (raw, bufsize);
+}
+
+void
+Transaction::put_borrowed_data (const String &str)
+{
+    m_holder->request_buffer_size (sizeof (uint32) + 1);
+
+    m_holder->m_buffer [m_holder->m_write_pos++] = (unsigned char) SCIM_TRANS_DATA_STRING;
+
+    scim_uint32tobytes (m_holder->m_buffer + m_holder->m_write_pos, str.length ());
+
+    m_holder->m_write_pos += sizeof (uint32);
+
+    if (str.length ())
+        m_holder->borrow (str.data (), str.length ());
+}
+
 void
 Transaction::put_data (const Transaction &trans)
 {
     if (!trans.valid ())
         return;
 
+    trans.m_holder->flatten ();
+
     m_holder->request_buffer_size (trans.m_holder->m_write_pos + sizeof (uint32) + 1);
 
     m_holder->m_buffer [m_holder->m_write_pos++] = (unsigned char) SCIM_TRANS_DATA_TRANSACTION;
@@ -526,6 +944,7 @@ void
 Transaction::clear ()
 {
     m_holder->m_write_pos = SCIM_TRANS_HEADER_SIZE;
+    m_holder->drop_borrowed ();
     m_reader->rewind ();
 }
 
@@ -589,6 +1008,12 @@ Transaction::get_data (CommonLookupTable &table)
     return m_reader->get_data (table);
 }
 
+bool
+Transaction::get_data (CommonLookupTable &table, LookupTableCache &cache)
+{
+    return m_reader->get_data (table, cache);
+}
+
 bool
 Transaction::get_data (std::vector<uint32> &vec)
 {
@@ -650,6 +1075,8 @@ public:
     }
 
     bool valid () const {
+        // Borrowed payloads must be copied in before they can be read.
+        if (m_holder) m_holder->flatten ();
         return m_holder && m_holder->valid ();
     }
 
@@ -1095,6 +1522,65 @@ TransactionReader::get_data (CommonLookupTable &table)
     return false;
 }
 
+bool
+TransactionReader::get_data (CommonLookupTable &table, LookupTableCache &cache)
+{
+    if (!valid () || m_impl->m_holder->m_write_pos <= m_impl->m_read_pos)
+        return false;
+
+    const unsigned char *buffer = m_impl->m_holder->m_buffer;
+    size_t start = m_impl->m_read_pos;
+
+    if (buffer [start] == SCIM_TRANS_DATA_LOOKUP_TABLE) {
+        if (!get_data (table))
+            return false;
+
+        const unsigned char *page = buffer + start + 4;
+        size_t page_len = m_impl->m_read_pos - start - 4;
+
+        cache.m_page.assign ((const char *) page, page_len);
+        cache.m_page_size = buffer [start + 2];
+        cache.m_checksum = ~__update_crc32c (0xFFFFFFFF, page, page_len);
+        cache.m_valid = true;
+        return true;
+    }
+
+    if (buffer [start] == SCIM_TRANS_DATA_LOOKUP_TABLE_DELTA) {
+        if (m_impl->m_holder->m_write_pos < start + 4 + sizeof (uint32))
+            return false;
+
+        unsigned char stat = buffer [start + 1];
+        unsigned char page_size = buffer [start + 2];
+        unsigned char cursor = buffer [start + 3];
+        uint32 checksum = scim_bytestouint32 (buffer + start + 4);
+
+        m_impl->m_read_pos += 4 + sizeof (uint32);
+
+        // Out of sync, the sender has to be told to send a whole page again.
+        if (!cache.m_valid || cache.m_page_size != page_size || cache.m_checksum != checksum) {
+            cache.clear ();
+            return false;
+        }
+
+        // Rebuild the whole lookup table data from the cached page.
+        Transaction temp;
+        TransactionHolder *holder = temp.m_holder;
+
+        holder->request_buffer_size (cache.m_page.length () + 4);
+
+        holder->m_buffer [holder->m_write_pos++] = (unsigned char) SCIM_TRANS_DATA_LOOKUP_TABLE;
+        holder->m_buffer [holder->m_write_pos++] = stat;
+        holder->m_buffer [holder->m_write_pos++] = page_size;
+        holder->m_buffer [holder->m_write_pos++] = cursor;
+        memcpy (holder->m_buffer + holder->m_write_pos, cache.m_page.data (), cache.m_page.length ());
+        holder->m_write_pos += cache.m_page.length ();
+
+        return temp.get_data (table);
+    }
+
+    return false;
+}
+
 bool
 TransactionReader::get_data (std::vector<uint32> &vec)
 {
@@ -1259,6 +1745,7 @@ TransactionReader::get_data (Transaction &trans)
             return false;
         }
 
+        trans.m_holder->drop_borrowed ();
         trans.m_holder->request_buffer_size (len);
 
         memcpy (trans.m_holder->m_buffer, m_impl->m_holder->m_buffer + m_impl->m_read_pos, len);
@@ -1343,6 +1830,14 @@ TransactionReader::skip_data ()
                 size_t bufsize;
                 return get_data (NULL, bufsize);
             }
+            case SCIM_TRANS_DATA_LOOKUP_TABLE_DELTA:
+            {
+                if (m_impl->m_holder->m_write_pos < (m_impl->m_read_pos + sizeof (uint32) + 4))
+                    return false;
+
+                m_impl->m_read_pos += (sizeof (uint32) + 4);
+                return true;
+            }
             case SCIM_TRANS_DATA_TRANSACTION:
             {
                 size_t len;
@@ -1369,6 +1864,25 @@ TransactionReader::rewind ()
     m_impl->rewind ();
 }
 
+void
+scim_transaction_get_pool_statistics (TransactionPoolStatistics &stats)
+{
+    stats = __transaction_pool.stats;
+    stats.pooled = __transaction_pool.num_holders;
+}
+
+void
+scim_transaction_clear_pool ()
+{
+    TransactionPool &pool = __transaction_pool;
+
+    while (pool.num_holders)
+        delete pool.holders [--pool.num_holders];
+
+    while (pool.num_readers)
+        delete pool.readers [--pool.num_readers];
+}
+
 } // namespace scim
 
 /*
@@ -56,7 +56,8 @@ enum TransactionDataType
     SCIM_TRANS_DATA_VECTOR_UINT32,  //!< Send/Receive vector<uint32>.
     SCIM_TRANS_DATA_VECTOR_STRING,  //!< Send/Receive vector<String>.
     SCIM_TRANS_DATA_VECTOR_WSTRING, //!< Send/Receive vector<WideString>.
-    SCIM_TRANS_DATA_TRANSACTION     //!< Send/Receive another Transaction.
+    SCIM_TRANS_DATA_TRANSACTION,    //!< Send/Receive another Transaction.
+    SCIM_TRANS_DATA_LOOKUP_TABLE_DELTA //!< Send/Receive the changes of a LookupTable against a LookupTableCache.
 };
 
 /**
@@ -72,9 +73,67 @@ public:
         : Exception (String("scim::Transaction: ") + what_arg) { }
 };
 
+/**
+ * @brief Statistics of the Transaction buffer pool.
+ *
+ * Each thread keeps a small pool of Transaction buffers, so that
+ * short-lived Transaction objects do not allocate memory in steady state.
+ *
+ * @sa scim_transaction_get_pool_statistics ()
+ */
+struct TransactionPoolStatistics
+{
+    size_t hits;        //!< Number of Transaction objects which reused a pooled buffer.
+    size_t misses;      //!< Number of Transaction objects which allocated a new buffer.
+    size_t peak_size;   //!< The largest buffer size ever used by a Transaction.
+    size_t pooled;      //!< Number of buffers currently kept in the pool.
+};
+
 class TransactionHolder;
 class TransactionReader;
 
+/**
+ * @brief The lookup table page last sent or received through a connection.
+ *
+ * If only the cursor or the paging state of a lookup table changed since
+ * the last time it was sent, Transaction::put_data (const LookupTable &, LookupTableCache &)
+ * stores a small #SCIM_TRANS_DATA_LOOKUP_TABLE_DELTA instead of the whole page,
+ * which is restored by Transaction::get_data (CommonLookupTable &, LookupTableCache &)
+ * with the cache of the receiver.
+ *
+ * Each side of a connection keeps its own cache, which must see all lookup tables
+ * sent through the connection in order, and must be cleared when the connection
+ * is reset. It should only be used if both sides negotiated
+ * #SCIM_SOCKET_PROTOCOL_LOOKUP_TABLE_DELTA.
+ *
+ * If a delta does not match the cache of the receiver, the receiver's cache is
+ * cleared, and the receiver must send #SCIM_TRANS_CMD_RESET_LOOKUP_TABLE_CACHE
+ * to the sender, so that the next lookup table is sent as a whole.
+ */
+class LookupTableCache
+{
+    friend class Transaction;
+    friend class TransactionReader;
+
+    String m_page;
+    uint32 m_page_size;
+    uint32 m_checksum;
+    bool   m_valid;
+
+public:
+    LookupTableCache () : m_page_size (0), m_checksum (0), m_valid (false) { }
+
+    /**
+     * @brief Forget the cached page, so that the next lookup table is sent as a whole.
+     */
+    void clear () {
+        m_page = String ();
+        m_page_size = 0;
+        m_checksum = 0;
+        m_valid = false;
+    }
+};
+
 /**
  * @brief This class is used to pack up many data and commands into one package
  *        and send them via socket.
@@ -202,6 +261,15 @@ public:
      */
     void put_data (const LookupTable &table);
 
+    /**
+     * @brief Store a LookupTable object into this transaction,
+     *        only the changes are stored if its page is the same as the cached one.
+     *
+     * @param table the LookupTable to be stored.
+     * @param cache the cache of the connection, which will be updated.
+     */
+    void put_data (const LookupTable &table, LookupTableCache &cache);
+
     /**
      * @brief Store a std::vector<uint32> object into this transaction.
      */
@@ -227,6 +295,27 @@ public:
      */
     void put_data (const Transaction &trans);
 
+    /**
+     * @brief Store a raw buffer into this transaction without copying it.
+     *
+     * Only a reference to the buffer is kept, write_to_socket () sends it
+     * directly from its original place. The buffer must stay valid and
+     * unchanged until the transaction is written out or cleared.
+     *
+     * The data is read back as a normal raw buffer.
+     */
+    void put_borrowed_data (const char *raw, size_t bufsize);
+
+    /**
+     * @brief Store a String object into this transaction without copying it.
+     *
+     * Same as put_borrowed_data (const char *, size_t), the string must
+     * stay alive and unchanged until the transaction is written out or cleared.
+     *
+     * The data is read back as a normal String.
+     */
+    void put_borrowed_data (const String &str);
+
     /**
      * @brief Get the type of the data at current read position.
      *
@@ -279,6 +368,18 @@ public:
      */
     bool get_data (CommonLookupTable &table);
 
+    /**
+     * @brief Get a CommonLookupTable from current read position,
+     *        which may be stored as the changes against the cached page.
+     *
+     * If the changes do not match the cached page, they are skipped, the cache
+     * is cleared and false is returned.
+     *
+     * @param table the CommonLookupTable to hold the result.
+     * @param cache the cache of the connection, which will be updated.
+     */
+    bool get_data (CommonLookupTable &table, LookupTableCache &cache);
+
     /**
      * @brief Get a std::vector<uint32> from current read position.
      */
@@ -440,6 +541,18 @@ public:
      */
     bool get_data (CommonLookupTable &table);
 
+    /**
+     * @brief Get a CommonLookupTable from current read position,
+     *        which may be stored as the changes against the cached page.
+     *
+     * If the changes do not match the cached page, they are skipped, the cache
+     * is cleared and false is returned.
+     *
+     * @param table the CommonLookupTable to hold the result.
+     * @param cache the cache of the connection, which will be updated.
+     */
+    bool get_data (CommonLookupTable &table, LookupTableCache &cache);
+
     /**
      * @brief Get a std::vector<uint32> from current read position.
      */
@@ -479,6 +592,20 @@ public:
     void rewind ();
 };
 
+/**
+ * @brief Get the statistics of the Transaction buffer pool of the calling thread.
+ *
+ * @param stats The statistics will be stored here.
+ */
+void scim_transaction_get_pool_statistics (TransactionPoolStatistics &stats);
+
+/**
+ * @brief Free all pooled Transaction buffers of the calling thread.
+ *
+ * It's useful before a thread exits, or after a burst of large transactions.
+ */
+void scim_transaction_clear_pool ();
+
 /** @} */
 
 } // namespace scim
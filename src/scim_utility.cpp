@@ -41,6 +41,10 @@
 #include <time.h>
 #include <errno.h>
 
+#if defined (__SSE2__)
+  #include <emmintrin.h>
+#endif
+
 #include "scim_private.h"
 #include "scim.h"
 
@@ -209,22 +213,216 @@ utf8_write_wstring (std::ostream &os, const WideString & wstr)
     return os;
 }
 
+/*
+ * Block transcoders used by utf8_mbstowcs () and utf8_wcstombs ().
+ *
+ * The result is sized exactly before being filled in place, and runs of
+ * ASCII chars are converted 16 (with SSE2) or 8 chars at a time. Other
+ * chars are converted by utf8_mbtowc () and utf8_wctomb (), so that the
+ * results are the same as converting char by char.
+ */
+static inline bool
+__utf8_is_ascii_block (const unsigned char *src)
+{
+#if defined (__SSE2__)
+    __m128i v = _mm_loadu_si128 ((const __m128i *) src);
+    // Neither a non-ASCII char nor a terminating zero.
+    return (_mm_movemask_epi8 (v) | _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, _mm_setzero_si128 ()))) == 0;
+#else
+    uint64 w [2];
+    memcpy (w, src, 16);
+    for (int i = 0; i < 2; ++i) {
+        if ((w [i] & 0x8080808080808080ULL) ||
+            ((w [i] - 0x0101010101010101ULL) & ~w [i] & 0x8080808080808080ULL))
+            return false;
+    }
+    return true;
+#endif
+}
+
+static inline void
+__utf8_widen_ascii_block (ucs4_t *dest, const unsigned char *src)
+{
+#if defined (__SSE2__)
+    if (sizeof (ucs4_t) == 4) {
+        __m128i zero = _mm_setzero_si128 ();
+        __m128i v  = _mm_loadu_si128 ((const __m128i *) src);
+        __m128i lo = _mm_unpacklo_epi8 (v, zero);
+        __m128i hi = _mm_unpackhi_epi8 (v, zero);
+        _mm_storeu_si128 ((__m128i *) dest,        _mm_unpacklo_epi16 (lo, zero));
+        _mm_storeu_si128 ((__m128i *) (dest + 4),  _mm_unpackhi_epi16 (lo, zero));
+        _mm_storeu_si128 ((__m128i *) (dest + 8),  _mm_unpacklo_epi16 (hi, zero));
+        _mm_storeu_si128 ((__m128i *) (dest + 12), _mm_unpackhi_epi16 (hi, zero));
+        return;
+    }
+#endif
+    for (int i = 0; i < 16; ++i)
+        dest [i] = src [i];
+}
+
+static inline size_t
+__utf8_count_chars (const unsigned char *src, size_t len)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+#if defined (__SSE2__)
+    // Count the bytes which are not continuation bytes (0x80 - 0xBF).
+    const __m128i limit = _mm_set1_epi8 ((char) 0xC0);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i));
+        count += 16 - __builtin_popcount (_mm_movemask_epi8 (_mm_cmplt_epi8 (v, limit)));
+    }
+#endif
+
+    for (; i < len; ++i)
+        count += ((src [i] & 0xC0) != 0x80);
+
+    return count;
+}
+
+static void
+__utf8_decode (WideString &wstr, const unsigned char *src, size_t len)
+{
+    wstr.resize (__utf8_count_chars (src, len));
+
+    if (!wstr.length ())
+        return;
+
+    ucs4_t *dest  = &wstr [0];
+    ucs4_t *begin = dest;
+    const unsigned char *end = src + len;
+    int un;
+
+    while (src < end) {
+        if (end - src >= 16 && __utf8_is_ascii_block (src)) {
+            __utf8_widen_ascii_block (dest, src);
+            src  += 16;
+            dest += 16;
+        } else if (*src && *src < 0x80) {
+            *dest++ = *src++;
+        } else if (*src >= 0xe1 && *src < 0xf0 && end - src >= 3 &&
+                   (src [1] ^ 0x80) < 0x40 && (src [2] ^ 0x80) < 0x40) {
+            // The most common case for CJK chars.
+            *dest++ = ((ucs4_t) (src [0] & 0x0f) << 12)
+                        | ((ucs4_t) (src [1] ^ 0x80) << 6)
+                        | (ucs4_t) (src [2] ^ 0x80);
+            src += 3;
+        } else if (*src && (un = utf8_mbtowc (dest, src, end - src)) > 0) {
+            src += un;
+            ++ dest;
+        } else {
+            break;
+        }
+    }
+
+    wstr.resize (dest - begin);
+}
+
+static inline int
+__utf8_char_length (ucs4_t wc)
+{
+    if (wc < 0x80)
+        return 1;
+    else if (wc < 0x800)
+        return 2;
+    else if (wc < 0x10000)
+        return 3;
+    else if (wc < 0x200000)
+        return 4;
+    else if (wc < 0x4000000)
+        return 5;
+    else if (wc <= 0x7fffffff)
+        return 6;
+    return 0;
+}
+
+static inline bool
+__ucs4_is_ascii_block (const ucs4_t *src)
+{
+#if defined (__SSE2__)
+    if (sizeof (ucs4_t) == 4) {
+        __m128i v = _mm_or_si128 (_mm_or_si128 (_mm_loadu_si128 ((const __m128i *) src),
+                                                _mm_loadu_si128 ((const __m128i *) (src + 4))),
+                                  _mm_or_si128 (_mm_loadu_si128 ((const __m128i *) (src + 8)),
+                                                _mm_loadu_si128 ((const __m128i *) (src + 12))));
+        return _mm_movemask_epi8 (_mm_cmpeq_epi32 (_mm_and_si128 (v, _mm_set1_epi32 (~0x7F)),
+                                                   _mm_setzero_si128 ())) == 0xFFFF;
+    }
+#endif
+    uint32 bits = 0;
+    for (int i = 0; i < 16; ++i)
+        bits |= (uint32) src [i];
+    return bits < 0x80;
+}
+
+static inline void
+__ucs4_narrow_ascii_block (unsigned char *dest, const ucs4_t *src)
+{
+#if defined (__SSE2__)
+    if (sizeof (ucs4_t) == 4) {
+        __m128i lo = _mm_packs_epi32 (_mm_loadu_si128 ((const __m128i *) src),
+                                      _mm_loadu_si128 ((const __m128i *) (src + 4)));
+        __m128i hi = _mm_packs_epi32 (_mm_loadu_si128 ((const __m128i *) (src + 8)),
+                                      _mm_loadu_si128 ((const __m128i *) (src + 12)));
+        _mm_storeu_si128 ((__m128i *) dest, _mm_packus_epi16 (lo, hi));
+        return;
+    }
+#endif
+    for (int i = 0; i < 16; ++i)
+        dest [i] = (unsigned char) src [i];
+}
+
+static void
+__utf8_encode (String &str, const ucs4_t *src, size_t len)
+{
+    size_t size = 0;
+    size_t i;
+
+    for (i = 0; i < len; ) {
+        if (len - i >= 16 && __ucs4_is_ascii_block (src + i)) {
+            size += 16;
+            i    += 16;
+        } else {
+            size += __utf8_char_length (src [i]);
+            ++ i;
+        }
+    }
+
+    str.resize (size);
+
+    if (!size)
+        return;
+
+    unsigned char *dest = (unsigned char *) &str [0];
+
+    for (i = 0; i < len; ) {
+        if (len - i >= 16 && __ucs4_is_ascii_block (src + i)) {
+            __ucs4_narrow_ascii_block (dest, src + i);
+            i    += 16;
+            dest += 16;
+        } else if (src [i] >= 0x800 && src [i] < 0x10000) {
+            // The most common case for CJK chars.
+            dest [0] = 0xe0 | (src [i] >> 12);
+            dest [1] = 0x80 | ((src [i] >> 6) & 0x3f);
+            dest [2] = 0x80 | (src [i] & 0x3f);
+            dest += 3;
+            ++ i;
+        } else {
+            int un = utf8_wctomb (dest, src [i], 6);
+            if (un > 0) dest += un;
+            ++ i;
+        }
+    }
+}
+
 WideString
 utf8_mbstowcs (const String & str)
 {
     WideString wstr;
-    ucs4_t wc;
-    unsigned int sn = 0;
-    int un = 0;
 
-    const unsigned char *s = (const unsigned char *) str.c_str ();
+    __utf8_decode (wstr, (const unsigned char *) str.data (), str.length ());
 
-    while (sn < str.length () && *s != 0 &&
-            (un=utf8_mbtowc (&wc, s, str.length () - sn)) > 0) {
-        wstr.push_back (wc);
-        s += un;
-        sn += un;
-    }
     return wstr;
 }
 
@@ -234,18 +432,9 @@ utf8_mbstowcs (const char *str, int len)
     WideString wstr;
 
     if (str) {
-        ucs4_t wc;
-        unsigned int sn = 0;
-        int un = 0;
-
         if (len < 0) len = strlen (str);
 
-        while (sn < len && *str != 0 && (un=utf8_mbtowc (&wc, (const unsigned char *)str, len - sn)) > 0) {
-            wstr.push_back (wc);
-            str += un;
-            sn += un;
-    
-        }
+        __utf8_decode (wstr, (const unsigned char *) str, len);
     }
     return wstr;
 }
@@ -254,14 +443,9 @@ String
 utf8_wcstombs (const WideString & wstr)
 {
     String str;
-    char utf8 [6];
-    int un = 0;
 
-    for (unsigned int i = 0; i<wstr.size (); ++i) {
-        un = utf8_wctomb ((unsigned char*)utf8, wstr [i], 6);
-        if (un > 0)
-            str.append (utf8, un);
-    }
+    __utf8_encode (str, wstr.data (), wstr.length ());
+
     return str;
 }
 
@@ -269,48 +453,55 @@ String
 utf8_wcstombs (const ucs4_t *wstr, int len)
 {
     String str;
-    char utf8 [6];
-    int un = 0;
 
     if (wstr) {
         if (len < 0)
             for (len = 0; wstr [len]; ++len) NULL;
 
-        for (int i = 0; i < len; ++i) {
-            un = utf8_wctomb ((unsigned char*)utf8, wstr [i], 6);
-            if (un > 0)
-                str.append (utf8, un);
-        }
+        __utf8_encode (str, wstr, len);
     }
     return str;
 }
 
-String
-scim_validate_locale (const String& locale)
+// Create a LC_CTYPE locale object for the locale, if it's not available,
+// try again with the case of the encoding swapped, eg. zh_CN.gb2312 for
+// zh_CN.GB2312. The name which works is stored into good.
+//
+// Unlike setlocale (), it doesn't touch the global locale, so the functions
+// below can be called by several threads at the same time.
+static locale_t
+__new_ctype_locale (const String &locale, String &good)
 {
-    String good;
+    locale_t loc = newlocale (LC_CTYPE_MASK, locale.c_str (), (locale_t) 0);
 
-    String last = String (setlocale (LC_CTYPE, 0));
-
-    if (setlocale (LC_CTYPE, locale.c_str ())) {
+    if (loc) {
         good = locale;
-    } else {
-        std::vector<String> vec;
-        if (scim_split_string_list (vec, locale, '.') == 2) {
-            if (isupper (vec[1][0])) {
-                for (String::iterator i=vec[1].begin (); i!=vec[1].end (); ++i) 
-                    *i = (char) tolower (*i);
-            } else {
-                for (String::iterator i=vec[1].begin (); i!=vec[1].end (); ++i) 
-                    *i = (char) toupper (*i);
-            }
-            if (setlocale (LC_CTYPE, (vec[0] + "." + vec[1]).c_str ())) {
-                good = vec [0] + "." + vec[1];
-            }
+        return loc;
+    }
+
+    std::vector<String> vec;
+    if (scim_split_string_list (vec, locale, '.') == 2 && vec[1].length ()) {
+        if (isupper (vec[1][0])) {
+            for (String::iterator i=vec[1].begin (); i!=vec[1].end (); ++i) 
+                *i = (char) tolower (*i);
+        } else {
+            for (String::iterator i=vec[1].begin (); i!=vec[1].end (); ++i) 
+                *i = (char) toupper (*i);
         }
+        loc = newlocale (LC_CTYPE_MASK, (vec[0] + "." + vec[1]).c_str (), (locale_t) 0);
+        if (loc) good = vec [0] + "." + vec[1];
     }
 
-    setlocale (LC_CTYPE, last.c_str ());
+    return loc;
+}
+
+String
+scim_validate_locale (const String& locale)
+{
+    String   good;
+    locale_t loc = __new_ctype_locale (locale, good);
+
+    if (loc) freelocale (loc);
 
     return good;
 }
@@ -318,28 +509,14 @@ scim_validate_locale (const String& locale)
 String
 scim_get_locale_encoding (const String& locale)
 {
-    String last = String (setlocale (LC_CTYPE, 0));
-    String encoding;
-
-    if (setlocale (LC_CTYPE, locale.c_str ()))
-        encoding = String (nl_langinfo (CODESET));
-    else {
-        std::vector<String> vec;
-        if (scim_split_string_list (vec, locale, '.') == 2) {
-            if (isupper (vec[1][0])) {
-                for (String::iterator i=vec[1].begin (); i!=vec[1].end (); ++i) 
-                    *i = (char) tolower (*i);
-            } else {
-                for (String::iterator i=vec[1].begin (); i!=vec[1].end (); ++i) 
-                    *i = (char) toupper (*i);
-            }
-            if (setlocale (LC_CTYPE, (vec[0] + "." + vec[1]).c_str ()))
-                encoding = String (nl_langinfo (CODESET));
-        }
-        
-    }
+    String   good;
+    String   encoding;
+    locale_t loc = __new_ctype_locale (locale, good);
 
-    setlocale (LC_CTYPE, last.c_str ());
+    if (loc) {
+        encoding = String (nl_langinfo_l (CODESET, loc));
+        freelocale (loc);
+    }
 
     return encoding;
 }
@@ -347,16 +524,17 @@ scim_get_locale_encoding (const String& locale)
 int
 scim_get_locale_maxlen (const String& locale)
 {
-    int maxlen;
+    int      maxlen = 1;
+    locale_t loc = newlocale (LC_CTYPE_MASK, locale.c_str (), (locale_t) 0);
 
-    String last = String (setlocale (LC_CTYPE, 0));
-
-    if (setlocale (LC_CTYPE, locale.c_str ()))
+    if (loc) {
+        // MB_CUR_MAX follows the locale of current thread.
+        locale_t last = uselocale (loc);
         maxlen = MB_CUR_MAX;
-    else
-        maxlen = 1;
+        uselocale (last);
+        freelocale (loc);
+    }
 
-    setlocale (LC_CTYPE, last.c_str ());
     return maxlen;
 }
 
@@ -0,0 +1,138 @@
+/*
+ * Smart Common Input Method
+ *
+ * Copyright (c) 2005 James Su <suzhe@tsinghua.org.cn>
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/*
+ * Test of the user's compose sequences loaded by ComposeKeyInstance.
+ *
+ * Usage: testcomposekey
+ *
+ * A temporary XCompose file is pointed to by XCOMPOSEFILE, it covers the
+ * string escapes, comments, include directives, malformed lines and a
+ * user sequence overriding a built-in one.
+ */
+
+#define Uses_SCIM_COMPOSE_KEY
+#define Uses_SCIM_IMENGINE
+#define Uses_STL_IOSTREAM
+#define Uses_STL_FSTREAM
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "scim.h"
+
+using namespace scim;
+
+static const char *compose_file_content =
+    "# The user's compose file.\n"
+    "include \"%L\"\n"
+    "\n"
+    "<Multi_key> <x> <h> : \"\\xc3\\xa6\"\n"
+    "<Multi_key> <x> <o> : \"\\303\\251\"    eacute\n"
+    "<Multi_key> <x> <q> : \"\\\"\\\\\"     # quote and backslash\n"
+    "<Multi_key> <x> <u> : \"a\\xz\"\n"
+    "# <Multi_key> <x> <c> : \"commented\"\n"
+    "   <Multi_key> <x> <s> : \"spaced\"\n"
+    "<Multi_key> <U0041> <U00E9> : \"unicode\"\n"
+    "<Multi_key> <a> <apostrophe> : \"user\"\n";
+
+static WideString committed;
+
+static void
+slot_commit (IMEngineInstanceBase *, const WideString &str)
+{
+    committed += str;
+}
+
+// Type the space separated key names, return the committed string.
+static String
+type (const IMEngineInstancePointer &inst, const char *keys)
+{
+    std::vector <String> names;
+    KeyEvent key;
+
+    committed.clear ();
+    inst->reset ();
+
+    scim_split_string_list (names, keys, ' ');
+
+    for (size_t i = 0; i < names.size (); ++i) {
+        if (scim_string_to_key (key, names [i]))
+            inst->process_key_event (key);
+    }
+
+    return utf8_wcstombs (committed);
+}
+
+static int errors = 0;
+
+static void
+check (bool cond, const char *what)
+{
+    std::cout << (cond ? "OK:   " : "FAIL: ") << what << "\n";
+    if (!cond) ++errors;
+}
+
+int main ()
+{
+    char file [] = "/tmp/testcomposekey.XXXXXX";
+    int  fd = mkstemp (file);
+
+    if (fd < 0) {
+        std::cerr << "Failed to create the temporary compose file.\n";
+        return 1;
+    }
+
+    close (fd);
+
+    {
+        std::ofstream os (file);
+        os << compose_file_content;
+    }
+
+    setenv ("XCOMPOSEFILE", file, 1);
+
+    IMEngineFactoryPointer  factory = new ComposeKeyFactory;
+    IMEngineInstancePointer inst = factory->create_instance ("UTF-8", 0);
+
+    inst->signal_connect_commit_string (slot (slot_commit));
+
+    check (type (inst, "Multi_key x h") == "\xc3\xa6", "hex escapes");
+    check (type (inst, "Multi_key x o") == "\xc3\xa9", "octal escapes, trailing keysym");
+    check (type (inst, "Multi_key x q") == "\"\\", "quote and backslash escapes, trailing comment");
+    check (type (inst, "Multi_key x u") == "", "\\x without hex digit rejected");
+    check (type (inst, "Multi_key x c") == "", "commented out line ignored");
+    check (type (inst, "Multi_key x s") == "spaced", "leading spaces");
+    check (type (inst, "Multi_key A eacute") == "unicode", "unicode keysyms");
+    check (type (inst, "Multi_key a apostrophe") == "user", "user sequence overrides the built-in one");
+    check (type (inst, "Multi_key e apostrophe") == "\xc3\xa9", "other built-in sequences kept after include");
+
+    unlink (file);
+
+    return errors ? 1 : 0;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab
+*/
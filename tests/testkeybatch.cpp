@@ -0,0 +1,213 @@
+/*
+ * Smart Common Input Method
+ *
+ * Copyright (c) 2005 James Su <suzhe@tsinghua.org.cn>
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/*
+ * Test of FrontEndBase::process_key_events ().
+ *
+ * Usage: testkeybatch
+ *
+ * A simple IMEngine puts letters into its preedit string and commits it
+ * on space. A batch of key events must coalesce the preedit updates around
+ * the commits, and stop at the first key which is not processed.
+ */
+
+#define Uses_SCIM_FRONTEND
+#define Uses_SCIM_BACKEND
+#define Uses_SCIM_IMENGINE
+#define Uses_SCIM_CONFIG_BASE
+#define Uses_STL_IOSTREAM
+
+#include "scim.h"
+
+using namespace scim;
+
+class TestInstance : public IMEngineInstanceBase
+{
+    WideString m_preedit;
+
+public:
+    TestInstance (IMEngineFactoryBase *factory, const String &encoding, int id)
+        : IMEngineInstanceBase (factory, encoding, id) { }
+
+    virtual bool process_key_event (const KeyEvent &key) {
+        if (key.code >= 'a' && key.code <= 'z') {
+            m_preedit.push_back ((ucs4_t) key.code);
+            show_preedit_string ();
+            update_preedit_string (m_preedit);
+            update_preedit_caret (m_preedit.length ());
+            return true;
+        }
+        if (key.code == ' ' && m_preedit.length ()) {
+            commit_string (m_preedit);
+            m_preedit.clear ();
+            update_preedit_string (m_preedit);
+            hide_preedit_string ();
+            return true;
+        }
+        return false;
+    }
+
+    virtual void move_preedit_caret (unsigned int) { }
+    virtual void select_candidate (unsigned int) { }
+    virtual void update_lookup_table_page_size (unsigned int) { }
+    virtual void lookup_table_page_up () { }
+    virtual void lookup_table_page_down () { }
+    virtual void reset () { m_preedit.clear (); }
+    virtual void focus_in () { }
+    virtual void focus_out () { }
+    virtual void trigger_property (const String &) { }
+};
+
+class TestFactory : public IMEngineFactoryBase
+{
+public:
+    TestFactory () { set_locales ("en_US.UTF-8"); }
+
+    virtual WideString get_name () const { return utf8_mbstowcs ("Test"); }
+    virtual String get_uuid () const { return "c8bd4a3e-0b3f-4d04-9a3a-testkeybatch"; }
+    virtual String get_icon_file () const { return String (); }
+    virtual WideString get_authors () const { return WideString (); }
+    virtual WideString get_credits () const { return WideString (); }
+    virtual WideString get_help () const { return WideString (); }
+
+    virtual IMEngineInstancePointer create_instance (const String &encoding, int id) {
+        return new TestInstance (this, encoding, id);
+    }
+};
+
+class TestBackEnd : public BackEndBase
+{
+public:
+    TestBackEnd () : BackEndBase (ConfigPointer (0)) { add_factory (new TestFactory); }
+};
+
+class TestFrontEnd : public FrontEndBase
+{
+public:
+    int        preedit_updates;
+    int        preedit_shown;
+    int        commits;
+    WideString preedit;
+    WideString committed;
+
+    TestFrontEnd (const BackEndPointer &backend)
+        : FrontEndBase (backend) { clear (); }
+
+    void clear () {
+        preedit_updates = 0;
+        preedit_shown = -1;
+        commits = 0;
+        preedit.clear ();
+        committed.clear ();
+    }
+
+    int create () {
+        return new_instance ("c8bd4a3e-0b3f-4d04-9a3a-testkeybatch", "UTF-8");
+    }
+
+    size_t process (int id, const char *keys, bool batch) {
+        KeyEventList list;
+        for (; *keys; ++keys)
+            list.push_back (KeyEvent ((uint32) *keys, 0));
+
+        if (batch)
+            return process_key_events (id, list);
+
+        size_t i;
+        for (i = 0; i < list.size (); ++i)
+            if (!process_key_event (id, list [i])) break;
+        return i;
+    }
+
+    virtual void init (int, char **) { }
+    virtual void run () { }
+
+protected:
+    virtual void show_preedit_string (int) { preedit_shown = 1; }
+    virtual void hide_preedit_string (int) { preedit_shown = 0; }
+    virtual void update_preedit_string (int, const WideString &str, const AttributeList &) {
+        ++preedit_updates;
+        preedit = str;
+    }
+    virtual void commit_string (int, const WideString &str) {
+        ++commits;
+        committed += str;
+    }
+};
+
+static int errors = 0;
+
+static void
+check (bool cond, const char *what)
+{
+    std::cout << (cond ? "OK:   " : "FAIL: ") << what << "\n";
+    if (!cond) ++errors;
+}
+
+int main ()
+{
+    BackEndPointer backend = new TestBackEnd;
+    TestFrontEnd  *frontend = new TestFrontEnd (backend);
+
+    int id = frontend->create ();
+
+    check (id >= 0, "create instance");
+
+    // One by one, every preedit change is emitted.
+    size_t n = frontend->process (id, "ab cd", false);
+
+    check (n == 5, "all keys processed one by one");
+    check (frontend->preedit_updates == 5, "five preedit updates one by one");
+    check (frontend->committed == utf8_mbstowcs ("ab"), "commit one by one");
+
+    frontend->process (id, " ", false);
+    frontend->clear ();
+
+    // In a batch, the preedit updates are coalesced, a commit only flushes
+    // the ones held before it, and it stops at the unprocessed key.
+    n = frontend->process (id, "ab cdXef", true);
+
+    check (n == 5, "batch stops at the unprocessed key");
+    check (frontend->preedit_updates == 2, "two preedit updates in a batch");
+    check (frontend->preedit == utf8_mbstowcs ("cd"), "final preedit string");
+    check (frontend->preedit_shown == 1, "final preedit visibility");
+    check (frontend->commits == 1 && frontend->committed == utf8_mbstowcs ("ab"), "commit in a batch");
+
+    // The remaining keys can be resubmitted.
+    frontend->clear ();
+    n = frontend->process (id, "ef ", true);
+
+    check (n == 3, "resubmitted keys processed");
+    check (frontend->committed == utf8_mbstowcs ("cdef"), "commit of resubmitted keys");
+    check (frontend->preedit_shown == 0 && frontend->preedit.length () == 0, "preedit hidden after commit");
+
+    delete frontend;
+
+    return errors ? 1 : 0;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab
+*/
@@ -0,0 +1,122 @@
+/*
+ * Smart Common Input Method
+ * 
+ * Copyright (c) 2005 James Su <suzhe@tsinghua.org.cn>
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/*
+ * Benchmark of the key code <-> unicode / key name conversions of KeyEvent.
+ *
+ * Usage: testkeyevent
+ *
+ * It also checks that every key string converts back to the same key.
+ */
+
+#define Uses_SCIM_EVENT
+#define Uses_STL_IOSTREAM
+
+#include <sys/time.h>
+#include "scim.h"
+
+using namespace scim;
+
+static double
+get_time ()
+{
+    struct timeval tv;
+    gettimeofday (&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main (int argc, char *argv [])
+{
+    const int rounds = 20;
+
+    std::vector <KeyEvent> keys;
+    std::vector <String>   names;
+
+    for (uint32 code = 0; code <= 0xFFFF; ++code)
+        keys.push_back (KeyEvent (code, 0));
+
+    // Only the keys having a name.
+    for (size_t i = 0; i < keys.size (); ++i) {
+        String str = keys [i].get_key_string ();
+        if (str.length () && str.compare (0, 2, "0x") != 0)
+            names.push_back (str);
+    }
+
+    std::cout << keys.size () << " key codes, " << names.size () << " key names.\n";
+
+    size_t errors = 0;
+
+    for (size_t i = 0; i < keys.size (); ++i) {
+        KeyEvent key;
+        String str = keys [i].get_key_string ();
+        if (str.length () && (!scim_string_to_key (key, str) || key.code != keys [i].code)) {
+            std::cout << "Mismatch: " << str << "\n";
+            ++ errors;
+        }
+    }
+
+    uint32 sum = 0;
+    double start = get_time ();
+
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < keys.size (); ++i)
+            sum += keys [i].get_unicode_code ();
+
+    double elapsed = get_time () - start;
+
+    std::cout << "get_unicode_code:   " << (elapsed * 1000000000.0 / (keys.size () * rounds)) << " ns/key (" << sum << ")\n";
+
+    size_t len = 0;
+    start = get_time ();
+
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < keys.size (); ++i)
+            len += keys [i].get_key_string ().length ();
+
+    elapsed = get_time () - start;
+
+    std::cout << "get_key_string:     " << (elapsed * 1000000000.0 / (keys.size () * rounds)) << " ns/key (" << len << ")\n";
+
+    sum = 0;
+    start = get_time ();
+
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < names.size (); ++i) {
+            KeyEvent key;
+            scim_string_to_key (key, names [i]);
+            sum += key.code;
+        }
+    }
+
+    elapsed = get_time () - start;
+
+    std::cout << "scim_string_to_key: " << (elapsed * 1000000000.0 / (names.size () * rounds)) << " ns/name (" << sum << ")\n";
+
+    return errors ? 1 : 0;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab
+*/
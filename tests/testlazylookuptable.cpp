@@ -0,0 +1,225 @@
+/*
+ * Smart Common Input Method
+ *
+ * Copyright (c) 2005 James Su <suzhe@tsinghua.org.cn>
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/*
+ * Test of LazyLookupTable and LookupTableSource.
+ *
+ * Usage: testlazylookuptable
+ *
+ * A source produces the candidates "0", "1", ... on demand, reporting
+ * either the exact number of candidates or a wrong estimation. Paging
+ * and moving the cursor must go through all candidates, stop at the
+ * real end of the source, and only request the candidates around the
+ * current page.
+ */
+
+#define Uses_SCIM_LOOKUP_TABLE
+#define Uses_STL_IOSTREAM
+
+#include "scim.h"
+
+using namespace scim;
+
+class TestSource : public LookupTableSource
+{
+    uint32 m_number;
+    uint32 m_estimation;
+    bool   m_exact;
+
+public:
+    uint32 requests;
+    uint32 produced;
+
+    TestSource (uint32 number, uint32 estimation, bool exact)
+        : m_number (number), m_estimation (estimation), m_exact (exact),
+          requests (0), produced (0) { }
+
+    virtual uint32 number_of_candidates () const {
+        return m_estimation;
+    }
+
+    virtual bool is_number_exact () const {
+        return m_exact;
+    }
+
+    virtual uint32 get_candidates (uint32                      start,
+                                   uint32                      count,
+                                   std::vector<WideString>    &cands,
+                                   std::vector<AttributeList> &attrs) {
+        ++requests;
+        for (uint32 i = start; i < start + count && i < m_number; ++i) {
+            char buf [16];
+            snprintf (buf, sizeof (buf), "%u", i);
+            cands.push_back (utf8_mbstowcs (buf));
+            ++produced;
+        }
+        return cands.size ();
+    }
+};
+
+static int errors = 0;
+
+static void
+check (bool cond, const char *what)
+{
+    std::cout << (cond ? "OK:   " : "FAIL: ") << what << "\n";
+    if (!cond) ++errors;
+}
+
+static WideString
+cand (uint32 i)
+{
+    char buf [16];
+    snprintf (buf, sizeof (buf), "%u", i);
+    return utf8_mbstowcs (buf);
+}
+
+// Page down to the end, checking every page, return the number of pages.
+static int
+page_through (LazyLookupTable &table, uint32 number, bool &ok)
+{
+    int pages = 1;
+
+    ok = true;
+
+    do {
+        int start = table.get_current_page_start ();
+        int size  = table.get_current_page_size ();
+
+        if (size <= 0 || (uint32) (start + size) > number)
+            ok = false;
+
+        for (int i = 0; i < size; ++i)
+            if (table.get_candidate_in_current_page (i) != cand (start + i))
+                ok = false;
+    } while (table.page_down () && ++pages < 100);
+
+    return pages;
+}
+
+int main ()
+{
+    LazyLookupTable table (10);
+
+    check (table.number_of_candidates () == 0, "empty without source");
+    check (table.get_candidate (0).length () == 0, "no candidate without source");
+
+    // The exact number is used as is.
+    {
+        TestSource *source = new TestSource (23, 23, true);
+        bool ok;
+
+        table.set_source (source);
+
+        check (table.number_of_candidates () == 23, "exact number of candidates");
+
+        int pages = page_through (table, 23, ok);
+
+        check (ok && pages == 3, "exact source paged to its end");
+        check (table.get_current_page_size () == 3, "last page of exact source");
+        check (table.get_candidate (23).length () == 0, "no candidate past the end");
+        check (source->produced <= 23 + 20, "exact source only produced the visible pages");
+    }
+
+    // An estimation larger than the real number, found when paging
+    // past the first batch.
+    {
+        TestSource *source = new TestSource (23, 100, false);
+        bool ok;
+
+        table.set_source (source);
+
+        check (table.get_current_page_start () == 0, "new source starts at first page");
+        check (table.number_of_candidates () == 100, "estimation used before reaching the end");
+
+        int pages = page_through (table, 23, ok);
+
+        check (ok && pages == 3, "overestimated source paged to its real end");
+        check (table.number_of_candidates () == 23, "real number found at the end");
+        check (!table.page_down (), "no page past the end");
+        check (table.get_candidate (40).length () == 0, "no candidate past the real end");
+    }
+
+    // An estimation smaller than the real number, the table must keep
+    // pulling more candidates during page_down.
+    {
+        TestSource *source = new TestSource (35, 5, false);
+        bool ok;
+
+        table.set_source (source);
+
+        check (table.number_of_candidates () >= 10, "underestimation corrected by look-ahead");
+
+        int pages = page_through (table, 35, ok);
+
+        check (ok && pages == 4, "underestimated source paged to its real end");
+        check (table.number_of_candidates () == 35, "real number found after underestimation");
+        check (table.get_current_page_size () == 5, "last page of underestimated source");
+    }
+
+    // The cursor also pulls more candidates, and stops at the real end.
+    {
+        TestSource *source = new TestSource (35, 5, false);
+        int moves = 0;
+
+        table.set_source (source);
+        table.show_cursor ();
+
+        while (table.cursor_down () && moves < 100) ++moves;
+
+        check (moves == 34, "cursor moved over all candidates");
+        check (table.get_cursor_pos () == 34, "cursor at the last candidate");
+        check (table.get_current_page_start () == 30, "cursor paged to the last page");
+        check (table.get_candidate_in_current_page (table.get_cursor_pos_in_current_page ()) == cand (34),
+               "candidate under the cursor");
+
+        while (table.cursor_up ()) ;
+
+        check (table.get_cursor_pos () == 0 && table.get_current_page_start () == 0, "cursor back to the first candidate");
+        check (table.get_candidate_in_current_page (0) == cand (0), "first candidate fetched again");
+    }
+
+    // A large source only produces the candidates around the visited pages.
+    {
+        TestSource *source = new TestSource (100000, 100000, false);
+
+        table.set_source (source);
+
+        for (int i = 0; i < 5; ++i) table.page_down ();
+
+        check (table.get_candidate_in_current_page (0) == cand (50), "sixth page of large source");
+        check (source->produced <= 7 * 20, "large source only produced the visited pages");
+    }
+
+    table.clear ();
+
+    check (table.get_source ().null () && table.number_of_candidates () == 0, "clear drops the source");
+
+    return errors ? 1 : 0;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab
+*/
@@ -0,0 +1,211 @@
+/*
+ * Smart Common Input Method
+ * 
+ * Copyright (c) 2005 James Su <suzhe@tsinghua.org.cn>
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/*
+ * Test and benchmark of the SC<->TC conversion used by the SCTC filter.
+ *
+ * Usage: testsctc [phrase-file [corpus-file]]
+ *
+ * A few known phrases are checked first, then the conversion is timed.
+ * The corpus is a UTF-8 text file, which is converted line by line, like
+ * the candidates of a lookup table. A corpus is generated if omitted.
+ */
+
+#define Uses_SCIM_UTILITY
+#define Uses_STL_IOSTREAM
+#define Uses_STL_FSTREAM
+
+#include <sys/time.h>
+#include <cstdlib>
+#include "scim.h"
+#include "scim_sctc_converter.h"
+#include "scim_sctc_filter_data.h"
+
+using namespace scim;
+
+// The phrase file in the source tree, passed by tests/Makefile.am,
+// so the test doesn't depend on an installed copy.
+#ifndef SCIM_SCTC_PHRASE_FILE
+#define SCIM_SCTC_PHRASE_FILE SCIM_DATADIR "/sctc-phrases"
+#endif
+
+static const char * sample_strings [] =
+{
+  "头发干了以后去理发",
+  "皇后的复杂关系",
+  "方便面和面包",
+  "尽管有词汇特征",
+  NULL
+};
+
+static int errors = 0;
+
+static void
+check (const SCTCConverter &converter, const char *from, const char *to, bool changed)
+{
+    WideString str = utf8_mbstowcs (from);
+    bool ret = converter.convert (str);
+    bool ok = (ret == changed && str == utf8_mbstowcs (to));
+
+    std::cout << (ok ? "OK:   " : "FAIL: ") << from << " -> " << utf8_wcstombs (str) << "\n";
+
+    if (!ok) ++errors;
+}
+
+static double
+get_time ()
+{
+    struct timeval tv;
+    gettimeofday (&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void
+generate_corpus (std::vector <WideString> &corpus, const std::vector <WideString> &phrases)
+{
+    const size_t nchars = sizeof (__sc_to_tc_table) / sizeof (__sc_to_tc_table [0]) - 1;
+
+    srand (1);
+
+    // Lines of 4 to 20 chars, mixing phrases, convertible chars,
+    // common chars which are not converted and some ASCII.
+    for (size_t i = 0; i < 200000; ++i) {
+        WideString line;
+        size_t len = 4 + rand () % 17;
+
+        while (line.length () < len) {
+            int r = rand () % 10;
+            if (r < 2 && phrases.size ())
+                line += phrases [rand () % phrases.size ()];
+            else if (r < 5)
+                line.push_back (__sc_to_tc_table [rand () % nchars].first);
+            else if (r < 9)
+                line.push_back (0x4E00 + rand () % 0x5000);
+            else
+                line.push_back ('a' + rand () % 26);
+        }
+        corpus.push_back (line);
+    }
+}
+
+static void
+run (const char *name, const SCTCConverter &converter, const std::vector <WideString> &corpus, size_t bytes)
+{
+    const int rounds = 5;
+    size_t changed = 0;
+
+    double start = get_time ();
+
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < corpus.size (); ++i) {
+            WideString str (corpus [i]);
+            if (converter.convert (str))
+                ++ changed;
+        }
+    }
+
+    double elapsed = get_time () - start;
+
+    std::cout << name << ": " << (bytes * rounds / elapsed / 1024 / 1024) << " MB/s, "
+              << (elapsed * 1000000000.0 / (corpus.size () * rounds)) << " ns/line, "
+              << changed / rounds << " lines changed\n";
+}
+
+int main (int argc, char *argv [])
+{
+    String phrase_file = (argc > 1) ? argv [1] : SCIM_SCTC_PHRASE_FILE;
+
+    SCTCConverter chars;
+    SCTCConverter phrases;
+    SCTCConverter reverse;
+
+    for (size_t i = 0; __sc_to_tc_table [i].first; ++i) {
+        chars.add_char (__sc_to_tc_table [i].first, __sc_to_tc_table [i].second);
+        phrases.add_char (__sc_to_tc_table [i].first, __sc_to_tc_table [i].second);
+    }
+
+    for (size_t i = 0; __tc_to_sc_table [i].first; ++i)
+        reverse.add_char (__tc_to_sc_table [i].first, __tc_to_sc_table [i].second);
+
+    if (!phrases.load_phrases (phrase_file, false))
+        std::cerr << "Failed to load phrases from " << phrase_file << "\n";
+
+    reverse.load_phrases (phrase_file, true);
+
+    std::cout << phrases.number_of_phrases () << " phrases loaded.\n";
+
+    check (phrases, "头发", "頭髮", true);
+    check (phrases, "干净", "乾淨", true);
+    check (phrases, "洗干净头发", "洗乾淨頭髮", true);
+    check (reverse, "頭髮乾淨", "头发干净", true);
+    check (phrases, "abc 123", "abc 123", false);
+    check (phrases, "", "", false);
+
+    for (const char **ptr = sample_strings; *ptr; ++ptr) {
+        WideString a = utf8_mbstowcs (*ptr);
+        WideString b = a;
+        chars.convert (a);
+        phrases.convert (b);
+        std::cout << *ptr << " -> " << utf8_wcstombs (a) << " / " << utf8_wcstombs (b) << "\n";
+    }
+
+    std::vector <WideString> corpus;
+
+    if (argc > 2) {
+        std::ifstream is (argv [2]);
+        String line;
+        while (std::getline (is, line))
+            if (line.length ()) corpus.push_back (utf8_mbstowcs (line));
+    } else {
+        std::vector <WideString> keys;
+        std::ifstream is (phrase_file.c_str ());
+        String line;
+        while (std::getline (is, line)) {
+            if (line.length () && line [0] != '#')
+                keys.push_back (utf8_mbstowcs (line.substr (0, line.find (' '))));
+        }
+        generate_corpus (corpus, keys);
+    }
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < corpus.size (); ++i)
+        bytes += utf8_wcstombs (corpus [i]).length ();
+
+    std::cout << "Corpus: " << corpus.size () << " lines, " << bytes << " bytes.\n";
+
+    run ("SC->TC chars only  ", chars, corpus, bytes);
+    run ("SC->TC with phrases", phrases, corpus, bytes);
+
+    for (size_t i = 0; i < corpus.size (); ++i)
+        phrases.convert (corpus [i]);
+
+    run ("TC->SC with phrases", reverse, corpus, bytes);
+
+    return errors ? 1 : 0;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab
+*/
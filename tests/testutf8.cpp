@@ -0,0 +1,209 @@
+/*
+ * Smart Common Input Method
+ * 
+ * Copyright (c) 2005 James Su <suzhe@tsinghua.org.cn>
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/*
+ * Benchmark of utf8_mbstowcs () and utf8_wcstombs ().
+ *
+ * Usage: testutf8
+ *
+ * The results are checked against the char by char conversion, which is
+ * also timed as the reference.
+ */
+
+#define Uses_SCIM_UTILITY
+#define Uses_STL_IOSTREAM
+
+#include <sys/time.h>
+#include <cstdlib>
+#include "scim.h"
+
+using namespace scim;
+
+static double
+get_time ()
+{
+    struct timeval tv;
+    gettimeofday (&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static WideString
+reference_mbstowcs (const String &str)
+{
+    WideString wstr;
+    ucs4_t wc;
+    unsigned int sn = 0;
+    int un = 0;
+
+    const unsigned char *s = (const unsigned char *) str.c_str ();
+
+    while (sn < str.length () && *s != 0 &&
+            (un = utf8_mbtowc (&wc, s, str.length () - sn)) > 0) {
+        wstr.push_back (wc);
+        s += un;
+        sn += un;
+    }
+    return wstr;
+}
+
+static String
+reference_wcstombs (const WideString &wstr)
+{
+    String str;
+    char utf8 [6];
+    int un = 0;
+
+    for (unsigned int i = 0; i < wstr.size (); ++i) {
+        un = utf8_wctomb ((unsigned char *) utf8, wstr [i], 6);
+        if (un > 0)
+            str.append (utf8, un);
+    }
+    return str;
+}
+
+static ucs4_t
+random_char (int kind)
+{
+    switch (kind) {
+        case 0:  return 0x20 + rand () % 0x5F;
+        case 1:  return 0x80 + rand () % 0x780;
+        case 2:  return 0x4E00 + rand () % 0x5000;
+        default: return 0x10000 + rand () % 0x10000;
+    }
+}
+
+// Lines of 4 to 40 chars, either ASCII only, CJK only or mixed.
+static void
+generate_corpus (std::vector <WideString> &corpus)
+{
+    srand (1);
+
+    for (size_t i = 0; i < 100000; ++i) {
+        WideString line;
+        size_t len = 4 + rand () % 37;
+        int type = i % 3;
+
+        while (line.length () < len) {
+            if (type == 0)
+                line.push_back (random_char (0));
+            else if (type == 1)
+                line.push_back (random_char (2));
+            else
+                line.push_back (random_char (rand () % 8 < 5 ? 0 : rand () % 4));
+        }
+        corpus.push_back (line);
+    }
+}
+
+static size_t
+check (const std::vector <WideString> &wcorpus, const std::vector <String> &corpus)
+{
+    size_t errors = 0;
+
+    for (size_t i = 0; i < wcorpus.size (); ++i) {
+        if (utf8_wcstombs (wcorpus [i]) != reference_wcstombs (wcorpus [i]))
+            ++ errors;
+    }
+
+    for (size_t i = 0; i < corpus.size (); ++i) {
+        if (utf8_mbstowcs (corpus [i]) != reference_mbstowcs (corpus [i]))
+            ++ errors;
+
+        // Truncated and corrupted strings.
+        String str = corpus [i].substr (0, corpus [i].length () - 1);
+        if (utf8_mbstowcs (str) != reference_mbstowcs (str))
+            ++ errors;
+
+        str = corpus [i];
+        str [rand () % str.length ()] = (char) (rand () % 256);
+        if (utf8_mbstowcs (str) != reference_mbstowcs (str))
+            ++ errors;
+    }
+
+    return errors;
+}
+
+int main (int argc, char *argv [])
+{
+    const int rounds = 10;
+
+    std::vector <WideString> wcorpus;
+    std::vector <String>     corpus;
+
+    generate_corpus (wcorpus);
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < wcorpus.size (); ++i) {
+        corpus.push_back (reference_wcstombs (wcorpus [i]));
+        bytes += corpus.back ().length ();
+    }
+
+    std::cout << "Corpus: " << corpus.size () << " lines, " << bytes << " bytes.\n";
+
+    size_t errors = check (wcorpus, corpus);
+
+    std::cout << errors << " mismatches.\n";
+
+    size_t len;
+    double start, elapsed;
+
+    len = 0;
+    start = get_time ();
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpus.size (); ++i)
+            len += reference_mbstowcs (corpus [i]).length ();
+    elapsed = get_time () - start;
+    std::cout << "char by char mbstowcs: " << (bytes * rounds / elapsed / 1024 / 1024) << " MB/s (" << len << ")\n";
+
+    len = 0;
+    start = get_time ();
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpus.size (); ++i)
+            len += utf8_mbstowcs (corpus [i]).length ();
+    elapsed = get_time () - start;
+    std::cout << "utf8_mbstowcs:         " << (bytes * rounds / elapsed / 1024 / 1024) << " MB/s (" << len << ")\n";
+
+    len = 0;
+    start = get_time ();
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < wcorpus.size (); ++i)
+            len += reference_wcstombs (wcorpus [i]).length ();
+    elapsed = get_time () - start;
+    std::cout << "char by char wcstombs: " << (bytes * rounds / elapsed / 1024 / 1024) << " MB/s (" << len << ")\n";
+
+    len = 0;
+    start = get_time ();
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < wcorpus.size (); ++i)
+            len += utf8_wcstombs (wcorpus [i]).length ();
+    elapsed = get_time () - start;
+    std::cout << "utf8_wcstombs:         " << (bytes * rounds / elapsed / 1024 / 1024) << " MB/s (" << len << ")\n";
+
+    return errors ? 1 : 0;
+}
+
+/*
+vi:ts=4:nowrap:ai:expandtab
+*/